@@ -8,6 +8,7 @@
 #include <StdInc.h>
 #include <ResourceManager.h>
 #include <ResourceEventComponent.h>
+#include <ResourceStartScheduler.h>
 
 #include <ScriptEngine.h>
 
@@ -178,7 +179,20 @@ static InitFunction initFunction([] ()
 
 				fx::ResourceManager* manager = Instance<fx::ResourceManager>::Get();
 
-				std::vector<concurrency::task<fwRefContainer<fx::Resource>>> tasks;
+				// resources get mounted in parallel, and started on the game thread
+				static fwRefContainer<fx::ResourceStartScheduler> scheduler;
+
+				if (!scheduler.GetRef())
+				{
+					scheduler = new fx::ResourceStartScheduler(manager);
+					scheduler->SetStartExecutor([] (const std::function<void()>& function)
+					{
+						std::unique_lock<std::mutex> lock(executeNextGameFrameMutex);
+						executeNextGameFrame.push_back(function);
+					});
+				}
+
+				std::vector<std::string> uris;
 
 				for (auto& resourceName : requiredResources)
 				{
@@ -191,33 +205,22 @@ static InitFunction initFunction([] ()
 						}
 					}
 
-					tasks.push_back(manager->AddResource("global://" + resourceName));
+					uris.push_back("global://" + resourceName);
 				}
 
-				concurrency::when_all(tasks.begin(), tasks.end()).then([=] (std::vector<fwRefContainer<fx::Resource>> resources)
+				scheduler->StartResources(uris).then([=] (fx::ResourceStartReport report)
 				{
-					for (auto& resource : resources)
-					{
-						if (!resource.GetRef())
-						{
-							GlobalError("Couldn't load some resource. :(");
-
-							return;
-						}
+					trace("%s", report.Format().c_str());
 
-						std::string resourceName = resource->GetName();
+					if (!report.succeeded)
+					{
+						GlobalError("Couldn't start some resources. :(\n%s", report.Format(0).c_str());
 
-						std::unique_lock<std::mutex> lock(executeNextGameFrameMutex);
-						executeNextGameFrame.push_back([=] ()
-						{
-							if (!resource->Start())
-							{
-								GlobalError("Couldn't start resource %s. :(", resourceName.c_str());
-							}
-						});
+						return;
 					}
 
 					// mark DownloadsComplete on the next frame so all resources will have started
+					std::unique_lock<std::mutex> lock(executeNextGameFrameMutex);
 					executeNextGameFrame.push_back([=] ()
 					{
 						netLibrary->DownloadsComplete();
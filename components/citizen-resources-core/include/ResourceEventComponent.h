@@ -9,10 +9,15 @@
 
 #include <ComponentHolder.h>
 
-#include <concurrent_queue.h>
+#include <ResourceEventQueue.h>
 
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <queue>
+#include <set>
 #include <stack>
 
 #ifdef COMPILING_CITIZEN_RESOURCES_CORE
@@ -34,16 +39,28 @@ private:
 
 	ResourceEventManagerComponent* m_managerComponent;
 
+	// where the resource gets triggered, relative to the others
+	uint64_t m_triggerOrder;
+
 private:
-	struct EventData
-	{
-		std::string eventName;
-		std::string eventSource;
-		std::string eventPayload;
-	};
+	MpscQueue<QueuedEvent> m_eventQueue;
+
+	std::mutex m_subscriptionMutex;
+
+	// the event names each script runtime of the resource subscribed to - an empty set for those that didn't yet
+	std::map<int32_t, std::set<std::string>> m_runtimeSubscriptions;
+
+	// event names the manager triggers the resource for
+	std::set<std::string> m_subscribedEvents;
+
+	bool m_receivesAllEvents;
 
 private:
-	concurrency::concurrent_queue<EventData> m_eventQueue;
+	// registers the resource for all events while any runtime didn't subscribe to something, or for the union of
+	// their subscriptions otherwise - m_subscriptionMutex has to be held
+	void UpdateSubscriptions(bool unsubscribe = false);
+
+	void UnsubscribeEvents();
 
 public:
 	ResourceEventComponent();
@@ -53,9 +70,47 @@ public:
 		return m_managerComponent;
 	}
 
+	//
+	// Returns whether or not the resource gets every triggered event, as opposed to only those it subscribed to.
+	//
+	inline bool ReceivesAllEvents()
+	{
+		return m_receivesAllEvents;
+	}
+
+	inline uint64_t GetTriggerOrder()
+	{
+		return m_triggerOrder;
+	}
+
 	void HandleTriggerEvent(const std::string& eventName, const std::string& eventPayload, const std::string& eventSource, bool* eventCanceled);
 
-	void QueueEvent(const std::string& eventName, const std::string& eventPayload, const std::string& eventSource = std::string());
+	//
+	// Enqueues an event for execution on the next resource tick.
+	//
+	void QueueEvent(const EventName& eventName, std::string eventPayload, const std::string& eventSource = std::string());
+
+	//
+	// Enqueues an event for execution on the next resource tick, sharing the payload with whoever else holds it.
+	//
+	void QueueEvent(const EventName& eventName, const EventPayload& eventPayload, const std::string& eventSource = std::string());
+
+	//
+	// Adds a script runtime handling events in the resource. The resource keeps receiving every event until each of
+	// its runtimes subscribed to something.
+	//
+	void AddEventRuntime(int32_t instanceId);
+
+	//
+	// Subscribes a runtime of the resource to triggered events with the passed name, or to all events for "*".
+	// Subscriptions not made on behalf of any script runtime use the instance ID 0.
+	//
+	void SubscribeEvent(const std::string& eventName, int32_t instanceId = 0);
+
+	//
+	// Drops all runtimes and subscriptions, going back to receiving every event.
+	//
+	void ResetEventSubscriptions();
 
 	virtual void AttachToObject(Resource* object) override;
 
@@ -72,17 +127,29 @@ class ResourceManager;
 class RESOURCES_CORE_EXPORT ResourceEventManagerComponent : public fwRefCountable, public IAttached<ResourceManager>
 {
 private:
-	struct EventData
-	{
-		std::string eventName;
-		std::string eventSource;
-		std::string eventPayload;
-	};
+	// lists get replaced instead of modified, so triggering can go on while the subscriptions change
+	typedef std::vector<fwRefContainer<ResourceEventComponent>> SubscriberList;
 
 private:
 	ResourceManager* m_manager;
 
-	concurrency::concurrent_queue<EventData> m_eventQueue;
+	MpscQueue<QueuedEvent> m_eventQueue;
+
+	std::mutex m_subscribersMutex;
+
+	// subscribed resources by event name, with the ones receiving every event under "*" - each sorted by trigger order
+	std::unordered_map<EventName, std::shared_ptr<const SubscriberList>> m_eventSubscribers;
+
+	EventName m_allEventsName;
+
+	std::atomic<uint64_t> m_nextTriggerOrder;
+
+	std::chrono::microseconds m_tickBudget;
+
+	// when the current resource manager tick stops handling queued events, set by the first queue drained in it
+	std::chrono::high_resolution_clock::time_point m_tickDeadline;
+
+	bool m_tickStarted;
 
 	std::stack<bool*> m_eventCancelationStack;
 
@@ -117,14 +184,62 @@ public:
 	fwEvent<const std::string&, const std::string&, const std::string&, bool*> OnTriggerEvent;
 
 	//
-	// Triggers an event immediately. Returns whether or not the event was canceled.
+	// Triggers an event immediately, in resources in the order they were added. Returns whether or not the event was
+	// canceled.
 	//
-	bool TriggerEvent(const std::string& eventName, const std::string& eventPayload, const std::string& eventSource = std::string());
+	bool TriggerEvent(const EventName& eventName, const std::string& eventPayload, const std::string& eventSource = std::string());
 
 	//
 	// Enqueues an event for execution on the next resource manager tick.
 	//
-	void QueueEvent(const std::string& eventName, const std::string& eventPayload, const std::string& eventSource = std::string());
+	void QueueEvent(const EventName& eventName, std::string eventPayload, const std::string& eventSource = std::string());
+
+	//
+	// Enqueues an event for execution on the next resource manager tick, sharing the payload with whoever else holds it.
+	//
+	void QueueEvent(const EventName& eventName, const EventPayload& eventPayload, const std::string& eventSource = std::string());
+
+	//
+	// Gets the time each resource manager tick may spend on queued events, shared by the manager and all resources.
+	// Events beyond that wait for the next tick, though every queue handles at least one per tick.
+	//
+	inline std::chrono::microseconds GetTickBudget()
+	{
+		return m_tickBudget;
+	}
+
+	//
+	// Sets the time each tick may spend on queued events.
+	//
+	inline void SetTickBudget(std::chrono::microseconds budget)
+	{
+		m_tickBudget = budget;
+	}
+
+	//
+	// Gets the point at which the current tick stops handling queued events, starting the tick's budget if this is
+	// the first queue drained in it.
+	//
+	std::chrono::high_resolution_clock::time_point GetTickDeadline();
+
+	//
+	// Returns the trigger order for a newly added resource, placing it after all existing ones.
+	//
+	inline uint64_t AllocateTriggerOrder()
+	{
+		return m_nextTriggerOrder++;
+	}
+
+	//
+	// Adds a resource to the list of those triggered for an event name, or for every event for "*".
+	// Used by ResourceEventComponent to keep the index up to date.
+	//
+	void AddEventSubscriber(const EventName& eventName, ResourceEventComponent* subscriber);
+
+	//
+	// Removes a resource from the list of those triggered for an event name.
+	//
+	void RemoveEventSubscriber(const EventName& eventName, ResourceEventComponent* subscriber);
 
 	virtual void AttachToObject(ResourceManager* object) override;
 };
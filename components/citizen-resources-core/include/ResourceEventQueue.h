@@ -0,0 +1,190 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#ifdef COMPILING_CITIZEN_RESOURCES_CORE
+#define RESOURCES_CORE_EXPORT DLL_EXPORT
+#else
+#define RESOURCES_CORE_EXPORT DLL_IMPORT
+#endif
+
+namespace fx
+{
+//
+// An interned event name. Every distinct name is stored once for as long as any EventName refers to it, so copying,
+// comparing and hashing a name never touches its characters - only creating one from a string does.
+//
+// Names nobody holds anymore are released again, as plenty of them come from scripts or the network and are only
+// seen once.
+//
+class RESOURCES_CORE_EXPORT EventName
+{
+private:
+	// null for the empty name
+	std::shared_ptr<const std::string> m_name;
+
+public:
+	// the empty name
+	EventName();
+
+	EventName(const std::string& name);
+
+	EventName(const char* name);
+
+	const std::string& GetString() const;
+
+	inline size_t GetHash() const
+	{
+		return std::hash<const void*>()(m_name.get());
+	}
+
+	inline bool operator==(const EventName& right) const
+	{
+		return (m_name == right.m_name);
+	}
+
+	inline bool operator!=(const EventName& right) const
+	{
+		return (m_name != right.m_name);
+	}
+
+	// the number of distinct names currently interned
+	static size_t GetInternedCount();
+};
+
+//
+// An event payload, immutable once queued so every resource receiving the event can share the same buffer.
+//
+typedef std::shared_ptr<const std::string> EventPayload;
+
+//
+// An unbounded queue for any number of producer threads and a single consumer, without any locks.
+//
+// Producers swap their node in as the new head and then link the previous head to it; the consumer follows the links
+// from a stub node, which is replaced by every node it pops. A producer that got preempted between the two steps
+// makes the nodes after it invisible until it's done, so popping may briefly report nothing while there's more.
+//
+template<typename T>
+class MpscQueue
+{
+private:
+	struct Node
+	{
+		std::atomic<Node*> next;
+
+		T value;
+
+		inline Node()
+			: next(nullptr)
+		{
+
+		}
+
+		inline Node(T&& value)
+			: next(nullptr), value(std::move(value))
+		{
+
+		}
+	};
+
+	// keep both ends on their own cache line - padded instead of using alignas, as over-aligned members would need
+	// aligned allocation of whatever holds the queue
+	char m_padding[64];
+
+	// producer side
+	std::atomic<Node*> m_head;
+
+	char m_headPadding[64 - sizeof(std::atomic<Node*>)];
+
+	// consumer side
+	Node* m_tail;
+
+	char m_tailPadding[64 - sizeof(Node*)];
+
+public:
+	MpscQueue()
+	{
+		Node* stub = new Node();
+
+		m_head = stub;
+		m_tail = stub;
+	}
+
+	~MpscQueue()
+	{
+		for (Node* node = m_tail; node; )
+		{
+			Node* next = node->next.load(std::memory_order_relaxed);
+			delete node;
+
+			node = next;
+		}
+	}
+
+	MpscQueue(const MpscQueue&) = delete;
+
+	MpscQueue& operator=(const MpscQueue&) = delete;
+
+	// any thread
+	void Push(T&& value)
+	{
+		Node* node = new Node(std::move(value));
+		Node* previous = m_head.exchange(node, std::memory_order_acq_rel);
+
+		previous->next.store(node, std::memory_order_release);
+	}
+
+	// consumer thread only
+	bool TryPop(T& value)
+	{
+		Node* tail = m_tail;
+		Node* next = tail->next.load(std::memory_order_acquire);
+
+		if (!next)
+		{
+			return false;
+		}
+
+		// the popped node becomes the new stub
+		value = std::move(next->value);
+		m_tail = next;
+
+		delete tail;
+
+		return true;
+	}
+};
+
+//
+// An event waiting in a queue, as the resource event components keep them.
+//
+struct QueuedEvent
+{
+	EventName eventName;
+
+	EventPayload eventPayload;
+
+	std::string eventSource;
+};
+}
+
+namespace std
+{
+template<>
+struct hash<fx::EventName>
+{
+	inline size_t operator()(const fx::EventName& name) const
+	{
+		return name.GetHash();
+	}
+};
+}
@@ -0,0 +1,115 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <ppltasks.h>
+
+#include <Resource.h>
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifdef COMPILING_CITIZEN_RESOURCES_CORE
+#define RESOURCES_CORE_EXPORT DLL_EXPORT
+#else
+#define RESOURCES_CORE_EXPORT DLL_IMPORT
+#endif
+
+namespace fx
+{
+class ResourceManager;
+
+struct ResourceStartTiming
+{
+	std::string uri;
+
+	// empty if the resource couldn't be mounted
+	std::string resourceName;
+
+	// from the thread pool getting to the resource until it was mounted and had its metadata loaded
+	std::chrono::microseconds mountTime;
+
+	// OnPrepareResource handlers - on the thread pool
+	std::chrono::microseconds prepareTime;
+
+	// Resource::Start - one resource at a time, through the start executor
+	std::chrono::microseconds startTime;
+
+	bool started;
+
+	// why the resource wasn't started, if it wasn't
+	std::string error;
+};
+
+struct RESOURCES_CORE_EXPORT ResourceStartReport
+{
+	// in start order, followed by anything that didn't start
+	std::vector<ResourceStartTiming> resources;
+
+	// wall clock time until the last resource was prepared, and from then until the last one was started
+	std::chrono::microseconds loadTime;
+
+	std::chrono::microseconds startTime;
+
+	std::chrono::microseconds totalTime;
+
+	bool succeeded;
+
+	//
+	// Formats the report as a table, with the stage totals first and the slowest resources after.
+	//
+	std::string Format(size_t maxResources = 10) const;
+};
+
+//
+// Starts a batch of resources, mounting and preparing all of them in parallel on the thread pool and then starting
+// them one by one once everything they depend on has started.
+//
+// Dependencies are the 'dependency' metadata entries of each resource; they're either part of the same batch or
+// have to be loaded in the resource manager already. Resources with dependencies that are missing, cyclic or failed to
+// start don't get started either.
+//
+class RESOURCES_CORE_EXPORT ResourceStartScheduler : public fwRefCountable
+{
+public:
+	// runs a function wherever resources may be started
+	typedef std::function<void(const std::function<void()>&)> TExecutor;
+
+private:
+	ResourceManager* m_manager;
+
+	TExecutor m_startExecutor;
+
+public:
+	ResourceStartScheduler(ResourceManager* manager);
+
+	//
+	// Sets where resources get started, such as the next game frame. By default, this is whichever thread happens to
+	// finish loading the batch.
+	//
+	inline void SetStartExecutor(const TExecutor& executor)
+	{
+		m_startExecutor = executor;
+	}
+
+	//
+	// Adds and starts resources from the passed URIs, completing once every resource is either started or failed.
+	//
+	concurrency::task<ResourceStartReport> StartResources(const std::vector<std::string>& uris);
+
+public:
+	//
+	// An event for work to be done on a resource before it starts, called on the thread pool as soon as the resource
+	// has been mounted. Anything I/O-bound that doesn't need the game thread - reading and compiling scripts, cache
+	// lookups - belongs here rather than in Resource::OnStart.
+	//
+	static fwEvent<Resource*> OnPrepareResource;
+};
+}
@@ -13,9 +13,29 @@
 
 #include <msgpack.hpp>
 
+#include <algorithm>
+
 namespace fx
 {
+// pops events until the queue is empty or the deadline passed, leaving the rest for the next tick
+template<typename TFunc>
+static void DrainEventQueue(MpscQueue<QueuedEvent>& queue, std::chrono::high_resolution_clock::time_point deadline, const TFunc& function)
+{
+	QueuedEvent event;
+
+	while (queue.TryPop(event))
+	{
+		function(event);
+
+		if (std::chrono::high_resolution_clock::now() >= deadline)
+		{
+			break;
+		}
+	}
+}
+
 ResourceEventComponent::ResourceEventComponent()
+	: m_triggerOrder(0), m_receivesAllEvents(true)
 {
 
 }
@@ -25,6 +45,14 @@ void ResourceEventComponent::AttachToObject(Resource* object)
 	m_resource = object;
 
 	m_managerComponent = m_resource->GetManager()->GetComponent<ResourceEventManagerComponent>().GetRef();
+	m_triggerOrder = m_managerComponent->AllocateTriggerOrder();
+
+	// receive everything until told otherwise
+	{
+		std::unique_lock<std::mutex> lock(m_subscriptionMutex);
+
+		UpdateSubscriptions();
+	}
 
 	// start/stop handling events
 	object->OnStart.Connect([=] ()
@@ -55,24 +83,25 @@ void ResourceEventComponent::AttachToObject(Resource* object)
 		// send the event out to the world
 		// TODO: handle server/client split
 		m_managerComponent->QueueEvent("onClientResourceStop", std::string(buf.data(), buf.size()));
+
+		// scripts will subscribe again when restarted
+		ResetEventSubscriptions();
+	});
+
+	object->OnRemove.Connect([=] ()
+	{
+		UnsubscribeEvents();
 	});
 
 	object->OnTick.Connect([=] ()
 	{
 		// take queued events and trigger them
-		while (!m_eventQueue.empty())
+		DrainEventQueue(m_eventQueue, m_managerComponent->GetTickDeadline(), [&] (const QueuedEvent& event)
 		{
-			// get the event
-			EventData event;
-
-			if (m_eventQueue.try_pop(event))
-			{
-				// and trigger it
-				bool canceled = false;
+			bool canceled = false;
 
-				HandleTriggerEvent(event.eventName, event.eventPayload, event.eventSource, &canceled);
-			}
-		}
+			HandleTriggerEvent(event.eventName.GetString(), *event.eventPayload, event.eventSource, &canceled);
+		});
 	});
 }
 
@@ -81,66 +110,186 @@ void ResourceEventComponent::HandleTriggerEvent(const std::string& eventName, co
 	OnTriggerEvent(eventName, eventPayload, eventSource, eventCanceled);
 }
 
-void ResourceEventComponent::QueueEvent(const std::string& eventName, const std::string& eventPayload, const std::string& eventSource /* = std::string() */)
+void ResourceEventComponent::QueueEvent(const EventName& eventName, std::string eventPayload, const std::string& eventSource /* = std::string() */)
+{
+	QueueEvent(eventName, std::make_shared<const std::string>(std::move(eventPayload)), eventSource);
+}
+
+void ResourceEventComponent::QueueEvent(const EventName& eventName, const EventPayload& eventPayload, const std::string& eventSource /* = std::string() */)
 {
-	EventData event;
+	QueuedEvent event;
 	event.eventName = eventName;
 	event.eventPayload = eventPayload;
 	event.eventSource = eventSource;
 
+	m_eventQueue.Push(std::move(event));
+}
+
+void ResourceEventComponent::AddEventRuntime(int32_t instanceId)
+{
+	std::unique_lock<std::mutex> lock(m_subscriptionMutex);
+
+	m_runtimeSubscriptions[instanceId];
+
+	UpdateSubscriptions();
+}
+
+void ResourceEventComponent::SubscribeEvent(const std::string& eventName, int32_t instanceId /* = 0 */)
+{
+	std::unique_lock<std::mutex> lock(m_subscriptionMutex);
+
+	if (!m_runtimeSubscriptions[instanceId].insert(eventName).second)
 	{
-		m_eventQueue.push(event);
+		return;
 	}
+
+	UpdateSubscriptions();
 }
 
-ResourceEventManagerComponent::ResourceEventManagerComponent()
-	: m_wasLastEventCanceled(false)
+void ResourceEventComponent::ResetEventSubscriptions()
 {
+	std::unique_lock<std::mutex> lock(m_subscriptionMutex);
 
+	m_runtimeSubscriptions.clear();
+
+	UpdateSubscriptions();
 }
 
-void ResourceEventManagerComponent::Tick()
+void ResourceEventComponent::UnsubscribeEvents()
 {
-	// take queued events and trigger them
-	while (!m_eventQueue.empty())
+	std::unique_lock<std::mutex> lock(m_subscriptionMutex);
+
+	m_runtimeSubscriptions.clear();
+
+	UpdateSubscriptions(true);
+}
+
+void ResourceEventComponent::UpdateSubscriptions(bool unsubscribe /* = false */)
+{
+	// a runtime that didn't subscribe to anything (yet) still expects every event
+	std::set<std::string> subscribedEvents;
+	bool receivesAllEvents = m_runtimeSubscriptions.empty();
+
+	for (auto& runtime : m_runtimeSubscriptions)
+	{
+		if (runtime.second.empty() || runtime.second.find("*") != runtime.second.end())
+		{
+			receivesAllEvents = true;
+			break;
+		}
+
+		subscribedEvents.insert(runtime.second.begin(), runtime.second.end());
+	}
+
+	if (unsubscribe)
+	{
+		subscribedEvents.clear();
+	}
+	else if (receivesAllEvents)
+	{
+		subscribedEvents = { "*" };
+	}
+
+	for (auto& eventName : m_subscribedEvents)
 	{
-		// get the event
-		EventData event;
-		
-		if (m_eventQueue.try_pop(event))
+		if (subscribedEvents.find(eventName) == subscribedEvents.end())
 		{
-			// and trigger it
-			TriggerEvent(event.eventName, event.eventPayload, event.eventSource);
+			m_managerComponent->RemoveEventSubscriber(eventName, this);
 		}
 	}
+
+	for (auto& eventName : subscribedEvents)
+	{
+		if (m_subscribedEvents.find(eventName) == m_subscribedEvents.end())
+		{
+			m_managerComponent->AddEventSubscriber(eventName, this);
+		}
+	}
+
+	m_subscribedEvents = std::move(subscribedEvents);
+	m_receivesAllEvents = receivesAllEvents;
+}
+
+ResourceEventManagerComponent::ResourceEventManagerComponent()
+	: m_allEventsName("*"), m_nextTriggerOrder(0), m_tickBudget(std::chrono::milliseconds(4)), m_tickStarted(false), m_wasLastEventCanceled(false)
+{
+
+}
+
+std::chrono::high_resolution_clock::time_point ResourceEventManagerComponent::GetTickDeadline()
+{
+	if (!m_tickStarted)
+	{
+		m_tickDeadline = std::chrono::high_resolution_clock::now() + m_tickBudget;
+		m_tickStarted = true;
+	}
+
+	return m_tickDeadline;
+}
+
+void ResourceEventManagerComponent::Tick()
+{
+	// take queued events and trigger them - the resources got ticked before, so this is what's left of the budget
+	DrainEventQueue(m_eventQueue, GetTickDeadline(), [&] (const QueuedEvent& event)
+	{
+		TriggerEvent(event.eventName, *event.eventPayload, event.eventSource);
+	});
+
+	// this ends the resource manager tick
+	m_tickStarted = false;
 }
 
-bool ResourceEventManagerComponent::TriggerEvent(const std::string& eventName, const std::string& eventPayload, const std::string& eventSource /* = std::string() */)
+bool ResourceEventManagerComponent::TriggerEvent(const EventName& eventName, const std::string& eventPayload, const std::string& eventSource /* = std::string() */)
 {
 	// add a value to signify event cancelation
 	bool eventCanceled = false;
 
 	m_eventCancelationStack.push(&eventCanceled);
 
+	const std::string& eventNameString = eventName.GetString();
+
 	// trigger global handlers for the event
-	OnTriggerEvent(eventName, eventPayload, eventSource, &eventCanceled);
+	OnTriggerEvent(eventNameString, eventPayload, eventSource, &eventCanceled);
+
+	// get the resources interested in the event
+	std::shared_ptr<const SubscriberList> subscribers;
+	std::shared_ptr<const SubscriberList> allSubscribers;
 
-	// trigger local handlers
-	m_manager->ForAllResources([&] (fwRefContainer<Resource> resource)
 	{
-		// get the event component
-		fwRefContainer<ResourceEventComponent> eventComponent = resource->GetComponent<ResourceEventComponent>();
+		std::unique_lock<std::mutex> lock(m_subscribersMutex);
 
-		// if there's none, return
-		if (!eventComponent.GetRef())
+		auto it = m_eventSubscribers.find(eventName);
+
+		if (it != m_eventSubscribers.end())
 		{
-			trace("no event component for resource %s\n", resource->GetName().c_str());
-			return;
+			subscribers = it->second;
 		}
 
-		// continue on
-		eventComponent->HandleTriggerEvent(eventName, eventPayload, eventSource, &eventCanceled);
-	});
+		it = m_eventSubscribers.find(m_allEventsName);
+
+		if (it != m_eventSubscribers.end())
+		{
+			allSubscribers = it->second;
+		}
+	}
+
+	// trigger local handlers, merging both lists so resources see the event (and its cancelation) in a fixed order
+	static const SubscriberList emptyList;
+
+	const SubscriberList& named = (subscribers) ? *subscribers : emptyList;
+	const SubscriberList& all = (allSubscribers) ? *allSubscribers : emptyList;
+
+	auto namedIt = named.begin();
+	auto allIt = all.begin();
+
+	while (namedIt != named.end() || allIt != all.end())
+	{
+		bool takeNamed = (allIt == all.end()) || (namedIt != named.end() && (*namedIt)->GetTriggerOrder() < (*allIt)->GetTriggerOrder());
+
+		const fwRefContainer<ResourceEventComponent>& eventComponent = (takeNamed) ? *namedIt++ : *allIt++;
+
+		eventComponent->HandleTriggerEvent(eventNameString, eventPayload, eventSource, &eventCanceled);
+	}
 
 	// pop the stack entry
 	m_eventCancelationStack.pop();
@@ -152,17 +301,72 @@ bool ResourceEventManagerComponent::TriggerEvent(const std::string& eventName, c
 	return !eventCanceled;
 }
 
-void ResourceEventManagerComponent::QueueEvent(const std::string& eventName, const std::string& eventPayload, const std::string& eventSource /* = std::string() */)
+void ResourceEventManagerComponent::QueueEvent(const EventName& eventName, std::string eventPayload, const std::string& eventSource /* = std::string() */)
+{
+	QueueEvent(eventName, std::make_shared<const std::string>(std::move(eventPayload)), eventSource);
+}
+
+void ResourceEventManagerComponent::QueueEvent(const EventName& eventName, const EventPayload& eventPayload, const std::string& eventSource /* = std::string() */)
 {
-	EventData event;
+	QueuedEvent event;
 	event.eventName = eventName;
 	event.eventPayload = eventPayload;
 	event.eventSource = eventSource;
 
-	trace("queue event %s\n", eventName.c_str());
+	m_eventQueue.Push(std::move(event));
+}
+
+void ResourceEventManagerComponent::AddEventSubscriber(const EventName& eventName, ResourceEventComponent* subscriber)
+{
+	std::unique_lock<std::mutex> lock(m_subscribersMutex);
+
+	auto& subscribers = m_eventSubscribers[eventName];
+	auto newSubscribers = (subscribers) ? std::make_shared<SubscriberList>(*subscribers) : std::make_shared<SubscriberList>();
+
+	auto isSubscriber = [=] (const fwRefContainer<ResourceEventComponent>& entry)
+	{
+		return (entry.GetRef() == subscriber);
+	};
+
+	if (std::none_of(newSubscribers->begin(), newSubscribers->end(), isSubscriber))
+	{
+		auto position = std::upper_bound(newSubscribers->begin(), newSubscribers->end(), subscriber->GetTriggerOrder(), [] (uint64_t order, const fwRefContainer<ResourceEventComponent>& entry)
+		{
+			return order < entry->GetTriggerOrder();
+		});
+
+		newSubscribers->insert(position, subscriber);
+	}
+
+	subscribers = newSubscribers;
+}
+
+void ResourceEventManagerComponent::RemoveEventSubscriber(const EventName& eventName, ResourceEventComponent* subscriber)
+{
+	std::unique_lock<std::mutex> lock(m_subscribersMutex);
+
+	auto it = m_eventSubscribers.find(eventName);
 
+	if (it == m_eventSubscribers.end())
+	{
+		return;
+	}
+
+	auto isSubscriber = [=] (const fwRefContainer<ResourceEventComponent>& entry)
+	{
+		return (entry.GetRef() == subscriber);
+	};
+
+	auto newSubscribers = std::make_shared<SubscriberList>(*it->second);
+	newSubscribers->erase(std::remove_if(newSubscribers->begin(), newSubscribers->end(), isSubscriber), newSubscribers->end());
+
+	if (newSubscribers->empty())
+	{
+		m_eventSubscribers.erase(it);
+	}
+	else
 	{
-		m_eventQueue.push(event);
+		it->second = newSubscribers;
 	}
 }
 
@@ -0,0 +1,89 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "ResourceEventQueue.h"
+
+#include <mutex>
+#include <unordered_map>
+
+namespace fx
+{
+static const std::string g_emptyEventName;
+
+// interned names by their string, each entry dropped again by the last reference to it - allocated once and never
+// freed, as names held by other static objects may outlive this module's statics
+static std::mutex* g_eventNamesMutex = new std::mutex();
+static std::unordered_map<std::string, std::weak_ptr<const std::string>>* g_eventNames = new std::unordered_map<std::string, std::weak_ptr<const std::string>>();
+
+static void ReleaseEventName(const std::string* name)
+{
+	{
+		std::unique_lock<std::mutex> lock(*g_eventNamesMutex);
+
+		auto it = g_eventNames->find(*name);
+
+		// the name might have been interned again since the last reference went away
+		if (it != g_eventNames->end() && it->second.expired())
+		{
+			g_eventNames->erase(it);
+		}
+	}
+
+	delete name;
+}
+
+static std::shared_ptr<const std::string> InternEventName(const std::string& name)
+{
+	if (name.empty())
+	{
+		return nullptr;
+	}
+
+	std::unique_lock<std::mutex> lock(*g_eventNamesMutex);
+
+	auto& entry = (*g_eventNames)[name];
+	auto internedName = entry.lock();
+
+	if (!internedName)
+	{
+		internedName = std::shared_ptr<const std::string>(new std::string(name), ReleaseEventName);
+		entry = internedName;
+	}
+
+	return internedName;
+}
+
+EventName::EventName()
+{
+
+}
+
+EventName::EventName(const std::string& name)
+	: m_name(InternEventName(name))
+{
+
+}
+
+EventName::EventName(const char* name)
+	: m_name(InternEventName(name))
+{
+
+}
+
+const std::string& EventName::GetString() const
+{
+	return (m_name) ? *m_name : g_emptyEventName;
+}
+
+size_t EventName::GetInternedCount()
+{
+	std::unique_lock<std::mutex> lock(*g_eventNamesMutex);
+
+	return g_eventNames->size();
+}
+}
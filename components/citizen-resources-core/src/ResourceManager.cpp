@@ -46,11 +46,30 @@ concurrency::task<fwRefContainer<Resource>> ResourceManagerImpl::AddResource(con
 		{
 			concurrency::task_completion_event<fwRefContainer<Resource>> completionEvent;
 
-			// set a completion event, as well
-			mounter->LoadResource(uri).then([=] (fwRefContainer<Resource> resource)
+			// set a completion event, as well - also if mounting fails, so nobody waits on it forever
+			try
 			{
-				completionEvent.set(resource);
-			});
+				mounter->LoadResource(uri).then([=] (concurrency::task<fwRefContainer<Resource>> task)
+				{
+					fwRefContainer<Resource> resource;
+
+					try
+					{
+						resource = task.get();
+					}
+					catch (std::exception& e)
+					{
+						trace("Mounting %s failed: %s\n", uri.c_str(), e.what());
+					}
+
+					completionEvent.set(resource);
+				});
+			}
+			catch (concurrency::invalid_operation&)
+			{
+				// mounters return an empty task for resources they don't know
+				completionEvent.set(nullptr);
+			}
 
 			return concurrency::task<fwRefContainer<Resource>>(completionEvent);
 		}
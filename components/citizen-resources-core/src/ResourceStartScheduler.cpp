@@ -0,0 +1,343 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "ResourceStartScheduler.h"
+
+#include <ResourceManager.h>
+#include <ResourceMetaDataComponent.h>
+
+#include <algorithm>
+#include <queue>
+
+namespace fx
+{
+typedef std::chrono::high_resolution_clock Clock;
+
+static inline std::chrono::microseconds GetElapsed(Clock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+}
+
+static inline double ToMilliseconds(std::chrono::microseconds time)
+{
+	return time.count() / 1000.0;
+}
+
+struct LoadedResource
+{
+	fwRefContainer<Resource> resource;
+
+	ResourceStartTiming timing;
+};
+
+ResourceStartScheduler::ResourceStartScheduler(ResourceManager* manager)
+	: m_manager(manager)
+{
+	m_startExecutor = [] (const std::function<void()>& function)
+	{
+		function();
+	};
+}
+
+// starts the loaded resources in dependency order, as long as their dependencies got started
+static ResourceStartReport StartLoadedResources(ResourceManager* manager, std::vector<LoadedResource>& loaded)
+{
+	size_t numResources = loaded.size();
+
+	std::unordered_map<std::string, size_t> batchIndices;
+
+	for (size_t i = 0; i < numResources; i++)
+	{
+		if (loaded[i].resource.GetRef())
+		{
+			batchIndices[loaded[i].resource->GetName()] = i;
+		}
+	}
+
+	// build the graph
+	std::vector<std::vector<size_t>> dependents(numResources);
+	std::vector<int> unmetDependencies(numResources, 0);
+
+	for (size_t i = 0; i < numResources; i++)
+	{
+		auto& resource = loaded[i].resource;
+
+		if (!resource.GetRef())
+		{
+			continue;
+		}
+
+		fwRefContainer<ResourceMetaDataComponent> metaData = resource->GetComponent<ResourceMetaDataComponent>();
+
+		if (!metaData.GetRef())
+		{
+			continue;
+		}
+
+		for (auto& entry : metaData->GetEntries("dependency"))
+		{
+			const std::string& dependency = entry.second;
+			auto it = batchIndices.find(dependency);
+
+			if (it != batchIndices.end())
+			{
+				if (it->second != i)
+				{
+					dependents[it->second].push_back(i);
+					unmetDependencies[i]++;
+				}
+			}
+			else if (!manager->GetResource(dependency).GetRef() && loaded[i].timing.error.empty())
+			{
+				loaded[i].timing.error = "missing dependency " + dependency;
+			}
+		}
+	}
+
+	// walk it - resources that are ready start in the order they were passed in
+	std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>> ready;
+	std::vector<size_t> startOrder;
+
+	for (size_t i = 0; i < numResources; i++)
+	{
+		if (unmetDependencies[i] == 0)
+		{
+			ready.push(i);
+		}
+	}
+
+	while (!ready.empty())
+	{
+		size_t index = ready.top();
+		ready.pop();
+
+		auto& entry = loaded[index];
+
+		if (entry.timing.error.empty())
+		{
+			auto startStart = Clock::now();
+
+			entry.timing.started = entry.resource->Start();
+			entry.timing.startTime = GetElapsed(startStart);
+
+			if (entry.timing.started)
+			{
+				startOrder.push_back(index);
+			}
+			else
+			{
+				entry.timing.error = "couldn't be started";
+			}
+		}
+
+		for (size_t dependent : dependents[index])
+		{
+			if (!entry.timing.started && loaded[dependent].timing.error.empty())
+			{
+				loaded[dependent].timing.error = "dependency " + entry.timing.resourceName + " wasn't started";
+			}
+
+			if (--unmetDependencies[dependent] == 0)
+			{
+				ready.push(dependent);
+			}
+		}
+	}
+
+	// anything left over is part of a cycle
+	ResourceStartReport report;
+	report.succeeded = (startOrder.size() == numResources);
+
+	for (size_t index : startOrder)
+	{
+		report.resources.push_back(loaded[index].timing);
+	}
+
+	for (size_t i = 0; i < numResources; i++)
+	{
+		auto& timing = loaded[i].timing;
+
+		if (!timing.started)
+		{
+			if (timing.error.empty())
+			{
+				timing.error = "cyclic dependency";
+			}
+
+			report.resources.push_back(timing);
+		}
+	}
+
+	return report;
+}
+
+concurrency::task<ResourceStartReport> ResourceStartScheduler::StartResources(const std::vector<std::string>& uris)
+{
+	auto batchStart = Clock::now();
+
+	if (uris.empty())
+	{
+		ResourceStartReport report;
+		report.loadTime = report.startTime = report.totalTime = std::chrono::microseconds(0);
+		report.succeeded = true;
+
+		return concurrency::task_from_result(report);
+	}
+
+	ResourceManager* manager = m_manager;
+	TExecutor executor = m_startExecutor;
+
+	// mount and prepare everything in parallel
+	std::vector<concurrency::task<LoadedResource>> tasks;
+
+	for (auto& uri : uris)
+	{
+		// the mount is timed from when the pool gets to it, so waiting behind other resources doesn't count
+		auto mountStart = std::make_shared<Clock::time_point>();
+
+		auto mountTask = concurrency::create_task([=] ()
+		{
+			*mountStart = Clock::now();
+
+			return manager->AddResource(uri);
+		});
+
+		tasks.push_back(mountTask.then([=] (concurrency::task<fwRefContainer<Resource>> task)
+		{
+			LoadedResource loaded;
+			loaded.timing.uri = uri;
+			loaded.timing.prepareTime = loaded.timing.startTime = std::chrono::microseconds(0);
+			loaded.timing.started = false;
+
+			try
+			{
+				loaded.resource = task.get();
+			}
+			catch (std::exception& e)
+			{
+				loaded.timing.error = e.what();
+			}
+
+			loaded.timing.mountTime = GetElapsed(*mountStart);
+
+			if (!loaded.resource.GetRef())
+			{
+				if (loaded.timing.error.empty())
+				{
+					loaded.timing.error = "couldn't be mounted";
+				}
+
+				return loaded;
+			}
+
+			loaded.timing.resourceName = loaded.resource->GetName();
+
+			auto prepareStart = Clock::now();
+
+			try
+			{
+				OnPrepareResource(loaded.resource.GetRef());
+			}
+			catch (std::exception& e)
+			{
+				loaded.timing.error = va("couldn't be prepared: %s", e.what());
+			}
+
+			loaded.timing.prepareTime = GetElapsed(prepareStart);
+
+			return loaded;
+		}));
+	}
+
+	// then start them, one by one
+	return concurrency::when_all(tasks.begin(), tasks.end()).then([=] (std::vector<LoadedResource> loaded)
+	{
+		auto loadTime = GetElapsed(batchStart);
+
+		concurrency::task_completion_event<ResourceStartReport> completionEvent;
+
+		executor([=] ()
+		{
+			auto startStart = Clock::now();
+
+			std::vector<LoadedResource> batch = loaded;
+			ResourceStartReport report = StartLoadedResources(manager, batch);
+
+			report.loadTime = loadTime;
+			report.startTime = GetElapsed(startStart);
+			report.totalTime = GetElapsed(batchStart);
+
+			completionEvent.set(report);
+		});
+
+		return concurrency::task<ResourceStartReport>(completionEvent);
+	});
+}
+
+std::string ResourceStartReport::Format(size_t maxResources /* = 10 */) const
+{
+	std::chrono::microseconds mountTotal(0), mountLongest(0), prepareTotal(0), startTotal(0);
+	size_t numStarted = 0;
+
+	for (auto& resource : resources)
+	{
+		mountTotal += resource.mountTime;
+		mountLongest = std::max(mountLongest, resource.mountTime);
+
+		prepareTotal += resource.prepareTime;
+		startTotal += resource.startTime;
+
+		numStarted += (resource.started) ? 1 : 0;
+	}
+
+	std::string result = va("Started %d of %d resources in %.1f ms: %.1f ms loading in parallel, %.1f ms starting.\n",
+		static_cast<int>(numStarted), static_cast<int>(resources.size()), ToMilliseconds(totalTime), ToMilliseconds(loadTime), ToMilliseconds(startTime));
+
+	// mounts and preparation overlap, so their sums are work done rather than time waited
+	if (!resources.empty())
+	{
+		result += va("Mounting took %.1f ms per resource on average and %.1f ms at most. Summed over all resources, preparing took %.1f ms and starting %.1f ms.\n",
+			ToMilliseconds(mountTotal) / resources.size(), ToMilliseconds(mountLongest), ToMilliseconds(prepareTotal), ToMilliseconds(startTotal));
+	}
+
+	// the slowest resources, by everything they spent on their own
+	std::vector<const ResourceStartTiming*> slowest;
+
+	for (auto& resource : resources)
+	{
+		slowest.push_back(&resource);
+	}
+
+	std::sort(slowest.begin(), slowest.end(), [] (const ResourceStartTiming* left, const ResourceStartTiming* right)
+	{
+		return (left->prepareTime + left->startTime) > (right->prepareTime + right->startTime);
+	});
+
+	result += va("%-32s %10s %10s %10s\n", "resource", "mount", "prepare", "start");
+
+	for (size_t i = 0; i < slowest.size() && i < maxResources; i++)
+	{
+		auto timing = slowest[i];
+
+		result += va("%-32s %7.1f ms %7.1f ms %7.1f ms\n", (timing->resourceName.empty()) ? timing->uri.c_str() : timing->resourceName.c_str(),
+			ToMilliseconds(timing->mountTime), ToMilliseconds(timing->prepareTime), ToMilliseconds(timing->startTime));
+	}
+
+	for (auto& resource : resources)
+	{
+		if (!resource.started)
+		{
+			result += va("%s was not started: %s\n", (resource.resourceName.empty()) ? resource.uri.c_str() : resource.resourceName.c_str(), resource.error.c_str());
+		}
+	}
+
+	return result;
+}
+
+fwEvent<Resource*> ResourceStartScheduler::OnPrepareResource;
+}
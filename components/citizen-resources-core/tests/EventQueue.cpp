@@ -0,0 +1,363 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <ResourceManager.h>
+#include <ResourceEventComponent.h>
+
+#include <concurrent_queue.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using fx::EventName;
+using fx::ResourceEventManagerComponent;
+
+TEST(EventQueue, InternsNames)
+{
+	std::string name = "playerSpawned";
+
+	EXPECT_EQ(EventName("playerSpawned"), EventName(name));
+	EXPECT_EQ(&EventName("playerSpawned").GetString(), &EventName(name).GetString());
+	EXPECT_NE(EventName("playerSpawned"), EventName("playerDropped"));
+
+	EXPECT_EQ(EventName(), EventName(""));
+	EXPECT_EQ("", EventName().GetString());
+}
+
+TEST(EventQueue, ReleasesUnusedNames)
+{
+	size_t internedCount = EventName::GetInternedCount();
+
+	{
+		EventName name("onlySeenOnce");
+		EventName copy = name;
+
+		EXPECT_EQ(internedCount + 1, EventName::GetInternedCount());
+	}
+
+	EXPECT_EQ(internedCount, EventName::GetInternedCount());
+
+	// and can be interned again after
+	EventName name("onlySeenOnce");
+
+	EXPECT_EQ("onlySeenOnce", name.GetString());
+	EXPECT_EQ(name, EventName("onlySeenOnce"));
+}
+
+TEST(EventQueue, KeepsProducerOrder)
+{
+	const int numProducers = 4;
+	const int count = 100000;
+
+	fx::MpscQueue<int> queue;
+	std::vector<std::thread> producers;
+
+	for (int p = 0; p < numProducers; p++)
+	{
+		producers.emplace_back([&queue, p, count] ()
+		{
+			for (int i = 0; i < count; i++)
+			{
+				queue.Push(p * count + i);
+			}
+		});
+	}
+
+	std::vector<int> next(numProducers, 0);
+	int popped = 0;
+
+	while (popped < numProducers * count)
+	{
+		int value;
+
+		if (!queue.TryPop(value))
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		int producer = value / count;
+
+		ASSERT_EQ(next[producer], value % count);
+		next[producer]++;
+
+		popped++;
+	}
+
+	for (auto& producer : producers)
+	{
+		producer.join();
+	}
+
+	int value;
+	EXPECT_FALSE(queue.TryPop(value));
+}
+
+static fwRefContainer<fx::ResourceManager> CreateTestManager()
+{
+	fwRefContainer<fx::ResourceManager> manager = fx::CreateResourceManager();
+
+	// components are normally added from the module's init functions
+	if (!manager->GetComponent<ResourceEventManagerComponent>().GetRef())
+	{
+		manager->SetComponent(fwRefContainer<ResourceEventManagerComponent>(new ResourceEventManagerComponent()));
+	}
+
+	return manager;
+}
+
+TEST(EventQueue, StopsAtTickBudget)
+{
+	auto manager = CreateTestManager();
+	auto eventManager = manager->GetComponent<ResourceEventManagerComponent>();
+
+	int handled = 0;
+
+	eventManager->OnTriggerEvent.Connect([&] (const std::string& eventName, const std::string& eventPayload, const std::string& eventSource, bool* eventCanceled)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		handled++;
+	});
+
+	for (int i = 0; i < 10; i++)
+	{
+		eventManager->QueueEvent("slowEvent", "");
+	}
+
+	eventManager->SetTickBudget(std::chrono::microseconds(0));
+
+	// at least one per tick
+	manager->Tick();
+	EXPECT_EQ(1, handled);
+
+	eventManager->SetTickBudget(std::chrono::seconds(10));
+
+	manager->Tick();
+	EXPECT_EQ(10, handled);
+}
+
+TEST(EventQueue, SharesTickBudgetBetweenResources)
+{
+	auto manager = CreateTestManager();
+	auto eventManager = manager->GetComponent<ResourceEventManagerComponent>();
+
+	int handled = 0;
+
+	std::vector<fwRefContainer<fx::ResourceEventComponent>> eventComponents;
+
+	for (int i = 0; i < 4; i++)
+	{
+		fwRefContainer<fx::Resource> resource = manager->CreateResource("slow" + std::to_string(i));
+		fwRefContainer<fx::ResourceEventComponent> eventComponent = resource->GetComponent<fx::ResourceEventComponent>();
+
+		if (!eventComponent.GetRef())
+		{
+			eventComponent = new fx::ResourceEventComponent();
+			resource->SetComponent(eventComponent);
+		}
+
+		resource->Start();
+
+		eventComponents.push_back(eventComponent);
+	}
+
+	// get the start events out of the way
+	manager->Tick();
+
+	for (auto& eventComponent : eventComponents)
+	{
+		eventComponent->OnTriggerEvent.Connect([&] (const std::string& eventName, const std::string& eventPayload, const std::string& eventSource, bool* eventCanceled)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			handled++;
+		});
+
+		for (int j = 0; j < 10; j++)
+		{
+			eventComponent->QueueEvent("slowEvent", "");
+		}
+	}
+
+	// room for about three events in all, though each resource still gets to handle one
+	eventManager->SetTickBudget(std::chrono::milliseconds(5));
+
+	manager->Tick();
+	EXPECT_GE(handled, 4);
+	EXPECT_LT(handled, 10);
+
+	// and the next tick gets a budget of its own
+	int lastHandled = handled;
+
+	manager->Tick();
+	EXPECT_GE(handled - lastHandled, 4);
+	EXPECT_LT(handled - lastHandled, 10);
+
+	manager->ResetResources();
+}
+
+// what the event queues looked like before
+struct CopiedEvent
+{
+	std::string eventName;
+	std::string eventSource;
+	std::string eventPayload;
+};
+
+TEST(EventQueue, KeepsProducerOrderThroughManager)
+{
+	const int numProducers = 4;
+	const int count = 10000;
+
+	auto manager = CreateTestManager();
+	auto eventManager = manager->GetComponent<ResourceEventManagerComponent>();
+
+	std::vector<int> next(numProducers, 0);
+	int received = 0;
+	bool ordered = true;
+
+	eventManager->OnTriggerEvent.Connect([&] (const std::string& eventName, const std::string& eventPayload, const std::string& eventSource, bool* eventCanceled)
+	{
+		int producer = eventSource[0] - '0';
+		int index = std::stoi(eventPayload);
+
+		ordered = ordered && (next[producer] == index);
+		next[producer] = index + 1;
+
+		received++;
+	});
+
+	std::vector<std::thread> producers;
+
+	for (int p = 0; p < numProducers; p++)
+	{
+		producers.emplace_back([eventManager, p, count] ()
+		{
+			for (int i = 0; i < count; i++)
+			{
+				eventManager->QueueEvent("stressEvent", std::to_string(i), std::string(1, '0' + p));
+			}
+		});
+	}
+
+	while (received < numProducers * count)
+	{
+		manager->Tick();
+	}
+
+	for (auto& producer : producers)
+	{
+		producer.join();
+	}
+
+	EXPECT_TRUE(ordered);
+}
+
+TEST(EventQueue, DISABLED_BenchmarkMultipleProducers)
+{
+	const int numProducers = 4;
+	const int count = 50000;
+
+	// about the size of a small net event
+	const std::string payload(120, 'x');
+
+	auto runProducers = [&] (std::function<void(int, int)> produce)
+	{
+		std::vector<std::thread> producers;
+
+		for (int p = 0; p < numProducers; p++)
+		{
+			producers.emplace_back([produce, p, count] ()
+			{
+				for (int i = 0; i < count; i++)
+				{
+					produce(p, i);
+				}
+			});
+		}
+
+		return producers;
+	};
+
+	auto rate = [&] (std::chrono::high_resolution_clock::time_point start)
+	{
+		auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+		return (numProducers * count) / (time / 1e9);
+	};
+
+	// the resource manager, ticked on this thread while the producers queue
+	{
+		auto manager = CreateTestManager();
+		auto eventManager = manager->GetComponent<ResourceEventManagerComponent>();
+
+		int received = 0;
+
+		eventManager->OnTriggerEvent.Connect([&] (const std::string& eventName, const std::string& eventPayload, const std::string& eventSource, bool* eventCanceled)
+		{
+			received++;
+		});
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		auto producers = runProducers([&] (int producer, int index)
+		{
+			std::string eventPayload = payload;
+			memcpy(&eventPayload[0], &index, sizeof(index));
+
+			eventManager->QueueEvent("stressEvent", std::move(eventPayload), std::string(1, '0' + producer));
+		});
+
+		while (received < numProducers * count)
+		{
+			manager->Tick();
+		}
+
+		double queueRate = rate(start);
+
+		for (auto& producer : producers)
+		{
+			producer.join();
+		}
+
+		printf("%d producers: %9.0f events/sec through the manager queue\n", numProducers, queueRate);
+	}
+
+	// the old queue, for comparison
+	{
+		concurrency::concurrent_queue<CopiedEvent> queue;
+		int received = 0;
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		auto producers = runProducers([&] (int producer, int index)
+		{
+			CopiedEvent event;
+			event.eventName = "stressEvent";
+			event.eventPayload = payload;
+			event.eventSource = std::string(1, '0' + producer);
+
+			queue.push(event);
+		});
+
+		while (received < numProducers * count)
+		{
+			CopiedEvent event;
+
+			if (queue.try_pop(event))
+			{
+				received++;
+			}
+		}
+
+		double queueRate = rate(start);
+
+		for (auto& producer : producers)
+		{
+			producer.join();
+		}
+
+		printf("%d producers: %9.0f events/sec through a concurrent_queue of copies\n", numProducers, queueRate);
+	}
+}
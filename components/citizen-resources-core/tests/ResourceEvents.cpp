@@ -0,0 +1,205 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <ResourceManager.h>
+#include <ResourceEventComponent.h>
+
+#include <chrono>
+
+using fx::ResourceEventComponent;
+using fx::ResourceEventManagerComponent;
+
+static fwRefContainer<fx::ResourceManager> CreateTestManager()
+{
+	fwRefContainer<fx::ResourceManager> manager = fx::CreateResourceManager();
+
+	// components are normally added from the module's init functions
+	if (!manager->GetComponent<ResourceEventManagerComponent>().GetRef())
+	{
+		manager->SetComponent(fwRefContainer<ResourceEventManagerComponent>(new ResourceEventManagerComponent()));
+	}
+
+	return manager;
+}
+
+static fwRefContainer<ResourceEventComponent> CreateTestResource(fwRefContainer<fx::ResourceManager> manager, const std::string& name, int* counter)
+{
+	fwRefContainer<fx::Resource> resource = manager->CreateResource(name);
+	fwRefContainer<ResourceEventComponent> eventComponent = resource->GetComponent<ResourceEventComponent>();
+
+	if (!eventComponent.GetRef())
+	{
+		eventComponent = new ResourceEventComponent();
+		resource->SetComponent(eventComponent);
+	}
+
+	eventComponent->OnTriggerEvent.Connect([=] (const std::string& eventName, const std::string& eventPayload, const std::string& eventSource, bool* eventCanceled)
+	{
+		(*counter)++;
+	});
+
+	return eventComponent;
+}
+
+TEST(ResourceEvents, DispatchesToSubscribers)
+{
+	auto manager = CreateTestManager();
+	auto eventManager = manager->GetComponent<ResourceEventManagerComponent>();
+
+	int unfiltered = 0, filtered = 0, wildcard = 0;
+
+	auto unfilteredResource = CreateTestResource(manager, "unfiltered", &unfiltered);
+	auto filteredResource = CreateTestResource(manager, "filtered", &filtered);
+	auto wildcardResource = CreateTestResource(manager, "wildcard", &wildcard);
+
+	filteredResource->SubscribeEvent("playerSpawned");
+	filteredResource->SubscribeEvent("playerSpawned");
+
+	wildcardResource->SubscribeEvent("playerSpawned");
+	wildcardResource->SubscribeEvent("*");
+
+	eventManager->TriggerEvent("playerSpawned", "");
+	eventManager->TriggerEvent("chatMessage", "");
+
+	EXPECT_EQ(2, unfiltered);
+	EXPECT_EQ(1, filtered);
+	EXPECT_EQ(2, wildcard);
+
+	// back to receiving everything
+	filteredResource->ResetEventSubscriptions();
+
+	eventManager->TriggerEvent("chatMessage", "");
+
+	EXPECT_EQ(2, filtered);
+	EXPECT_EQ(3, unfiltered);
+
+	manager->ResetResources();
+}
+
+TEST(ResourceEvents, WaitsForEveryRuntime)
+{
+	auto manager = CreateTestManager();
+	auto eventManager = manager->GetComponent<ResourceEventManagerComponent>();
+
+	int calls = 0;
+	auto resource = CreateTestResource(manager, "runtimes", &calls);
+
+	resource->AddEventRuntime(1);
+	resource->AddEventRuntime(2);
+
+	// the second runtime didn't subscribe to anything, so it still expects every event
+	resource->SubscribeEvent("playerSpawned", 1);
+
+	eventManager->TriggerEvent("chatMessage", "");
+
+	EXPECT_EQ(1, calls);
+	EXPECT_TRUE(resource->ReceivesAllEvents());
+
+	resource->SubscribeEvent("chatMessage", 2);
+
+	eventManager->TriggerEvent("playerSpawned", "");
+	eventManager->TriggerEvent("chatMessage", "");
+	eventManager->TriggerEvent("playerDied", "");
+
+	EXPECT_EQ(3, calls);
+	EXPECT_FALSE(resource->ReceivesAllEvents());
+
+	manager->ResetResources();
+}
+
+TEST(ResourceEvents, KeepsResourceOrder)
+{
+	auto manager = CreateTestManager();
+	auto eventManager = manager->GetComponent<ResourceEventManagerComponent>();
+
+	std::vector<std::string> order;
+	std::vector<bool> sawCancel;
+
+	std::vector<fwRefContainer<ResourceEventComponent>> resources;
+	int unused = 0;
+
+	for (int i = 0; i < 4; i++)
+	{
+		resources.push_back(CreateTestResource(manager, va("ordered%d", i), &unused));
+
+		resources.back()->OnTriggerEvent.Connect([=, &order, &sawCancel] (const std::string& eventName, const std::string& eventPayload, const std::string& eventSource, bool* eventCanceled)
+		{
+			order.push_back(va("ordered%d", i));
+			sawCancel.push_back(*eventCanceled);
+
+			// the first resource cancels, which every later one has to see
+			if (i == 0)
+			{
+				eventManager->CancelEvent();
+			}
+		});
+	}
+
+	// subscribed and unsubscribed resources interleave
+	resources[1]->SubscribeEvent("playerSpawned");
+	resources[3]->SubscribeEvent("playerSpawned");
+
+	EXPECT_FALSE(eventManager->TriggerEvent("playerSpawned", ""));
+
+	EXPECT_EQ((std::vector<std::string>{ "ordered0", "ordered1", "ordered2", "ordered3" }), order);
+	EXPECT_EQ((std::vector<bool>{ false, true, true, true }), sawCancel);
+
+	manager->ResetResources();
+}
+
+TEST(ResourceEvents, DISABLED_BenchmarkAgainstResourceCount)
+{
+	const int count = 20000;
+
+	for (int numResources : { 10, 50, 150, 500 })
+	{
+		auto manager = CreateTestManager();
+		auto eventManager = manager->GetComponent<ResourceEventManagerComponent>();
+
+		int calls = 0;
+		std::vector<fwRefContainer<ResourceEventComponent>> resources;
+
+		for (int i = 0; i < numResources; i++)
+		{
+			resources.push_back(CreateTestResource(manager, va("resource%d", i), &calls));
+		}
+
+		auto measure = [&] ()
+		{
+			calls = 0;
+
+			auto start = std::chrono::high_resolution_clock::now();
+
+			for (int i = 0; i < count; i++)
+			{
+				eventManager->TriggerEvent("benchmarkEvent", "");
+			}
+
+			auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+			return count / (time / 1e9);
+		};
+
+		// every resource taking every event, as before subscriptions
+		double broadcastRate = measure();
+		EXPECT_EQ(count * numResources, calls);
+
+		// every resource subscribed to its own events, and two of them to this one as well
+		for (int i = 0; i < numResources; i++)
+		{
+			resources[i]->SubscribeEvent(va("resource%d:event", i));
+
+			if (i < 2)
+			{
+				resources[i]->SubscribeEvent("benchmarkEvent");
+			}
+		}
+
+		double subscribedRate = measure();
+		EXPECT_EQ(count * 2, calls);
+
+		printf("%3d resources: %9.0f events/sec broadcast, %9.0f events/sec with 2 subscribers\n", numResources, broadcastRate, subscribedRate);
+
+		manager->ResetResources();
+	}
+}
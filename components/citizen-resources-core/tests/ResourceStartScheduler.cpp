@@ -0,0 +1,325 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <ResourceManager.h>
+#include <ResourceMetaDataComponent.h>
+#include <ResourceStartScheduler.h>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+
+using fx::ResourceStartReport;
+using fx::ResourceStartScheduler;
+
+// OnPrepareResource can't be disconnected from, so tests swap what it calls instead
+static std::function<void(fx::Resource*)> g_prepareResource;
+
+static InitFunction initFunction([] ()
+{
+	ResourceStartScheduler::OnPrepareResource.Connect([] (fx::Resource* resource)
+	{
+		if (g_prepareResource)
+		{
+			g_prepareResource(resource);
+		}
+	});
+});
+
+// mounts test://name resources, taking a while like an actual download and metadata load would
+//
+// Starting a resource takes a while too, like loading its scripts - unless it got prepared before.
+class TestResourceMounter : public fx::ResourceMounter
+{
+private:
+	fx::ResourceManager* m_manager;
+
+	std::map<std::string, std::vector<std::string>> m_dependencies;
+
+	std::chrono::milliseconds m_mountTime;
+
+	std::chrono::milliseconds m_loadTime;
+
+public:
+	std::mutex startedMutex;
+
+	std::vector<std::string> started;
+
+	// started resources that didn't get prepared before
+	std::vector<std::string> startedUnprepared;
+
+	std::set<std::string> prepared;
+
+public:
+	TestResourceMounter(fx::ResourceManager* manager, std::chrono::milliseconds mountTime, std::chrono::milliseconds loadTime = std::chrono::milliseconds(0))
+		: m_manager(manager), m_mountTime(mountTime), m_loadTime(loadTime)
+	{
+
+	}
+
+	void AddResource(const std::string& name, const std::vector<std::string>& dependencies = {})
+	{
+		m_dependencies[name] = dependencies;
+	}
+
+	void Prepare(fx::Resource* resource)
+	{
+		std::this_thread::sleep_for(m_loadTime);
+
+		std::unique_lock<std::mutex> lock(startedMutex);
+		prepared.insert(resource->GetName());
+	}
+
+	virtual bool HandlesScheme(const std::string& scheme) override
+	{
+		return (scheme == "test");
+	}
+
+	virtual concurrency::task<fwRefContainer<fx::Resource>> LoadResource(const std::string& uri) override
+	{
+		std::string name = uri.substr(strlen("test://"));
+		auto it = m_dependencies.find(name);
+
+		if (it == m_dependencies.end())
+		{
+			return concurrency::task<fwRefContainer<fx::Resource>>();
+		}
+
+		std::vector<std::string> dependencies = it->second;
+
+		return concurrency::create_task([=] ()
+		{
+			std::this_thread::sleep_for(m_mountTime);
+
+			fwRefContainer<fx::Resource> resource = m_manager->CreateResource(name);
+
+			// the metadata loader normally adds this
+			fwRefContainer<fx::ResourceMetaDataComponent> metaData = new fx::ResourceMetaDataComponent(resource.GetRef());
+			resource->SetComponent(metaData);
+
+			for (auto& dependency : dependencies)
+			{
+				metaData->AddMetaData("dependency", dependency);
+			}
+
+			resource->OnStart.Connect([=] ()
+			{
+				bool wasPrepared;
+
+				{
+					std::unique_lock<std::mutex> lock(startedMutex);
+					wasPrepared = (prepared.find(name) != prepared.end());
+				}
+
+				if (!wasPrepared)
+				{
+					std::this_thread::sleep_for(m_loadTime);
+				}
+
+				std::unique_lock<std::mutex> lock(startedMutex);
+				started.push_back(name);
+
+				if (!wasPrepared)
+				{
+					startedUnprepared.push_back(name);
+				}
+			});
+
+			return resource;
+		});
+	}
+};
+
+static int IndexOf(const std::vector<std::string>& list, const std::string& entry)
+{
+	auto it = std::find(list.begin(), list.end(), entry);
+
+	return (it == list.end()) ? -1 : static_cast<int>(it - list.begin());
+}
+
+TEST(ResourceStartScheduler, StartsInDependencyOrder)
+{
+	fwRefContainer<fx::ResourceManager> manager = fx::CreateResourceManager();
+	fwRefContainer<TestResourceMounter> mounter = new TestResourceMounter(manager.GetRef(), std::chrono::milliseconds(1));
+
+	mounter->AddResource("chat", { "baseevents" });
+	mounter->AddResource("baseevents");
+	mounter->AddResource("map", { "mapmanager", "spawnmanager" });
+	mounter->AddResource("mapmanager");
+	mounter->AddResource("spawnmanager", { "mapmanager" });
+	mounter->AddResource("cycleA", { "cycleB" });
+	mounter->AddResource("cycleB", { "cycleA" });
+	mounter->AddResource("needsCycle", { "cycleA" });
+	mounter->AddResource("needsMissing", { "missing" });
+
+	manager->AddMounter(mounter);
+
+	fwRefContainer<ResourceStartScheduler> scheduler = new ResourceStartScheduler(manager.GetRef());
+
+	ResourceStartReport report = scheduler->StartResources({
+		"test://chat", "test://map", "test://baseevents", "test://spawnmanager", "test://mapmanager",
+		"test://cycleA", "test://cycleB", "test://needsCycle", "test://needsMissing", "test://unknown"
+	}).get();
+
+	auto& started = mounter->started;
+
+	EXPECT_FALSE(report.succeeded);
+	EXPECT_EQ(5u, started.size());
+	EXPECT_EQ(10u, report.resources.size());
+
+	EXPECT_LT(IndexOf(started, "baseevents"), IndexOf(started, "chat"));
+	EXPECT_LT(IndexOf(started, "mapmanager"), IndexOf(started, "spawnmanager"));
+	EXPECT_LT(IndexOf(started, "spawnmanager"), IndexOf(started, "map"));
+
+	for (const char* name : { "cycleA", "cycleB", "needsCycle", "needsMissing" })
+	{
+		EXPECT_EQ(-1, IndexOf(started, name)) << name;
+	}
+
+	// the report lists started resources in order, then the rest with a reason
+	for (size_t i = 0; i < started.size(); i++)
+	{
+		EXPECT_EQ(started[i], report.resources[i].resourceName);
+		EXPECT_TRUE(report.resources[i].started);
+
+		// each mount is timed on its own
+		EXPECT_GE(report.resources[i].mountTime, std::chrono::milliseconds(1));
+		EXPECT_LE(report.resources[i].mountTime, report.loadTime);
+	}
+
+	std::string formatted = report.Format();
+
+	for (size_t i = started.size(); i < report.resources.size(); i++)
+	{
+		EXPECT_FALSE(report.resources[i].started);
+		EXPECT_NE("", report.resources[i].error);
+
+		std::string name = (report.resources[i].resourceName.empty()) ? report.resources[i].uri : report.resources[i].resourceName;
+		EXPECT_NE(std::string::npos, formatted.find(name + " was not started: " + report.resources[i].error)) << name;
+	}
+
+	manager->ResetResources();
+}
+
+TEST(ResourceStartScheduler, PreparesBeforeStarting)
+{
+	fwRefContainer<fx::ResourceManager> manager = fx::CreateResourceManager();
+	fwRefContainer<TestResourceMounter> mounter = new TestResourceMounter(manager.GetRef(), std::chrono::milliseconds(1), std::chrono::milliseconds(2));
+
+	mounter->AddResource("mapmanager");
+	mounter->AddResource("spawnmanager", { "mapmanager" });
+	mounter->AddResource("chat");
+
+	manager->AddMounter(mounter);
+
+	g_prepareResource = [=] (fx::Resource* resource)
+	{
+		mounter->Prepare(resource);
+	};
+
+	fwRefContainer<ResourceStartScheduler> scheduler = new ResourceStartScheduler(manager.GetRef());
+	ResourceStartReport report = scheduler->StartResources({ "test://spawnmanager", "test://mapmanager", "test://chat" }).get();
+
+	g_prepareResource = nullptr;
+
+	EXPECT_TRUE(report.succeeded);
+	EXPECT_EQ(3u, mounter->started.size());
+	EXPECT_TRUE(mounter->startedUnprepared.empty());
+
+	for (auto& resource : report.resources)
+	{
+		EXPECT_GE(resource.prepareTime, std::chrono::milliseconds(2)) << resource.resourceName;
+	}
+
+	manager->ResetResources();
+}
+
+TEST(ResourceStartScheduler, DISABLED_BenchmarkAgainstWhenAll)
+{
+	const int numResources = 200;
+	const auto mountTime = std::chrono::milliseconds(5);
+	const auto loadTime = std::chrono::milliseconds(2);
+
+	auto setUp = [&] (fwRefContainer<fx::ResourceManager> manager)
+	{
+		fwRefContainer<TestResourceMounter> mounter = new TestResourceMounter(manager.GetRef(), mountTime, loadTime);
+		std::vector<std::string> uris;
+
+		for (int i = 0; i < numResources; i++)
+		{
+			// every resource depends on a few of the ones before it
+			std::vector<std::string> dependencies;
+
+			for (int j = i / 2; j < i; j += 17)
+			{
+				dependencies.push_back(va("resource%d", j));
+			}
+
+			mounter->AddResource(va("resource%d", i), dependencies);
+			uris.push_back(va("test://resource%d", i));
+		}
+
+		manager->AddMounter(mounter);
+
+		return std::make_pair(mounter, uris);
+	};
+
+	// mounted all at once and then started in the order passed, with scripts loaded on start - as the net bindings
+	// used to do it
+	double whenAllTime;
+
+	{
+		fwRefContainer<fx::ResourceManager> manager = fx::CreateResourceManager();
+		auto uris = setUp(manager).second;
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		std::vector<concurrency::task<fwRefContainer<fx::Resource>>> tasks;
+
+		for (auto& uri : uris)
+		{
+			tasks.push_back(manager->AddResource(uri));
+		}
+
+		std::vector<fwRefContainer<fx::Resource>> resources = concurrency::when_all(tasks.begin(), tasks.end()).get();
+
+		for (auto& resource : resources)
+		{
+			ASSERT_TRUE(resource.GetRef());
+			ASSERT_TRUE(resource->Start());
+		}
+
+		whenAllTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count() / 1000.0;
+
+		manager->ResetResources();
+	}
+
+	// through the scheduler, with scripts loaded while preparing
+	{
+		fwRefContainer<fx::ResourceManager> manager = fx::CreateResourceManager();
+		auto setUpResult = setUp(manager);
+
+		auto mounter = setUpResult.first;
+
+		g_prepareResource = [=] (fx::Resource* resource)
+		{
+			mounter->Prepare(resource);
+		};
+
+		fwRefContainer<ResourceStartScheduler> scheduler = new ResourceStartScheduler(manager.GetRef());
+		ResourceStartReport report = scheduler->StartResources(setUpResult.second).get();
+
+		g_prepareResource = nullptr;
+
+		EXPECT_TRUE(report.succeeded);
+
+		printf("%d resources, %d ms mount and %d ms script load each: %.1f ms through when_all, %.1f ms scheduled\n", numResources, static_cast<int>(mountTime.count()),
+			static_cast<int>(loadTime.count()), whenAllTime, report.totalTime.count() / 1000.0);
+
+		printf("%s", report.Format(5).c_str());
+
+		manager->ResetResources();
+	}
+}
@@ -24,12 +24,28 @@ private:
 
 	std::recursive_mutex m_scriptRuntimesLock;
 
+	// client scripts read before the resource started, by file name
+	std::map<std::string, std::vector<uint8_t>> m_preparedFiles;
+
+	std::mutex m_preparedFilesLock;
+
 private:
 	void CreateEnvironments();
 
 public:
 	ResourceScriptingComponent(Resource* resource);
 
+	//
+	// Reads the client scripts of the resource into memory, so starting it doesn't wait on the file system. Called
+	// on the thread pool while the resource gets prepared for starting.
+	//
+	void PrepareFiles();
+
+	//
+	// Takes the contents of a client script read by PrepareFiles, if there are any.
+	//
+	bool TakePreparedFile(const std::string& fileName, std::vector<uint8_t>* data);
+
 	inline fx::OMPtr<IScriptHost> GetScriptHost()
 	{
 		return m_scriptHost;
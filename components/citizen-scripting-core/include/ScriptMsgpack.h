@@ -0,0 +1,46 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+namespace fx
+{
+//
+// msgpack extension types used in event payloads and reference calls, shared by all script runtime codecs.
+//
+// Vector payloads are 2 to 4 little-endian IEEE floats, in x/y/z/w order.
+//
+enum class MsgpackExtType : int8_t
+{
+	FunctionReference = 10,
+	LocalFunctionReference = 11,
+	Vector2 = 20,
+	Vector3 = 21,
+	Vector4 = 22,
+	Quaternion = 23
+};
+
+// returns the number of floats in a vector extension type, or 0 if the type isn't one
+inline int GetMsgpackVectorComponents(int8_t type)
+{
+	switch (static_cast<MsgpackExtType>(type))
+	{
+		case MsgpackExtType::Vector2:
+			return 2;
+		case MsgpackExtType::Vector3:
+			return 3;
+		case MsgpackExtType::Vector4:
+		case MsgpackExtType::Quaternion:
+			return 4;
+		default:
+			return 0;
+	}
+}
+
+// nesting depth at which codecs give up, as the value is most likely cyclic
+static const int kMsgpackMaxDepth = 64;
+}
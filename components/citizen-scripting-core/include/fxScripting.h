@@ -149,6 +149,12 @@ class NS_NO_VTABLE IScriptHost : public fxIBase {
   /* void CanonicalizeRef (in int32_t localRef, in int32_t instanceId, out charPtr refString); */
   NS_IMETHOD CanonicalizeRef(int32_t localRef, int32_t instanceId, char **refString) = 0;
 
+  /* void GetNativeHandle (in uint64_t nativeIdentifier, out voidPtr handle); */
+  NS_IMETHOD GetNativeHandle(uint64_t nativeIdentifier, void * *handle) = 0;
+
+  /* void InvokeNativeHandle (in voidPtr handle, inout NativeCtx context); */
+  NS_IMETHOD InvokeNativeHandle(void *handle, fxNativeContext & context) = 0;
+
 };
 
   NS_DEFINE_STATIC_IID_ACCESSOR(IScriptHost, ISCRIPTHOST_IID)
@@ -158,21 +164,27 @@ class NS_NO_VTABLE IScriptHost : public fxIBase {
   NS_IMETHOD InvokeNative(fxNativeContext & context) override; \
   NS_IMETHOD OpenSystemFile(char *fileName, fxIStream * *stream) override; \
   NS_IMETHOD OpenHostFile(char *fileName, fxIStream * *stream) override; \
-  NS_IMETHOD CanonicalizeRef(int32_t localRef, int32_t instanceId, char **refString) override; 
+  NS_IMETHOD CanonicalizeRef(int32_t localRef, int32_t instanceId, char **refString) override; \
+  NS_IMETHOD GetNativeHandle(uint64_t nativeIdentifier, void * *handle) override; \
+  NS_IMETHOD InvokeNativeHandle(void *handle, fxNativeContext & context) override; 
 
 /* Use this macro to declare functions that forward the behavior of this interface to another object. */
 #define NS_FORWARD_ISCRIPTHOST(_to) \
   NS_IMETHOD InvokeNative(fxNativeContext & context) override { return _to InvokeNative(context); } \
   NS_IMETHOD OpenSystemFile(char *fileName, fxIStream * *stream) override { return _to OpenSystemFile(fileName, stream); } \
   NS_IMETHOD OpenHostFile(char *fileName, fxIStream * *stream) override { return _to OpenHostFile(fileName, stream); } \
-  NS_IMETHOD CanonicalizeRef(int32_t localRef, int32_t instanceId, char **refString) override { return _to CanonicalizeRef(localRef, instanceId, refString); } 
+  NS_IMETHOD CanonicalizeRef(int32_t localRef, int32_t instanceId, char **refString) override { return _to CanonicalizeRef(localRef, instanceId, refString); } \
+  NS_IMETHOD GetNativeHandle(uint64_t nativeIdentifier, void * *handle) override { return _to GetNativeHandle(nativeIdentifier, handle); } \
+  NS_IMETHOD InvokeNativeHandle(void *handle, fxNativeContext & context) override { return _to InvokeNativeHandle(handle, context); } 
 
 /* Use this macro to declare functions that forward the behavior of this interface to another object in a safe way. */
 #define NS_FORWARD_SAFE_ISCRIPTHOST(_to) \
   NS_IMETHOD InvokeNative(fxNativeContext & context) override { return !_to ? NS_ERROR_NULL_POINTER : _to->InvokeNative(context); } \
   NS_IMETHOD OpenSystemFile(char *fileName, fxIStream * *stream) override { return !_to ? NS_ERROR_NULL_POINTER : _to->OpenSystemFile(fileName, stream); } \
   NS_IMETHOD OpenHostFile(char *fileName, fxIStream * *stream) override { return !_to ? NS_ERROR_NULL_POINTER : _to->OpenHostFile(fileName, stream); } \
-  NS_IMETHOD CanonicalizeRef(int32_t localRef, int32_t instanceId, char **refString) override { return !_to ? NS_ERROR_NULL_POINTER : _to->CanonicalizeRef(localRef, instanceId, refString); } 
+  NS_IMETHOD CanonicalizeRef(int32_t localRef, int32_t instanceId, char **refString) override { return !_to ? NS_ERROR_NULL_POINTER : _to->CanonicalizeRef(localRef, instanceId, refString); } \
+  NS_IMETHOD GetNativeHandle(uint64_t nativeIdentifier, void * *handle) override { return !_to ? NS_ERROR_NULL_POINTER : _to->GetNativeHandle(nativeIdentifier, handle); } \
+  NS_IMETHOD InvokeNativeHandle(void *handle, fxNativeContext & context) override { return !_to ? NS_ERROR_NULL_POINTER : _to->InvokeNativeHandle(handle, context); } 
 
 #if 0
 /* Use the code below as a template for the implementation class for this interface. */
@@ -230,6 +242,18 @@ NS_IMETHODIMP _MYCLASS_::CanonicalizeRef(int32_t localRef, int32_t instanceId, c
     return NS_ERROR_NOT_IMPLEMENTED;
 }
 
+/* void GetNativeHandle (in uint64_t nativeIdentifier, out voidPtr handle); */
+NS_IMETHODIMP _MYCLASS_::GetNativeHandle(uint64_t nativeIdentifier, void * *handle)
+{
+    return NS_ERROR_NOT_IMPLEMENTED;
+}
+
+/* void InvokeNativeHandle (in voidPtr handle, inout NativeCtx context); */
+NS_IMETHODIMP _MYCLASS_::InvokeNativeHandle(void *handle, fxNativeContext & context)
+{
+    return NS_ERROR_NOT_IMPLEMENTED;
+}
+
 /* End of implementation class template. */
 #endif
 
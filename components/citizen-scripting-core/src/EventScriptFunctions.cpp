@@ -11,6 +11,8 @@
 #include <ResourceManager.h>
 #include <ResourceEventComponent.h>
 
+#include <fxScripting.h>
+
 static InitFunction initFunction([] ()
 {
 	fx::ScriptEngine::RegisterNativeHandler("TRIGGER_EVENT_INTERNAL", [] (fx::ScriptContext& context)
@@ -26,6 +28,24 @@ static InitFunction initFunction([] ()
 		context.SetResult(wasCanceled);
 	});
 
+	fx::ScriptEngine::RegisterNativeHandler("REGISTER_RESOURCE_AS_EVENT_HANDLER", [] (fx::ScriptContext& context)
+	{
+		fx::OMPtr<IScriptRuntime> runtime;
+
+		if (FX_SUCCEEDED(fx::GetCurrentScriptRuntime(&runtime)))
+		{
+			fx::Resource* resource = reinterpret_cast<fx::Resource*>(runtime->GetParentObject());
+
+			if (resource)
+			{
+				fwRefContainer<fx::ResourceEventComponent> eventComponent = resource->GetComponent<fx::ResourceEventComponent>();
+
+				// once all of the resource's runtimes did this, only events they registered for get triggered in it
+				eventComponent->SubscribeEvent(context.GetArgument<const char*>(0), runtime->GetInstanceId());
+			}
+		}
+	});
+
 	fx::ScriptEngine::RegisterNativeHandler("CANCEL_EVENT", [] (fx::ScriptContext& context)
 	{
 		// TODO: handle multiple resource managers for server
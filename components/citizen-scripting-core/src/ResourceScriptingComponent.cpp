@@ -10,6 +10,9 @@
 #include "ResourceEventComponent.h"
 #include "ResourceMetaDataComponent.h"
 #include "ResourceScriptingComponent.h"
+#include "ResourceStartScheduler.h"
+
+#include <VFSManager.h>
 
 namespace fx
 {
@@ -89,6 +92,10 @@ ResourceScriptingComponent::ResourceScriptingComponent(Resource* resource)
 		{
 			CreateEnvironments();
 		}
+
+		// anything not taken by now isn't going to be
+		std::unique_lock<std::mutex> lock(m_preparedFilesLock);
+		m_preparedFiles.clear();
 	});
 
 	resource->OnTick.Connect([=] ()
@@ -119,6 +126,45 @@ ResourceScriptingComponent::ResourceScriptingComponent(Resource* resource)
 	});
 }
 
+void ResourceScriptingComponent::PrepareFiles()
+{
+	fwRefContainer<ResourceMetaDataComponent> metaData = m_resource->GetComponent<ResourceMetaDataComponent>();
+	std::map<std::string, std::vector<uint8_t>> preparedFiles;
+
+	for (auto& clientScript : metaData->GetEntries("client_script"))
+	{
+		fwRefContainer<vfs::Stream> stream = vfs::OpenRead(m_resource->GetPath() + "/" + clientScript.second);
+
+		// the runtime will report it when it tries to load the file
+		if (!stream.GetRef())
+		{
+			continue;
+		}
+
+		preparedFiles[clientScript.second] = stream->ReadToEnd();
+	}
+
+	std::unique_lock<std::mutex> lock(m_preparedFilesLock);
+	m_preparedFiles = std::move(preparedFiles);
+}
+
+bool ResourceScriptingComponent::TakePreparedFile(const std::string& fileName, std::vector<uint8_t>* data)
+{
+	std::unique_lock<std::mutex> lock(m_preparedFilesLock);
+
+	auto it = m_preparedFiles.find(fileName);
+
+	if (it == m_preparedFiles.end())
+	{
+		return false;
+	}
+
+	*data = std::move(it->second);
+	m_preparedFiles.erase(it);
+
+	return true;
+}
+
 OMPtr<IScriptHost> GetScriptHostForResource(Resource* resource);
 
 void ResourceScriptingComponent::CreateEnvironments()
@@ -126,10 +172,20 @@ void ResourceScriptingComponent::CreateEnvironments()
 	std::unique_lock<std::recursive_mutex> lock(m_scriptRuntimesLock);
 
 	m_scriptHost = GetScriptHostForResource(m_resource);
+
+	fwRefContainer<ResourceEventComponent> eventComponent = m_resource->GetComponent<ResourceEventComponent>();
 	
 	for (auto& environment : m_scriptRuntimes)
 	{
 		environment.second->Create(m_scriptHost.GetRef());
+
+		// the resource keeps getting every event until all runtimes handling them subscribed to what they want
+		OMPtr<IScriptEventRuntime> eventRuntime;
+
+		if (eventComponent.GetRef() && FX_SUCCEEDED(environment.second.As(&eventRuntime)))
+		{
+			eventComponent->AddEventRuntime(environment.second->GetInstanceId());
+		}
 	}
 
 	// iterate over the runtimes and load scripts as requested
@@ -160,8 +216,6 @@ void ResourceScriptingComponent::CreateEnvironments()
 	}
 
 	// initialize event handler calls
-	fwRefContainer<ResourceEventComponent> eventComponent = m_resource->GetComponent<ResourceEventComponent>();
-
 	assert(eventComponent.GetRef());
 
 	if (eventComponent.GetRef())
@@ -203,4 +257,9 @@ static InitFunction initFunction([] ()
 	{
 		resource->SetComponent<fx::ResourceScriptingComponent>(new fx::ResourceScriptingComponent(resource));
 	});
+
+	fx::ResourceStartScheduler::OnPrepareResource.Connect([] (fx::Resource* resource)
+	{
+		resource->GetComponent<fx::ResourceScriptingComponent>()->PrepareFiles();
+	});
 });
\ No newline at end of file
@@ -12,6 +12,7 @@
 #include <ScriptEngine.h>
 
 #include <Resource.h>
+#include <ResourceScriptingComponent.h>
 #include <VFSManager.h>
 
 #include <stack>
@@ -73,6 +74,77 @@ result_t StreamWrapper::GetLength(uint64_t *length)
 	return FX_S_OK;
 }
 
+// a file read ahead of time by ResourceScriptingComponent::PrepareFiles
+class MemoryStreamWrapper : public OMClass<MemoryStreamWrapper, fxIStream>
+{
+private:
+	std::vector<uint8_t> m_data;
+
+	size_t m_position;
+
+public:
+	MemoryStreamWrapper(const std::vector<uint8_t>& data);
+
+public:
+	NS_DECL_FXISTREAM;
+};
+
+MemoryStreamWrapper::MemoryStreamWrapper(const std::vector<uint8_t>& data)
+	: m_data(data), m_position(0)
+{
+
+}
+
+result_t MemoryStreamWrapper::Read(void *data, uint32_t size, uint32_t *bytesRead)
+{
+	size_t read = std::min(static_cast<size_t>(size), m_data.size() - m_position);
+
+	if (read > 0)
+	{
+		memcpy(data, &m_data[m_position], read);
+		m_position += read;
+	}
+
+	if (bytesRead)
+	{
+		*bytesRead = read;
+	}
+
+	return FX_S_OK;
+}
+
+result_t MemoryStreamWrapper::Write(void *data, uint32_t size, uint32_t *bytesWritten)
+{
+	return FX_E_NOTIMPL;
+}
+
+result_t MemoryStreamWrapper::Seek(int64_t offset, int32_t origin, uint64_t *newPosition)
+{
+	int64_t base = (origin == SEEK_CUR) ? m_position : (origin == SEEK_END) ? m_data.size() : 0;
+	int64_t position = base + offset;
+
+	if (position < 0 || position > static_cast<int64_t>(m_data.size()))
+	{
+		return FX_E_INVALIDARG;
+	}
+
+	m_position = static_cast<size_t>(position);
+
+	if (newPosition)
+	{
+		*newPosition = m_position;
+	}
+
+	return FX_S_OK;
+}
+
+result_t MemoryStreamWrapper::GetLength(uint64_t *length)
+{
+	*length = m_data.size();
+
+	return FX_S_OK;
+}
+
 class TestScriptHost : public OMClass<TestScriptHost, IScriptHost>
 {
 public:
@@ -94,38 +166,42 @@ public:
 
 result_t TestScriptHost::InvokeNative(fxNativeContext & context)
 {
-	// get a native handler for the identifier
-	auto nativeHandler = ScriptEngine::GetNativeHandler(context.nativeIdentifier);
+	void* handle;
 
-	if (nativeHandler)
+	// natives that don't exist are a no-op
+	if (FX_FAILED(GetNativeHandle(context.nativeIdentifier, &handle)))
 	{
-		// prepare an invocation context
-		fx::ScriptContext scriptContext;
-		
-		// push arguments
-		for (int i = 0; i < context.numArguments; i++)
-		{
-			scriptContext.Push(context.arguments[i]);
-		}
+		return FX_S_OK;
+	}
 
-		// invoke the native handler
-		try
-		{
-			(*nativeHandler)(scriptContext);
-		}
-		catch (std::exception& e)
-		{
-			trace(__FUNCTION__ ": execution failed: %s\n", e.what());
+	return InvokeNativeHandle(handle, context);
+}
 
-			return FX_E_INVALIDARG;
-		}
+result_t TestScriptHost::GetNativeHandle(uint64_t nativeIdentifier, void** handle)
+{
+	*handle = ScriptEngine::ResolveNative(nativeIdentifier);
+
+	return (*handle) ? FX_S_OK : FX_E_INVALIDARG;
+}
+
+result_t TestScriptHost::InvokeNativeHandle(void* handle, fxNativeContext & context)
+{
+	static_assert(sizeof(fxNativeContext::arguments) == ScriptContext::MaxArguments * ScriptContext::ArgumentSize, "native argument buffers differ in size");
 
-		// set the result value
-		context.numResults = 1;
-		
-		memcpy(&context.arguments[0], &scriptContext.GetArgument<uintptr_t>(0), sizeof(uintptr_t) * 3);
+	// the native reads its arguments from the context and writes the result over them
+	try
+	{
+		reinterpret_cast<ResolvedNative*>(handle)->Invoke(context.arguments, context.numArguments);
+	}
+	catch (std::exception& e)
+	{
+		trace(__FUNCTION__ ": execution failed: %s\n", e.what());
+
+		return FX_E_INVALIDARG;
 	}
 
+	context.numResults = 1;
+
 	return FX_S_OK;
 }
 
@@ -154,6 +230,20 @@ result_t TestScriptHost::OpenSystemFile(char *fileName, fxIStream * *stream)
 
 result_t TestScriptHost::OpenHostFile(char *fileName, fxIStream * *stream)
 {
+	// scripts read before the resource started don't have to be read again
+	fwRefContainer<ResourceScriptingComponent> scriptingComponent = m_resource->GetComponent<ResourceScriptingComponent>();
+	std::vector<uint8_t> preparedData;
+
+	if (scriptingComponent->TakePreparedFile(fileName, &preparedData))
+	{
+		auto streamWrapper = fx::MakeNew<MemoryStreamWrapper>(preparedData);
+		streamWrapper->AddRef();
+
+		*stream = streamWrapper.GetRef();
+
+		return FX_S_OK;
+	}
+
 	fwRefContainer<vfs::Stream> nativeStream = vfs::OpenRead(m_resource->GetPath() + "/" + fileName);
 	
 	return WrapVFSStreamResult(nativeStream, stream);
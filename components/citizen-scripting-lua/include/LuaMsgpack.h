@@ -0,0 +1,40 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <lua.hpp>
+
+#ifdef COMPILING_CITIZEN_SCRIPTING_LUA
+#define SCRIPTING_LUA_EXPORT DLL_EXPORT
+#else
+#define SCRIPTING_LUA_EXPORT DLL_IMPORT
+#endif
+
+namespace fx
+{
+//
+// Native versions of msgpack.pack/msgpack.unpack from MessagePack.lua, walking the Lua stack and tables directly.
+//
+// The encoding matches the script implementation: integers and doubles in their smallest form, tables with keys
+// 1..n as arrays and anything else as maps, and the vector types as the extensions in ScriptMsgpack.h.
+//
+// Values without a native form - functions, userdata and tables with a metatable (such as function references) -
+// are handed to `msgpack.packers[type]`, and extensions other than vectors to `msgpack.build_ext`, so the hooks
+// scheduler.lua installs in the msgpack table keep working.
+//
+
+// packs the value at `index` and pushes the result as a string; on failure, pushes an error message instead
+// `msgpackIndex` is the stack index of the msgpack table to get hooks from, or 0 for none
+SCRIPTING_LUA_EXPORT bool LuaMsgpackPack(lua_State* L, int index, int msgpackIndex);
+
+// unpacks a single value and pushes it; on failure, pushes an error message instead
+SCRIPTING_LUA_EXPORT bool LuaMsgpackUnpack(lua_State* L, const char* data, size_t length, int msgpackIndex);
+
+// replaces `pack` and `unpack` in the global msgpack table (created if missing) with the native versions
+SCRIPTING_LUA_EXPORT void LuaMsgpackInstall(lua_State* L);
+}
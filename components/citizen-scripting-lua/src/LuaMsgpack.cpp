@@ -0,0 +1,638 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include <LuaMsgpack.h>
+
+#include <ScriptMsgpack.h>
+
+#include <msgpack.hpp>
+
+// Lua is built as C, so a Lua error would longjmp over the C++ state in here: everything that can fail (including the
+// script hooks, which get called through lua_pcall) reports errors by return value instead, and only the Lua-facing
+// functions raise them once that state is gone.
+
+namespace fx
+{
+// gets a hook function from the msgpack table without tripping the erroring __index MessagePack.lua sets on `packers`
+static bool GetMsgpackHook(lua_State* L, int msgpackIndex, const char* tableName, const char* name)
+{
+	if (msgpackIndex == 0 || !lua_istable(L, msgpackIndex))
+	{
+		return false;
+	}
+
+	int top = lua_gettop(L);
+
+	lua_pushvalue(L, msgpackIndex);
+
+	if (tableName)
+	{
+		lua_pushstring(L, tableName);
+		lua_rawget(L, -2);
+
+		if (!lua_istable(L, -1))
+		{
+			lua_settop(L, top);
+			return false;
+		}
+	}
+
+	lua_pushstring(L, name);
+	lua_rawget(L, -2);
+
+	if (!lua_isfunction(L, -1))
+	{
+		lua_settop(L, top);
+		return false;
+	}
+
+	// leave only the function on the stack
+	lua_replace(L, top + 1);
+	lua_settop(L, top + 1);
+
+	return true;
+}
+
+class LuaMsgpackPacker
+{
+private:
+	lua_State* L;
+
+	int m_msgpackIndex;
+
+	msgpack::sbuffer m_buffer;
+
+	msgpack::packer<msgpack::sbuffer> m_packer;
+
+	std::string m_error;
+
+public:
+	inline LuaMsgpackPacker(lua_State* L, int msgpackIndex)
+		: L(L), m_msgpackIndex(msgpackIndex), m_packer(m_buffer)
+	{
+
+	}
+
+	// packs the value at the absolute stack index `index`
+	bool Pack(int index, int depth);
+
+	inline const msgpack::sbuffer& GetBuffer()
+	{
+		return m_buffer;
+	}
+
+	inline const std::string& GetError()
+	{
+		return m_error;
+	}
+
+private:
+	bool PackTable(int index, int depth);
+
+	bool PackVector(int index, int type);
+
+	bool PackWithHook(int index);
+
+	inline bool Fail(const std::string& error)
+	{
+		m_error = error;
+		return false;
+	}
+};
+
+bool LuaMsgpackPacker::Pack(int index, int depth)
+{
+	if (depth > kMsgpackMaxDepth)
+	{
+		return Fail("pack: table nesting too deep (is it cyclic?)");
+	}
+
+	if (!lua_checkstack(L, 8))
+	{
+		return Fail("pack: out of stack space");
+	}
+
+	int type = lua_type(L, index);
+
+	switch (type)
+	{
+		case LUA_TNIL:
+			m_packer.pack_nil();
+			return true;
+
+		case LUA_TBOOLEAN:
+			if (lua_toboolean(L, index))
+			{
+				m_packer.pack_true();
+			}
+			else
+			{
+				m_packer.pack_false();
+			}
+
+			return true;
+
+		case LUA_TNUMBER:
+			if (lua_isinteger(L, index))
+			{
+				m_packer.pack_int64(lua_tointeger(L, index));
+			}
+			else
+			{
+				m_packer.pack_double(lua_tonumber(L, index));
+			}
+
+			return true;
+
+		case LUA_TSTRING:
+		{
+			size_t length;
+			const char* string = lua_tolstring(L, index, &length);
+
+			m_packer.pack_str(static_cast<uint32_t>(length));
+			m_packer.pack_str_body(string, static_cast<uint32_t>(length));
+
+			return true;
+		}
+
+		case LUA_TVECTOR2:
+		case LUA_TVECTOR3:
+		case LUA_TVECTOR4:
+		case LUA_TQUAT:
+			return PackVector(index, type);
+
+		case LUA_TTABLE:
+			// tables with a metatable may well be something else entirely (e.g. a function reference)
+			if (lua_getmetatable(L, index))
+			{
+				lua_pop(L, 1);
+
+				return PackWithHook(index);
+			}
+
+			return PackTable(index, depth);
+
+		default:
+			return PackWithHook(index);
+	}
+}
+
+bool LuaMsgpackPacker::PackTable(int index, int depth)
+{
+	// same rule as MessagePack.lua: keys 1..n without holes make an array, anything else a map
+	lua_Integer maxKey = 0;
+	uint32_t count = 0;
+	bool isMap = false;
+
+	lua_pushnil(L);
+
+	while (lua_next(L, index))
+	{
+		if (lua_isinteger(L, -2) && lua_tointeger(L, -2) > 0)
+		{
+			lua_Integer key = lua_tointeger(L, -2);
+
+			if (key > maxKey)
+			{
+				maxKey = key;
+			}
+		}
+		else
+		{
+			isMap = true;
+		}
+
+		count++;
+
+		lua_pop(L, 1);
+	}
+
+	if (maxKey != count)
+	{
+		isMap = true;
+	}
+
+	if (!isMap)
+	{
+		m_packer.pack_array(count);
+
+		for (uint32_t i = 1; i <= count; i++)
+		{
+			lua_rawgeti(L, index, i);
+
+			bool success = Pack(lua_gettop(L), depth + 1);
+			lua_pop(L, 1);
+
+			if (!success)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	m_packer.pack_map(count);
+
+	lua_pushnil(L);
+
+	while (lua_next(L, index))
+	{
+		int top = lua_gettop(L);
+
+		if (!Pack(top - 1, depth + 1) || !Pack(top, depth + 1))
+		{
+			lua_pop(L, 2);
+			return false;
+		}
+
+		lua_pop(L, 1);
+	}
+
+	return true;
+}
+
+bool LuaMsgpackPacker::PackVector(int index, int type)
+{
+	float values[4];
+	MsgpackExtType extType;
+
+	switch (type)
+	{
+		case LUA_TVECTOR2:
+			lua_checkvector2(L, index, &values[0], &values[1]);
+			extType = MsgpackExtType::Vector2;
+			break;
+
+		case LUA_TVECTOR3:
+			lua_checkvector3(L, index, &values[0], &values[1], &values[2]);
+			extType = MsgpackExtType::Vector3;
+			break;
+
+		case LUA_TVECTOR4:
+			lua_checkvector4(L, index, &values[0], &values[1], &values[2], &values[3]);
+			extType = MsgpackExtType::Vector4;
+			break;
+
+		default:
+			lua_checkquat(L, index, &values[3], &values[0], &values[1], &values[2]);
+			extType = MsgpackExtType::Quaternion;
+			break;
+	}
+
+	uint32_t size = GetMsgpackVectorComponents(static_cast<int8_t>(extType)) * sizeof(float);
+
+	m_packer.pack_ext(size, static_cast<int8_t>(extType));
+	m_packer.pack_ext_body(reinterpret_cast<const char*>(values), size);
+
+	return true;
+}
+
+bool LuaMsgpackPacker::PackWithHook(int index)
+{
+	const char* typeName = luaL_typename(L, index);
+
+	if (!GetMsgpackHook(L, m_msgpackIndex, "packers", typeName))
+	{
+		return Fail(std::string("pack '") + typeName + "' is unimplemented");
+	}
+
+	// MessagePack.lua packers append string chunks to a buffer table
+	lua_newtable(L);
+	lua_pushvalue(L, -2);
+	lua_pushvalue(L, -2);
+	lua_pushvalue(L, index);
+
+	if (lua_pcall(L, 2, 0, 0) != 0)
+	{
+		const char* error = lua_tostring(L, -1);
+		m_error = (error) ? error : "pack: error in packer";
+
+		lua_pop(L, 3);
+		return false;
+	}
+
+	size_t chunks = lua_rawlen(L, -1);
+
+	for (size_t i = 1; i <= chunks; i++)
+	{
+		lua_rawgeti(L, -1, i);
+
+		size_t length;
+		const char* chunk = lua_tolstring(L, -1, &length);
+
+		if (chunk)
+		{
+			m_buffer.write(chunk, length);
+		}
+
+		lua_pop(L, 1);
+	}
+
+	lua_pop(L, 2);
+
+	return true;
+}
+
+class LuaMsgpackUnpacker
+{
+private:
+	lua_State* L;
+
+	int m_msgpackIndex;
+
+	std::string m_error;
+
+public:
+	inline LuaMsgpackUnpacker(lua_State* L, int msgpackIndex)
+		: L(L), m_msgpackIndex(msgpackIndex)
+	{
+
+	}
+
+	// pushes the value of `object`; leaves the stack untouched on failure
+	bool Push(const msgpack::object& object, int depth);
+
+	inline const std::string& GetError()
+	{
+		return m_error;
+	}
+
+private:
+	bool PushExt(const msgpack::object_ext& ext);
+
+	inline bool Fail(const std::string& error)
+	{
+		m_error = error;
+		return false;
+	}
+};
+
+bool LuaMsgpackUnpacker::Push(const msgpack::object& object, int depth)
+{
+	if (depth > kMsgpackMaxDepth)
+	{
+		return Fail("unpack: nesting too deep");
+	}
+
+	if (!lua_checkstack(L, 8))
+	{
+		return Fail("unpack: out of stack space");
+	}
+
+	switch (object.type)
+	{
+		case msgpack::type::NIL:
+			lua_pushnil(L);
+			return true;
+
+		case msgpack::type::BOOLEAN:
+			lua_pushboolean(L, object.via.boolean);
+			return true;
+
+		case msgpack::type::POSITIVE_INTEGER:
+			lua_pushinteger(L, static_cast<lua_Integer>(object.via.u64));
+			return true;
+
+		case msgpack::type::NEGATIVE_INTEGER:
+			lua_pushinteger(L, static_cast<lua_Integer>(object.via.i64));
+			return true;
+
+		case msgpack::type::FLOAT:
+			lua_pushnumber(L, object.via.f64);
+			return true;
+
+		case msgpack::type::STR:
+			lua_pushlstring(L, object.via.str.ptr, object.via.str.size);
+			return true;
+
+		case msgpack::type::BIN:
+			lua_pushlstring(L, object.via.bin.ptr, object.via.bin.size);
+			return true;
+
+		case msgpack::type::ARRAY:
+		{
+			const msgpack::object_array& array = object.via.array;
+
+			lua_createtable(L, array.size, 0);
+
+			for (uint32_t i = 0; i < array.size; i++)
+			{
+				if (!Push(array.ptr[i], depth + 1))
+				{
+					lua_pop(L, 1);
+					return false;
+				}
+
+				lua_rawseti(L, -2, i + 1);
+			}
+
+			return true;
+		}
+
+		case msgpack::type::MAP:
+		{
+			const msgpack::object_map& map = object.via.map;
+
+			lua_createtable(L, 0, map.size);
+
+			for (uint32_t i = 0; i < map.size; i++)
+			{
+				if (!Push(map.ptr[i].key, depth + 1))
+				{
+					lua_pop(L, 1);
+					return false;
+				}
+
+				// lua_rawset would raise an error for these
+				if (lua_isnil(L, -1) || (lua_type(L, -1) == LUA_TNUMBER && lua_tonumber(L, -1) != lua_tonumber(L, -1)))
+				{
+					lua_pop(L, 2);
+					return Fail("unpack: table index is nil or NaN");
+				}
+
+				if (!Push(map.ptr[i].val, depth + 1))
+				{
+					lua_pop(L, 2);
+					return false;
+				}
+
+				lua_rawset(L, -3);
+			}
+
+			return true;
+		}
+
+		case msgpack::type::EXT:
+			return PushExt(object.via.ext);
+
+		default:
+			return Fail("unpack: unsupported type");
+	}
+}
+
+bool LuaMsgpackUnpacker::PushExt(const msgpack::object_ext& ext)
+{
+	int components = GetMsgpackVectorComponents(ext.type());
+
+	if (components > 0 && ext.size == components * sizeof(float))
+	{
+		float values[4];
+		memcpy(values, ext.data(), ext.size);
+
+		switch (static_cast<MsgpackExtType>(ext.type()))
+		{
+			case MsgpackExtType::Vector2:
+				lua_pushvector2(L, values[0], values[1]);
+				break;
+
+			case MsgpackExtType::Vector3:
+				lua_pushvector3(L, values[0], values[1], values[2]);
+				break;
+
+			case MsgpackExtType::Vector4:
+				lua_pushvector4(L, values[0], values[1], values[2], values[3]);
+				break;
+
+			default:
+				lua_pushquat(L, values[3], values[0], values[1], values[2]);
+				break;
+		}
+
+		return true;
+	}
+
+	if (!GetMsgpackHook(L, m_msgpackIndex, nullptr, "build_ext"))
+	{
+		lua_pushnil(L);
+		return true;
+	}
+
+	lua_pushinteger(L, ext.type());
+	lua_pushlstring(L, ext.data(), ext.size);
+
+	if (lua_pcall(L, 2, 1, 0) != 0)
+	{
+		const char* error = lua_tostring(L, -1);
+		m_error = (error) ? error : "unpack: error in build_ext";
+
+		lua_pop(L, 1);
+		return false;
+	}
+
+	return true;
+}
+
+bool LuaMsgpackPack(lua_State* L, int index, int msgpackIndex)
+{
+	index = lua_absindex(L, index);
+
+	if (msgpackIndex != 0)
+	{
+		msgpackIndex = lua_absindex(L, msgpackIndex);
+	}
+
+	LuaMsgpackPacker packer(L, msgpackIndex);
+
+	if (!packer.Pack(index, 0))
+	{
+		lua_pushstring(L, packer.GetError().c_str());
+		return false;
+	}
+
+	lua_pushlstring(L, packer.GetBuffer().data(), packer.GetBuffer().size());
+	return true;
+}
+
+bool LuaMsgpackUnpack(lua_State* L, const char* data, size_t length, int msgpackIndex)
+{
+	if (msgpackIndex != 0)
+	{
+		msgpackIndex = lua_absindex(L, msgpackIndex);
+	}
+
+	msgpack::unpacked unpacked;
+	size_t offset = 0;
+
+	try
+	{
+		msgpack::unpack(unpacked, data, length, offset);
+	}
+	catch (std::exception& e)
+	{
+		lua_pushfstring(L, "unpack: %s", e.what());
+		return false;
+	}
+
+	if (offset != length)
+	{
+		lua_pushstring(L, "extra bytes");
+		return false;
+	}
+
+	LuaMsgpackUnpacker unpacker(L, msgpackIndex);
+
+	if (!unpacker.Push(unpacked.get(), 0))
+	{
+		lua_pushstring(L, unpacker.GetError().c_str());
+		return false;
+	}
+
+	return true;
+}
+
+static int Lua_MsgpackPack(lua_State* L)
+{
+	luaL_checkany(L, 1);
+
+	if (!LuaMsgpackPack(L, 1, lua_upvalueindex(1)))
+	{
+		return lua_error(L);
+	}
+
+	return 1;
+}
+
+static int Lua_MsgpackUnpack(lua_State* L)
+{
+	size_t length;
+	const char* data = luaL_checklstring(L, 1, &length);
+
+	if (!LuaMsgpackUnpack(L, data, length, lua_upvalueindex(1)))
+	{
+		return lua_error(L);
+	}
+
+	return 1;
+}
+
+void LuaMsgpackInstall(lua_State* L)
+{
+	lua_getglobal(L, "msgpack");
+
+	if (!lua_istable(L, -1))
+	{
+		lua_pop(L, 1);
+
+		lua_newtable(L);
+		lua_pushvalue(L, -1);
+		lua_setglobal(L, "msgpack");
+	}
+
+	// both functions get the msgpack table as upvalue, to find the hooks in
+	lua_pushvalue(L, -1);
+	lua_pushcclosure(L, Lua_MsgpackPack, 1);
+	lua_setfield(L, -2, "pack");
+
+	lua_pushvalue(L, -1);
+	lua_pushcclosure(L, Lua_MsgpackUnpack, 1);
+	lua_setfield(L, -2, "unpack");
+
+	lua_pop(L, 1);
+}
+}
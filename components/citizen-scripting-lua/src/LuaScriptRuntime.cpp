@@ -10,6 +10,8 @@
 
 #include <lua.hpp>
 
+#include <LuaMsgpack.h>
+
 #include <om/OMComponent.h>
 
 namespace fx
@@ -99,6 +101,9 @@ private:
 
 	int m_instanceId;
 
+	// native handles resolved through the script host
+	std::unordered_map<uint64_t, void*> m_nativeHandles;
+
 public:
 	inline LuaScriptRuntime()
 	{
@@ -138,6 +143,8 @@ public:
 		return m_pointerFields;
 	}
 
+	void* GetNativeHandle(uint64_t nativeIdentifier);
+
 private:
 	result_t LoadFileInternal(OMPtr<fxIStream> stream, char* scriptFile);
 
@@ -166,6 +173,26 @@ LuaScriptRuntime::~LuaScriptRuntime()
 	
 }
 
+void* LuaScriptRuntime::GetNativeHandle(uint64_t nativeIdentifier)
+{
+	auto it = m_nativeHandles.find(nativeIdentifier);
+
+	if (it != m_nativeHandles.end())
+	{
+		return it->second;
+	}
+
+	// failed lookups aren't cached, as the native may still show up later
+	void* handle = nullptr;
+
+	if (FX_SUCCEEDED(m_scriptHost->GetNativeHandle(nativeIdentifier, &handle)))
+	{
+		m_nativeHandles.insert({ nativeIdentifier, handle });
+	}
+
+	return handle;
+}
+
 static int lua_error_handler(lua_State* L);
 
 OMPtr<LuaScriptRuntime> LuaScriptRuntime::GetCurrent()
@@ -510,7 +537,7 @@ enum class LuaMetaFields
 
 static uint8_t g_metaFields[(int)LuaMetaFields::Max];
 
-int Lua_InvokeNative(lua_State* L)
+static int Lua_InvokeNativeInternal(lua_State* L, uint64_t hash, void* nativeHandle, int firstArgument)
 {
 	// get required entries
 	OMPtr<LuaScriptRuntime> luaRuntime = LuaScriptRuntime::GetCurrent();
@@ -535,9 +562,6 @@ int Lua_InvokeNative(lua_State* L)
 	// get argument count for the loop
 	int numArgs = lua_gettop(L);
 
-	// get the hash
-	uint64_t hash = lua_tointeger(L, 1);
-
 	context.nativeIdentifier = hash;
 
 	// pushing function
@@ -549,7 +573,7 @@ int Lua_InvokeNative(lua_State* L)
 	};
 
 	// the big argument loop
-	for (int i = 2; i <= numArgs; i++)
+	for (int i = firstArgument; i <= numArgs; i++)
 	{
 		// get the type and decide what to do based on it
 		int type = lua_type(L, i);
@@ -718,7 +742,14 @@ int Lua_InvokeNative(lua_State* L)
 	}
 
 	// invoke the native on the script host
-	if (!FX_SUCCEEDED(scriptHost->InvokeNative(context)))
+	if (!nativeHandle)
+	{
+		nativeHandle = luaRuntime->GetNativeHandle(hash);
+	}
+
+	result_t hr = (nativeHandle) ? scriptHost->InvokeNativeHandle(nativeHandle, context) : scriptHost->InvokeNative(context);
+
+	if (!FX_SUCCEEDED(hr))
 	{
 		lua_pushstring(L, va("Execution of native %016x in script host failed.", hash));
 		lua_error(L);
@@ -837,6 +868,32 @@ int Lua_InvokeNative(lua_State* L)
 	return numResults;
 }
 
+int Lua_InvokeNative(lua_State* L)
+{
+	return Lua_InvokeNativeInternal(L, lua_tointeger(L, 1), nullptr, 2);
+}
+
+static int Lua_InvokeResolvedNative(lua_State* L)
+{
+	uint64_t hash = lua_tointeger(L, lua_upvalueindex(1));
+	void* nativeHandle = lua_touserdata(L, lua_upvalueindex(2));
+
+	return Lua_InvokeNativeInternal(L, hash, nativeHandle, 1);
+}
+
+// returns a function invoking a native directly, so per-call dispatch doesn't need to look up the hash again
+static int Lua_GetNative(lua_State* L)
+{
+	uint64_t hash = luaL_checkinteger(L, 1);
+	void* nativeHandle = LuaScriptRuntime::GetCurrent()->GetNativeHandle(hash);
+
+	lua_pushinteger(L, hash);
+	lua_pushlightuserdata(L, nativeHandle);
+	lua_pushcclosure(L, Lua_InvokeResolvedNative, 2);
+
+	return 1;
+}
+
 template<LuaMetaFields metaField>
 int Lua_GetMetaField(lua_State* L)
 {
@@ -890,6 +947,7 @@ static const struct luaL_Reg g_citizenLib[] =
 	{ "SetEventRoutine", Lua_SetEventRoutine },
 	{ "Trace", Lua_Trace },
 	{ "InvokeNative", Lua_InvokeNative },
+	{ "GetNative", Lua_GetNative },
 	// ref things
 	{ "SetCallRefRoutine", Lua_SetCallRefRoutine },
 	{ "SetDeleteRefRoutine", Lua_SetDeleteRefRoutine },
@@ -939,6 +997,9 @@ result_t LuaScriptRuntime::Create(IScriptHost *scriptHost)
 		return hr;
 	}
 
+	// replace the script pack/unpack with the native codec, before the scheduler gets to use them
+	LuaMsgpackInstall(m_state);
+
 	if (FX_FAILED(hr = LoadSystemFile("citizen:/scripting/lua/scheduler.lua")))
 	{
 		return hr;
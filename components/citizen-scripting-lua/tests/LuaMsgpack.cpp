@@ -0,0 +1,310 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <LuaMsgpack.h>
+
+#include <chrono>
+
+// deep comparison, as round-tripped tables are never the same table
+static const char* g_luaHelpers = R"(
+	function deepEqual(a, b)
+		if type(a) ~= type(b) then
+			return false
+		end
+
+		if type(a) ~= 'table' then
+			return a == b
+		end
+
+		for k, v in pairs(a) do
+			if not deepEqual(v, b[k]) then
+				return false
+			end
+		end
+
+		for k in pairs(b) do
+			if a[k] == nil then
+				return false
+			end
+		end
+
+		return true
+	end
+
+	function toHex(s)
+		return (s:gsub('.', function(c) return string.format('%02x', c:byte()) end))
+	end
+)";
+
+class LuaMsgpackTest : public ::testing::Test
+{
+protected:
+	lua_State* L;
+
+	virtual void SetUp() override
+	{
+		L = luaL_newstate();
+		luaL_openlibs(L);
+
+		fx::LuaMsgpackInstall(L);
+
+		ASSERT_EQ("", Run(g_luaHelpers));
+	}
+
+	virtual void TearDown() override
+	{
+		lua_close(L);
+	}
+
+	// runs a chunk, returning the error message if it fails
+	std::string Run(const char* code)
+	{
+		if (luaL_dostring(L, code) != 0)
+		{
+			std::string error = lua_tostring(L, -1);
+			lua_pop(L, 1);
+
+			return error;
+		}
+
+		return "";
+	}
+};
+
+TEST_F(LuaMsgpackTest, RoundTripsValues)
+{
+	EXPECT_EQ("", Run(R"(
+		local values = {
+			0, 1, -1, 127, 128, 255, 65536, -33, -2147483649, math.maxinteger, math.mininteger,
+			1.5, -0.25, 1e300,
+			true, false,
+			'', 'hello', string.rep('x', 300), 'binary\0data\255',
+			{}, { 1, 2, 3 }, { a = 1, b = { c = 'd' } }, { 1, 2, nil, 4 }, { [-1] = 'negative', [0] = 'zero' },
+			{ playerId = 12, coords = vector3(1.5, -2, 300.25), list = { 'a', 'b', { nested = true } } },
+			vector2(1, 2), vector3(1, 2, 3), vector4(1, 2, 3, 4), quat(1, 0, 0, 0)
+		}
+
+		for i = 1, #values do
+			local value = values[i]
+			local result = msgpack.unpack(msgpack.pack(value))
+
+			assert(deepEqual(value, result), 'value ' .. i .. ' (' .. tostring(value) .. ') did not round-trip')
+			assert(math.type(value) == math.type(result), 'value ' .. i .. ' changed number subtype')
+		end
+
+		assert(msgpack.unpack(msgpack.pack(nil)) == nil)
+	)"));
+}
+
+TEST_F(LuaMsgpackTest, EncodesLikeMessagePackLua)
+{
+	EXPECT_EQ("", Run(R"(
+		local cases = {
+			{ 1, '01' },
+			{ -1, 'ff' },
+			{ 200, 'ccc8' },
+			{ -200, 'd1ff38' },
+			{ 1.5, 'cb3ff8000000000000' },
+			{ 'abc', 'a3616263' },
+			{ { 1, 2, 3 }, '93010203' },
+			{ {}, '90' },
+			{ { a = 1 }, '81a16101' },
+			{ { [2] = true }, '8102c3' },
+			{ vector3(1, 2, 3), 'c70c15' .. '0000803f' .. '00000040' .. '00004040' },
+		}
+
+		for i, case in ipairs(cases) do
+			local packed = toHex(msgpack.pack(case[1]))
+
+			assert(packed == case[2], 'case ' .. i .. ' packed as ' .. packed)
+		end
+	)"));
+}
+
+TEST_F(LuaMsgpackTest, UsesScriptHooks)
+{
+	// this is about what scheduler.lua does for function references
+	EXPECT_EQ("", Run(R"(
+		msgpack.packers = setmetatable({}, { __index = function(t, k) error("pack '" .. k .. "' is unimplemented") end })
+
+		msgpack.packers['function'] = function(buffer, fn)
+			local ref = 'ref:' .. tostring(fn():len())
+			buffer[#buffer + 1] = string.char(0xC7, #ref, 10)
+			buffer[#buffer + 1] = ref
+		end
+
+		msgpack.build_ext = function(tag, data)
+			return { tag = tag, data = data }
+		end
+
+		local result = msgpack.unpack(msgpack.pack({ 'x', function() return 'abcd' end }))
+
+		assert(result[1] == 'x')
+		assert(result[2].tag == 10)
+		assert(result[2].data == 'ref:4')
+	)"));
+}
+
+TEST_F(LuaMsgpackTest, RaisesErrors)
+{
+	EXPECT_NE("", Run("msgpack.pack(coroutine.create(function() end))"));
+	EXPECT_NE("", Run("local t = {} t.t = t msgpack.pack(t)"));
+	EXPECT_NE("", Run("msgpack.unpack('')"));
+	EXPECT_NE("", Run("msgpack.unpack(msgpack.pack(1) .. msgpack.pack(2))"));
+	EXPECT_NE("", Run("msgpack.packers = { ['function'] = function() error('nope') end } msgpack.pack({ print })"));
+
+	// and the state is still fine afterwards
+	EXPECT_EQ("", Run("assert(msgpack.unpack(msgpack.pack({ 1, 2 }))[2] == 2)"));
+	EXPECT_EQ(0, lua_gettop(L));
+}
+
+struct AllocationCounter
+{
+	size_t allocations;
+
+	size_t bytes;
+};
+
+static void* CountingAlloc(void* userData, void* ptr, size_t oldSize, size_t newSize)
+{
+	auto counter = reinterpret_cast<AllocationCounter*>(userData);
+
+	if (newSize == 0)
+	{
+		free(ptr);
+		return nullptr;
+	}
+
+	if (!ptr || newSize > oldSize)
+	{
+		counter->allocations++;
+		counter->bytes += newSize;
+	}
+
+	return realloc(ptr, newSize);
+}
+
+// a few payloads shaped like net events and export calls
+static const char* g_benchmarkPayloads = R"(
+	payloads = {
+		small = { 12, 'chatMessage', { 255, 0, 0 } },
+		event = { 5, { coords = vector3(120.5, -880.25, 30.0), heading = 91.5, model = 'adder', plate = 'CFX 123', mods = { 1, 4, 0, 2, 0, 0, 3 } }, true },
+		large = {},
+	}
+
+	for i = 1, 64 do
+		payloads.large[i] = { id = i, name = 'player' .. i, position = vector3(i, i * 2, i * 3), health = 200 - i, alive = (i % 3) ~= 0 }
+	end
+
+	function runBenchmark(codec, payload, count)
+		local pack, unpack = codec.pack, codec.unpack
+		local size = 0
+
+		for i = 1, count do
+			size = size + #pack(unpack(pack(payload)))
+		end
+
+		return size
+	end
+)";
+
+TEST(LuaMsgpack, DISABLED_BenchmarkAgainstMessagePackLua)
+{
+	AllocationCounter counter = { 0 };
+
+	lua_State* L = lua_newstate(CountingAlloc, &counter);
+	luaL_openlibs(L);
+
+	ASSERT_EQ(0, luaL_dostring(L, g_benchmarkPayloads));
+
+	// the native codec, in its own table
+	lua_newtable(L);
+	lua_setglobal(L, "msgpack");
+	fx::LuaMsgpackInstall(L);
+
+	lua_getglobal(L, "msgpack");
+	lua_setglobal(L, "native");
+
+	// the script codec, if it can be found - it's part of the client data files, not of this tree
+	const char* scriptPath = getenv("CFX_MESSAGEPACK_LUA");
+
+	if (!scriptPath)
+	{
+		scriptPath = "citizen/scripting/lua/MessagePack.lua";
+	}
+
+	bool haveScript = false;
+
+	lua_pushnil(L);
+	lua_setglobal(L, "msgpack");
+
+	int top = lua_gettop(L);
+
+	if (luaL_dofile(L, scriptPath) == 0)
+	{
+		// the module may either be returned or set as global
+		if (lua_gettop(L) == top || !lua_istable(L, top + 1))
+		{
+			lua_settop(L, top);
+			lua_getglobal(L, "msgpack");
+		}
+
+		lua_settop(L, top + 1);
+
+		haveScript = lua_istable(L, -1);
+		lua_setglobal(L, "script");
+	}
+	else
+	{
+		printf("%s not found, benchmarking the native codec only\n", scriptPath);
+		lua_pop(L, 1);
+	}
+
+	const int count = 20000;
+
+	auto measure = [&] (const char* codec, const char* payload)
+	{
+		lua_getglobal(L, "runBenchmark");
+		lua_getglobal(L, codec);
+		lua_getglobal(L, "payloads");
+		lua_getfield(L, -1, payload);
+		lua_replace(L, -2);
+		lua_pushinteger(L, count);
+
+		AllocationCounter before = counter;
+		auto start = std::chrono::high_resolution_clock::now();
+
+		if (lua_pcall(L, 3, 1, 0) != 0)
+		{
+			// older MessagePack.lua versions don't know about vectors
+			EXPECT_STRNE("native", codec) << lua_tostring(L, -1);
+			printf("%-6s %-6s failed: %s\n", codec, payload, lua_tostring(L, -1));
+
+			lua_pop(L, 1);
+			return;
+		}
+
+		auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+		// every iteration is two packs and an unpack
+		printf("%-6s %-6s %9.0f ops/sec, %6.1f Lua allocations (%7.0f bytes)/op, %4lld bytes\n", codec, payload,
+			(count * 3) / (time / 1e9),
+			(counter.allocations - before.allocations) / (count * 3.0),
+			(counter.bytes - before.bytes) / (count * 3.0),
+			lua_tointeger(L, -1) / count);
+
+		lua_pop(L, 1);
+	};
+
+	for (const char* payload : { "small", "event", "large" })
+	{
+		measure("native", payload);
+
+		if (haveScript)
+		{
+			measure("script", payload);
+		}
+	}
+
+	lua_close(L);
+}
@@ -0,0 +1,41 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <include/v8.h>
+
+#ifdef COMPILING_CITIZEN_SCRIPTING_V8
+#define SCRIPTING_V8_EXPORT DLL_EXPORT
+#else
+#define SCRIPTING_V8_EXPORT DLL_IMPORT
+#endif
+
+namespace fx
+{
+//
+// Native msgpack codec for V8 values, walking objects directly instead of going through the JS implementation.
+//
+// Arrays pack as arrays, other objects as maps of their own property names, typed arrays and ArrayBuffers as bin.
+// Functions pack as function reference extensions through a script-provided function returning the reference string,
+// vector extensions unpack to arrays of numbers (the same vectors natives return) and any other extension goes to a
+// script-provided function as (type, Uint8Array).
+//
+struct V8MsgpackHooks
+{
+	v8::Local<v8::Function> packFunction;
+
+	v8::Local<v8::Function> unpackExt;
+};
+
+// packs `value` into a Uint8Array; returns an empty handle with an exception scheduled on failure
+SCRIPTING_V8_EXPORT v8::Local<v8::Value> V8MsgpackPack(v8::Isolate* isolate, v8::Local<v8::Value> value, const V8MsgpackHooks& hooks);
+
+// unpacks a single value from a Uint8Array (or any other ArrayBuffer view, or ArrayBuffer)
+// returns an empty handle with an exception scheduled on failure
+SCRIPTING_V8_EXPORT v8::Local<v8::Value> V8MsgpackUnpack(v8::Isolate* isolate, v8::Local<v8::Value> data, const V8MsgpackHooks& hooks);
+}
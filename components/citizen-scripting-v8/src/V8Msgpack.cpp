@@ -0,0 +1,439 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include <V8Msgpack.h>
+
+#include <ScriptMsgpack.h>
+
+#include <msgpack.hpp>
+
+using namespace v8;
+
+namespace fx
+{
+static bool ThrowError(Isolate* isolate, const char* error)
+{
+	isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, error)));
+	return false;
+}
+
+static Local<Uint8Array> MakeUint8Array(Isolate* isolate, const char* data, size_t length)
+{
+	Local<ArrayBuffer> buffer = ArrayBuffer::New(isolate, length);
+	memcpy(buffer->GetContents().Data(), data, length);
+
+	return Uint8Array::New(buffer, 0, length);
+}
+
+class V8MsgpackPacker
+{
+private:
+	Isolate* m_isolate;
+
+	const V8MsgpackHooks& m_hooks;
+
+	msgpack::sbuffer m_buffer;
+
+	msgpack::packer<msgpack::sbuffer> m_packer;
+
+public:
+	inline V8MsgpackPacker(Isolate* isolate, const V8MsgpackHooks& hooks)
+		: m_isolate(isolate), m_hooks(hooks), m_packer(m_buffer)
+	{
+
+	}
+
+	bool Pack(Local<Value> value, int depth);
+
+	inline const msgpack::sbuffer& GetBuffer()
+	{
+		return m_buffer;
+	}
+
+private:
+	bool PackObject(Local<Object> object, int depth);
+
+	bool PackFunction(Local<Value> function);
+};
+
+bool V8MsgpackPacker::Pack(Local<Value> value, int depth)
+{
+	if (depth > kMsgpackMaxDepth)
+	{
+		return ThrowError(m_isolate, "msgpackPack: nesting too deep (is the value cyclic?)");
+	}
+
+	if (value->IsUndefined() || value->IsNull())
+	{
+		m_packer.pack_nil();
+	}
+	else if (value->IsBoolean())
+	{
+		if (value->BooleanValue())
+		{
+			m_packer.pack_true();
+		}
+		else
+		{
+			m_packer.pack_false();
+		}
+	}
+	else if (value->IsInt32())
+	{
+		m_packer.pack_int32(value->Int32Value());
+	}
+	else if (value->IsUint32())
+	{
+		m_packer.pack_uint32(value->Uint32Value());
+	}
+	else if (value->IsNumber())
+	{
+		double number = value->NumberValue();
+
+		// integral numbers beyond 32 bits still go out as integers, as long as they're exact
+		if (floor(number) == number && fabs(number) <= 9007199254740992.0)
+		{
+			m_packer.pack_int64(static_cast<int64_t>(number));
+		}
+		else
+		{
+			m_packer.pack_double(number);
+		}
+	}
+	else if (value->IsString())
+	{
+		String::Utf8Value string(value);
+
+		m_packer.pack_str(string.length());
+		m_packer.pack_str_body(*string, string.length());
+	}
+	else if (value->IsArrayBufferView())
+	{
+		Local<ArrayBufferView> view = Local<ArrayBufferView>::Cast(value);
+		const char* data = reinterpret_cast<const char*>(view->Buffer()->GetContents().Data()) + view->ByteOffset();
+
+		m_packer.pack_bin(view->ByteLength());
+		m_packer.pack_bin_body(data, view->ByteLength());
+	}
+	else if (value->IsArrayBuffer())
+	{
+		Local<ArrayBuffer> buffer = Local<ArrayBuffer>::Cast(value);
+		ArrayBuffer::Contents contents = buffer->GetContents();
+
+		m_packer.pack_bin(contents.ByteLength());
+		m_packer.pack_bin_body(reinterpret_cast<const char*>(contents.Data()), contents.ByteLength());
+	}
+	else if (value->IsArray())
+	{
+		Local<Array> array = Local<Array>::Cast(value);
+		uint32_t length = array->Length();
+
+		m_packer.pack_array(length);
+
+		for (uint32_t i = 0; i < length; i++)
+		{
+			Local<Value> entry = array->Get(i);
+
+			if (entry.IsEmpty() || !Pack(entry, depth + 1))
+			{
+				return false;
+			}
+		}
+	}
+	else if (value->IsFunction())
+	{
+		return PackFunction(value);
+	}
+	else if (value->IsObject())
+	{
+		return PackObject(Local<Object>::Cast(value), depth);
+	}
+	else
+	{
+		return ThrowError(m_isolate, "msgpackPack: unsupported value type");
+	}
+
+	return true;
+}
+
+bool V8MsgpackPacker::PackObject(Local<Object> object, int depth)
+{
+	Local<Array> names = object->GetOwnPropertyNames();
+
+	if (names.IsEmpty())
+	{
+		return false;
+	}
+
+	uint32_t length = names->Length();
+
+	m_packer.pack_map(length);
+
+	for (uint32_t i = 0; i < length; i++)
+	{
+		Local<Value> name = names->Get(i);
+
+		if (name.IsEmpty())
+		{
+			return false;
+		}
+
+		Local<Value> entry = object->Get(name);
+
+		// keys are always strings, even for integer-like property names
+		if (entry.IsEmpty() || !Pack(name->ToString(), depth + 1) || !Pack(entry, depth + 1))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool V8MsgpackPacker::PackFunction(Local<Value> function)
+{
+	if (m_hooks.packFunction.IsEmpty())
+	{
+		return ThrowError(m_isolate, "msgpackPack: can't pack functions without a reference function set");
+	}
+
+	Local<Value> arguments[] = { function };
+	Local<Value> reference = m_hooks.packFunction->Call(Null(m_isolate), 1, arguments);
+
+	// the exception is left pending for the caller
+	if (reference.IsEmpty())
+	{
+		return false;
+	}
+
+	String::Utf8Value referenceString(reference);
+
+	m_packer.pack_ext(referenceString.length(), static_cast<int8_t>(MsgpackExtType::FunctionReference));
+	m_packer.pack_ext_body(*referenceString, referenceString.length());
+
+	return true;
+}
+
+class V8MsgpackUnpacker
+{
+private:
+	Isolate* m_isolate;
+
+	const V8MsgpackHooks& m_hooks;
+
+public:
+	inline V8MsgpackUnpacker(Isolate* isolate, const V8MsgpackHooks& hooks)
+		: m_isolate(isolate), m_hooks(hooks)
+	{
+
+	}
+
+	// returns an empty handle with an exception scheduled on failure
+	Local<Value> Unpack(const msgpack::object& object, int depth);
+
+private:
+	Local<Value> UnpackExt(const msgpack::object_ext& ext);
+};
+
+Local<Value> V8MsgpackUnpacker::Unpack(const msgpack::object& object, int depth)
+{
+	if (depth > kMsgpackMaxDepth)
+	{
+		ThrowError(m_isolate, "msgpackUnpack: nesting too deep");
+		return Local<Value>();
+	}
+
+	switch (object.type)
+	{
+		case msgpack::type::NIL:
+			return Null(m_isolate);
+
+		case msgpack::type::BOOLEAN:
+			return Boolean::New(m_isolate, object.via.boolean);
+
+		case msgpack::type::POSITIVE_INTEGER:
+			if (object.via.u64 <= UINT32_MAX)
+			{
+				return Integer::NewFromUnsigned(m_isolate, static_cast<uint32_t>(object.via.u64));
+			}
+
+			return Number::New(m_isolate, static_cast<double>(object.via.u64));
+
+		case msgpack::type::NEGATIVE_INTEGER:
+			if (object.via.i64 >= INT32_MIN)
+			{
+				return Integer::New(m_isolate, static_cast<int32_t>(object.via.i64));
+			}
+
+			return Number::New(m_isolate, static_cast<double>(object.via.i64));
+
+		case msgpack::type::FLOAT:
+			return Number::New(m_isolate, object.via.f64);
+
+		case msgpack::type::STR:
+		{
+			Local<String> string;
+
+			if (!String::NewFromUtf8(m_isolate, object.via.str.ptr, NewStringType::kNormal, object.via.str.size).ToLocal(&string))
+			{
+				ThrowError(m_isolate, "msgpackUnpack: string too long");
+				return Local<Value>();
+			}
+
+			return string;
+		}
+
+		case msgpack::type::BIN:
+			return MakeUint8Array(m_isolate, object.via.bin.ptr, object.via.bin.size);
+
+		case msgpack::type::ARRAY:
+		{
+			const msgpack::object_array& list = object.via.array;
+			Local<Array> array = Array::New(m_isolate, list.size);
+
+			for (uint32_t i = 0; i < list.size; i++)
+			{
+				Local<Value> entry = Unpack(list.ptr[i], depth + 1);
+
+				if (entry.IsEmpty())
+				{
+					return entry;
+				}
+
+				array->Set(i, entry);
+			}
+
+			return array;
+		}
+
+		case msgpack::type::MAP:
+		{
+			const msgpack::object_map& map = object.via.map;
+			Local<Object> result = Object::New(m_isolate);
+
+			for (uint32_t i = 0; i < map.size; i++)
+			{
+				Local<Value> key = Unpack(map.ptr[i].key, depth + 1);
+
+				if (key.IsEmpty())
+				{
+					return key;
+				}
+
+				Local<Value> value = Unpack(map.ptr[i].val, depth + 1);
+
+				if (value.IsEmpty())
+				{
+					return value;
+				}
+
+				result->Set(key, value);
+			}
+
+			return result;
+		}
+
+		case msgpack::type::EXT:
+			return UnpackExt(object.via.ext);
+
+		default:
+			ThrowError(m_isolate, "msgpackUnpack: unsupported type");
+			return Local<Value>();
+	}
+}
+
+Local<Value> V8MsgpackUnpacker::UnpackExt(const msgpack::object_ext& ext)
+{
+	int components = GetMsgpackVectorComponents(ext.type());
+
+	if (components > 0 && ext.size == components * sizeof(float))
+	{
+		float values[4];
+		memcpy(values, ext.data(), ext.size);
+
+		Local<Array> vector = Array::New(m_isolate, components);
+
+		for (int i = 0; i < components; i++)
+		{
+			vector->Set(i, Number::New(m_isolate, values[i]));
+		}
+
+		return vector;
+	}
+
+	if (m_hooks.unpackExt.IsEmpty())
+	{
+		return Null(m_isolate);
+	}
+
+	Local<Value> arguments[] = { Integer::New(m_isolate, ext.type()), MakeUint8Array(m_isolate, ext.data(), ext.size) };
+
+	return m_hooks.unpackExt->Call(Null(m_isolate), _countof(arguments), arguments);
+}
+
+Local<Value> V8MsgpackPack(Isolate* isolate, Local<Value> value, const V8MsgpackHooks& hooks)
+{
+	V8MsgpackPacker packer(isolate, hooks);
+
+	if (!packer.Pack(value, 0))
+	{
+		return Local<Value>();
+	}
+
+	return MakeUint8Array(isolate, packer.GetBuffer().data(), packer.GetBuffer().size());
+}
+
+Local<Value> V8MsgpackUnpack(Isolate* isolate, Local<Value> data, const V8MsgpackHooks& hooks)
+{
+	const char* bytes;
+	size_t length;
+
+	if (data->IsArrayBufferView())
+	{
+		Local<ArrayBufferView> view = Local<ArrayBufferView>::Cast(data);
+
+		bytes = reinterpret_cast<const char*>(view->Buffer()->GetContents().Data()) + view->ByteOffset();
+		length = view->ByteLength();
+	}
+	else if (data->IsArrayBuffer())
+	{
+		ArrayBuffer::Contents contents = Local<ArrayBuffer>::Cast(data)->GetContents();
+
+		bytes = reinterpret_cast<const char*>(contents.Data());
+		length = contents.ByteLength();
+	}
+	else
+	{
+		isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "msgpackUnpack: expected a Uint8Array or ArrayBuffer")));
+		return Local<Value>();
+	}
+
+	msgpack::unpacked unpacked;
+	size_t offset = 0;
+
+	try
+	{
+		msgpack::unpack(unpacked, bytes, length, offset);
+	}
+	catch (std::exception& e)
+	{
+		ThrowError(isolate, va("msgpackUnpack: %s", e.what()));
+		return Local<Value>();
+	}
+
+	if (offset != length)
+	{
+		ThrowError(isolate, "msgpackUnpack: extra bytes");
+		return Local<Value>();
+	}
+
+	V8MsgpackUnpacker unpacker(isolate, hooks);
+
+	return unpacker.Unpack(unpacked.get(), 0);
+}
+}
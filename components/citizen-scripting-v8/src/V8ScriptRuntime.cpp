@@ -13,6 +13,7 @@
 
 #include <V8Platform.h>
 #include <V8Debugger.h>
+#include <V8Msgpack.h>
 
 #include <om/OMComponent.h>
 
@@ -47,6 +48,10 @@ private:
 
 	std::function<void()> m_tickRoutine;
 
+	UniquePersistent<Function> m_msgpackPackFunction;
+
+	UniquePersistent<Function> m_msgpackUnpackExt;
+
 	IScriptHost* m_scriptHost;
 
 	int m_instanceId;
@@ -60,6 +65,9 @@ private:
 
 	int m_curStringValue;
 
+	// native handles resolved through the script host
+	std::unordered_map<uint64_t, void*> m_nativeHandles;
+
 private:
 	result_t LoadFileInternal(OMPtr<fxIStream> stream, char* scriptFile, Local<Script>* outScript);
 
@@ -93,6 +101,21 @@ public:
 		return m_scriptHost;
 	}
 
+	inline void SetMsgpackHooks(Local<Function> packFunction, Local<Function> unpackExt)
+	{
+		m_msgpackPackFunction.Reset(GetV8Isolate(), packFunction);
+		m_msgpackUnpackExt.Reset(GetV8Isolate(), unpackExt);
+	}
+
+	inline V8MsgpackHooks GetMsgpackHooks()
+	{
+		V8MsgpackHooks hooks;
+		hooks.packFunction = m_msgpackPackFunction.Get(GetV8Isolate());
+		hooks.unpackExt = m_msgpackUnpackExt.Get(GetV8Isolate());
+
+		return hooks;
+	}
+
 	inline PointerField* GetPointerFields()
 	{
 		return m_pointerFields;
@@ -100,6 +123,8 @@ public:
 
 	const char* AssignStringValue(const Local<Value>& value);
 
+	void* GetNativeHandle(uint64_t nativeIdentifier);
+
 	NS_DECL_ISCRIPTRUNTIME;
 
 	NS_DECL_ISCRIPTFILEHANDLINGRUNTIME;
@@ -220,6 +245,26 @@ const char* V8ScriptRuntime::AssignStringValue(const Local<Value>& value)
 	return str;
 }
 
+void* V8ScriptRuntime::GetNativeHandle(uint64_t nativeIdentifier)
+{
+	auto it = m_nativeHandles.find(nativeIdentifier);
+
+	if (it != m_nativeHandles.end())
+	{
+		return it->second;
+	}
+
+	// failed lookups aren't cached, as the native may still show up later
+	void* handle = nullptr;
+
+	if (FX_SUCCEEDED(m_scriptHost->GetNativeHandle(nativeIdentifier, &handle)))
+	{
+		m_nativeHandles.insert({ nativeIdentifier, handle });
+	}
+
+	return handle;
+}
+
 static void V8_InvokeNative(const v8::FunctionCallbackInfo<v8::Value>& args)
 {
 	// get required entries
@@ -484,7 +529,10 @@ static void V8_InvokeNative(const v8::FunctionCallbackInfo<v8::Value>& args)
 	}
 
 	// invoke the native on the script host
-	if (!FX_SUCCEEDED(scriptHost->InvokeNative(context)))
+	void* nativeHandle = runtime->GetNativeHandle(hash);
+	result_t hr = (nativeHandle) ? scriptHost->InvokeNativeHandle(nativeHandle, context) : scriptHost->InvokeNative(context);
+
+	if (!FX_SUCCEEDED(hr))
 	{
 		return throwException(va("Execution of native %016x in script host failed.", hash));;
 	}
@@ -668,6 +716,41 @@ static void V8_GetPointerField(const v8::FunctionCallbackInfo<v8::Value>& args)
 	args.GetReturnValue().Set(External::New(GetV8Isolate(), (pointerField) ? static_cast<void*>(pointerField) : &dummyOut));
 }
 
+static void V8_SetMsgpackHooks(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+	V8ScriptRuntime* runtime = GetScriptRuntimeFromArgs(args);
+
+	Local<Function> packFunction = (args[0]->IsFunction()) ? Local<Function>::Cast(args[0]) : Local<Function>();
+	Local<Function> unpackExt = (args[1]->IsFunction()) ? Local<Function>::Cast(args[1]) : Local<Function>();
+
+	runtime->SetMsgpackHooks(packFunction, unpackExt);
+}
+
+static void V8_MsgpackPack(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+	V8ScriptRuntime* runtime = GetScriptRuntimeFromArgs(args);
+
+	Local<Value> result = V8MsgpackPack(args.GetIsolate(), args[0], runtime->GetMsgpackHooks());
+
+	// an empty result means an exception is pending already
+	if (!result.IsEmpty())
+	{
+		args.GetReturnValue().Set(result);
+	}
+}
+
+static void V8_MsgpackUnpack(const v8::FunctionCallbackInfo<v8::Value>& args)
+{
+	V8ScriptRuntime* runtime = GetScriptRuntimeFromArgs(args);
+
+	Local<Value> result = V8MsgpackUnpack(args.GetIsolate(), args[0], runtime->GetMsgpackHooks());
+
+	if (!result.IsEmpty())
+	{
+		args.GetReturnValue().Set(result);
+	}
+}
+
 std::string SaveProfileToString(CpuProfile* profile);
 
 static void V8_StartProfiling(const v8::FunctionCallbackInfo<v8::Value>& args)
@@ -705,6 +788,10 @@ static std::pair<std::string, FunctionCallback> g_citizenFunctions[] =
 	{ "invokeNative", V8_InvokeNative },
 	{ "startProfiling", V8_StartProfiling },
 	{ "stopProfiling", V8_StopProfiling },
+	// serialization
+	{ "setMsgpackHooks", V8_SetMsgpackHooks },
+	{ "msgpackPack", V8_MsgpackPack },
+	{ "msgpackUnpack", V8_MsgpackUnpack },
 	// metafields
 	{ "pointerValueIntInitialized", V8_GetPointerField<V8MetaFields::PointerValueInt> },
 	{ "pointerValueFloatInitialized", V8_GetPointerField<V8MetaFields::PointerValueFloat> },
@@ -788,6 +875,8 @@ result_t V8ScriptRuntime::Create(IScriptHost* scriptHost)
 result_t V8ScriptRuntime::Destroy()
 {
 	m_tickRoutine.swap(std::function<void()>());
+	m_msgpackPackFunction.Reset();
+	m_msgpackUnpackExt.Reset();
 	m_context.Reset();
 
 	return FX_S_OK;
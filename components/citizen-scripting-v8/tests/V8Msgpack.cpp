@@ -0,0 +1,510 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <V8Msgpack.h>
+
+#include <include/v8-platform.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+// just enough of a platform to run scripts on the test thread
+class TestPlatform : public v8::Platform
+{
+public:
+	virtual void CallOnBackgroundThread(v8::Task* task, ExpectedRuntime expectedRuntime) override
+	{
+		std::thread([task] ()
+		{
+			task->Run();
+			delete task;
+		}).detach();
+	}
+
+	// nothing here waits on foreground tasks, so they're simply dropped
+	virtual void CallOnForegroundThread(v8::Isolate* isolate, v8::Task* task) override
+	{
+		delete task;
+	}
+
+	virtual void CallDelayedOnForegroundThread(v8::Isolate* isolate, v8::Task* task, double delayInSeconds) override
+	{
+		delete task;
+	}
+
+	virtual double MonotonicallyIncreasingTime() override
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+};
+
+// counts ArrayBuffer allocations, which is what packing mostly allocates outside of the JS heap
+class CountingAllocator : public v8::ArrayBuffer::Allocator
+{
+public:
+	std::atomic<size_t> allocations;
+
+	std::atomic<size_t> bytes;
+
+	CountingAllocator()
+		: allocations(0), bytes(0)
+	{
+
+	}
+
+	virtual void* Allocate(size_t length) override
+	{
+		void* data = AllocateUninitialized(length);
+		return data == NULL ? data : memset(data, 0, length);
+	}
+
+	virtual void* AllocateUninitialized(size_t length) override
+	{
+		allocations++;
+		bytes += length;
+
+		return malloc(length);
+	}
+
+	virtual void Free(void* data, size_t) override
+	{
+		free(data);
+	}
+};
+
+static CountingAllocator g_allocator;
+
+static std::string ReadFile(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+
+	return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// V8 can only be initialized once per process, so every test shares the isolate
+static v8::Isolate* GetIsolate()
+{
+	static v8::Isolate* isolate = ([] () -> v8::Isolate*
+	{
+		// the startup blobs are part of the client data files, not of this tree
+		const char* dataPath = getenv("CFX_V8_DATA");
+		std::string directory = (dataPath) ? dataPath : "citizen/scripting/v8";
+
+		static std::string natives = ReadFile(directory + "/natives_blob.bin");
+		static std::string snapshot = ReadFile(directory + "/snapshot_blob.bin");
+
+		if (natives.empty() || snapshot.empty())
+		{
+			return nullptr;
+		}
+
+		static v8::StartupData nativesBlob;
+		nativesBlob.data = natives.data();
+		nativesBlob.raw_size = static_cast<int>(natives.size());
+
+		static v8::StartupData snapshotBlob;
+		snapshotBlob.data = snapshot.data();
+		snapshotBlob.raw_size = static_cast<int>(snapshot.size());
+
+		v8::V8::SetNativesDataBlob(&nativesBlob);
+		v8::V8::SetSnapshotDataBlob(&snapshotBlob);
+
+		static TestPlatform platform;
+		v8::V8::InitializePlatform(&platform);
+
+		v8::V8::Initialize();
+
+		v8::Isolate::CreateParams params;
+		params.array_buffer_allocator = &g_allocator;
+
+		return v8::Isolate::New(params);
+	})();
+
+	return isolate;
+}
+
+// deep comparison, as round-tripped objects are never the same object
+static const char* g_v8Helpers = R"(
+	function deepEqual(a, b) {
+		if (a instanceof Uint8Array || b instanceof Uint8Array) {
+			if (!(a instanceof Uint8Array) || !(b instanceof Uint8Array) || a.length !== b.length) {
+				return false;
+			}
+
+			for (var i = 0; i < a.length; i++) {
+				if (a[i] !== b[i]) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		if (typeof a !== 'object' || a === null || b === null) {
+			return a === b;
+		}
+
+		if (Array.isArray(a) !== Array.isArray(b) || Object.keys(a).length !== Object.keys(b).length) {
+			return false;
+		}
+
+		for (var key in a) {
+			if (!deepEqual(a[key], b[key])) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	function toHex(data) {
+		var s = '';
+
+		for (var i = 0; i < data.length; i++) {
+			s += (data[i] < 16 ? '0' : '') + data[i].toString(16);
+		}
+
+		return s;
+	}
+
+	function assert(condition, message) {
+		if (!condition) {
+			throw new Error(message || 'assertion failed');
+		}
+	}
+
+	function assertThrows(fn, message) {
+		try {
+			fn();
+		} catch (e) {
+			return;
+		}
+
+		throw new Error(message || 'expected an exception');
+	}
+)";
+
+class V8MsgpackTest : public ::testing::Test
+{
+protected:
+	v8::Isolate* m_isolate;
+
+	v8::Global<v8::Context> m_context;
+
+	v8::Global<v8::Function> m_packFunction;
+
+	v8::Global<v8::Function> m_unpackExt;
+
+	virtual void SetUp() override
+	{
+		m_isolate = GetIsolate();
+		ASSERT_NE(nullptr, m_isolate) << "V8 startup data not found - set CFX_V8_DATA to the directory containing natives_blob.bin and snapshot_blob.bin";
+
+		m_isolate->Enter();
+
+		v8::HandleScope handleScope(m_isolate);
+		v8::Local<v8::External> self = v8::External::New(m_isolate, this);
+
+		// the same functions the runtime exposes on the Citizen object
+		v8::Local<v8::ObjectTemplate> global = v8::ObjectTemplate::New(m_isolate);
+		global->Set(m_isolate, "pack", v8::FunctionTemplate::New(m_isolate, Pack, self));
+		global->Set(m_isolate, "unpack", v8::FunctionTemplate::New(m_isolate, Unpack, self));
+		global->Set(m_isolate, "setHooks", v8::FunctionTemplate::New(m_isolate, SetHooks, self));
+
+		m_context.Reset(m_isolate, v8::Context::New(m_isolate, nullptr, global));
+
+		ASSERT_EQ("", Run(g_v8Helpers));
+	}
+
+	virtual void TearDown() override
+	{
+		if (!m_isolate)
+		{
+			return;
+		}
+
+		m_packFunction.Reset();
+		m_unpackExt.Reset();
+		m_context.Reset();
+
+		m_isolate->Exit();
+	}
+
+	// runs a script, returning the exception message if it throws - `result` gets the completion value as a number
+	std::string Run(const std::string& code, double* result = nullptr)
+	{
+		v8::HandleScope handleScope(m_isolate);
+
+		v8::Local<v8::Context> context = v8::Local<v8::Context>::New(m_isolate, m_context);
+		v8::Context::Scope contextScope(context);
+
+		v8::TryCatch tryCatch(m_isolate);
+
+		v8::Local<v8::Script> script;
+		v8::Local<v8::Value> value;
+
+		if (!v8::Script::Compile(context, v8::String::NewFromUtf8(m_isolate, code.c_str())).ToLocal(&script) || !script->Run(context).ToLocal(&value))
+		{
+			v8::String::Utf8Value error(tryCatch.Exception());
+
+			return (*error) ? *error : "unknown exception";
+		}
+
+		if (result)
+		{
+			*result = value->NumberValue();
+		}
+
+		return "";
+	}
+
+	fx::V8MsgpackHooks GetHooks()
+	{
+		fx::V8MsgpackHooks hooks;
+		hooks.packFunction = v8::Local<v8::Function>::New(m_isolate, m_packFunction);
+		hooks.unpackExt = v8::Local<v8::Function>::New(m_isolate, m_unpackExt);
+
+		return hooks;
+	}
+
+private:
+	static V8MsgpackTest* GetTest(const v8::FunctionCallbackInfo<v8::Value>& args)
+	{
+		return reinterpret_cast<V8MsgpackTest*>(v8::Local<v8::External>::Cast(args.Data())->Value());
+	}
+
+	static void Pack(const v8::FunctionCallbackInfo<v8::Value>& args)
+	{
+		v8::Local<v8::Value> result = fx::V8MsgpackPack(args.GetIsolate(), args[0], GetTest(args)->GetHooks());
+
+		// an empty result means an exception is pending already
+		if (!result.IsEmpty())
+		{
+			args.GetReturnValue().Set(result);
+		}
+	}
+
+	static void Unpack(const v8::FunctionCallbackInfo<v8::Value>& args)
+	{
+		v8::Local<v8::Value> result = fx::V8MsgpackUnpack(args.GetIsolate(), args[0], GetTest(args)->GetHooks());
+
+		if (!result.IsEmpty())
+		{
+			args.GetReturnValue().Set(result);
+		}
+	}
+
+	static void SetHooks(const v8::FunctionCallbackInfo<v8::Value>& args)
+	{
+		V8MsgpackTest* test = GetTest(args);
+
+		test->m_packFunction.Reset(args.GetIsolate(), (args[0]->IsFunction()) ? v8::Local<v8::Function>::Cast(args[0]) : v8::Local<v8::Function>());
+		test->m_unpackExt.Reset(args.GetIsolate(), (args[1]->IsFunction()) ? v8::Local<v8::Function>::Cast(args[1]) : v8::Local<v8::Function>());
+	}
+};
+
+TEST_F(V8MsgpackTest, RoundTripsValues)
+{
+	EXPECT_EQ("", Run(R"(
+		var values = [
+			0, 1, -1, 127, 128, 255, 65536, -33, 2147483647, 4294967295, -2147483649, Math.pow(2, 53), -Math.pow(2, 53),
+			1.5, -0.25, 1e300,
+			true, false, null,
+			'', 'hello', new Array(301).join('x'), 'café ✓',
+			[], {}, [1, 2, 3], { a: 1, b: { c: 'd' } }, [1, [2, [3, []]]], { 1: 'integer-like', '': 'empty' },
+			{ playerId: 12, coords: [1.5, -2, 300.25], list: ['a', 'b', { nested: true }] },
+			new Uint8Array([0, 1, 255]), new Uint8Array(0)
+		];
+
+		for (var i = 0; i < values.length; i++) {
+			var result = unpack(pack(values[i]));
+
+			assert(deepEqual(values[i], result), 'value ' + i + ' (' + JSON.stringify(values[i]) + ') did not round-trip');
+		}
+
+		// undefined has no msgpack form of its own
+		assert(unpack(pack(undefined)) === null);
+
+		// other byte views and ArrayBuffers pack as bin as well, and unpack accepts either
+		assert(deepEqual(unpack(pack(new Uint16Array([0x0201]))), new Uint8Array([1, 2])));
+		assert(deepEqual(unpack(pack(new Uint8Array([1, 2, 3, 4]).subarray(1, 3))), new Uint8Array([2, 3])));
+		assert(deepEqual(unpack(pack(new Uint8Array([9]).buffer)), new Uint8Array([9])));
+		assert(unpack(pack('buffer').buffer) === 'buffer');
+	)"));
+}
+
+TEST_F(V8MsgpackTest, EncodesLikeMessagePack)
+{
+	EXPECT_EQ("", Run(R"(
+		var cases = [
+			[1, '01'],
+			[-1, 'ff'],
+			[200, 'ccc8'],
+			[-200, 'd1ff38'],
+			[Math.pow(2, 40), 'cf0000010000000000'],
+			[1.5, 'cb3ff8000000000000'],
+			['abc', 'a3616263'],
+			[[1, 2, 3], '93010203'],
+			[[], '90'],
+			[{}, '80'],
+			[{ a: 1 }, '81a16101'],
+			[null, 'c0'],
+			[true, 'c3'],
+			[new Uint8Array([1, 2]), 'c4020102'],
+		];
+
+		for (var i = 0; i < cases.length; i++) {
+			var packed = toHex(pack(cases[i][0]));
+
+			assert(packed === cases[i][1], 'case ' + i + ' packed as ' + packed);
+		}
+	)"));
+}
+
+TEST_F(V8MsgpackTest, UsesScriptHooks)
+{
+	// about what the runtime's main.js does for function references
+	EXPECT_EQ("", Run(R"(
+		setHooks(function(fn) {
+			return 'ref:' + fn().length;
+		}, function(type, data) {
+			return { type: type, data: String.fromCharCode.apply(null, data) };
+		});
+
+		var packed = pack(['x', function() { return 'abcd'; }]);
+		assert(toHex(packed) === '92a178c7050a7265663a34', 'packed as ' + toHex(packed));
+
+		var result = unpack(packed);
+
+		assert(result[0] === 'x');
+		assert(result[1].type === 10);
+		assert(result[1].data === 'ref:4');
+
+		// vectors become arrays of numbers, without going through the hook
+		var vector = unpack(new Uint8Array([0xc7, 0x0c, 0x15, 0x00, 0x00, 0x80, 0x3f, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x40, 0x40]));
+		assert(deepEqual(vector, [1, 2, 3]), 'vector unpacked as ' + JSON.stringify(vector));
+
+		// and without a hook, other extensions unpack to null
+		setHooks(null, null);
+		assert(unpack(new Uint8Array([0xd4, 0x0a, 0x01])) === null);
+	)"));
+}
+
+TEST_F(V8MsgpackTest, ThrowsErrors)
+{
+	EXPECT_EQ("", Run(R"(
+		var cyclic = {};
+		cyclic.self = cyclic;
+
+		assertThrows(function() { pack(cyclic); }, 'cyclic objects');
+		assertThrows(function() { pack(function() {}); }, 'functions without a reference function');
+		assertThrows(function() { unpack('not bytes'); }, 'strings');
+		assertThrows(function() { unpack(new Uint8Array(0)); }, 'empty data');
+		assertThrows(function() { unpack(new Uint8Array([0x01, 0x02])); }, 'extra bytes');
+		assertThrows(function() { unpack(new Uint8Array([0x92, 0x01])); }, 'truncated data');
+
+		setHooks(function() { throw new Error('nope'); }, null);
+		assertThrows(function() { pack([function() {}]); }, 'throwing hooks');
+	)"));
+
+	// and the context is still fine afterwards
+	EXPECT_EQ("", Run("assert(unpack(pack([1, 2]))[1] === 2)"));
+}
+
+// a few payloads shaped like net events and export calls
+static const char* g_benchmarkPayloads = R"(
+	var payloads = {
+		small: [12, 'chatMessage', [255, 0, 0]],
+		event: [5, { coords: [120.5, -880.25, 30.0], heading: 91.5, model: 'adder', plate: 'CFX 123', mods: [1, 4, 0, 2, 0, 0, 3] }, true],
+		large: [],
+	};
+
+	for (var i = 1; i <= 64; i++) {
+		payloads.large.push({ id: i, name: 'player' + i, position: [i, i * 2, i * 3], health: 200 - i, alive: (i % 3) !== 0 });
+	}
+
+	var codecs = {
+		native: { pack: pack, unpack: unpack },
+	};
+
+	function runBenchmark(codec, payload, count) {
+		var encode = codecs[codec].pack, decode = codecs[codec].unpack;
+		var data = payloads[payload];
+		var size = 0;
+
+		for (var i = 0; i < count; i++) {
+			size += encode(decode(encode(data))).length;
+		}
+
+		return size;
+	}
+)";
+
+TEST_F(V8MsgpackTest, DISABLED_BenchmarkAgainstScriptCodec)
+{
+	ASSERT_EQ("", Run(g_benchmarkPayloads));
+
+	// the script codec, if it can be found - it's bundled with the client data files, not part of this tree, and is
+	// expected to set a global `msgpack` with msgpack-lite's encode/decode
+	const char* scriptPath = getenv("CFX_MSGPACK_JS");
+
+	if (!scriptPath)
+	{
+		scriptPath = "citizen/scripting/v8/msgpack.js";
+	}
+
+	std::string script = ReadFile(scriptPath);
+	bool haveScript = false;
+
+	if (!script.empty() && Run(script) == "")
+	{
+		haveScript = (Run("codecs.script = { pack: msgpack.encode, unpack: msgpack.decode }") == "");
+	}
+
+	if (!haveScript)
+	{
+		printf("%s not found, benchmarking the native codec only\n", scriptPath);
+	}
+
+	const int count = 20000;
+
+	auto measure = [&] (const char* codec, const char* payload)
+	{
+		size_t allocations = g_allocator.allocations;
+		size_t bytes = g_allocator.bytes;
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		double size = 0.0;
+		std::string error = Run(va("runBenchmark('%s', '%s', %d)", codec, payload, count), &size);
+
+		if (!error.empty())
+		{
+			EXPECT_STRNE("native", codec) << error;
+			printf("%-6s %-6s failed: %s\n", codec, payload, error.c_str());
+
+			return;
+		}
+
+		auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+		// every iteration is two packs and an unpack
+		printf("%-6s %-6s %9.0f ops/sec, %6.1f ArrayBuffer allocations (%7.0f bytes)/op, %4.0f bytes\n", codec, payload,
+			(count * 3) / (time / 1e9),
+			(g_allocator.allocations - allocations) / (count * 3.0),
+			(g_allocator.bytes - bytes) / (count * 3.0),
+			size / count);
+	};
+
+	for (const char* payload : { "small", "event", "large" })
+	{
+		measure("native", payload);
+
+		if (haveScript)
+		{
+			measure("script", payload);
+		}
+	}
+}
@@ -26,8 +26,8 @@ namespace fx
 
 	TcpListenManager::TcpListenManager(const boost::property_tree::ptree& pt)
 	{
-		// initialize a TCP stack
-		m_tcpStack = new net::TcpServerManager();
+		// initialize a TCP stack, optionally sharded over multiple loops (0 being one per hardware thread)
+		m_tcpStack = new net::TcpServerManager(pt.get<int>("server.tcpLoopCount", 1));
 
 		// for each defined endpoint
 		for (auto& child : pt.get_child("server.endpoints"))
@@ -34,6 +34,8 @@ public:
 
 	virtual void OnPingResult(int msec);
 
+	virtual void OnQueuedMessage(NetQueueType queue, uint32_t depth, uint32_t latency);
+
 private:
 	int m_ping;
 
@@ -49,6 +51,14 @@ private:
 	int m_inBytes;
 	int m_outBytes;
 
+	// time messages waited for the game, and how many were waiting at most
+	uint64_t m_queueLatency;
+	int m_queueMessages;
+	int m_queueDepth;
+
+	int m_lastQueueLatency;
+	int m_lastQueueDepth;
+
 	bool m_enabled;
 
 	NetPacketMetrics m_metrics[g_netOverlaySampleCount + 1];
@@ -95,6 +105,7 @@ NetOverlayMetricSink::NetOverlayMetricSink()
 	: m_ping(0), m_lastInBytes(0), m_lastInPackets(0), m_lastOutBytes(0), m_lastOutPackets(0),
 	  m_lastUpdatePerSample(0), m_lastUpdatePerSec(0),
 	  m_inBytes(0), m_inPackets(0), m_outBytes(0), m_outPackets(0),
+	  m_queueLatency(0), m_queueMessages(0), m_queueDepth(0), m_lastQueueLatency(0), m_lastQueueDepth(0),
 	  m_enabled(false)
 {
 	ConHost::OnInvokeNative.Connect([=] (const char* nativeName, const char* argument)
@@ -128,13 +139,13 @@ void NetOverlayMetricSink::OnIncomingPacket(const NetPacketMetrics& packetMetric
 	m_metrics[g_netOverlaySampleCount] = m_metrics[g_netOverlaySampleCount] + packetMetrics;
 
 	m_inPackets++;
-	m_inBytes += packetMetrics.GetTotalSize();
+	m_inBytes += packetMetrics.GetCompressedSize();
 }
 
 void NetOverlayMetricSink::OnOutgoingPacket(const NetPacketMetrics& packetMetrics)
 {
 	m_outPackets++;
-	m_outBytes += packetMetrics.GetTotalSize();
+	m_outBytes += packetMetrics.GetCompressedSize();
 }
 
 void NetOverlayMetricSink::OnPingResult(int msec)
@@ -142,6 +153,14 @@ void NetOverlayMetricSink::OnPingResult(int msec)
 	m_ping = msec;
 }
 
+void NetOverlayMetricSink::OnQueuedMessage(NetQueueType queue, uint32_t depth, uint32_t latency)
+{
+	m_queueLatency += latency;
+	m_queueMessages++;
+
+	m_queueDepth = std::max(m_queueDepth, static_cast<int>(depth));
+}
+
 void NetOverlayMetricSink::UpdateMetrics()
 {
 	uint32_t time = timeGetTime();
@@ -167,6 +186,9 @@ void NetOverlayMetricSink::UpdateMetrics()
 		m_lastOutBytes = m_outBytes;
 		m_lastOutPackets = m_outPackets;
 
+		m_lastQueueLatency = (m_queueMessages) ? static_cast<int>(m_queueLatency / m_queueMessages) : 0;
+		m_lastQueueDepth = m_queueDepth;
+
 		// reset 'current' values
 		m_inBytes = 0;
 		m_inPackets = 0;
@@ -174,6 +196,10 @@ void NetOverlayMetricSink::UpdateMetrics()
 		m_outBytes = 0;
 		m_outPackets = 0;
 
+		m_queueLatency = 0;
+		m_queueMessages = 0;
+		m_queueDepth = 0;
+
 		// update the timer
 		m_lastUpdatePerSec = time;
 	}
@@ -257,9 +283,10 @@ void NetOverlayMetricSink::DrawBaseMetrics()
 	int ping = m_ping;
 	int inPackets = m_lastInPackets;
 	int outPackets = m_lastOutPackets;
+	int queueLatency = m_lastQueueLatency;
 
 	// drawing
-	TheFonts->DrawText(va(L"ping: %dms\nin: %d/s\nout: %d/s", ping, inPackets, outPackets), rect, color, 22.0f, 1.0f, "Lucida Console");
+	TheFonts->DrawText(va(L"ping: %dms\nin: %d/s\nout: %d/s\nqueue: %dus", ping, inPackets, outPackets, queueLatency), rect, color, 22.0f, 1.0f, "Lucida Console");
 
 	//
 	// second column
@@ -271,9 +298,10 @@ void NetOverlayMetricSink::DrawBaseMetrics()
 	// collecting
 	int inBytes = m_lastInBytes;
 	int outBytes = m_lastOutBytes;
+	int queueDepth = m_lastQueueDepth;
 
 	// drawing
-	TheFonts->DrawText(va(L"\nin: %d b/s\nout: %d b/s", inBytes, outBytes), rect, color, 22.0f, 1.0f, "Lucida Console");
+	TheFonts->DrawText(va(L"\nin: %d b/s\nout: %d b/s\ndepth: %d", inBytes, outBytes, queueDepth), rect, color, 22.0f, 1.0f, "Lucida Console");
 }
 
 static InitFunction initFunction([] ()
@@ -0,0 +1,329 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace net
+{
+//
+// A bump allocator for short-lived packet storage, e.g. everything written during a single tick. Reset makes all
+// memory available again without freeing it, so after warming up a tick doesn't allocate at all.
+//
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	BufferArena
+{
+private:
+	struct Block
+	{
+		std::unique_ptr<uint8_t[]> data;
+
+		size_t size;
+	};
+
+	std::vector<Block> m_blocks;
+
+	size_t m_blockSize;
+
+	// the block currently being allocated from, and the offset in there
+	size_t m_curBlock;
+
+	size_t m_curOffset;
+
+public:
+	BufferArena(size_t blockSize = 65536);
+
+	uint8_t* Allocate(size_t length);
+
+	void Reset();
+
+	// the total amount of memory held, used or not
+	size_t GetCapacity() const;
+};
+
+//
+// A non-owning reader over caller memory. Byte-sized reads (Read, Read<T>, ReadVarInt) start at the next byte
+// boundary, bit-sized reads (ReadBits, ReadBool, ReadQuantizedFloat) continue right where the last read ended -
+// so a run of bools only takes up a bit each, as long as the writer used the same sequence of calls.
+//
+// Reading past the end returns zeroes and marks the view as being at the end, like Buffer does.
+//
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	BufferView
+{
+private:
+	const uint8_t* m_data;
+
+	size_t m_length;
+
+	// in bits
+	size_t m_offset;
+
+	bool m_end;
+
+private:
+	inline void AlignToByte()
+	{
+		m_offset = (m_offset + 7) & ~static_cast<size_t>(7);
+	}
+
+public:
+	inline BufferView()
+		: m_data(nullptr), m_length(0), m_offset(0), m_end(false)
+	{
+	}
+
+	inline BufferView(const uint8_t* data, size_t length)
+		: m_data(data), m_length(length), m_offset(0), m_end(false)
+	{
+	}
+
+	inline explicit BufferView(const std::vector<uint8_t>& data)
+		: m_data(data.data()), m_length(data.size()), m_offset(0), m_end(false)
+	{
+	}
+
+	inline bool Read(void* buffer, size_t length)
+	{
+		AlignToByte();
+
+		size_t byteOffset = m_offset >> 3;
+
+		if (byteOffset + length > m_length)
+		{
+			m_end = true;
+			memset(buffer, 0, length);
+
+			return false;
+		}
+
+		memcpy(buffer, m_data + byteOffset, length);
+		m_offset += length << 3;
+
+		return true;
+	}
+
+	template<typename T>
+	inline T Read()
+	{
+		T value;
+		Read(&value, sizeof(T));
+
+		return value;
+	}
+
+	// up to 32 bits, least significant bit first
+	inline uint32_t ReadBits(int bits)
+	{
+		if (m_offset + bits > (m_length << 3))
+		{
+			m_end = true;
+			m_offset = m_length << 3;
+
+			return 0;
+		}
+
+		size_t byteOffset = m_offset >> 3;
+		int shift = static_cast<int>(m_offset & 7);
+
+		// shift + bits never exceeds 39 bits, so 5 bytes always cover the value
+		uint64_t value = 0;
+		memcpy(&value, m_data + byteOffset, std::min<size_t>(m_length - byteOffset, 5));
+
+		m_offset += bits;
+
+		return static_cast<uint32_t>((value >> shift) & ((uint64_t(1) << bits) - 1));
+	}
+
+	inline bool ReadBool()
+	{
+		return ReadBits(1) != 0;
+	}
+
+	uint64_t ReadVarInt();
+
+	inline int64_t ReadSignedVarInt()
+	{
+		uint64_t value = ReadVarInt();
+
+		return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+	}
+
+	inline float ReadQuantizedFloat(float min, float max, int bits)
+	{
+		uint32_t quantized = ReadBits(bits);
+
+		return static_cast<float>(min + quantized * ((static_cast<double>(max) - min) / ((uint64_t(1) << bits) - 1)));
+	}
+
+	inline void Reset()
+	{
+		m_offset = 0;
+		m_end = false;
+	}
+
+	inline bool IsAtEnd() const
+	{
+		return (m_end || m_offset >= (m_length << 3));
+	}
+
+	// whether a read went past the end, as opposed to everything having been read
+	inline bool IsOverrun() const
+	{
+		return m_end;
+	}
+
+	inline const uint8_t* GetBuffer() const { return m_data; }
+	inline size_t GetLength() const { return m_length; }
+	inline size_t GetCurOffset() const { return (m_offset + 7) >> 3; }
+	inline size_t GetRemainingBytes() const { return (GetCurOffset() < m_length) ? m_length - GetCurOffset() : 0; }
+};
+
+//
+// A writer into caller memory or arena memory, with the same bit/byte layout rules as BufferView. It never grows:
+// writes that don't fit are dropped and mark the writer as overflowed, so callers should check IsOverflowed once
+// they're done writing.
+//
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	BufferWriter
+{
+private:
+	uint8_t* m_data;
+
+	size_t m_capacity;
+
+	// in bits
+	size_t m_offset;
+
+	bool m_overflowed;
+
+private:
+	inline void AlignToByte()
+	{
+		m_offset = (m_offset + 7) & ~static_cast<size_t>(7);
+	}
+
+public:
+	inline BufferWriter(uint8_t* data, size_t capacity)
+		: m_data(data), m_capacity(capacity), m_offset(0), m_overflowed(false)
+	{
+	}
+
+	inline BufferWriter(BufferArena& arena, size_t capacity)
+		: m_data(arena.Allocate(capacity)), m_capacity(capacity), m_offset(0), m_overflowed(false)
+	{
+	}
+
+	inline bool Write(const void* buffer, size_t length)
+	{
+		AlignToByte();
+
+		size_t byteOffset = m_offset >> 3;
+
+		if (byteOffset + length > m_capacity)
+		{
+			m_overflowed = true;
+			return false;
+		}
+
+		memcpy(m_data + byteOffset, buffer, length);
+		m_offset += length << 3;
+
+		return true;
+	}
+
+	template<typename T>
+	inline bool Write(T value)
+	{
+		return Write(&value, sizeof(T));
+	}
+
+	// up to 32 bits, least significant bit first
+	inline bool WriteBits(uint32_t value, int bits)
+	{
+		if (((m_offset + bits + 7) >> 3) > m_capacity)
+		{
+			m_overflowed = true;
+			return false;
+		}
+
+		size_t byteOffset = m_offset >> 3;
+		int shift = static_cast<int>(m_offset & 7);
+
+		uint64_t shiftedValue = (static_cast<uint64_t>(value) & ((uint64_t(1) << bits) - 1)) << shift;
+
+		// the caller's memory isn't cleared, so bytes get overwritten entirely the first time they're touched
+		if (shift != 0)
+		{
+			shiftedValue |= m_data[byteOffset];
+		}
+
+		memcpy(m_data + byteOffset, &shiftedValue, (shift + bits + 7) >> 3);
+
+		m_offset += bits;
+
+		return true;
+	}
+
+	inline bool WriteBool(bool value)
+	{
+		return WriteBits(value ? 1 : 0, 1);
+	}
+
+	// LEB128 - 7 bits per byte, so values below 128 take a single byte
+	bool WriteVarInt(uint64_t value);
+
+	// zigzag-encoded, so small negative values stay small as well
+	inline bool WriteSignedVarInt(int64_t value)
+	{
+		return WriteVarInt((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+	}
+
+	// maps [min, max] onto the given amount of bits, clamping values out of range
+	inline bool WriteQuantizedFloat(float value, float min, float max, int bits)
+	{
+		double scaled = (static_cast<double>(value) - min) * (((uint64_t(1) << bits) - 1) / (static_cast<double>(max) - min));
+		scaled = std::min(static_cast<double>((uint64_t(1) << bits) - 1), std::max(0.0, scaled));
+
+		return WriteBits(static_cast<uint32_t>(scaled + 0.5), bits);
+	}
+
+	inline void Reset()
+	{
+		m_offset = 0;
+		m_overflowed = false;
+	}
+
+	inline bool IsOverflowed() const
+	{
+		return m_overflowed;
+	}
+
+	inline const uint8_t* GetBuffer() const { return m_data; }
+	inline size_t GetCapacity() const { return m_capacity; }
+
+	// the amount of bytes written so far, including a partially written last byte
+	inline size_t GetLength() const { return (m_offset + 7) >> 3; }
+
+	inline BufferView GetView() const
+	{
+		return BufferView(m_data, GetLength());
+	}
+};
+}
@@ -0,0 +1,427 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace net
+{
+template<typename TSignature, size_t InlineSize = 64>
+class InlineFunction;
+
+//
+// A copyable callable wrapper like std::function, except that callables of up to InlineSize bytes are stored
+// inside the object itself - so a table of these keeps its handlers next to each other instead of behind a
+// separate allocation each. Larger callables still work, but end up on the heap.
+//
+template<typename TReturn, typename... TArgs, size_t InlineSize>
+class InlineFunction<TReturn(TArgs...), InlineSize>
+{
+private:
+	enum class Operation
+	{
+		Copy,
+		Move,
+		Destroy
+	};
+
+	typedef TReturn(*TInvoker)(void* storage, TArgs&&... args);
+	typedef void(*TManager)(Operation operation, void* storage, void* other);
+
+	typename std::aligned_storage<InlineSize, alignof(std::max_align_t)>::type m_storage;
+
+	TInvoker m_invoke;
+
+	TManager m_manage;
+
+private:
+	template<typename TFunc>
+	struct IsInline
+	{
+		static const bool value = sizeof(TFunc) <= InlineSize && alignof(TFunc) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible<TFunc>::value;
+	};
+
+	template<typename TFunc>
+	static TFunc* GetCallable(void* storage, std::true_type)
+	{
+		return reinterpret_cast<TFunc*>(storage);
+	}
+
+	template<typename TFunc>
+	static TFunc* GetCallable(void* storage, std::false_type)
+	{
+		return *reinterpret_cast<TFunc**>(storage);
+	}
+
+	template<typename TFunc>
+	static TReturn Invoke(void* storage, TArgs&&... args)
+	{
+		return (*GetCallable<TFunc>(storage, std::integral_constant<bool, IsInline<TFunc>::value>()))(std::forward<TArgs>(args)...);
+	}
+
+	template<typename TFunc>
+	static void Manage(Operation operation, void* storage, void* other)
+	{
+		Manage<TFunc>(operation, storage, other, std::integral_constant<bool, IsInline<TFunc>::value>());
+	}
+
+	template<typename TFunc>
+	static void Manage(Operation operation, void* storage, void* other, std::true_type)
+	{
+		switch (operation)
+		{
+			case Operation::Copy:
+				new(storage) TFunc(*reinterpret_cast<const TFunc*>(other));
+				break;
+			case Operation::Move:
+				new(storage) TFunc(std::move(*reinterpret_cast<TFunc*>(other)));
+				reinterpret_cast<TFunc*>(other)->~TFunc();
+				break;
+			case Operation::Destroy:
+				reinterpret_cast<TFunc*>(storage)->~TFunc();
+				break;
+		}
+	}
+
+	template<typename TFunc>
+	static void Manage(Operation operation, void* storage, void* other, std::false_type)
+	{
+		switch (operation)
+		{
+			case Operation::Copy:
+				*reinterpret_cast<TFunc**>(storage) = new TFunc(**reinterpret_cast<TFunc**>(other));
+				break;
+			case Operation::Move:
+				*reinterpret_cast<TFunc**>(storage) = *reinterpret_cast<TFunc**>(other);
+				break;
+			case Operation::Destroy:
+				delete *reinterpret_cast<TFunc**>(storage);
+				break;
+		}
+	}
+
+	template<typename TFunc>
+	void Construct(TFunc&& function, std::true_type)
+	{
+		new(&m_storage) typename std::decay<TFunc>::type(std::forward<TFunc>(function));
+	}
+
+	template<typename TFunc>
+	void Construct(TFunc&& function, std::false_type)
+	{
+		*reinterpret_cast<typename std::decay<TFunc>::type**>(&m_storage) = new typename std::decay<TFunc>::type(std::forward<TFunc>(function));
+	}
+
+	void Assign(const InlineFunction& other)
+	{
+		m_invoke = other.m_invoke;
+		m_manage = other.m_manage;
+
+		if (m_manage)
+		{
+			m_manage(Operation::Copy, &m_storage, const_cast<void*>(reinterpret_cast<const void*>(&other.m_storage)));
+		}
+	}
+
+	void Assign(InlineFunction&& other)
+	{
+		m_invoke = other.m_invoke;
+		m_manage = other.m_manage;
+
+		if (m_manage)
+		{
+			m_manage(Operation::Move, &m_storage, &other.m_storage);
+		}
+
+		other.m_invoke = nullptr;
+		other.m_manage = nullptr;
+	}
+
+	void Clear()
+	{
+		if (m_manage)
+		{
+			m_manage(Operation::Destroy, &m_storage, nullptr);
+		}
+
+		m_invoke = nullptr;
+		m_manage = nullptr;
+	}
+
+public:
+	inline InlineFunction()
+		: m_invoke(nullptr), m_manage(nullptr)
+	{
+	}
+
+	template<typename TFunc, typename = typename std::enable_if<!std::is_same<typename std::decay<TFunc>::type, InlineFunction>::value>::type>
+	InlineFunction(TFunc&& function)
+	{
+		typedef typename std::decay<TFunc>::type TCallable;
+
+		Construct(std::forward<TFunc>(function), std::integral_constant<bool, IsInline<TCallable>::value>());
+
+		m_invoke = &Invoke<TCallable>;
+		m_manage = &Manage<TCallable>;
+	}
+
+	inline InlineFunction(const InlineFunction& other)
+	{
+		Assign(other);
+	}
+
+	inline InlineFunction(InlineFunction&& other)
+	{
+		Assign(std::move(other));
+	}
+
+	inline ~InlineFunction()
+	{
+		Clear();
+	}
+
+	inline InlineFunction& operator=(const InlineFunction& other)
+	{
+		if (this != &other)
+		{
+			Clear();
+			Assign(other);
+		}
+
+		return *this;
+	}
+
+	inline InlineFunction& operator=(InlineFunction&& other)
+	{
+		if (this != &other)
+		{
+			Clear();
+			Assign(std::move(other));
+		}
+
+		return *this;
+	}
+
+	inline explicit operator bool() const
+	{
+		return (m_invoke != nullptr);
+	}
+
+	inline TReturn operator()(TArgs... args) const
+	{
+		return m_invoke(const_cast<void*>(reinterpret_cast<const void*>(&m_storage)), std::forward<TArgs>(args)...);
+	}
+};
+
+template<typename TSignature, size_t InlineSize = 64>
+class DispatchTable;
+
+//
+// Maps message types (usually name hashes) to any number of handlers, called in the order they got registered.
+//
+// Lookups go through an open-addressed hash table of type indices, which are dense: once a type is known (e.g. after
+// a type mapping handshake), GetIndex can be cached and handlers invoked by index without hashing at all. Indices
+// stay valid for the lifetime of the table.
+//
+template<typename... TArgs, size_t InlineSize>
+class DispatchTable<void(TArgs...), InlineSize>
+{
+public:
+	typedef InlineFunction<void(TArgs...), InlineSize> THandler;
+
+private:
+	struct Handler
+	{
+		THandler function;
+
+		// the next handler for the same type, or -1
+		int next;
+	};
+
+	struct Type
+	{
+		uint32_t type;
+
+		int firstHandler;
+
+		int lastHandler;
+	};
+
+	struct Slot
+	{
+		uint32_t type;
+
+		// -1 for an empty slot
+		int index;
+	};
+
+	std::vector<Handler> m_handlers;
+
+	std::vector<Type> m_types;
+
+	// a power of two, and never more than half full
+	std::vector<Slot> m_slots;
+
+private:
+	inline size_t GetSlot(uint32_t type) const
+	{
+		// types are mostly hashes already, but mix them anyway so sequential ids don't cluster
+		uint32_t hash = (type ^ (type >> 16)) * 0x85EBCA6Bu;
+		hash ^= hash >> 13;
+
+		return hash & (m_slots.size() - 1);
+	}
+
+	void Rehash(size_t slotCount)
+	{
+		m_slots.assign(slotCount, Slot{ 0, -1 });
+
+		for (size_t i = 0; i < m_types.size(); i++)
+		{
+			size_t slot = GetSlot(m_types[i].type);
+
+			while (m_slots[slot].index >= 0)
+			{
+				slot = (slot + 1) & (m_slots.size() - 1);
+			}
+
+			m_slots[slot] = Slot{ m_types[i].type, static_cast<int>(i) };
+		}
+	}
+
+	int GetOrAddIndex(uint32_t type)
+	{
+		int index = GetIndex(type);
+
+		if (index >= 0)
+		{
+			return index;
+		}
+
+		index = static_cast<int>(m_types.size());
+		m_types.push_back(Type{ type, -1, -1 });
+
+		if (m_types.size() * 2 > m_slots.size())
+		{
+			Rehash(std::max<size_t>(16, m_slots.size() * 2));
+		}
+		else
+		{
+			size_t slot = GetSlot(type);
+
+			while (m_slots[slot].index >= 0)
+			{
+				slot = (slot + 1) & (m_slots.size() - 1);
+			}
+
+			m_slots[slot] = Slot{ type, index };
+		}
+
+		return index;
+	}
+
+public:
+	// returns the type index the handler got registered under
+	template<typename TFunc>
+	int Register(uint32_t type, TFunc&& function)
+	{
+		int index = GetOrAddIndex(type);
+		int handlerIndex = static_cast<int>(m_handlers.size());
+
+		m_handlers.push_back(Handler{ THandler(std::forward<TFunc>(function)), -1 });
+
+		Type& typeEntry = m_types[index];
+
+		if (typeEntry.lastHandler >= 0)
+		{
+			m_handlers[typeEntry.lastHandler].next = handlerIndex;
+		}
+		else
+		{
+			typeEntry.firstHandler = handlerIndex;
+		}
+
+		typeEntry.lastHandler = handlerIndex;
+
+		return index;
+	}
+
+	// returns -1 if nothing is registered for the type
+	inline int GetIndex(uint32_t type) const
+	{
+		if (m_slots.empty())
+		{
+			return -1;
+		}
+
+		for (size_t slot = GetSlot(type); m_slots[slot].index >= 0; slot = (slot + 1) & (m_slots.size() - 1))
+		{
+			if (m_slots[slot].type == type)
+			{
+				return m_slots[slot].index;
+			}
+		}
+
+		return -1;
+	}
+
+	inline uint32_t GetType(int index) const
+	{
+		return m_types[index].type;
+	}
+
+	inline bool HasType(uint32_t type) const
+	{
+		return (GetIndex(type) >= 0);
+	}
+
+	inline size_t GetTypeCount() const
+	{
+		return m_types.size();
+	}
+
+	inline void DispatchIndex(int index, TArgs... args) const
+	{
+		for (int handler = m_types[index].firstHandler; handler >= 0; handler = m_handlers[handler].next)
+		{
+			m_handlers[handler].function(args...);
+		}
+	}
+
+	// returns false if nothing is registered for the type
+	inline bool Dispatch(uint32_t type, TArgs... args) const
+	{
+		int index = GetIndex(type);
+
+		if (index < 0)
+		{
+			return false;
+		}
+
+		DispatchIndex(index, args...);
+		return true;
+	}
+
+	template<typename TReceiver>
+	void ForEach(const TReceiver& receiver) const
+	{
+		for (auto& type : m_types)
+		{
+			for (int handler = type.firstHandler; handler >= 0; handler = m_handlers[handler].next)
+			{
+				receiver(type.type, m_handlers[handler].function);
+			}
+		}
+	}
+};
+}
@@ -0,0 +1,111 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace net
+{
+//
+// A copy of a histogram's counts at one point in time, to compute statistics from.
+//
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	HistogramSnapshot
+{
+private:
+	std::vector<uint64_t> m_buckets;
+
+	uint64_t m_count;
+
+	uint64_t m_sum;
+
+	uint64_t m_max;
+
+	friend class Histogram;
+
+public:
+	HistogramSnapshot();
+
+	inline uint64_t GetCount() const
+	{
+		return m_count;
+	}
+
+	inline uint64_t GetSum() const
+	{
+		return m_sum;
+	}
+
+	inline uint64_t GetMax() const
+	{
+		return m_max;
+	}
+
+	inline double GetMean() const
+	{
+		return (m_count) ? (m_sum / static_cast<double>(m_count)) : 0.0;
+	}
+
+	// the smallest value that at least `quantile` (0 to 1) of all recorded values are equal to or below, within the
+	// histogram's precision
+	uint64_t GetQuantile(double quantile) const;
+};
+
+//
+// Counts values in log-linear buckets, like an HDR histogram: every power of two is split into 32 equally sized
+// buckets, so any value is known to within about 3% no matter how large, using a fixed amount of memory. Values
+// above 2^32 count as 2^32.
+//
+// Recording is lock-free and wait-free, so any number of threads can record while another one takes snapshots.
+//
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	Histogram
+{
+public:
+	static const int kSubBucketBits = 5;
+
+	static const int kSubBucketCount = 1 << kSubBucketBits;
+
+	static const int kMaxValueBits = 32;
+
+	static const int kBucketCount = kSubBucketCount + (kMaxValueBits - kSubBucketBits) * kSubBucketCount;
+
+private:
+	std::atomic<uint64_t> m_buckets[kBucketCount];
+
+	std::atomic<uint64_t> m_sum;
+
+	std::atomic<uint64_t> m_max;
+
+public:
+	Histogram();
+
+	Histogram(const Histogram&) = delete;
+
+	Histogram& operator=(const Histogram&) = delete;
+
+	void Record(uint64_t value);
+
+	HistogramSnapshot GetSnapshot() const;
+
+	void Reset();
+
+	static int GetBucketIndex(uint64_t value);
+
+	// the largest value counted in a bucket
+	static uint64_t GetBucketUpperBound(int index);
+};
+}
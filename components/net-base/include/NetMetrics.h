@@ -0,0 +1,105 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <NetHistogram.h>
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace net
+{
+enum class ConnectionMetric
+{
+	// round-trip time, in milliseconds
+	Rtt,
+
+	// sizes of datagrams as received/sent on the wire, in bytes
+	IncomingPacketSize,
+	OutgoingPacketSize,
+
+	// times a reliable command got sent again before it was acknowledged
+	ReliableResends,
+
+	// datagrams a message had to be split into
+	FragmentCount,
+
+	// messages waiting in a queue between threads, whenever one gets taken off it
+	QueueDepth,
+
+	Max
+};
+
+//
+// Histograms of everything worth knowing about a single connection. Recording is lock-free, so any thread handling
+// the connection can record straight into it.
+//
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	ConnectionMetrics : public fwRefCountable
+{
+private:
+	std::string m_name;
+
+	Histogram m_histograms[static_cast<int>(ConnectionMetric::Max)];
+
+public:
+	ConnectionMetrics(const std::string& name);
+
+	inline const std::string& GetName() const
+	{
+		return m_name;
+	}
+
+	inline void Record(ConnectionMetric metric, uint64_t value)
+	{
+		m_histograms[static_cast<int>(metric)].Record(value);
+	}
+
+	inline const Histogram& GetHistogram(ConnectionMetric metric) const
+	{
+		return m_histograms[static_cast<int>(metric)];
+	}
+
+	void Reset();
+};
+
+//
+// Keeps track of the metrics of all live connections, for anyone wanting to pull or export them.
+//
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	MetricsRegistry : public fwRefCountable
+{
+private:
+	std::mutex m_mutex;
+
+	std::vector<fwRefContainer<ConnectionMetrics>> m_connections;
+
+public:
+	// connections are identified by name in exports - names don't have to be unique, but should be
+	fwRefContainer<ConnectionMetrics> CreateConnection(const std::string& name);
+
+	void RemoveConnection(const fwRefContainer<ConnectionMetrics>& connection);
+
+	void ForEachConnection(const std::function<void(const fwRefContainer<ConnectionMetrics>&)>& callback);
+
+	// formats all connections in the Prometheus text exposition format, as a summary per metric
+	std::string FormatPrometheus();
+
+	static const char* GetMetricName(ConnectionMetric metric);
+};
+}
+
+DECLARE_INSTANCE_TYPE(net::MetricsRegistry);
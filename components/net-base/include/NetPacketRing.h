@@ -0,0 +1,236 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace net
+{
+struct PacketRingStatistics
+{
+	uint64_t pushed;
+
+	uint64_t popped;
+
+	// pushes that failed as the ring was full
+	uint64_t droppedFull;
+
+	// pushes that failed as the packet didn't fit into a slot
+	uint64_t droppedOversized;
+
+	// the most packets that were ever waiting at once
+	uint64_t highWater;
+};
+
+//
+// A bounded queue of packets for any number of producer threads and a single consumer, without any locks. Packets
+// get copied straight into one of a fixed number of preallocated slots, so pushing or popping never allocates.
+//
+// Every slot carries a sequence number telling whose turn it is: producers claim a position by moving the tail
+// forward, and publish the slot by bumping its sequence - the consumer only reads slots published that way, and
+// hands them back to producers one lap ahead.
+//
+// Pushing fails if the ring is full, or the packet is larger than SlotSize; what to do then is up to the producer.
+//
+template<size_t SlotSize, size_t Capacity>
+class PacketRing
+{
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two");
+
+public:
+	struct Slot
+	{
+		// whatever the producer wants to pass along, like who the packet is from or for
+		uint16_t tag;
+
+		uint16_t length;
+
+		uint32_t time;
+
+		uint8_t data[SlotSize];
+
+	private:
+		friend class PacketRing;
+
+		std::atomic<size_t> m_sequence;
+	};
+
+	static_assert(SlotSize <= UINT16_MAX, "SlotSize has to fit into a slot's length");
+
+private:
+	// padded to a cache line each rather than aligned, so the ring can be a member of anything allocated with plain new
+	struct Index
+	{
+		std::atomic<size_t> value;
+
+		char padding[64 - sizeof(std::atomic<size_t>)];
+	};
+
+	char m_padding[64];
+
+	Index m_head;
+
+	Index m_tail;
+
+	std::unique_ptr<Slot[]> m_slots;
+
+	struct Counters
+	{
+		std::atomic<uint64_t> pushed;
+		std::atomic<uint64_t> droppedFull;
+		std::atomic<uint64_t> droppedOversized;
+		std::atomic<uint64_t> highWater;
+
+		char padding[64 - 4 * sizeof(std::atomic<uint64_t>)];
+	};
+
+	char m_countersPadding[64];
+
+	Counters m_counters;
+
+public:
+	PacketRing()
+		: m_slots(new Slot[Capacity])
+	{
+		for (size_t i = 0; i < Capacity; i++)
+		{
+			m_slots[i].m_sequence.store(i, std::memory_order_relaxed);
+		}
+
+		m_head.value = 0;
+		m_tail.value = 0;
+
+		m_counters.pushed = 0;
+		m_counters.droppedFull = 0;
+		m_counters.droppedOversized = 0;
+		m_counters.highWater = 0;
+	}
+
+	PacketRing(const PacketRing&) = delete;
+
+	PacketRing& operator=(const PacketRing&) = delete;
+
+	// any thread
+	bool TryPush(uint16_t tag, const void* data, size_t length, uint32_t time)
+	{
+		if (length > SlotSize)
+		{
+			m_counters.droppedOversized.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		size_t position = m_tail.value.load(std::memory_order_relaxed);
+		Slot* slot;
+
+		while (true)
+		{
+			slot = &m_slots[position & (Capacity - 1)];
+
+			size_t sequence = slot->m_sequence.load(std::memory_order_acquire);
+			intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+			if (difference == 0)
+			{
+				// it's free - claim it, unless another producer was faster
+				if (m_tail.value.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (difference < 0)
+			{
+				// the consumer hasn't gotten to this one from the last lap yet
+				m_counters.droppedFull.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			else
+			{
+				position = m_tail.value.load(std::memory_order_relaxed);
+			}
+		}
+
+		slot->tag = tag;
+		slot->length = static_cast<uint16_t>(length);
+		slot->time = time;
+		memcpy(slot->data, data, length);
+
+		slot->m_sequence.store(position + 1, std::memory_order_release);
+
+		m_counters.pushed.fetch_add(1, std::memory_order_relaxed);
+
+		// good enough as a high-water mark, even if racing another producer
+		uint64_t depth = (position + 1) - m_head.value.load(std::memory_order_relaxed);
+
+		if (depth > m_counters.highWater.load(std::memory_order_relaxed))
+		{
+			m_counters.highWater.store(depth, std::memory_order_relaxed);
+		}
+
+		return true;
+	}
+
+	// consumer only: the oldest packet, or nullptr if there's none - it stays valid until Pop
+	const Slot* Peek() const
+	{
+		size_t position = m_head.value.load(std::memory_order_relaxed);
+		const Slot* slot = &m_slots[position & (Capacity - 1)];
+
+		if (slot->m_sequence.load(std::memory_order_acquire) != position + 1)
+		{
+			return nullptr;
+		}
+
+		return slot;
+	}
+
+	// consumer only: hands the slot returned by Peek back to the producers
+	void Pop()
+	{
+		size_t position = m_head.value.load(std::memory_order_relaxed);
+
+		m_slots[position & (Capacity - 1)].m_sequence.store(position + Capacity, std::memory_order_release);
+		m_head.value.store(position + 1, std::memory_order_relaxed);
+	}
+
+	// consumer only
+	inline bool IsEmpty() const
+	{
+		return Peek() == nullptr;
+	}
+
+	// a snapshot, including packets producers are still copying in
+	inline size_t GetSize() const
+	{
+		size_t head = m_head.value.load(std::memory_order_relaxed);
+		size_t tail = m_tail.value.load(std::memory_order_relaxed);
+
+		return (tail > head) ? (tail - head) : 0;
+	}
+
+	inline size_t GetCapacity() const
+	{
+		return Capacity;
+	}
+
+	PacketRingStatistics GetStatistics() const
+	{
+		PacketRingStatistics statistics;
+		statistics.pushed = m_counters.pushed.load(std::memory_order_relaxed);
+		statistics.popped = m_head.value.load(std::memory_order_relaxed);
+		statistics.droppedFull = m_counters.droppedFull.load(std::memory_order_relaxed);
+		statistics.droppedOversized = m_counters.droppedOversized.load(std::memory_order_relaxed);
+		statistics.highWater = m_counters.highWater.load(std::memory_order_relaxed);
+
+		return statistics;
+	}
+};
+}
@@ -9,6 +9,8 @@
 
 #include <DatagramSink.h>
 #include <NetBuffer.h>
+#include <NetBufferView.h>
+#include <NetDispatchTable.h>
 
 #include <SequencedInputDatagramChannel.h>
 #include <SequencedOutputDatagramChannel.h>
@@ -18,8 +20,9 @@ namespace net
 {
 class PeerBase;
 
-typedef std::function<void(PeerBase*, Buffer&)> NetProcessor;
-typedef std::function<void(PeerBase*, Buffer&)> NetGenerator;
+// the dispatch tables' own handler types, so registered callables don't end up behind a std::function as well
+typedef DispatchTable<void(PeerBase*, BufferView&)>::THandler NetProcessor;
+typedef DispatchTable<void(PeerBase*, Buffer&)>::THandler NetGenerator;
 
 class PeerHandler
 {
@@ -30,7 +33,7 @@ private:
 
 private:
 	template<typename TContainer, typename TReceiver>
-	void AddTo(const TContainer& container, const TReceiver& receiver)
+	void AddTo(const TContainer& container, const TReceiver& receiver) const
 	{
 		for (auto&& entry : container)
 		{
@@ -40,19 +43,19 @@ private:
 
 public:
 	template<typename TReceiver>
-	void AddProcessors(const TReceiver& receiver)
+	void AddProcessors(const TReceiver& receiver) const
 	{
 		AddTo(m_processors, receiver);
 	}
 
 	template<typename TReceiver>
-	void AddHandlers(const TReceiver& receiver)
+	void AddGenerators(const TReceiver& receiver) const
 	{
-		AddTo(m_handlers, receiver);
+		AddTo(m_generators, receiver);
 	}
 
 	template<typename TReceiver>
-	void AddComponents(const TReceiver& receiver)
+	void AddComponents(const TReceiver& receiver) const
 	{
 		AddTo(m_components, receiver);
 	}
@@ -62,7 +65,7 @@ public:
 	{
 		uint32_t nameHash = HashRageString(name);
 
-		m_processors.insert(std::make_pair(nameHash, std::function<void(PeerBase*, Buffer&)>(processor)));
+		m_processors.insert(std::make_pair(nameHash, NetProcessor(processor)));
 
 		return nameHash;
 	}
@@ -72,13 +75,15 @@ public:
 	{
 		uint32_t nameHash = RegisterType<TProcess>(name, processor);
 
-		m_generators.insert(std::make_pair(nameHash, std::function<void(PeerBase*, Buffer&)>(generator)));
+		m_generators.insert(std::make_pair(nameHash, NetGenerator(generator)));
+
+		return nameHash;
 	}
 
 	template<typename TComponent, typename... TArgs>
 	void RegisterComponent(TArgs... args)
 	{
-		m_components.push_back(std::make_pair(Instance<TComponent>::GetName(), new TComponent(Args...)));
+		m_components.push_back(std::make_pair(Instance<TComponent>::GetName(), new TComponent(args...)));
 	}
 };
 
@@ -122,15 +127,15 @@ private:
 
 	fwRefContainer<SequencedOutputDatagramChannel> m_outputChannel;
 
-	std::map<uint32_t, NetProcessor> m_processors;
+	DispatchTable<void(PeerBase*, BufferView&)> m_processors;
 
-	std::map<uint32_t, NetGenerator> m_generators;
+	DispatchTable<void(PeerBase*, Buffer&)> m_generators;
 
 	// mapping of shorthand to full packet types (local to remote)
-	std::map<uint32_t, int> m_localToRemoteMapping;
+	std::unordered_map<uint32_t, int> m_localToRemoteMapping;
 
-	// mapping of shorthand to full packet types (remote to local)
-	std::map<int, uint32_t> m_remoteToLocalMapping;
+	// mapping of remote shorthand types to indices in m_processors, or -1 for types we can't handle
+	std::vector<int> m_remoteToLocalMapping;
 
 	fwRefContainer<RefInstanceRegistry> m_components;
 
@@ -141,9 +146,9 @@ private:
 
 	void ProcessEncapsulatedPacket(const std::vector<uint8_t>& buffer);
 
-	void ProcessMappingPacket(Buffer& buffer);
+	void ProcessMappingPacket(BufferView& buffer);
 
-	int ReadCompressedType(Buffer& buffer);
+	int ReadCompressedType(BufferView& buffer);
 
 public:
 	PeerBase(const fwRefContainer<DatagramSink>& outSink);
@@ -0,0 +1,128 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace net
+{
+//
+// A bounded queue between exactly one producer thread and one consumer thread, without any locks: both ends only
+// ever write their own index, and read the other one's. Capacity has to be a power of two.
+//
+// Pushing to a full queue fails instead of blocking or growing - what to do then is up to the producer.
+//
+template<typename T, size_t Capacity>
+class SpscQueue
+{
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two");
+
+private:
+	// keep both indices on their own cache line, so the two threads don't keep taking it from each other - this
+	// pads instead of using alignas, as over-aligned members would need aligned allocation of whatever holds the queue
+	struct Index
+	{
+		std::atomic<size_t> value;
+
+		// the last value seen of the other end's index, to not touch its cache line unless needed
+		size_t cachedOther;
+
+		char padding[64 - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+	};
+
+	char m_padding[64];
+
+	Index m_head;
+
+	Index m_tail;
+
+	std::unique_ptr<T[]> m_items;
+
+public:
+	SpscQueue()
+		: m_items(new T[Capacity])
+	{
+		m_head.value = 0;
+		m_head.cachedOther = 0;
+
+		m_tail.value = 0;
+		m_tail.cachedOther = 0;
+	}
+
+	SpscQueue(const SpscQueue&) = delete;
+
+	SpscQueue& operator=(const SpscQueue&) = delete;
+
+	// producer only
+	template<typename TItem>
+	bool TryPush(TItem&& item)
+	{
+		size_t tail = m_tail.value.load(std::memory_order_relaxed);
+
+		if (tail - m_tail.cachedOther == Capacity)
+		{
+			m_tail.cachedOther = m_head.value.load(std::memory_order_acquire);
+
+			if (tail - m_tail.cachedOther == Capacity)
+			{
+				return false;
+			}
+		}
+
+		m_items[tail & (Capacity - 1)] = std::forward<TItem>(item);
+
+		m_tail.value.store(tail + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	// consumer only
+	bool TryPop(T& item)
+	{
+		size_t head = m_head.value.load(std::memory_order_relaxed);
+
+		if (head == m_head.cachedOther)
+		{
+			m_head.cachedOther = m_tail.value.load(std::memory_order_acquire);
+
+			if (head == m_head.cachedOther)
+			{
+				return false;
+			}
+		}
+
+		item = std::move(m_items[head & (Capacity - 1)]);
+
+		m_head.value.store(head + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	// exact when called from either end while the other one is idle, a snapshot otherwise
+	inline size_t GetSize() const
+	{
+		size_t head = m_head.value.load(std::memory_order_acquire);
+		size_t tail = m_tail.value.load(std::memory_order_acquire);
+
+		return tail - head;
+	}
+
+	inline bool IsEmpty() const
+	{
+		return GetSize() == 0;
+	}
+
+	inline size_t GetCapacity() const
+	{
+		return Capacity;
+	}
+};
+}
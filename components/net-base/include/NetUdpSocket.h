@@ -12,6 +12,82 @@
 
 namespace net
 {
+//
+// A caller-owned arena of fixed-size datagram slots for batched sends and receives. Keeping one around and
+// reusing it means batching doesn't allocate at all.
+//
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	UdpPacketBatch
+{
+	friend class UdpSocket;
+
+private:
+	std::vector<uint8_t> m_data;
+
+	size_t m_slotSize;
+
+	size_t m_count;
+
+	std::vector<size_t> m_lengths;
+
+	std::vector<sockaddr_storage> m_addresses;
+
+	std::vector<socklen_t> m_addressLengths;
+
+#ifdef __linux__
+	// message headers for recvmmsg/sendmmsg, pointing into the slots above
+	std::vector<mmsghdr> m_messages;
+
+	std::vector<iovec> m_vectors;
+#endif
+
+public:
+	UdpPacketBatch(size_t capacity, size_t slotSize = 1500);
+
+	inline size_t GetCapacity() const
+	{
+		return m_lengths.size();
+	}
+
+	inline size_t GetSlotSize() const
+	{
+		return m_slotSize;
+	}
+
+	inline size_t GetCount() const
+	{
+		return m_count;
+	}
+
+	inline void Clear()
+	{
+		m_count = 0;
+	}
+
+	inline const uint8_t* GetData(size_t index) const
+	{
+		return &m_data[index * m_slotSize];
+	}
+
+	inline size_t GetLength(size_t index) const
+	{
+		return m_lengths[index];
+	}
+
+	inline PeerAddress GetAddress(size_t index) const
+	{
+		return PeerAddress(reinterpret_cast<const sockaddr*>(&m_addresses[index]), m_addressLengths[index]);
+	}
+
+	//
+	// Copies a datagram into the next free slot, returning false if the batch is full or the datagram doesn't fit.
+	//
+	bool Add(const uint8_t* data, size_t length, const PeerAddress& address);
+};
+
 class
 #ifdef COMPILING_NET_BASE
 	DLL_EXPORT
@@ -23,6 +99,10 @@ private:
 
 	AddressFamily m_addressFamily;
 
+	uint64_t m_systemCalls;
+
+	uint64_t m_truncatedDatagrams;
+
 public:
 	UdpSocket(AddressFamily addressFamily = AddressFamily::IPv4);
 
@@ -44,5 +124,32 @@ public:
 	boost::optional<std::vector<uint8_t>> ReceiveFrom(size_t size, PeerAddress* outAddress);
 
 	bool SendTo(const std::vector<uint8_t>& data, const PeerAddress& outAddress);
+
+	//
+	// Replaces the batch's contents with as many datagrams as it has room for, waiting only for the first one.
+	// Datagrams larger than the batch's slots get dropped. Returns the amount of datagrams received.
+	//
+	size_t ReceiveBatch(UdpPacketBatch& batch);
+
+	//
+	// Sends all datagrams in the batch, returning how many of them were sent.
+	//
+	size_t SendBatch(UdpPacketBatch& batch);
+
+	//
+	// Gets the amount of send/receive system calls made on this socket, for measuring batching efficiency.
+	//
+	inline uint64_t GetSystemCallCount() const
+	{
+		return m_systemCalls;
+	}
+
+	//
+	// Gets the amount of datagrams ReceiveBatch dropped for not fitting into a slot.
+	//
+	inline uint64_t GetTruncatedCount() const
+	{
+		return m_truncatedDatagrams;
+	}
 };
 }
\ No newline at end of file
@@ -0,0 +1,308 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include "DatagramSink.h"
+
+#include <deque>
+#include <functional>
+#include <map>
+
+namespace net
+{
+enum class DeliveryMode : uint8_t
+{
+	// may get lost, duplicated or arrive out of order
+	Unreliable = 0,
+
+	// may get lost, but anything older than the newest message delivered so far is dropped
+	Sequenced = 1,
+
+	// always arrives, exactly once and in order
+	ReliableOrdered = 2
+};
+
+struct ReliableChannelStatistics
+{
+	uint64_t packetsSent;
+
+	uint64_t packetsReceived;
+
+	uint64_t retransmissions;
+
+	uint64_t messagesDelivered;
+
+	// duplicate, stale or malformed packets/messages that got dropped
+	uint64_t dropped;
+
+	// reliable messages refused by Send as too much was still waiting for acknowledgement
+	uint64_t sendsRefused;
+};
+
+//
+// A message channel over an unreliable datagram transport. Messages are sent on one of several lanes, each with
+// its own DeliveryMode, and may be larger than a datagram - they get split into fragments and reassembled on
+// the other end. Reliable fragments are acknowledged selectively and retransmitted after an RTT-based timeout.
+//
+// The channel never looks at the clock itself: all times are passed in by the caller (in milliseconds), and
+// Update has to be called regularly to send acknowledgements and retransmissions. Both ends have to use the
+// same maximum datagram size. This is not thread-safe.
+//
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	ReliableDatagramChannel : public fwRefCountable
+{
+public:
+	static const size_t kLaneCount = 8;
+
+	// packet sequence, ack sequence and ack bits, followed by the message header
+	static const size_t kPacketHeaderSize = 12;
+
+	// flags, lane, message sequence, and fragment index/count if fragmented
+	static const size_t kMessageHeaderSize = 4;
+
+	static const size_t kFragmentHeaderSize = 4;
+
+	// the largest message either end will send or reassemble
+	static const size_t kMaxMessageSize = 1024 * 1024;
+
+	// reliable messages that may wait for acknowledgement at once, about what the other end is willing to buffer
+	static const size_t kMaxPendingReliableMessages = 4096;
+
+	static const size_t kDefaultMaxPendingReliableBytes = 16 * kMaxMessageSize;
+
+	typedef std::function<void(uint8_t lane, const std::vector<uint8_t>& message)> TMessageCallback;
+
+private:
+	struct OutgoingFragment
+	{
+		uint64_t lastSendTime;
+
+		uint32_t retries;
+
+		bool acked;
+	};
+
+	struct OutgoingMessage
+	{
+		uint8_t lane;
+
+		uint16_t sequence;
+
+		std::vector<uint8_t> data;
+
+		std::vector<OutgoingFragment> fragments;
+
+		size_t fragmentsLeft;
+	};
+
+	// sent packets, indexed by their sequence modulo the window size
+	struct SentPacket
+	{
+		uint32_t sequence;
+
+		uint32_t messageId;
+
+		uint16_t fragment;
+
+		// cleared once acknowledged
+		bool reliable;
+
+		uint64_t sendTime;
+	};
+
+	struct Reassembly
+	{
+		std::vector<uint8_t> data;
+
+		std::vector<bool> received;
+
+		size_t fragmentsLeft;
+
+		size_t length;
+
+		// the payload received so far, counted against the lane's buffer budget
+		size_t receivedBytes;
+
+		uint64_t startTime;
+	};
+
+	struct Lane
+	{
+		DeliveryMode mode;
+
+		uint16_t nextSequence;
+
+		// the next sequence to deliver - or for Sequenced lanes, the newest one delivered plus one
+		uint16_t nextExpected;
+
+		// reliable messages that arrived ahead of one still missing
+		std::map<uint16_t, std::vector<uint8_t>> pending;
+
+		std::map<uint16_t, Reassembly> reassemblies;
+
+		// bytes held in pending messages and reassemblies
+		size_t bufferedBytes;
+	};
+
+private:
+	fwRefContainer<DatagramSink> m_sink;
+
+	TMessageCallback m_messageCallback;
+
+	size_t m_maxDatagramSize;
+
+	Lane m_lanes[kLaneCount];
+
+	// outgoing packet state
+	uint32_t m_nextPacketSequence;
+
+	std::vector<SentPacket> m_sentPackets;
+
+	// reliable messages still waiting for acks, the first one having m_firstMessageId
+	std::deque<OutgoingMessage> m_outgoingMessages;
+
+	uint32_t m_firstMessageId;
+
+	// the data held by m_outgoingMessages
+	size_t m_outgoingBytes;
+
+	size_t m_maxOutgoingBytes;
+
+	// incoming packet state, to be acknowledged
+	bool m_receivedAny;
+
+	uint32_t m_remoteSequence;
+
+	uint32_t m_receivedBits;
+
+	uint32_t m_unackedPackets;
+
+	// round-trip estimation, as in RFC 6298
+	bool m_hasRttSample;
+
+	double m_smoothedRtt;
+
+	double m_rttVariance;
+
+	uint64_t m_minRetransmitTimeout;
+
+	// reassembly/delivery buffers, kept around so they don't get allocated over and over
+	std::vector<std::vector<uint8_t>> m_freeBuffers;
+
+	std::vector<uint8_t> m_packetBuffer;
+
+	ReliableChannelStatistics m_statistics;
+
+private:
+	inline size_t GetFragmentPayloadSize() const
+	{
+		return m_maxDatagramSize - kPacketHeaderSize - kMessageHeaderSize - kFragmentHeaderSize;
+	}
+
+	inline size_t GetMaxFragmentCount() const
+	{
+		return (kMaxMessageSize + GetFragmentPayloadSize() - 1) / GetFragmentPayloadSize();
+	}
+
+	std::vector<uint8_t> AcquireBuffer();
+
+	void ReleaseBuffer(std::vector<uint8_t>&& buffer);
+
+	void SendFragment(uint8_t lane, DeliveryMode mode, uint16_t sequence, const uint8_t* data, size_t length,
+		uint16_t fragmentIndex, uint16_t fragmentCount, uint32_t messageId, uint64_t now);
+
+	void SendAck();
+
+	void WritePacketHeader(uint32_t sequence);
+
+	bool IsDuplicatePacket(uint32_t sequence) const;
+
+	void RecordReceivedPacket(uint32_t sequence);
+
+	// returns false if a reliable message got refused for lack of buffer space, so its packet shouldn't be acknowledged
+	bool ReceiveMessage(uint8_t lane, uint8_t flags, uint16_t sequence, const std::vector<uint8_t>& packet, uint64_t now);
+
+	void DropReassembly(Lane& lane, std::map<uint16_t, Reassembly>::iterator it);
+
+	void ProcessAck(uint32_t ackSequence, uint32_t ackBits, uint64_t now);
+
+	void AcknowledgeFragment(uint32_t sequence, uint64_t now);
+
+	void AddRttSample(double rtt);
+
+	void ProcessMessage(uint8_t lane, uint16_t sequence, std::vector<uint8_t>&& message);
+
+	void Deliver(uint8_t lane, std::vector<uint8_t>&& message);
+
+public:
+	ReliableDatagramChannel(size_t maxDatagramSize = 1300);
+
+	virtual ~ReliableDatagramChannel();
+
+	inline void SetSink(const fwRefContainer<DatagramSink>& sink)
+	{
+		m_sink = sink;
+	}
+
+	inline void SetMessageCallback(const TMessageCallback& callback)
+	{
+		m_messageCallback = callback;
+	}
+
+	// lanes default to ReliableOrdered - both ends have to agree on the mode
+	void SetLaneMode(uint8_t lane, DeliveryMode mode);
+
+	// a peer that's gone or can't keep up would otherwise make reliable messages pile up forever
+	inline void SetMaxPendingReliableBytes(size_t bytes)
+	{
+		m_maxOutgoingBytes = bytes;
+	}
+
+	//
+	// Sends a message right away, returning false if it's larger than kMaxMessageSize or the lane is invalid.
+	// Reliable messages also get refused while too many (or too much data) are still waiting for acknowledgement,
+	// which is up to the caller to treat as the connection having failed, or to try again later.
+	//
+	bool Send(uint8_t lane, const uint8_t* data, size_t length, uint64_t now);
+
+	void ProcessPacket(const std::vector<uint8_t>& packet, uint64_t now);
+
+	//
+	// Retransmits timed-out reliable fragments, sends pending acknowledgements and drops stale unreliable
+	// reassemblies. Reliable ones never time out: their fragments got acknowledged, so they're bounded by
+	// refusing to buffer any more instead.
+	//
+	void Update(uint64_t now);
+
+	uint64_t GetRetransmitTimeout() const;
+
+	inline double GetSmoothedRtt() const
+	{
+		return m_smoothedRtt;
+	}
+
+	// reliable messages that haven't been fully acknowledged yet
+	inline size_t GetPendingReliableCount() const
+	{
+		return m_outgoingMessages.size();
+	}
+
+	inline size_t GetPendingReliableBytes() const
+	{
+		return m_outgoingBytes;
+	}
+
+	inline const ReliableChannelStatistics& GetStatistics() const
+	{
+		return m_statistics;
+	}
+};
+}
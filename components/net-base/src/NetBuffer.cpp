@@ -63,7 +63,7 @@ bool Buffer::Read(void* buffer, size_t length)
 		// and if it really doesn't fit out of our buffer
 		if ((m_curOff + length) > m_bytes->size())
 		{
-			memset(buffer, 0xCE, sizeof(length));
+			memset(buffer, 0xCE, length);
 			return false;
 		}
 	}
@@ -0,0 +1,101 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "NetBufferView.h"
+
+namespace net
+{
+BufferArena::BufferArena(size_t blockSize)
+	: m_blockSize(blockSize), m_curBlock(0), m_curOffset(0)
+{
+
+}
+
+uint8_t* BufferArena::Allocate(size_t length)
+{
+	// find a block with enough space left, moving on (and never back) until the next reset
+	while (m_curBlock < m_blocks.size())
+	{
+		Block& block = m_blocks[m_curBlock];
+
+		if (m_curOffset + length <= block.size)
+		{
+			uint8_t* data = block.data.get() + m_curOffset;
+			m_curOffset += length;
+
+			return data;
+		}
+
+		m_curBlock++;
+		m_curOffset = 0;
+	}
+
+	Block block;
+	block.size = std::max(m_blockSize, length);
+	block.data = std::make_unique<uint8_t[]>(block.size);
+
+	m_blocks.push_back(std::move(block));
+
+	m_curBlock = m_blocks.size() - 1;
+	m_curOffset = length;
+
+	return m_blocks.back().data.get();
+}
+
+void BufferArena::Reset()
+{
+	m_curBlock = 0;
+	m_curOffset = 0;
+}
+
+size_t BufferArena::GetCapacity() const
+{
+	size_t capacity = 0;
+
+	for (auto& block : m_blocks)
+	{
+		capacity += block.size;
+	}
+
+	return capacity;
+}
+
+uint64_t BufferView::ReadVarInt()
+{
+	uint64_t value = 0;
+
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		uint8_t byte = Read<uint8_t>();
+		value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+		if (!(byte & 0x80))
+		{
+			break;
+		}
+	}
+
+	return value;
+}
+
+bool BufferWriter::WriteVarInt(uint64_t value)
+{
+	uint8_t bytes[10];
+	size_t length = 0;
+
+	do
+	{
+		uint8_t byte = value & 0x7F;
+		value >>= 7;
+
+		bytes[length++] = byte | ((value != 0) ? 0x80 : 0);
+	} while (value != 0);
+
+	return Write(bytes, length);
+}
+}
@@ -0,0 +1,128 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "NetHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace net
+{
+HistogramSnapshot::HistogramSnapshot()
+	: m_count(0), m_sum(0), m_max(0)
+{
+
+}
+
+uint64_t HistogramSnapshot::GetQuantile(double quantile) const
+{
+	if (m_count == 0)
+	{
+		return 0;
+	}
+
+	uint64_t rank = static_cast<uint64_t>(std::ceil(std::min(std::max(quantile, 0.0), 1.0) * m_count));
+	rank = std::max<uint64_t>(rank, 1);
+
+	uint64_t seen = 0;
+
+	for (size_t i = 0; i < m_buckets.size(); i++)
+	{
+		seen += m_buckets[i];
+
+		if (seen >= rank)
+		{
+			return std::min(Histogram::GetBucketUpperBound(i), m_max);
+		}
+	}
+
+	return m_max;
+}
+
+Histogram::Histogram()
+{
+	Reset();
+}
+
+void Histogram::Reset()
+{
+	for (auto& bucket : m_buckets)
+	{
+		bucket.store(0, std::memory_order_relaxed);
+	}
+
+	m_sum.store(0, std::memory_order_relaxed);
+	m_max.store(0, std::memory_order_relaxed);
+}
+
+int Histogram::GetBucketIndex(uint64_t value)
+{
+	value = std::min<uint64_t>(value, 1ULL << kMaxValueBits);
+
+	if (value < kSubBucketCount)
+	{
+		return static_cast<int>(value);
+	}
+
+	int highestBit = 0;
+
+	for (uint64_t v = value; v > 1; v >>= 1)
+	{
+		highestBit++;
+	}
+
+	int shift = highestBit - kSubBucketBits;
+	int index = kSubBucketCount + (shift * kSubBucketCount) + static_cast<int>((value >> shift) - kSubBucketCount);
+
+	return std::min(index, kBucketCount - 1);
+}
+
+uint64_t Histogram::GetBucketUpperBound(int index)
+{
+	if (index < kSubBucketCount)
+	{
+		return index;
+	}
+
+	int shift = (index - kSubBucketCount) / kSubBucketCount;
+	uint64_t subBucket = (index - kSubBucketCount) % kSubBucketCount;
+
+	return ((kSubBucketCount + subBucket + 1) << shift) - 1;
+}
+
+void Histogram::Record(uint64_t value)
+{
+	m_buckets[GetBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+
+	m_sum.fetch_add(value, std::memory_order_relaxed);
+
+	uint64_t max = m_max.load(std::memory_order_relaxed);
+
+	while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+	{
+	}
+}
+
+HistogramSnapshot Histogram::GetSnapshot() const
+{
+	HistogramSnapshot snapshot;
+	snapshot.m_buckets.resize(kBucketCount);
+
+	// count from the buckets, so quantiles add up even if values get recorded while we're copying
+	for (int i = 0; i < kBucketCount; i++)
+	{
+		snapshot.m_buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+		snapshot.m_count += snapshot.m_buckets[i];
+	}
+
+	snapshot.m_sum = m_sum.load(std::memory_order_relaxed);
+	snapshot.m_max = m_max.load(std::memory_order_relaxed);
+
+	return snapshot;
+}
+}
@@ -0,0 +1,179 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "NetMetrics.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace net
+{
+ConnectionMetrics::ConnectionMetrics(const std::string& name)
+	: m_name(name)
+{
+
+}
+
+void ConnectionMetrics::Reset()
+{
+	for (auto& histogram : m_histograms)
+	{
+		histogram.Reset();
+	}
+}
+
+fwRefContainer<ConnectionMetrics> MetricsRegistry::CreateConnection(const std::string& name)
+{
+	fwRefContainer<ConnectionMetrics> connection = new ConnectionMetrics(name);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_connections.push_back(connection);
+
+	return connection;
+}
+
+void MetricsRegistry::RemoveConnection(const fwRefContainer<ConnectionMetrics>& connection)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_connections.erase(std::remove_if(m_connections.begin(), m_connections.end(), [&] (const fwRefContainer<ConnectionMetrics>& entry)
+	{
+		return entry.GetRef() == connection.GetRef();
+	}), m_connections.end());
+}
+
+void MetricsRegistry::ForEachConnection(const std::function<void(const fwRefContainer<ConnectionMetrics>&)>& callback)
+{
+	// call back on a copy, so callbacks can take their time or even remove connections
+	std::vector<fwRefContainer<ConnectionMetrics>> connections;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		connections = m_connections;
+	}
+
+	for (auto& connection : connections)
+	{
+		callback(connection);
+	}
+}
+
+const char* MetricsRegistry::GetMetricName(ConnectionMetric metric)
+{
+	switch (metric)
+	{
+		case ConnectionMetric::Rtt:
+			return "rtt_milliseconds";
+		case ConnectionMetric::IncomingPacketSize:
+			return "incoming_packet_size_bytes";
+		case ConnectionMetric::OutgoingPacketSize:
+			return "outgoing_packet_size_bytes";
+		case ConnectionMetric::ReliableResends:
+			return "reliable_resends";
+		case ConnectionMetric::FragmentCount:
+			return "fragment_count";
+		case ConnectionMetric::QueueDepth:
+			return "queue_depth";
+		default:
+			return "unknown";
+	}
+}
+
+static const char* GetMetricHelp(ConnectionMetric metric)
+{
+	switch (metric)
+	{
+		case ConnectionMetric::Rtt:
+			return "Round-trip time to the remote end.";
+		case ConnectionMetric::IncomingPacketSize:
+			return "Size of received datagrams on the wire.";
+		case ConnectionMetric::OutgoingPacketSize:
+			return "Size of sent datagrams on the wire.";
+		case ConnectionMetric::ReliableResends:
+			return "Times a reliable command was resent before being acknowledged.";
+		case ConnectionMetric::FragmentCount:
+			return "Datagrams a sent message was split into.";
+		case ConnectionMetric::QueueDepth:
+			return "Messages waiting in a queue between threads.";
+		default:
+			return "";
+	}
+}
+
+// label values may contain anything but have to escape backslashes, quotes and line breaks
+static std::string EscapeLabel(const std::string& value)
+{
+	std::string escaped;
+	escaped.reserve(value.size());
+
+	for (char c : value)
+	{
+		switch (c)
+		{
+			case '\\':
+				escaped += "\\\\";
+				break;
+			case '"':
+				escaped += "\\\"";
+				break;
+			case '\n':
+				escaped += "\\n";
+				break;
+			default:
+				escaped += c;
+				break;
+		}
+	}
+
+	return escaped;
+}
+
+std::string MetricsRegistry::FormatPrometheus()
+{
+	static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+	std::vector<fwRefContainer<ConnectionMetrics>> connections;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		connections = m_connections;
+	}
+
+	std::ostringstream output;
+
+	for (int i = 0; i < static_cast<int>(ConnectionMetric::Max); i++)
+	{
+		auto metric = static_cast<ConnectionMetric>(i);
+		std::string name = std::string("citizen_net_") + GetMetricName(metric);
+
+		output << "# HELP " << name << " " << GetMetricHelp(metric) << "\n";
+		output << "# TYPE " << name << " summary\n";
+
+		for (auto& connection : connections)
+		{
+			auto snapshot = connection->GetHistogram(metric).GetSnapshot();
+			std::string label = "connection=\"" + EscapeLabel(connection->GetName()) + "\"";
+
+			for (double quantile : quantiles)
+			{
+				output << name << "{" << label << ",quantile=\"" << quantile << "\"} " << snapshot.GetQuantile(quantile) << "\n";
+			}
+
+			output << name << "_sum{" << label << "} " << snapshot.GetSum() << "\n";
+			output << name << "_count{" << label << "} " << snapshot.GetCount() << "\n";
+		}
+	}
+
+	return output.str();
+}
+}
+
+static InitFunction initFunction([] ()
+{
+	Instance<net::MetricsRegistry>::Set(new net::MetricsRegistry());
+}, -5000);
@@ -21,12 +21,30 @@ PeerBase::PeerBase(const fwRefContainer<DatagramSink>& outSink)
 	m_outputChannel->SetSink(outSink);
 }
 
+void PeerBase::RegisterHandlerInternal(const PeerHandler& trait)
+{
+	trait.AddProcessors([&] (uint32_t type, const NetProcessor& processor)
+	{
+		m_processors.Register(type, processor);
+	});
+
+	trait.AddGenerators([&] (uint32_t type, const NetGenerator& generator)
+	{
+		m_generators.Register(type, generator);
+	});
+
+	trait.AddComponents([&] (const char* name, const fwRefContainer<fwRefCountable>& component)
+	{
+		m_components->SetInstance(name, component);
+	});
+}
+
 void PeerBase::ProcessPacket(const std::vector<uint8_t>& buffer)
 {
 	m_inputChannel->ProcessPacket(buffer);
 }
 
-int PeerBase::ReadCompressedType(Buffer& buffer)
+int PeerBase::ReadCompressedType(BufferView& buffer)
 {
 	uint8_t lead = buffer.Read<uint8_t>();
 	int result;
@@ -40,13 +58,18 @@ int PeerBase::ReadCompressedType(Buffer& buffer)
 		result = buffer.Read<uint8_t>() << 7;
 		result |= (lead & ~0x80);
 	}
+	else
+	{
+		result = lead;
+	}
 
 	return result;
 }
 
 void PeerBase::ProcessEncapsulatedPacket(const std::vector<uint8_t>& buffer)
 {
-	Buffer netBuffer(buffer);
+	// the packet outlives this call, so there's no need to copy it
+	BufferView netBuffer(buffer);
 
 	// if we don't have a list of remote trusted packets, only expect such
 	if (m_remoteToLocalMapping.empty())
@@ -57,10 +80,22 @@ void PeerBase::ProcessEncapsulatedPacket(const std::vector<uint8_t>& buffer)
 		{
 			ProcessMappingPacket(netBuffer);
 		}
+
+		return;
+	}
+
+	// past the handshake, a remote type maps straight to a handler index
+	int type = ReadCompressedType(netBuffer);
+
+	if (type < 0 || type >= static_cast<int>(m_remoteToLocalMapping.size()) || m_remoteToLocalMapping[type] < 0)
+	{
+		return;
 	}
+
+	m_processors.DispatchIndex(m_remoteToLocalMapping[type], this, netBuffer);
 }
 
-void PeerBase::ProcessMappingPacket(Buffer& buffer)
+void PeerBase::ProcessMappingPacket(BufferView& buffer)
 {
 	// while the packet type isn't -1
 	int type;
@@ -73,12 +108,19 @@ void PeerBase::ProcessMappingPacket(Buffer& buffer)
 		{
 			uint32_t mappedType = buffer.Read<uint32_t>();
 
-			if (m_processors.find(mappedType) == m_processors.end())
+			int index = m_processors.GetIndex(mappedType);
+
+			if (index < 0)
 			{
 				trace("Peer %s knows to send mapped type 0x%08x, but we don't know to handle it...\n", GetName().c_str(), mappedType);
 			}
 
-			m_remoteToLocalMapping[type] = mappedType;
+			if (type >= static_cast<int>(m_remoteToLocalMapping.size()))
+			{
+				m_remoteToLocalMapping.resize(type + 1, -1);
+			}
+
+			m_remoteToLocalMapping[type] = index;
 		}
 	} while (type >= 0);
 }
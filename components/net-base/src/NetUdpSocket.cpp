@@ -8,9 +8,41 @@
 #include "StdInc.h"
 #include "NetUdpSocket.h"
 
+#ifndef _WIN32
+#include <sys/ioctl.h>
+#endif
+
 namespace net
 {
+UdpPacketBatch::UdpPacketBatch(size_t capacity, size_t slotSize)
+	: m_data(capacity * slotSize), m_slotSize(slotSize), m_count(0), m_lengths(capacity), m_addresses(capacity), m_addressLengths(capacity)
+#ifdef __linux__
+	, m_messages(capacity), m_vectors(capacity)
+#endif
+{
+
+}
+
+bool UdpPacketBatch::Add(const uint8_t* data, size_t length, const PeerAddress& address)
+{
+	if (m_count >= GetCapacity() || length > m_slotSize)
+	{
+		return false;
+	}
+
+	memcpy(&m_data[m_count * m_slotSize], data, length);
+	m_lengths[m_count] = length;
+
+	memcpy(&m_addresses[m_count], address.GetSocketAddress(), address.GetSocketAddressLength());
+	m_addressLengths[m_count] = address.GetSocketAddressLength();
+
+	m_count++;
+
+	return true;
+}
+
 UdpSocket::UdpSocket(AddressFamily addressFamily)
+	: m_systemCalls(0), m_truncatedDatagrams(0)
 {
 	EnsureNetInitialized();
 
@@ -81,6 +113,8 @@ bool UdpSocket::ReceiveFrom(std::vector<uint8_t>& outArray, int* outLength, Peer
 	sockaddr_storage fromAddr = { 0 };
 	socklen_t fromLen = sizeof(fromAddr);
 
+	m_systemCalls++;
+
 	int len = recvfrom(m_socket, reinterpret_cast<char*>(&outArray[0]), outArray.size(), 0, reinterpret_cast<sockaddr*>(&fromAddr), &fromLen);
 
 	if (len < 0)
@@ -121,7 +155,7 @@ boost::optional<std::vector<uint8_t>> UdpSocket::ReceiveFrom(size_t size, PeerAd
 	{
 		outBuffer.resize(outLength);
 
-		retval = outBuffer;
+		retval = std::move(outBuffer);
 	}
 
 	return retval;
@@ -136,6 +170,8 @@ bool UdpSocket::SendTo(const std::vector<uint8_t>& data, const PeerAddress& outA
 		return false;
 	}
 
+	m_systemCalls++;
+
 	int len = sendto(m_socket, reinterpret_cast<const char*>(&data[0]), data.size(), 0, outAddress.GetSocketAddress(), outAddress.GetSocketAddressLength());
 
 	if (len < 0)
@@ -144,7 +180,7 @@ bool UdpSocket::SendTo(const std::vector<uint8_t>& data, const PeerAddress& outA
 
 		if (lastError != EAGAIN)
 		{
-			trace("Failed to send to socket - error code %d.\n");
+			trace("Failed to send to socket - error code %d.\n", lastError);
 
 			return false;
 		}
@@ -152,4 +188,210 @@ bool UdpSocket::SendTo(const std::vector<uint8_t>& data, const PeerAddress& outA
 
 	return true;
 }
+
+size_t UdpSocket::ReceiveBatch(UdpPacketBatch& batch)
+{
+	batch.Clear();
+
+	if (!IsValidSocket())
+	{
+		trace("Failed to receive from socket - socket is not valid.\n");
+
+		return 0;
+	}
+
+#ifdef __linux__
+	size_t capacity = batch.GetCapacity();
+
+	// the batch may have been copied or moved since, so point the headers at the slots every time
+	for (size_t i = 0; i < capacity; i++)
+	{
+		iovec& vector = batch.m_vectors[i];
+		vector.iov_base = &batch.m_data[i * batch.m_slotSize];
+		vector.iov_len = batch.m_slotSize;
+
+		msghdr& message = batch.m_messages[i].msg_hdr;
+		memset(&message, 0, sizeof(message));
+
+		message.msg_name = &batch.m_addresses[i];
+		message.msg_namelen = sizeof(sockaddr_storage);
+		message.msg_iov = &vector;
+		message.msg_iovlen = 1;
+	}
+
+	m_systemCalls++;
+
+	// only wait for the first datagram, and take whatever else is pending along with it
+	int count = recvmmsg(m_socket, batch.m_messages.data(), capacity, MSG_WAITFORONE, nullptr);
+
+	if (count < 0)
+	{
+		int lastError = GetLastNetError();
+
+		if (lastError != EAGAIN)
+		{
+			trace("Failed to receive from socket - error code %d.\n", lastError);
+		}
+
+		return 0;
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		// the rest of a datagram larger than the slot is gone, so what's left can't be used
+		if (batch.m_messages[i].msg_hdr.msg_flags & MSG_TRUNC)
+		{
+			m_truncatedDatagrams++;
+			continue;
+		}
+
+		size_t index = batch.m_count;
+
+		// keep the batch dense by moving later datagrams over dropped ones
+		if (index != static_cast<size_t>(i))
+		{
+			memmove(&batch.m_data[index * batch.m_slotSize], &batch.m_data[i * batch.m_slotSize], batch.m_messages[i].msg_len);
+			batch.m_addresses[index] = batch.m_addresses[i];
+		}
+
+		batch.m_lengths[index] = batch.m_messages[i].msg_len;
+		batch.m_addressLengths[index] = batch.m_messages[i].msg_hdr.msg_namelen;
+
+		batch.m_count++;
+	}
+#else
+	while (batch.m_count < batch.GetCapacity())
+	{
+		size_t index = batch.m_count;
+
+		// don't block for anything but the first datagram
+		if (index > 0)
+		{
+#ifdef _WIN32
+			u_long pending = 0;
+			ioctlsocket(m_socket, FIONREAD, &pending);
+#else
+			int pending = 0;
+			ioctl(m_socket, FIONREAD, &pending);
+#endif
+
+			m_systemCalls++;
+
+			if (pending == 0)
+			{
+				break;
+			}
+		}
+
+		socklen_t fromLen = sizeof(sockaddr_storage);
+
+		m_systemCalls++;
+
+		int len = recvfrom(m_socket, reinterpret_cast<char*>(&batch.m_data[index * batch.m_slotSize]), batch.m_slotSize, 0,
+			reinterpret_cast<sockaddr*>(&batch.m_addresses[index]), &fromLen);
+
+		if (len < 0)
+		{
+			int lastError = GetLastNetError();
+
+#ifdef _WIN32
+			// the datagram didn't fit into the slot, and what did is of no use
+			if (lastError == WSAEMSGSIZE)
+			{
+				m_truncatedDatagrams++;
+				continue;
+			}
+#endif
+
+			if (lastError != EAGAIN)
+			{
+				trace("Failed to receive from socket - error code %d.\n", lastError);
+			}
+
+			break;
+		}
+
+		batch.m_lengths[index] = len;
+		batch.m_addressLengths[index] = fromLen;
+
+		batch.m_count++;
+	}
+#endif
+
+	return batch.m_count;
+}
+
+size_t UdpSocket::SendBatch(UdpPacketBatch& batch)
+{
+	if (!IsValidSocket())
+	{
+		trace("Failed to send to socket - socket is not valid.\n");
+
+		return 0;
+	}
+
+	size_t count = batch.GetCount();
+	size_t sent = 0;
+
+#ifdef __linux__
+	for (size_t i = 0; i < count; i++)
+	{
+		iovec& vector = batch.m_vectors[i];
+		vector.iov_base = &batch.m_data[i * batch.m_slotSize];
+		vector.iov_len = batch.m_lengths[i];
+
+		msghdr& message = batch.m_messages[i].msg_hdr;
+		memset(&message, 0, sizeof(message));
+
+		message.msg_name = &batch.m_addresses[i];
+		message.msg_namelen = batch.m_addressLengths[i];
+		message.msg_iov = &vector;
+		message.msg_iovlen = 1;
+	}
+
+	// sendmmsg may stop short, so keep going until everything is out or we get an error
+	while (sent < count)
+	{
+		m_systemCalls++;
+
+		int result = sendmmsg(m_socket, &batch.m_messages[sent], count - sent, 0);
+
+		if (result <= 0)
+		{
+			int lastError = GetLastNetError();
+
+			if (lastError != EAGAIN)
+			{
+				trace("Failed to send to socket - error code %d.\n", lastError);
+			}
+
+			break;
+		}
+
+		sent += result;
+	}
+#else
+	for (; sent < count; sent++)
+	{
+		m_systemCalls++;
+
+		int len = sendto(m_socket, reinterpret_cast<const char*>(batch.GetData(sent)), batch.m_lengths[sent], 0,
+			reinterpret_cast<const sockaddr*>(&batch.m_addresses[sent]), batch.m_addressLengths[sent]);
+
+		if (len < 0)
+		{
+			int lastError = GetLastNetError();
+
+			if (lastError != EAGAIN)
+			{
+				trace("Failed to send to socket - error code %d.\n", lastError);
+			}
+
+			break;
+		}
+	}
+#endif
+
+	return sent;
+}
 }
\ No newline at end of file
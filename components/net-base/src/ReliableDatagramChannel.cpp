@@ -0,0 +1,760 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "ReliableDatagramChannel.h"
+
+// message header flags
+enum : uint8_t
+{
+	FlagModeMask = 0x03,
+	FlagFragmented = 0x04,
+	FlagAckOnly = 0x08,
+	FlagHasAck = 0x10
+};
+
+// the amount of sent packets we can match acknowledgements against
+static const size_t kSentPacketWindow = 1024;
+
+// the furthest a reliable message may be ahead of the next one to deliver
+static const int kMaxReliableLookahead = 4096;
+
+// acknowledge right away after this many packets, so the sender's view doesn't fall behind our ack bits
+static const uint32_t kMaxUnackedPackets = 16;
+
+// incomplete unreliable messages get dropped after this long
+static const uint64_t kReassemblyTimeout = 5000;
+
+// messages being reassembled at once on a single lane
+static const size_t kMaxReassembliesPerLane = 32;
+
+// what a lane may buffer for messages it can't deliver yet - the next reliable message always gets through
+static const size_t kMaxLaneBufferSize = 4 * net::ReliableDatagramChannel::kMaxMessageSize;
+
+static const uint64_t kInitialRetransmitTimeout = 200;
+
+static const uint64_t kMaxRetransmitTimeout = 2000;
+
+template<typename T>
+static inline void AppendValue(std::vector<uint8_t>& buffer, T value)
+{
+	size_t offset = buffer.size();
+	buffer.resize(offset + sizeof(T));
+
+	memcpy(&buffer[offset], &value, sizeof(T));
+}
+
+template<typename T>
+static inline T ReadValue(const uint8_t* data)
+{
+	T value;
+	memcpy(&value, data, sizeof(T));
+
+	return value;
+}
+
+namespace net
+{
+ReliableDatagramChannel::ReliableDatagramChannel(size_t maxDatagramSize)
+	: m_maxDatagramSize(maxDatagramSize), m_nextPacketSequence(0), m_sentPackets(kSentPacketWindow), m_firstMessageId(0),
+	  m_outgoingBytes(0), m_maxOutgoingBytes(kDefaultMaxPendingReliableBytes),
+	  m_receivedAny(false), m_remoteSequence(0), m_receivedBits(0), m_unackedPackets(0),
+	  m_hasRttSample(false), m_smoothedRtt(0.0), m_rttVariance(0.0), m_minRetransmitTimeout(20)
+{
+	assert(maxDatagramSize > kPacketHeaderSize + kMessageHeaderSize + kFragmentHeaderSize);
+
+	for (auto& lane : m_lanes)
+	{
+		lane.mode = DeliveryMode::ReliableOrdered;
+		lane.nextSequence = 0;
+		lane.nextExpected = 0;
+		lane.bufferedBytes = 0;
+	}
+
+	for (auto& packet : m_sentPackets)
+	{
+		packet.sequence = 0;
+		packet.reliable = false;
+	}
+
+	memset(&m_statistics, 0, sizeof(m_statistics));
+
+	m_packetBuffer.reserve(maxDatagramSize);
+}
+
+ReliableDatagramChannel::~ReliableDatagramChannel()
+{
+
+}
+
+void ReliableDatagramChannel::SetLaneMode(uint8_t lane, DeliveryMode mode)
+{
+	if (lane < kLaneCount)
+	{
+		m_lanes[lane].mode = mode;
+	}
+}
+
+std::vector<uint8_t> ReliableDatagramChannel::AcquireBuffer()
+{
+	if (m_freeBuffers.empty())
+	{
+		return std::vector<uint8_t>();
+	}
+
+	std::vector<uint8_t> buffer = std::move(m_freeBuffers.back());
+	m_freeBuffers.pop_back();
+
+	return buffer;
+}
+
+void ReliableDatagramChannel::ReleaseBuffer(std::vector<uint8_t>&& buffer)
+{
+	// clearing keeps the capacity around for the next message
+	if (m_freeBuffers.size() < 64)
+	{
+		buffer.clear();
+		m_freeBuffers.push_back(std::move(buffer));
+	}
+}
+
+bool ReliableDatagramChannel::Send(uint8_t lane, const uint8_t* data, size_t length, uint64_t now)
+{
+	if (lane >= kLaneCount)
+	{
+		return false;
+	}
+
+	size_t fragmentSize = GetFragmentPayloadSize();
+	size_t fragmentCount = std::max<size_t>(1, (length + fragmentSize - 1) / fragmentSize);
+
+	if (length > kMaxMessageSize || fragmentCount > UINT16_MAX)
+	{
+		return false;
+	}
+
+	Lane& laneData = m_lanes[lane];
+
+	// checked before taking a sequence, as the other end would wait for a skipped one forever
+	if (laneData.mode == DeliveryMode::ReliableOrdered &&
+		(m_outgoingMessages.size() >= kMaxPendingReliableMessages || m_outgoingBytes + length > m_maxOutgoingBytes))
+	{
+		m_statistics.sendsRefused++;
+		return false;
+	}
+
+	uint16_t sequence = laneData.nextSequence++;
+
+	uint32_t messageId = 0;
+
+	if (laneData.mode == DeliveryMode::ReliableOrdered)
+	{
+		messageId = m_firstMessageId + static_cast<uint32_t>(m_outgoingMessages.size());
+
+		m_outgoingMessages.emplace_back();
+
+		OutgoingMessage& message = m_outgoingMessages.back();
+		message.lane = lane;
+		message.sequence = sequence;
+		message.data.assign(data, data + length);
+		message.fragments.resize(fragmentCount, OutgoingFragment{ now, 0, false });
+		message.fragmentsLeft = fragmentCount;
+
+		m_outgoingBytes += length;
+	}
+
+	for (size_t i = 0; i < fragmentCount; i++)
+	{
+		size_t offset = i * fragmentSize;
+
+		SendFragment(lane, laneData.mode, sequence, data + offset, std::min(fragmentSize, length - offset),
+			static_cast<uint16_t>(i), static_cast<uint16_t>(fragmentCount), messageId, now);
+	}
+
+	return true;
+}
+
+void ReliableDatagramChannel::WritePacketHeader(uint32_t sequence)
+{
+	m_packetBuffer.clear();
+
+	AppendValue<uint32_t>(m_packetBuffer, sequence);
+	AppendValue<uint32_t>(m_packetBuffer, m_remoteSequence);
+	AppendValue<uint32_t>(m_packetBuffer, m_receivedBits);
+
+	// every packet carries our acknowledgements
+	m_unackedPackets = 0;
+}
+
+void ReliableDatagramChannel::SendFragment(uint8_t lane, DeliveryMode mode, uint16_t sequence, const uint8_t* data, size_t length,
+	uint16_t fragmentIndex, uint16_t fragmentCount, uint32_t messageId, uint64_t now)
+{
+	uint32_t packetSequence = m_nextPacketSequence++;
+
+	WritePacketHeader(packetSequence);
+
+	uint8_t flags = static_cast<uint8_t>(mode);
+
+	if (fragmentCount > 1)
+	{
+		flags |= FlagFragmented;
+	}
+
+	if (m_receivedAny)
+	{
+		flags |= FlagHasAck;
+	}
+
+	AppendValue<uint8_t>(m_packetBuffer, flags);
+	AppendValue<uint8_t>(m_packetBuffer, lane);
+	AppendValue<uint16_t>(m_packetBuffer, sequence);
+
+	if (fragmentCount > 1)
+	{
+		AppendValue<uint16_t>(m_packetBuffer, fragmentIndex);
+		AppendValue<uint16_t>(m_packetBuffer, fragmentCount);
+	}
+
+	m_packetBuffer.insert(m_packetBuffer.end(), data, data + length);
+
+	// remember what this packet carried, so an acknowledgement can be matched to the fragment
+	SentPacket& sentPacket = m_sentPackets[packetSequence % kSentPacketWindow];
+	sentPacket.sequence = packetSequence;
+	sentPacket.messageId = messageId;
+	sentPacket.fragment = fragmentIndex;
+	sentPacket.reliable = (mode == DeliveryMode::ReliableOrdered);
+	sentPacket.sendTime = now;
+
+	m_statistics.packetsSent++;
+
+	if (m_sink.GetRef())
+	{
+		m_sink->WritePacket(m_packetBuffer);
+	}
+}
+
+void ReliableDatagramChannel::SendAck()
+{
+	uint32_t packetSequence = m_nextPacketSequence++;
+
+	WritePacketHeader(packetSequence);
+
+	AppendValue<uint8_t>(m_packetBuffer, FlagAckOnly | FlagHasAck);
+	AppendValue<uint8_t>(m_packetBuffer, 0);
+	AppendValue<uint16_t>(m_packetBuffer, 0);
+
+	// nothing to acknowledge in here
+	m_sentPackets[packetSequence % kSentPacketWindow].reliable = false;
+
+	m_statistics.packetsSent++;
+
+	if (m_sink.GetRef())
+	{
+		m_sink->WritePacket(m_packetBuffer);
+	}
+}
+
+bool ReliableDatagramChannel::IsDuplicatePacket(uint32_t sequence) const
+{
+	if (!m_receivedAny)
+	{
+		return false;
+	}
+
+	int32_t difference = static_cast<int32_t>(sequence - m_remoteSequence);
+
+	if (difference > 0)
+	{
+		return false;
+	}
+
+	// a duplicate of the newest packet
+	if (difference == 0)
+	{
+		return true;
+	}
+
+	uint32_t age = static_cast<uint32_t>(-difference);
+
+	// too old to tell whether it's a duplicate - reliable messages get deduplicated later on
+	if (age > 32)
+	{
+		return false;
+	}
+
+	return (m_receivedBits & (1u << (age - 1))) != 0;
+}
+
+void ReliableDatagramChannel::RecordReceivedPacket(uint32_t sequence)
+{
+	if (!m_receivedAny)
+	{
+		m_receivedAny = true;
+		m_remoteSequence = sequence;
+		m_receivedBits = 0;
+
+		return;
+	}
+
+	int32_t difference = static_cast<int32_t>(sequence - m_remoteSequence);
+
+	if (difference > 0)
+	{
+		// bit n stands for m_remoteSequence - 1 - n, so the previous newest packet ends up at bit difference - 1
+		if (difference < 32)
+		{
+			m_receivedBits = (m_receivedBits << difference) | (1u << (difference - 1));
+		}
+		else
+		{
+			m_receivedBits = (difference == 32) ? (1u << 31) : 0;
+		}
+
+		m_remoteSequence = sequence;
+	}
+	else if (difference < 0 && difference >= -32)
+	{
+		// too old packets can't be acknowledged anymore
+		m_receivedBits |= 1u << (-difference - 1);
+	}
+}
+
+void ReliableDatagramChannel::ProcessAck(uint32_t ackSequence, uint32_t ackBits, uint64_t now)
+{
+	AcknowledgeFragment(ackSequence, now);
+
+	for (uint32_t i = 0; i < 32 && ackBits != 0; i++, ackBits >>= 1)
+	{
+		if (ackBits & 1)
+		{
+			AcknowledgeFragment(ackSequence - 1 - i, now);
+		}
+	}
+}
+
+void ReliableDatagramChannel::AcknowledgeFragment(uint32_t sequence, uint64_t now)
+{
+	SentPacket& sentPacket = m_sentPackets[sequence % kSentPacketWindow];
+
+	if (sentPacket.sequence != sequence || !sentPacket.reliable)
+	{
+		return;
+	}
+
+	sentPacket.reliable = false;
+
+	// every transmission has its own packet sequence, so samples aren't ambiguous even for retransmissions
+	AddRttSample(static_cast<double>(now - sentPacket.sendTime));
+
+	uint32_t index = sentPacket.messageId - m_firstMessageId;
+
+	if (index >= m_outgoingMessages.size())
+	{
+		return;
+	}
+
+	OutgoingMessage& message = m_outgoingMessages[index];
+	OutgoingFragment& fragment = message.fragments[sentPacket.fragment];
+
+	if (fragment.acked)
+	{
+		return;
+	}
+
+	fragment.acked = true;
+
+	if (--message.fragmentsLeft == 0)
+	{
+		// later messages may complete first, so only the data goes now
+		m_outgoingBytes -= message.data.size();
+		std::vector<uint8_t>().swap(message.data);
+
+		while (!m_outgoingMessages.empty() && m_outgoingMessages.front().fragmentsLeft == 0)
+		{
+			m_outgoingMessages.pop_front();
+			m_firstMessageId++;
+		}
+	}
+}
+
+void ReliableDatagramChannel::AddRttSample(double rtt)
+{
+	if (!m_hasRttSample)
+	{
+		m_smoothedRtt = rtt;
+		m_rttVariance = rtt / 2.0;
+
+		m_hasRttSample = true;
+	}
+	else
+	{
+		m_rttVariance = 0.75 * m_rttVariance + 0.25 * std::abs(m_smoothedRtt - rtt);
+		m_smoothedRtt = 0.875 * m_smoothedRtt + 0.125 * rtt;
+	}
+}
+
+uint64_t ReliableDatagramChannel::GetRetransmitTimeout() const
+{
+	if (!m_hasRttSample)
+	{
+		return kInitialRetransmitTimeout;
+	}
+
+	uint64_t timeout = static_cast<uint64_t>(m_smoothedRtt + std::max(1.0, 4.0 * m_rttVariance));
+
+	return std::min(kMaxRetransmitTimeout, std::max(m_minRetransmitTimeout, timeout));
+}
+
+void ReliableDatagramChannel::ProcessPacket(const std::vector<uint8_t>& packet, uint64_t now)
+{
+	if (packet.size() < kPacketHeaderSize + kMessageHeaderSize)
+	{
+		m_statistics.dropped++;
+		return;
+	}
+
+	const uint8_t* data = packet.data();
+
+	uint32_t sequence = ReadValue<uint32_t>(&data[0]);
+	uint8_t flags = data[kPacketHeaderSize];
+	uint8_t lane = data[kPacketHeaderSize + 1];
+	uint16_t messageSequence = ReadValue<uint16_t>(&data[kPacketHeaderSize + 2]);
+
+	if (lane >= kLaneCount)
+	{
+		m_statistics.dropped++;
+		return;
+	}
+
+	// even duplicates carry acknowledgements that may be news to us
+	if (flags & FlagHasAck)
+	{
+		ProcessAck(ReadValue<uint32_t>(&data[4]), ReadValue<uint32_t>(&data[8]), now);
+	}
+
+	if (IsDuplicatePacket(sequence))
+	{
+		m_statistics.dropped++;
+		return;
+	}
+
+	// leaving a refused packet unacknowledged makes the sender retransmit it once we've got room again
+	if (!(flags & FlagAckOnly) && !ReceiveMessage(lane, flags, messageSequence, packet, now))
+	{
+		m_statistics.dropped++;
+		return;
+	}
+
+	RecordReceivedPacket(sequence);
+
+	m_statistics.packetsReceived++;
+
+	if (!(flags & FlagAckOnly) && ++m_unackedPackets >= kMaxUnackedPackets)
+	{
+		SendAck();
+	}
+}
+
+bool ReliableDatagramChannel::ReceiveMessage(uint8_t lane, uint8_t flags, uint16_t messageSequence, const std::vector<uint8_t>& packet, uint64_t now)
+{
+	const uint8_t* data = packet.data();
+
+	Lane& laneData = m_lanes[lane];
+
+	if (static_cast<DeliveryMode>(flags & FlagModeMask) != laneData.mode)
+	{
+		m_statistics.dropped++;
+		return true;
+	}
+
+	bool reliable = (laneData.mode == DeliveryMode::ReliableOrdered);
+
+	size_t offset = kPacketHeaderSize + kMessageHeaderSize;
+
+	// drop anything that's been delivered already before it gets to take up reassembly space
+	int16_t ahead = static_cast<int16_t>(messageSequence - laneData.nextExpected);
+
+	if ((reliable && (ahead < 0 || laneData.pending.find(messageSequence) != laneData.pending.end())) ||
+		(laneData.mode == DeliveryMode::Sequenced && ahead < 0))
+	{
+		m_statistics.dropped++;
+		return true;
+	}
+
+	// messages after the next one to deliver have to wait for it, and only get buffered while there's room
+	bool mayRefuse = reliable && ahead > 0;
+
+	if (mayRefuse && ahead > kMaxReliableLookahead)
+	{
+		return false;
+	}
+
+	if (!(flags & FlagFragmented))
+	{
+		size_t length = packet.size() - offset;
+
+		if (mayRefuse && laneData.bufferedBytes + length > kMaxLaneBufferSize)
+		{
+			return false;
+		}
+
+		std::vector<uint8_t> message = AcquireBuffer();
+		message.assign(data + offset, data + packet.size());
+
+		ProcessMessage(lane, messageSequence, std::move(message));
+		return true;
+	}
+
+	if (packet.size() < offset + kFragmentHeaderSize)
+	{
+		m_statistics.dropped++;
+		return true;
+	}
+
+	uint16_t fragmentIndex = ReadValue<uint16_t>(&data[offset]);
+	uint16_t fragmentCount = ReadValue<uint16_t>(&data[offset + 2]);
+
+	offset += kFragmentHeaderSize;
+
+	size_t fragmentSize = GetFragmentPayloadSize();
+	size_t length = packet.size() - offset;
+
+	// all but the last fragment have to be full-sized, or we couldn't tell where they go
+	bool isLast = (fragmentIndex == fragmentCount - 1);
+
+	if (fragmentIndex >= fragmentCount || fragmentCount > GetMaxFragmentCount() || length > fragmentSize || (!isLast && length != fragmentSize))
+	{
+		m_statistics.dropped++;
+		return true;
+	}
+
+	auto it = laneData.reassemblies.find(messageSequence);
+	bool isNew = (it == laneData.reassemblies.end());
+
+	if (mayRefuse && (laneData.bufferedBytes + length > kMaxLaneBufferSize || (isNew && laneData.reassemblies.size() >= kMaxReassembliesPerLane)))
+	{
+		return false;
+	}
+
+	// reliable reassemblies got their fragments acknowledged already, but others can make room by dropping the oldest
+	if (!reliable)
+	{
+		while (laneData.bufferedBytes + length > kMaxLaneBufferSize || (isNew && laneData.reassemblies.size() >= kMaxReassembliesPerLane))
+		{
+			auto oldest = laneData.reassemblies.end();
+
+			for (auto candidate = laneData.reassemblies.begin(); candidate != laneData.reassemblies.end(); candidate++)
+			{
+				if (candidate->first != messageSequence && (oldest == laneData.reassemblies.end() || candidate->second.startTime < oldest->second.startTime))
+				{
+					oldest = candidate;
+				}
+			}
+
+			if (oldest == laneData.reassemblies.end())
+			{
+				break;
+			}
+
+			m_statistics.dropped++;
+			DropReassembly(laneData, oldest);
+		}
+	}
+
+	if (isNew)
+	{
+		// the buffer grows as fragments come in, so a bogus fragment count doesn't get to allocate anything
+		Reassembly reassembly;
+		reassembly.data = AcquireBuffer();
+		reassembly.received.assign(fragmentCount, false);
+		reassembly.fragmentsLeft = fragmentCount;
+		reassembly.length = 0;
+		reassembly.receivedBytes = 0;
+		reassembly.startTime = now;
+
+		it = laneData.reassemblies.emplace(messageSequence, std::move(reassembly)).first;
+	}
+
+	Reassembly& reassembly = it->second;
+
+	if (reassembly.received.size() != fragmentCount || reassembly.received[fragmentIndex])
+	{
+		m_statistics.dropped++;
+		return true;
+	}
+
+	size_t fragmentOffset = fragmentIndex * fragmentSize;
+
+	if (reassembly.data.size() < fragmentOffset + length)
+	{
+		reassembly.data.resize(fragmentOffset + length);
+	}
+
+	memcpy(&reassembly.data[fragmentOffset], data + offset, length);
+
+	reassembly.received[fragmentIndex] = true;
+	reassembly.fragmentsLeft--;
+	reassembly.receivedBytes += length;
+
+	laneData.bufferedBytes += length;
+
+	if (isLast)
+	{
+		reassembly.length = fragmentOffset + length;
+	}
+
+	if (reassembly.fragmentsLeft == 0)
+	{
+		std::vector<uint8_t> message = std::move(reassembly.data);
+		message.resize(reassembly.length);
+
+		laneData.bufferedBytes -= reassembly.receivedBytes;
+		laneData.reassemblies.erase(it);
+
+		ProcessMessage(lane, messageSequence, std::move(message));
+	}
+
+	return true;
+}
+
+void ReliableDatagramChannel::DropReassembly(Lane& lane, std::map<uint16_t, Reassembly>::iterator it)
+{
+	lane.bufferedBytes -= it->second.receivedBytes;
+
+	ReleaseBuffer(std::move(it->second.data));
+	lane.reassemblies.erase(it);
+}
+
+void ReliableDatagramChannel::ProcessMessage(uint8_t lane, uint16_t sequence, std::vector<uint8_t>&& message)
+{
+	Lane& laneData = m_lanes[lane];
+
+	switch (laneData.mode)
+	{
+	case DeliveryMode::Unreliable:
+		Deliver(lane, std::move(message));
+		break;
+
+	case DeliveryMode::Sequenced:
+		// a newer message may have completed while this one was being reassembled
+		if (static_cast<int16_t>(sequence - laneData.nextExpected) < 0)
+		{
+			m_statistics.dropped++;
+			ReleaseBuffer(std::move(message));
+
+			break;
+		}
+
+		laneData.nextExpected = sequence + 1;
+
+		Deliver(lane, std::move(message));
+		break;
+
+	case DeliveryMode::ReliableOrdered:
+		if (sequence != laneData.nextExpected)
+		{
+			laneData.bufferedBytes += message.size();
+			laneData.pending.emplace(sequence, std::move(message));
+			break;
+		}
+
+		Deliver(lane, std::move(message));
+		laneData.nextExpected++;
+
+		// anything that was waiting on this message can go now
+		for (auto it = laneData.pending.find(laneData.nextExpected); it != laneData.pending.end(); it = laneData.pending.find(laneData.nextExpected))
+		{
+			std::vector<uint8_t> pendingMessage = std::move(it->second);
+			laneData.pending.erase(it);
+
+			laneData.bufferedBytes -= pendingMessage.size();
+
+			Deliver(lane, std::move(pendingMessage));
+			laneData.nextExpected++;
+		}
+
+		break;
+	}
+}
+
+void ReliableDatagramChannel::Deliver(uint8_t lane, std::vector<uint8_t>&& message)
+{
+	m_statistics.messagesDelivered++;
+
+	if (m_messageCallback)
+	{
+		m_messageCallback(lane, message);
+	}
+
+	ReleaseBuffer(std::move(message));
+}
+
+void ReliableDatagramChannel::Update(uint64_t now)
+{
+	uint64_t retransmitTimeout = GetRetransmitTimeout();
+
+	for (size_t i = 0; i < m_outgoingMessages.size(); i++)
+	{
+		OutgoingMessage& message = m_outgoingMessages[i];
+
+		if (message.fragmentsLeft == 0)
+		{
+			continue;
+		}
+
+		size_t fragmentSize = GetFragmentPayloadSize();
+		size_t fragmentCount = message.fragments.size();
+
+		for (size_t j = 0; j < fragmentCount; j++)
+		{
+			OutgoingFragment& fragment = message.fragments[j];
+
+			// back off exponentially while a fragment keeps getting lost
+			if (fragment.acked || (now - fragment.lastSendTime) < std::min(kMaxRetransmitTimeout, retransmitTimeout << std::min(fragment.retries, 5u)))
+			{
+				continue;
+			}
+
+			fragment.retries++;
+			fragment.lastSendTime = now;
+
+			m_statistics.retransmissions++;
+
+			size_t offset = j * fragmentSize;
+
+			SendFragment(message.lane, DeliveryMode::ReliableOrdered, message.sequence, message.data.data() + offset, std::min(fragmentSize, message.data.size() - offset),
+				static_cast<uint16_t>(j), static_cast<uint16_t>(fragmentCount), m_firstMessageId + static_cast<uint32_t>(i), now);
+		}
+	}
+
+	if (m_unackedPackets > 0)
+	{
+		SendAck();
+	}
+
+	// incomplete reliable messages will still get completed by retransmissions, but others might never be
+	for (auto& lane : m_lanes)
+	{
+		if (lane.mode == DeliveryMode::ReliableOrdered)
+		{
+			continue;
+		}
+
+		for (auto it = lane.reassemblies.begin(); it != lane.reassemblies.end(); )
+		{
+			auto current = it++;
+
+			if ((now - current->second.startTime) >= kReassemblyTimeout)
+			{
+				m_statistics.dropped++;
+
+				DropReassembly(lane, current);
+			}
+		}
+	}
+}
+}
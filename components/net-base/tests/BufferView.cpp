@@ -0,0 +1,293 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <NetBuffer.h>
+#include <NetBufferView.h>
+
+#include <chrono>
+#include <random>
+
+TEST(BufferViewTest, MixedBitsAndBytesRoundTrip)
+{
+	uint8_t storage[64];
+	memset(storage, 0xFF, sizeof(storage));
+
+	net::BufferWriter writer(storage, sizeof(storage));
+
+	writer.WriteBool(true);
+	writer.WriteBool(false);
+	writer.WriteBits(5, 3);
+	writer.Write<uint16_t>(0x1234);
+	writer.WriteBits(0xABCDEF, 24);
+	writer.WriteBits(0xFFFFFFFF, 32);
+	writer.WriteVarInt(127);
+	writer.WriteVarInt(300);
+	writer.WriteVarInt(UINT64_MAX);
+	writer.WriteSignedVarInt(-1);
+	writer.WriteSignedVarInt(INT64_MIN);
+	writer.WriteQuantizedFloat(0.25f, -1.0f, 1.0f, 12);
+	writer.WriteQuantizedFloat(5.0f, -1.0f, 1.0f, 12);
+
+	ASSERT_FALSE(writer.IsOverflowed());
+
+	net::BufferView reader = writer.GetView();
+
+	EXPECT_TRUE(reader.ReadBool());
+	EXPECT_FALSE(reader.ReadBool());
+	EXPECT_EQ(5, reader.ReadBits(3));
+	EXPECT_EQ(0x1234, reader.Read<uint16_t>());
+	EXPECT_EQ(0xABCDEF, reader.ReadBits(24));
+	EXPECT_EQ(0xFFFFFFFF, reader.ReadBits(32));
+	EXPECT_EQ(127, reader.ReadVarInt());
+	EXPECT_EQ(300, reader.ReadVarInt());
+	EXPECT_EQ(UINT64_MAX, reader.ReadVarInt());
+	EXPECT_EQ(-1, reader.ReadSignedVarInt());
+	EXPECT_EQ(INT64_MIN, reader.ReadSignedVarInt());
+	EXPECT_NEAR(0.25f, reader.ReadQuantizedFloat(-1.0f, 1.0f, 12), 2.0f / 4095);
+	EXPECT_FLOAT_EQ(1.0f, reader.ReadQuantizedFloat(-1.0f, 1.0f, 12));
+
+	EXPECT_TRUE(reader.IsAtEnd());
+	EXPECT_FALSE(reader.IsOverrun());
+
+	// and past the end, there's nothing but zeroes
+	EXPECT_EQ(0, reader.Read<uint32_t>());
+	EXPECT_EQ(0, reader.ReadBits(8));
+	EXPECT_TRUE(reader.IsOverrun());
+}
+
+TEST(BufferViewTest, WriterOverflowIsSticky)
+{
+	uint8_t storage[4];
+	net::BufferWriter writer(storage, sizeof(storage));
+
+	EXPECT_TRUE(writer.Write<uint16_t>(1));
+	EXPECT_FALSE(writer.Write<uint32_t>(2));
+	EXPECT_TRUE(writer.WriteBits(3, 16));
+	EXPECT_FALSE(writer.WriteBool(true));
+
+	EXPECT_TRUE(writer.IsOverflowed());
+	EXPECT_EQ(4, writer.GetLength());
+}
+
+TEST(BufferViewTest, ArenaReusesMemoryAfterReset)
+{
+	net::BufferArena arena(1024);
+
+	uint8_t* first = arena.Allocate(600);
+	uint8_t* second = arena.Allocate(600);
+	uint8_t* large = arena.Allocate(4096);
+
+	EXPECT_NE(first, second);
+	EXPECT_NE(nullptr, large);
+
+	size_t capacity = arena.GetCapacity();
+	arena.Reset();
+
+	// a tick with the same allocations shouldn't need any new memory
+	EXPECT_EQ(first, arena.Allocate(600));
+	EXPECT_EQ(second, arena.Allocate(600));
+	arena.Allocate(4096);
+
+	EXPECT_EQ(capacity, arena.GetCapacity());
+}
+
+// a typical replicated entity update
+struct EntityState
+{
+	uint16_t objectId;
+
+	float position[3];
+
+	float heading;
+
+	bool flags[4];
+
+	uint16_t health;
+};
+
+static std::vector<EntityState> MakeStates(size_t count)
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> coordinate(-4000.0f, 4000.0f);
+	std::uniform_real_distribution<float> angle(0.0f, 360.0f);
+
+	std::vector<EntityState> states(count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		EntityState& state = states[i];
+		state.objectId = static_cast<uint16_t>(i);
+		state.position[0] = coordinate(random);
+		state.position[1] = coordinate(random);
+		state.position[2] = coordinate(random) / 20.0f;
+		state.heading = angle(random);
+		state.health = static_cast<uint16_t>(random() % 200);
+
+		for (auto& flag : state.flags)
+		{
+			flag = (random() & 1) != 0;
+		}
+	}
+
+	return states;
+}
+
+// the existing Buffer, writing every field as-is
+static void WriteStates(net::Buffer& buffer, const std::vector<EntityState>& states)
+{
+	for (auto& state : states)
+	{
+		buffer.Write<uint16_t>(state.objectId);
+		buffer.Write<float>(state.position[0]);
+		buffer.Write<float>(state.position[1]);
+		buffer.Write<float>(state.position[2]);
+		buffer.Write<float>(state.heading);
+
+		for (bool flag : state.flags)
+		{
+			buffer.Write<uint8_t>(flag);
+		}
+
+		buffer.Write<uint16_t>(state.health);
+	}
+}
+
+// the writer, quantizing positions to ~1cm and heading to ~1.4 degrees
+static void WriteStates(net::BufferWriter& writer, const std::vector<EntityState>& states)
+{
+	for (auto& state : states)
+	{
+		writer.WriteVarInt(state.objectId);
+		writer.WriteQuantizedFloat(state.position[0], -4096.0f, 4096.0f, 20);
+		writer.WriteQuantizedFloat(state.position[1], -4096.0f, 4096.0f, 20);
+		writer.WriteQuantizedFloat(state.position[2], -256.0f, 256.0f, 16);
+		writer.WriteQuantizedFloat(state.heading, 0.0f, 360.0f, 8);
+
+		for (bool flag : state.flags)
+		{
+			writer.WriteBool(flag);
+		}
+
+		writer.WriteVarInt(state.health);
+	}
+}
+
+TEST(BufferViewTest, PacksStatesSmallerThanBuffer)
+{
+	std::vector<EntityState> states = MakeStates(64);
+
+	net::Buffer buffer;
+	WriteStates(buffer, states);
+
+	net::BufferArena arena;
+	net::BufferWriter writer(arena, 2048);
+	WriteStates(writer, states);
+
+	ASSERT_FALSE(writer.IsOverflowed());
+	EXPECT_LT(writer.GetLength(), buffer.GetLength() / 2);
+
+	// and positions survive the quantization to within a centimeter
+	net::BufferView reader = writer.GetView();
+
+	for (auto& state : states)
+	{
+		EXPECT_EQ(state.objectId, reader.ReadVarInt());
+		EXPECT_NEAR(state.position[0], reader.ReadQuantizedFloat(-4096.0f, 4096.0f, 20), 0.01f);
+		EXPECT_NEAR(state.position[1], reader.ReadQuantizedFloat(-4096.0f, 4096.0f, 20), 0.01f);
+		EXPECT_NEAR(state.position[2], reader.ReadQuantizedFloat(-256.0f, 256.0f, 16), 0.01f);
+		EXPECT_NEAR(state.heading, reader.ReadQuantizedFloat(0.0f, 360.0f, 8), 1.5f);
+
+		for (bool flag : state.flags)
+		{
+			EXPECT_EQ(flag, reader.ReadBool());
+		}
+
+		EXPECT_EQ(state.health, reader.ReadVarInt());
+	}
+
+	EXPECT_FALSE(reader.IsOverrun());
+}
+
+TEST(BufferViewTest, DISABLED_BenchmarkAgainstBuffer)
+{
+	const size_t stateCount = 64;
+	const int iterations = 20000;
+
+	// every field counts, the entity id and health included
+	const size_t fieldsPerState = 10;
+
+	std::vector<EntityState> states = MakeStates(stateCount);
+
+	volatile float sink = 0.0f;
+
+	size_t bufferBytes = 0;
+
+	auto bufferStart = std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < iterations; i++)
+	{
+		net::Buffer buffer;
+		WriteStates(buffer, states);
+
+		// as a received packet would be
+		net::Buffer readBuffer(buffer.GetData());
+
+		for (size_t j = 0; j < stateCount; j++)
+		{
+			readBuffer.Read<uint16_t>();
+			sink = sink + readBuffer.Read<float>() + readBuffer.Read<float>() + readBuffer.Read<float>() + readBuffer.Read<float>();
+
+			for (int k = 0; k < 4; k++)
+			{
+				readBuffer.Read<uint8_t>();
+			}
+
+			readBuffer.Read<uint16_t>();
+		}
+
+		bufferBytes = buffer.GetLength();
+	}
+
+	auto bufferTime = std::chrono::high_resolution_clock::now() - bufferStart;
+
+	net::BufferArena arena;
+	size_t viewBytes = 0;
+
+	auto viewStart = std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < iterations; i++)
+	{
+		arena.Reset();
+
+		net::BufferWriter writer(arena, 2048);
+		WriteStates(writer, states);
+
+		net::BufferView reader = writer.GetView();
+
+		for (size_t j = 0; j < stateCount; j++)
+		{
+			reader.ReadVarInt();
+			sink = sink + reader.ReadQuantizedFloat(-4096.0f, 4096.0f, 20) + reader.ReadQuantizedFloat(-4096.0f, 4096.0f, 20) +
+				reader.ReadQuantizedFloat(-256.0f, 256.0f, 16) + reader.ReadQuantizedFloat(0.0f, 360.0f, 8);
+
+			for (int k = 0; k < 4; k++)
+			{
+				reader.ReadBool();
+			}
+
+			reader.ReadVarInt();
+		}
+
+		ASSERT_FALSE(writer.IsOverflowed());
+		viewBytes = writer.GetLength();
+	}
+
+	auto viewTime = std::chrono::high_resolution_clock::now() - viewStart;
+
+	double fieldCount = static_cast<double>(iterations) * stateCount * fieldsPerState * 2;
+
+	printf("Buffer:      %zu bytes/packet, %.2f ns/field\n", bufferBytes,
+		std::chrono::duration_cast<std::chrono::nanoseconds>(bufferTime).count() / fieldCount);
+	printf("BufferView:  %zu bytes/packet, %.2f ns/field\n", viewBytes,
+		std::chrono::duration_cast<std::chrono::nanoseconds>(viewTime).count() / fieldCount);
+}
@@ -0,0 +1,220 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <NetDispatchTable.h>
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <random>
+#include <unordered_map>
+
+TEST(DispatchTableTest, CallsHandlersInRegistrationOrder)
+{
+	net::DispatchTable<void(int)> table;
+
+	std::vector<std::pair<int, int>> calls;
+
+	int first = table.Register(0x1234, [&] (int value) { calls.emplace_back(1, value); });
+	table.Register(0x5678, [&] (int value) { calls.emplace_back(2, value); });
+	int again = table.Register(0x1234, [&] (int value) { calls.emplace_back(3, value); });
+
+	EXPECT_EQ(first, again);
+	EXPECT_EQ(2, table.GetTypeCount());
+
+	EXPECT_TRUE(table.Dispatch(0x1234, 42));
+	EXPECT_FALSE(table.Dispatch(0x9999, 0));
+
+	table.DispatchIndex(table.GetIndex(0x5678), 7);
+
+	ASSERT_EQ(3, calls.size());
+	EXPECT_EQ(std::make_pair(1, 42), calls[0]);
+	EXPECT_EQ(std::make_pair(3, 42), calls[1]);
+	EXPECT_EQ(std::make_pair(2, 7), calls[2]);
+}
+
+TEST(DispatchTableTest, IndicesSurviveGrowth)
+{
+	net::DispatchTable<void(int&)> table;
+
+	std::vector<int> indices;
+
+	for (uint32_t i = 0; i < 1000; i++)
+	{
+		indices.push_back(table.Register(i, [i] (int& sum) { sum += i; }));
+	}
+
+	for (uint32_t i = 0; i < 1000; i++)
+	{
+		ASSERT_EQ(indices[i], table.GetIndex(i));
+		EXPECT_EQ(i, table.GetType(indices[i]));
+
+		int sum = 0;
+		table.Dispatch(i, sum);
+
+		EXPECT_EQ(i, sum);
+	}
+}
+
+TEST(DispatchTableTest, LargeCallablesAndCopies)
+{
+	std::array<uint64_t, 32> payload;
+	payload.fill(3);
+
+	auto sharedCounter = std::make_shared<int>(0);
+
+	net::InlineFunction<int()> small = [sharedCounter] () { return ++(*sharedCounter); };
+	net::InlineFunction<int()> large = [payload] () { return static_cast<int>(payload[31]); };
+
+	net::InlineFunction<int()> smallCopy = small;
+	net::InlineFunction<int()> largeMoved = std::move(large);
+
+	EXPECT_EQ(1, small());
+	EXPECT_EQ(2, smallCopy());
+	EXPECT_EQ(3, largeMoved());
+	EXPECT_FALSE(static_cast<bool>(large));
+
+	EXPECT_EQ(3, sharedCounter.use_count());
+
+	small = net::InlineFunction<int()>();
+	smallCopy = largeMoved;
+
+	EXPECT_EQ(1, sharedCounter.use_count());
+	EXPECT_EQ(3, smallCopy());
+}
+
+class DispatchTableBenchmark : public ::testing::TestWithParam<int>
+{
+};
+
+TEST_P(DispatchTableBenchmark, DISABLED_BenchmarkMessagesPerSecond)
+{
+	const int typeCount = GetParam();
+	const int messageCount = 2000000;
+
+	std::mt19937 random(typeCount);
+
+	std::vector<uint32_t> types(typeCount);
+
+	for (auto& type : types)
+	{
+		type = random();
+	}
+
+	// the incoming message stream, as indices into the type list
+	std::vector<int> stream(messageCount);
+
+	for (auto& entry : stream)
+	{
+		entry = random() % typeCount;
+	}
+
+	auto measure = [&] (const char* name, const std::function<void()>& run)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		run();
+		auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+		printf("%3d types, %-28s %6.1f M msgs/sec\n", typeCount, name, messageCount / (time / 1000.0));
+	};
+
+	size_t expected = 0;
+
+	for (int entry : stream)
+	{
+		expected += entry;
+	}
+
+	{
+		std::map<uint32_t, std::function<void(const char*, size_t)>> handlers;
+		size_t sum = 0;
+
+		for (int i = 0; i < typeCount; i++)
+		{
+			handlers[types[i]] = [&sum, i] (const char*, size_t) { sum += i; };
+		}
+
+		measure("std::map", [&] ()
+		{
+			for (int entry : stream)
+			{
+				auto it = handlers.find(types[entry]);
+
+				if (it != handlers.end())
+				{
+					it->second(nullptr, 0);
+				}
+			}
+		});
+
+		EXPECT_EQ(expected, sum);
+	}
+
+	{
+		std::unordered_multimap<uint32_t, std::function<void(const char*, size_t)>> handlers;
+		size_t sum = 0;
+
+		for (int i = 0; i < typeCount; i++)
+		{
+			handlers.insert({ types[i], [&sum, i] (const char*, size_t) { sum += i; } });
+		}
+
+		measure("std::unordered_multimap", [&] ()
+		{
+			for (int entry : stream)
+			{
+				auto range = handlers.equal_range(types[entry]);
+
+				for (auto it = range.first; it != range.second; it++)
+				{
+					it->second(nullptr, 0);
+				}
+			}
+		});
+
+		EXPECT_EQ(expected, sum);
+	}
+
+	{
+		net::DispatchTable<void(const char*, size_t)> table;
+		size_t sum = 0;
+
+		for (int i = 0; i < typeCount; i++)
+		{
+			table.Register(types[i], [&sum, i] (const char*, size_t) { sum += i; });
+		}
+
+		measure("DispatchTable by type", [&] ()
+		{
+			for (int entry : stream)
+			{
+				table.Dispatch(types[entry], nullptr, 0);
+			}
+		});
+
+		EXPECT_EQ(expected, sum);
+
+		// as PeerBase does once the type mapping is known
+		std::vector<int> mapping(typeCount);
+
+		for (int i = 0; i < typeCount; i++)
+		{
+			mapping[i] = table.GetIndex(types[i]);
+		}
+
+		sum = 0;
+
+		measure("DispatchTable by index", [&] ()
+		{
+			for (int entry : stream)
+			{
+				table.DispatchIndex(mapping[entry], nullptr, 0);
+			}
+		});
+
+		EXPECT_EQ(expected, sum);
+	}
+}
+
+INSTANTIATE_TEST_CASE_P(TypeCounts, DispatchTableBenchmark, ::testing::Values(50, 200, 500));
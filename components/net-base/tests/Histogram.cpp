@@ -0,0 +1,116 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <NetHistogram.h>
+#include <NetMetrics.h>
+
+#include <thread>
+#include <vector>
+
+TEST(HistogramTest, BucketsKeepRelativePrecision)
+{
+	// small values are exact
+	for (uint64_t value = 0; value < net::Histogram::kSubBucketCount; value++)
+	{
+		EXPECT_EQ(value, net::Histogram::GetBucketUpperBound(net::Histogram::GetBucketIndex(value)));
+	}
+
+	for (uint64_t value = 32; value < (1ULL << 32); value = value * 3 + 7)
+	{
+		int index = net::Histogram::GetBucketIndex(value);
+		uint64_t upperBound = net::Histogram::GetBucketUpperBound(index);
+
+		EXPECT_GE(upperBound, value);
+		EXPECT_LE(upperBound - value, value / net::Histogram::kSubBucketCount);
+
+		// and the previous bucket ends right before this one's values
+		EXPECT_LT(net::Histogram::GetBucketUpperBound(index - 1), value);
+	}
+
+	// anything too large ends up in the last bucket
+	EXPECT_EQ(net::Histogram::kBucketCount - 1, net::Histogram::GetBucketIndex(UINT64_MAX));
+}
+
+TEST(HistogramTest, Quantiles)
+{
+	net::Histogram histogram;
+
+	EXPECT_EQ(0, histogram.GetSnapshot().GetQuantile(0.5));
+
+	for (uint64_t value = 1; value <= 10000; value++)
+	{
+		histogram.Record(value);
+	}
+
+	auto snapshot = histogram.GetSnapshot();
+
+	EXPECT_EQ(10000, snapshot.GetCount());
+	EXPECT_EQ(50005000, snapshot.GetSum());
+	EXPECT_EQ(10000, snapshot.GetMax());
+
+	EXPECT_NEAR(5000, snapshot.GetQuantile(0.5), 5000 / 32);
+	EXPECT_NEAR(9900, snapshot.GetQuantile(0.99), 9900 / 32);
+	EXPECT_EQ(10000, snapshot.GetQuantile(1.0));
+
+	histogram.Reset();
+	EXPECT_EQ(0, histogram.GetSnapshot().GetCount());
+}
+
+TEST(HistogramTest, ConcurrentRecording)
+{
+	net::Histogram histogram;
+
+	std::vector<std::thread> threads;
+
+	for (int t = 0; t < 4; t++)
+	{
+		threads.emplace_back([&, t] ()
+		{
+			for (uint64_t i = 0; i < 100000; i++)
+			{
+				histogram.Record(i + t);
+			}
+		});
+	}
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	auto snapshot = histogram.GetSnapshot();
+
+	EXPECT_EQ(400000, snapshot.GetCount());
+	EXPECT_EQ(99999 + 3, snapshot.GetMax());
+}
+
+TEST(MetricsRegistryTest, FormatsPrometheusText)
+{
+	net::MetricsRegistry registry;
+
+	auto server = registry.CreateConnection("server \"main\"");
+	auto other = registry.CreateConnection("other");
+
+	server->Record(net::ConnectionMetric::Rtt, 40);
+	server->Record(net::ConnectionMetric::Rtt, 60);
+
+	int connections = 0;
+	registry.ForEachConnection([&] (const fwRefContainer<net::ConnectionMetrics>& connection)
+	{
+		connections++;
+	});
+
+	EXPECT_EQ(2, connections);
+
+	registry.RemoveConnection(other);
+
+	std::string text = registry.FormatPrometheus();
+
+	EXPECT_NE(std::string::npos, text.find("# TYPE citizen_net_rtt_milliseconds summary\n"));
+	EXPECT_NE(std::string::npos, text.find("citizen_net_rtt_milliseconds{connection=\"server \\\"main\\\"\",quantile=\"0.5\"} 40\n"));
+	EXPECT_NE(std::string::npos, text.find("citizen_net_rtt_milliseconds_sum{connection=\"server \\\"main\\\"\"} 100\n"));
+	EXPECT_NE(std::string::npos, text.find("citizen_net_rtt_milliseconds_count{connection=\"server \\\"main\\\"\"} 2\n"));
+	EXPECT_NE(std::string::npos, text.find("citizen_net_queue_depth_count{connection=\"server \\\"main\\\"\"} 0\n"));
+
+	EXPECT_EQ(std::string::npos, text.find("other"));
+}
@@ -0,0 +1,250 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <NetPacketRing.h>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(PacketRingTest, CopiesPacketsIntoSlots)
+{
+	net::PacketRing<64, 4> ring;
+
+	EXPECT_TRUE(ring.IsEmpty());
+	EXPECT_EQ(nullptr, ring.Peek());
+
+	for (int i = 0; i < 4; i++)
+	{
+		std::string packet = "packet " + std::to_string(i);
+
+		EXPECT_TRUE(ring.TryPush(i, packet.c_str(), packet.size(), i * 10));
+	}
+
+	// full, and too large
+	EXPECT_FALSE(ring.TryPush(5, "x", 1, 0));
+	EXPECT_FALSE(ring.TryPush(6, std::string(65, 'x').c_str(), 65, 0));
+
+	for (int i = 0; i < 4; i++)
+	{
+		auto slot = ring.Peek();
+		ASSERT_NE(nullptr, slot);
+
+		EXPECT_EQ(i, slot->tag);
+		EXPECT_EQ(i * 10, slot->time);
+		EXPECT_EQ("packet " + std::to_string(i), std::string(reinterpret_cast<const char*>(slot->data), slot->length));
+
+		ring.Pop();
+	}
+
+	EXPECT_TRUE(ring.IsEmpty());
+
+	// slots get reused on the next lap
+	EXPECT_TRUE(ring.TryPush(7, "again", 5, 0));
+	ASSERT_NE(nullptr, ring.Peek());
+	EXPECT_EQ(7, ring.Peek()->tag);
+
+	auto statistics = ring.GetStatistics();
+	EXPECT_EQ(5, statistics.pushed);
+	EXPECT_EQ(4, statistics.popped);
+	EXPECT_EQ(1, statistics.droppedFull);
+	EXPECT_EQ(1, statistics.droppedOversized);
+	EXPECT_EQ(4, statistics.highWater);
+}
+
+static uint32_t GetMicroseconds()
+{
+	return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+struct StressResult
+{
+	double packetsPerSecond;
+
+	std::vector<uint32_t> latencies;
+};
+
+static void PrintResult(const char* name, StressResult& result)
+{
+	std::sort(result.latencies.begin(), result.latencies.end());
+
+	auto percentile = [&] (double p)
+	{
+		return result.latencies[std::min(result.latencies.size() - 1, static_cast<size_t>(result.latencies.size() * p))];
+	};
+
+	printf("%-20s %6.2f M packets/sec, latency p50 %u us, p99 %u us, p99.9 %u us\n", name, result.packetsPerSecond / 1000000.0,
+		percentile(0.5), percentile(0.99), percentile(0.999));
+}
+
+static const int kProducers = 3;
+static const uint32_t kPacketsPerProducer = 200000;
+
+// a few game threads routing packets of typical sizes, with the network thread sending them on
+static void StressPacketRing(StressResult& ringResult)
+{
+	char payload[1200];
+	memset(payload, 0x5A, sizeof(payload));
+
+	{
+		net::PacketRing<1200, 1024> ring;
+
+		std::vector<std::thread> producers;
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		for (int p = 0; p < kProducers; p++)
+		{
+			producers.emplace_back([&, p] ()
+			{
+				for (uint32_t i = 0; i < kPacketsPerProducer; i++)
+				{
+					// each packet carries its own sequence number, to check order per producer
+					size_t length = 40 + (i % 1000);
+
+					char packet[1200];
+					memcpy(packet, payload, length);
+					*reinterpret_cast<uint32_t*>(packet) = i;
+
+					while (!ring.TryPush(p, packet, length, GetMicroseconds()))
+					{
+						std::this_thread::yield();
+					}
+				}
+			});
+		}
+
+		std::vector<uint32_t> expected(kProducers, 0);
+		uint32_t received = 0;
+		uint32_t mismatched = 0;
+
+		ringResult.latencies.reserve(kProducers * kPacketsPerProducer);
+
+		while (received < kProducers * kPacketsPerProducer)
+		{
+			auto slot = ring.Peek();
+
+			if (!slot)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			ringResult.latencies.push_back(GetMicroseconds() - slot->time);
+
+			uint32_t sequence = *reinterpret_cast<const uint32_t*>(slot->data);
+			mismatched += (sequence != expected[slot->tag] || slot->length != 40 + (sequence % 1000));
+
+			expected[slot->tag] = sequence + 1;
+			received++;
+
+			ring.Pop();
+		}
+
+		ringResult.packetsPerSecond = received / std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		for (auto& thread : producers)
+		{
+			thread.join();
+		}
+
+		EXPECT_EQ(0, mismatched);
+		EXPECT_EQ(0, ring.GetStatistics().droppedOversized);
+	}
+}
+
+TEST(PacketRingTest, KeepsProducerOrderUnderContention)
+{
+	StressResult result;
+	StressPacketRing(result);
+}
+
+TEST(PacketRingTest, DISABLED_BenchmarkAgainstMutexQueue)
+{
+	char payload[1200];
+	memset(payload, 0x5A, sizeof(payload));
+
+	StressResult ringResult;
+	StressPacketRing(ringResult);
+
+	// the same through what NetLibrary used to have: a std::string per packet, in a queue behind a mutex
+	StressResult mutexResult;
+
+	{
+		struct QueuedPacket
+		{
+			uint16_t netID;
+			std::string payload;
+			uint32_t time;
+		};
+
+		std::mutex mutex;
+		std::queue<QueuedPacket> queue;
+
+		std::vector<std::thread> producers;
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		for (int p = 0; p < kProducers; p++)
+		{
+			producers.emplace_back([&, p] ()
+			{
+				for (uint32_t i = 0; i < kPacketsPerProducer; i++)
+				{
+					QueuedPacket packet;
+					packet.netID = p;
+					packet.payload = std::string(payload, 40 + (i % 1000));
+					packet.time = GetMicroseconds();
+
+					std::lock_guard<std::mutex> guard(mutex);
+					queue.push(packet);
+				}
+			});
+		}
+
+		uint32_t received = 0;
+
+		mutexResult.latencies.reserve(kProducers * kPacketsPerProducer);
+
+		while (received < kProducers * kPacketsPerProducer)
+		{
+			QueuedPacket packet;
+			bool popped = false;
+
+			{
+				std::lock_guard<std::mutex> guard(mutex);
+
+				if (!queue.empty())
+				{
+					packet = queue.front();
+					queue.pop();
+
+					popped = true;
+				}
+			}
+
+			if (!popped)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			mutexResult.latencies.push_back(GetMicroseconds() - packet.time);
+			received++;
+		}
+
+		mutexResult.packetsPerSecond = received / std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		for (auto& thread : producers)
+		{
+			thread.join();
+		}
+	}
+
+	PrintResult("packet ring", ringResult);
+	PrintResult("mutex + std::queue", mutexResult);
+}
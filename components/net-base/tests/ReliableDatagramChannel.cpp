@@ -0,0 +1,435 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <ReliableDatagramChannel.h>
+
+#include <algorithm>
+#include <queue>
+#include <random>
+
+// a one-way link that drops, delays and (through jitter) reorders datagrams
+class SimulatedLink : public net::DatagramSink
+{
+private:
+	struct InFlight
+	{
+		uint64_t deliveryTime;
+
+		uint64_t order;
+
+		std::vector<uint8_t> packet;
+
+		bool operator>(const InFlight& right) const
+		{
+			return (deliveryTime != right.deliveryTime) ? (deliveryTime > right.deliveryTime) : (order > right.order);
+		}
+	};
+
+	std::priority_queue<InFlight, std::vector<InFlight>, std::greater<InFlight>> m_inFlight;
+
+	std::mt19937& m_random;
+
+	double m_lossRate;
+
+	uint64_t m_latency;
+
+	uint64_t m_jitter;
+
+	uint64_t m_order;
+
+public:
+	uint64_t now;
+
+	uint64_t sent;
+
+	uint64_t lost;
+
+public:
+	SimulatedLink(std::mt19937& random, double lossRate, uint64_t latency, uint64_t jitter)
+		: m_random(random), m_lossRate(lossRate), m_latency(latency), m_jitter(jitter), m_order(0), now(0), sent(0), lost(0)
+	{
+	}
+
+	virtual void WritePacket(const std::vector<uint8_t>& packet) override
+	{
+		sent++;
+
+		if (std::uniform_real_distribution<double>(0.0, 1.0)(m_random) < m_lossRate)
+		{
+			lost++;
+			return;
+		}
+
+		uint64_t delay = m_latency + std::uniform_int_distribution<uint64_t>(0, m_jitter)(m_random);
+
+		m_inFlight.push({ now + delay, m_order++, packet });
+	}
+
+	void DeliverDue(net::ReliableDatagramChannel* target)
+	{
+		while (!m_inFlight.empty() && m_inFlight.top().deliveryTime <= now)
+		{
+			std::vector<uint8_t> packet = m_inFlight.top().packet;
+			m_inFlight.pop();
+
+			target->ProcessPacket(packet, now);
+		}
+	}
+};
+
+class ReliableDatagramChannelTest : public ::testing::TestWithParam<double>
+{
+protected:
+	std::mt19937 m_random{ 0x5EED };
+
+	fwRefContainer<net::ReliableDatagramChannel> m_client;
+
+	fwRefContainer<net::ReliableDatagramChannel> m_server;
+
+	fwRefContainer<SimulatedLink> m_toServer;
+
+	fwRefContainer<SimulatedLink> m_toClient;
+
+	uint64_t m_now = 0;
+
+protected:
+	void SetUpLink(double lossRate)
+	{
+		m_client = new net::ReliableDatagramChannel(1200);
+		m_server = new net::ReliableDatagramChannel(1200);
+
+		m_toServer = new SimulatedLink(m_random, lossRate, 30, 10);
+		m_toClient = new SimulatedLink(m_random, lossRate, 30, 10);
+
+		m_client->SetSink(m_toServer);
+		m_server->SetSink(m_toClient);
+	}
+
+	// advances the simulation by a millisecond
+	void Step()
+	{
+		m_now++;
+
+		m_toServer->now = m_now;
+		m_toClient->now = m_now;
+
+		m_toServer->DeliverDue(m_server.GetRef());
+		m_toClient->DeliverDue(m_client.GetRef());
+
+		if ((m_now % 5) == 0)
+		{
+			m_client->Update(m_now);
+			m_server->Update(m_now);
+		}
+	}
+};
+
+static std::vector<uint8_t> MakeMessage(uint32_t index, uint64_t sendTime, size_t length)
+{
+	std::vector<uint8_t> message(std::max<size_t>(length, 12));
+	memcpy(&message[0], &index, sizeof(index));
+	memcpy(&message[4], &sendTime, sizeof(sendTime));
+
+	for (size_t i = 12; i < message.size(); i++)
+	{
+		message[i] = static_cast<uint8_t>(index + i);
+	}
+
+	return message;
+}
+
+TEST_P(ReliableDatagramChannelTest, ReliableOrderedSurvivesLoss)
+{
+	double lossRate = GetParam();
+	SetUpLink(lossRate);
+
+	const uint32_t messageCount = 2000;
+
+	uint32_t nextExpected = 0;
+	bool intact = true;
+
+	std::vector<uint64_t> latencies;
+
+	m_server->SetMessageCallback([&] (uint8_t lane, const std::vector<uint8_t>& message)
+	{
+		uint32_t index;
+		uint64_t sendTime;
+		memcpy(&index, &message[0], sizeof(index));
+		memcpy(&sendTime, &message[4], sizeof(sendTime));
+
+		EXPECT_EQ(0, lane);
+		EXPECT_EQ(nextExpected, index);
+
+		intact = intact && (message == MakeMessage(index, sendTime, message.size()));
+
+		nextExpected = index + 1;
+
+		latencies.push_back(m_now - sendTime);
+	});
+
+	// mostly small messages, with the odd one that needs a few fragments
+	std::uniform_int_distribution<size_t> smallSize(16, 200);
+	std::uniform_int_distribution<size_t> largeSize(2000, 8000);
+
+	uint32_t sentMessages = 0;
+
+	while ((sentMessages < messageCount || nextExpected < messageCount) && m_now < 600000)
+	{
+		if (sentMessages < messageCount && (m_now % 2) == 0)
+		{
+			size_t length = ((sentMessages % 20) == 0) ? largeSize(m_random) : smallSize(m_random);
+			std::vector<uint8_t> message = MakeMessage(sentMessages, m_now, length);
+
+			ASSERT_TRUE(m_client->Send(0, message.data(), message.size(), m_now));
+			sentMessages++;
+		}
+
+		Step();
+	}
+
+	ASSERT_EQ(messageCount, nextExpected);
+	EXPECT_TRUE(intact);
+
+	// let the last acknowledgements through
+	for (int i = 0; i < 2000 && m_client->GetPendingReliableCount() > 0; i++)
+	{
+		Step();
+	}
+
+	EXPECT_EQ(0, m_client->GetPendingReliableCount());
+	EXPECT_EQ(messageCount, m_server->GetStatistics().messagesDelivered);
+
+	std::sort(latencies.begin(), latencies.end());
+
+	// with ~60ms round trips, even the tail shouldn't take more than a handful of retransmissions
+	EXPECT_LT(latencies[latencies.size() * 99 / 100], 1000);
+}
+
+INSTANTIATE_TEST_CASE_P(LossRates, ReliableDatagramChannelTest, ::testing::Values(0.01, 0.05, 0.10));
+
+TEST_F(ReliableDatagramChannelTest, SequencedDropsStaleMessages)
+{
+	SetUpLink(0.0);
+
+	m_client->SetLaneMode(1, net::DeliveryMode::Sequenced);
+	m_server->SetLaneMode(1, net::DeliveryMode::Sequenced);
+
+	std::vector<uint32_t> delivered;
+
+	m_server->SetMessageCallback([&] (uint8_t lane, const std::vector<uint8_t>& message)
+	{
+		uint32_t index;
+		memcpy(&index, &message[0], sizeof(index));
+
+		delivered.push_back(index);
+	});
+
+	for (uint32_t i = 0; i < 500; i++)
+	{
+		std::vector<uint8_t> message = MakeMessage(i, m_now, 32);
+		m_client->Send(1, message.data(), message.size(), m_now);
+
+		Step();
+	}
+
+	for (int i = 0; i < 100; i++)
+	{
+		Step();
+	}
+
+	ASSERT_FALSE(delivered.empty());
+	EXPECT_TRUE(std::is_sorted(delivered.begin(), delivered.end()));
+	EXPECT_TRUE(std::adjacent_find(delivered.begin(), delivered.end()) == delivered.end());
+
+	// the jitter reorders plenty of these, and those never make it
+	EXPECT_LT(delivered.size(), 500);
+	EXPECT_EQ(0, m_client->GetStatistics().retransmissions);
+}
+
+TEST_F(ReliableDatagramChannelTest, UnreliableFragmentsReassemble)
+{
+	SetUpLink(0.0);
+
+	m_client->SetLaneMode(2, net::DeliveryMode::Unreliable);
+	m_server->SetLaneMode(2, net::DeliveryMode::Unreliable);
+
+	std::vector<std::vector<uint8_t>> delivered;
+
+	m_server->SetMessageCallback([&] (uint8_t lane, const std::vector<uint8_t>& message)
+	{
+		EXPECT_EQ(2, lane);
+		delivered.push_back(message);
+	});
+
+	std::vector<std::vector<uint8_t>> sent;
+
+	for (uint32_t i = 0; i < 50; i++)
+	{
+		sent.push_back(MakeMessage(i, m_now, 100 + i * 97));
+		m_client->Send(2, sent.back().data(), sent.back().size(), m_now);
+
+		Step();
+	}
+
+	for (int i = 0; i < 100; i++)
+	{
+		Step();
+	}
+
+	ASSERT_EQ(sent.size(), delivered.size());
+
+	// order isn't guaranteed, but every message should be intact
+	std::sort(sent.begin(), sent.end());
+	std::sort(delivered.begin(), delivered.end());
+
+	EXPECT_EQ(sent, delivered);
+	EXPECT_EQ(0, m_client->GetPendingReliableCount());
+}
+
+TEST_F(ReliableDatagramChannelTest, RejectsOversizedMessages)
+{
+	SetUpLink(0.0);
+
+	m_server->SetLaneMode(2, net::DeliveryMode::Unreliable);
+
+	std::vector<uint8_t> message(net::ReliableDatagramChannel::kMaxMessageSize + 1);
+	EXPECT_FALSE(m_client->Send(0, message.data(), message.size(), m_now));
+	EXPECT_EQ(0, m_client->GetPendingReliableCount());
+
+	// a fragment claiming to be part of a message larger than we'd ever reassemble
+	std::vector<uint8_t> packet(12);
+	packet.push_back(0x04 | static_cast<uint8_t>(net::DeliveryMode::Unreliable));
+	packet.push_back(2);
+	packet.push_back(0);
+	packet.push_back(0);
+
+	uint16_t fragmentHeader[] = { 0, UINT16_MAX };
+	packet.insert(packet.end(), reinterpret_cast<uint8_t*>(fragmentHeader), reinterpret_cast<uint8_t*>(fragmentHeader) + sizeof(fragmentHeader));
+	packet.resize(1200);
+
+	m_server->ProcessPacket(packet, m_now);
+
+	EXPECT_EQ(1, m_server->GetStatistics().dropped);
+}
+
+TEST_F(ReliableDatagramChannelTest, ReliableOrderedSurvivesFullBuffers)
+{
+	SetUpLink(0.05);
+
+	const uint32_t messageCount = 24;
+
+	uint32_t nextExpected = 0;
+	bool intact = true;
+
+	m_server->SetMessageCallback([&] (uint8_t lane, const std::vector<uint8_t>& message)
+	{
+		uint32_t index;
+		uint64_t sendTime;
+		memcpy(&index, &message[0], sizeof(index));
+		memcpy(&sendTime, &message[4], sizeof(sendTime));
+
+		EXPECT_EQ(nextExpected, index);
+		intact = intact && (message == MakeMessage(index, sendTime, message.size()));
+
+		nextExpected = index + 1;
+	});
+
+	// more than the receiving lane is willing to buffer at once, so some fragments get refused and sent again
+	for (uint32_t i = 0; i < messageCount; i++)
+	{
+		std::vector<uint8_t> message = MakeMessage(i, m_now, net::ReliableDatagramChannel::kMaxMessageSize / 2);
+		ASSERT_TRUE(m_client->Send(0, message.data(), message.size(), m_now));
+	}
+
+	while (nextExpected < messageCount && m_now < 600000)
+	{
+		Step();
+	}
+
+	EXPECT_EQ(messageCount, nextExpected);
+	EXPECT_TRUE(intact);
+}
+
+TEST_F(ReliableDatagramChannelTest, RefusesSendsWhileTooMuchIsPending)
+{
+	SetUpLink(0.0);
+
+	m_client->SetMaxPendingReliableBytes(64 * 1024);
+
+	uint32_t nextExpected = 0;
+
+	m_server->SetMessageCallback([&] (uint8_t lane, const std::vector<uint8_t>& message)
+	{
+		if (lane != 0)
+		{
+			return;
+		}
+
+		uint32_t index;
+		memcpy(&index, &message[0], sizeof(index));
+
+		EXPECT_EQ(nextExpected, index);
+		nextExpected = index + 1;
+	});
+
+	// nothing gets acknowledged before the link is stepped, like with a peer that went away
+	uint32_t accepted = 0;
+
+	while (true)
+	{
+		std::vector<uint8_t> message = MakeMessage(accepted, m_now, 10000);
+
+		if (!m_client->Send(0, message.data(), message.size(), m_now))
+		{
+			break;
+		}
+
+		accepted++;
+	}
+
+	EXPECT_EQ(6, accepted);
+	EXPECT_EQ(60000, m_client->GetPendingReliableBytes());
+	EXPECT_EQ(1, m_client->GetStatistics().sendsRefused);
+
+	// unreliable lanes don't hold on to anything
+	m_client->SetLaneMode(1, net::DeliveryMode::Unreliable);
+	m_server->SetLaneMode(1, net::DeliveryMode::Unreliable);
+
+	std::vector<uint8_t> unreliable(10000);
+	EXPECT_TRUE(m_client->Send(1, unreliable.data(), unreliable.size(), m_now));
+
+	// once acknowledged, there's room again - and the refused message didn't use up a sequence
+	while (nextExpected < accepted && m_now < 10000)
+	{
+		Step();
+	}
+
+	for (int i = 0; i < 1000 && m_client->GetPendingReliableCount() > 0; i++)
+	{
+		Step();
+	}
+
+	EXPECT_EQ(0, m_client->GetPendingReliableBytes());
+
+	std::vector<uint8_t> message = MakeMessage(accepted, m_now, 10000);
+	ASSERT_TRUE(m_client->Send(0, message.data(), message.size(), m_now));
+
+	while ((nextExpected <= accepted || m_client->GetPendingReliableCount() > 0) && m_now < 20000)
+	{
+		Step();
+	}
+
+	EXPECT_EQ(accepted + 1, nextExpected);
+	EXPECT_EQ(0, m_client->GetPendingReliableCount());
+
+	// lots of tiny messages are limited by their count instead
+	m_client->SetMaxPendingReliableBytes(SIZE_MAX);
+
+	for (size_t i = 0; i < net::ReliableDatagramChannel::kMaxPendingReliableMessages; i++)
+	{
+		ASSERT_TRUE(m_client->Send(2, message.data(), 16, m_now));
+	}
+
+	EXPECT_FALSE(m_client->Send(2, message.data(), 16, m_now));
+	EXPECT_EQ(2, m_client->GetStatistics().sendsRefused);
+}
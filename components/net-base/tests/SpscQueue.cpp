@@ -0,0 +1,139 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <NetSpscQueue.h>
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+TEST(SpscQueueTest, FillsUpAndDrains)
+{
+	net::SpscQueue<std::string, 4> queue;
+
+	EXPECT_TRUE(queue.IsEmpty());
+
+	for (int i = 0; i < 4; i++)
+	{
+		EXPECT_TRUE(queue.TryPush(std::to_string(i)));
+	}
+
+	EXPECT_FALSE(queue.TryPush(std::string("full")));
+	EXPECT_EQ(4, queue.GetSize());
+
+	std::string item;
+
+	for (int i = 0; i < 4; i++)
+	{
+		ASSERT_TRUE(queue.TryPop(item));
+		EXPECT_EQ(std::to_string(i), item);
+	}
+
+	EXPECT_FALSE(queue.TryPop(item));
+	EXPECT_TRUE(queue.IsEmpty());
+
+	// and around the end of the ring
+	for (int i = 0; i < 10; i++)
+	{
+		EXPECT_TRUE(queue.TryPush(std::to_string(i)));
+		ASSERT_TRUE(queue.TryPop(item));
+		EXPECT_EQ(std::to_string(i), item);
+	}
+}
+
+// pushes 0..count-1 from another thread, returning how long it took to pop them all in order
+static int64_t RunSpscQueue(uint32_t count)
+{
+	net::SpscQueue<uint32_t, 1024> queue;
+
+	std::thread producer([&] ()
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			while (!queue.TryPush(i))
+			{
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	uint32_t expected = 0;
+	uint32_t outOfOrder = 0;
+	uint32_t item;
+
+	while (expected < count)
+	{
+		if (queue.TryPop(item))
+		{
+			outOfOrder += (item != expected);
+			expected++;
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+	producer.join();
+
+	EXPECT_EQ(0, outOfOrder);
+
+	return time;
+}
+
+TEST(SpscQueueTest, KeepsOrderAcrossThreads)
+{
+	RunSpscQueue(1000000);
+}
+
+TEST(SpscQueueTest, DISABLED_BenchmarkAgainstMutexQueue)
+{
+	const uint32_t count = 1000000;
+
+	auto spscTime = RunSpscQueue(count);
+
+	// the same with the mutex-guarded std::queue NetLibrary used to have
+	std::mutex mutex;
+	std::deque<uint32_t> locked;
+
+	std::thread lockedProducer([&] ()
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			locked.push_back(i);
+		}
+	});
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	uint32_t expected = 0;
+
+	while (expected < count)
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+
+		while (!locked.empty())
+		{
+			locked.pop_front();
+			expected++;
+		}
+
+		if (expected < count)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	auto lockedTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+	lockedProducer.join();
+
+	printf("spsc queue %.1f M items/sec, mutex queue %.1f M items/sec\n", count / static_cast<double>(spscTime), count / static_cast<double>(lockedTime));
+}
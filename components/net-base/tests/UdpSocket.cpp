@@ -0,0 +1,177 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <NetUdpSocket.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// binds to an ephemeral loopback port
+static fwRefContainer<net::UdpSocket> CreateBoundSocket()
+{
+	fwRefContainer<net::UdpSocket> socket = new net::UdpSocket();
+
+	if (!socket->Bind(net::PeerAddress::FromString("127.0.0.1:0", 0, net::PeerAddress::LookupType::ResolveName).get()))
+	{
+		return nullptr;
+	}
+
+	return socket;
+}
+
+TEST(UdpSocketTest, BatchRoundTrip)
+{
+	fwRefContainer<net::UdpSocket> receiver = CreateBoundSocket();
+	fwRefContainer<net::UdpSocket> sender = CreateBoundSocket();
+
+	ASSERT_NE(nullptr, receiver.GetRef());
+	ASSERT_NE(nullptr, sender.GetRef());
+
+	net::PeerAddress receiverAddress = receiver->GetLocalAddress();
+
+	net::UdpPacketBatch sendBatch(16, 256);
+
+	for (int i = 0; i < 16; i++)
+	{
+		std::vector<uint8_t> data(i + 1, static_cast<uint8_t>(i));
+		ASSERT_TRUE(sendBatch.Add(data.data(), data.size(), receiverAddress));
+	}
+
+	// full batches and oversized datagrams are refused
+	uint8_t oversized[300] = { 0 };
+	EXPECT_FALSE(sendBatch.Add(oversized, 1, receiverAddress));
+
+	net::UdpPacketBatch largeBatch(1, 256);
+	EXPECT_FALSE(largeBatch.Add(oversized, sizeof(oversized), receiverAddress));
+
+	EXPECT_EQ(16, sender->SendBatch(sendBatch));
+
+	net::UdpPacketBatch receiveBatch(64, 256);
+	size_t received = 0;
+
+	while (received < 16)
+	{
+		size_t count = receiver->ReceiveBatch(receiveBatch);
+		ASSERT_GT(count, 0);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t index = received + i;
+
+			ASSERT_EQ(index + 1, receiveBatch.GetLength(i));
+			EXPECT_EQ(index, receiveBatch.GetData(i)[0]);
+			EXPECT_EQ(index, receiveBatch.GetData(i)[index]);
+
+			EXPECT_EQ(sender->GetLocalAddress().ToString(), receiveBatch.GetAddress(i).ToString());
+		}
+
+		received += count;
+	}
+
+	EXPECT_EQ(16, received);
+}
+
+TEST(UdpSocketTest, DropsTruncatedDatagrams)
+{
+	fwRefContainer<net::UdpSocket> receiver = CreateBoundSocket();
+	fwRefContainer<net::UdpSocket> sender = CreateBoundSocket();
+
+	ASSERT_NE(nullptr, receiver.GetRef());
+	ASSERT_NE(nullptr, sender.GetRef());
+
+	net::PeerAddress receiverAddress = receiver->GetLocalAddress();
+
+	// one datagram too large for the receiving slots, between two that fit
+	ASSERT_TRUE(sender->SendTo(std::vector<uint8_t>(16, 1), receiverAddress));
+	ASSERT_TRUE(sender->SendTo(std::vector<uint8_t>(300, 2), receiverAddress));
+	ASSERT_TRUE(sender->SendTo(std::vector<uint8_t>(32, 3), receiverAddress));
+
+	net::UdpPacketBatch receiveBatch(16, 256);
+	std::vector<std::pair<size_t, uint8_t>> received;
+
+	while (received.size() < 2)
+	{
+		size_t count = receiver->ReceiveBatch(receiveBatch);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			received.emplace_back(receiveBatch.GetLength(i), receiveBatch.GetData(i)[0]);
+		}
+	}
+
+	ASSERT_EQ(2, received.size());
+
+	EXPECT_EQ(16, received[0].first);
+	EXPECT_EQ(1, received[0].second);
+
+	EXPECT_EQ(32, received[1].first);
+	EXPECT_EQ(3, received[1].second);
+
+	EXPECT_EQ(1, receiver->GetTruncatedCount());
+}
+
+// loopback throughput at various batch sizes - the sender keeps going until the receiver got enough,
+// as datagrams that overflow the receive buffer are simply lost
+static const int kBenchmarkPackets = 200000;
+static const size_t kBenchmarkPacketSize = 200;
+
+class UdpSocketBenchmark : public ::testing::TestWithParam<int>
+{
+};
+
+TEST_P(UdpSocketBenchmark, DISABLED_BenchmarkLoopbackPacketsPerSecond)
+{
+	int batchSize = GetParam();
+	fwRefContainer<net::UdpSocket> receiver = CreateBoundSocket();
+	fwRefContainer<net::UdpSocket> sender = CreateBoundSocket();
+
+	ASSERT_NE(nullptr, receiver.GetRef());
+	ASSERT_NE(nullptr, sender.GetRef());
+
+	net::PeerAddress receiverAddress = receiver->GetLocalAddress();
+
+	std::atomic<bool> done(false);
+	uint64_t sentPackets = 0;
+
+	std::thread senderThread([&] ()
+	{
+		net::UdpPacketBatch batch(batchSize);
+		std::vector<uint8_t> payload(kBenchmarkPacketSize, 0x42);
+
+		for (int i = 0; i < batchSize; i++)
+		{
+			batch.Add(payload.data(), payload.size(), receiverAddress);
+		}
+
+		while (!done)
+		{
+			sentPackets += sender->SendBatch(batch);
+		}
+	});
+
+	net::UdpPacketBatch batch(batchSize);
+	int receivedPackets = 0;
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	while (receivedPackets < kBenchmarkPackets)
+	{
+		receivedPackets += receiver->ReceiveBatch(batch);
+	}
+
+	double time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	done = true;
+	senderThread.join();
+
+	printf("batch size %d: %.0f packets/s received, %.3f receive syscalls/packet, %.3f send syscalls/packet\n",
+		batchSize,
+		receivedPackets / time,
+		receiver->GetSystemCallCount() / static_cast<double>(receivedPackets),
+		sender->GetSystemCallCount() / static_cast<double>(sentPackets));
+
+	EXPECT_GE(receivedPackets, kBenchmarkPackets);
+}
+
+INSTANTIATE_TEST_CASE_P(BatchSizes, UdpSocketBenchmark, ::testing::Values(1, 16, 64));
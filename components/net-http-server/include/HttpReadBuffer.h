@@ -0,0 +1,61 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+namespace net
+{
+//
+// A contiguous buffer for incoming request data. Bytes get appended at the tail and consumed from the head; the
+// unconsumed part only gets moved back to the start once the tail runs out of room, so parsing can always work on
+// a single pointer/length pair without the buffer being copied for every read.
+//
+class
+#ifdef COMPILING_NET_HTTP_SERVER
+	DLL_EXPORT
+#endif
+	HttpReadBuffer
+{
+private:
+	std::vector<uint8_t> m_data;
+
+	size_t m_start;
+
+	size_t m_end;
+
+	// statistics
+	size_t m_bytesCopied;
+
+public:
+	HttpReadBuffer();
+
+	void Append(const uint8_t* data, size_t length);
+
+	void Consume(size_t length);
+
+	inline const uint8_t* GetData() const
+	{
+		return m_data.data() + m_start;
+	}
+
+	inline size_t GetSize() const
+	{
+		return m_end - m_start;
+	}
+
+	inline bool IsEmpty() const
+	{
+		return (m_start == m_end);
+	}
+
+	// gets the amount of bytes that were copied in or moved around by this buffer
+	inline size_t GetBytesCopied() const
+	{
+		return m_bytesCopied;
+	}
+};
+}
@@ -9,6 +9,10 @@
 
 #include "TcpServer.h"
 
+#include <atomic>
+
+#include <boost/utility/string_ref.hpp>
+
 namespace net
 {
 struct HeaderComparator : std::binary_function<std::string, std::string, bool>
@@ -21,7 +25,14 @@ struct HeaderComparator : std::binary_function<std::string, std::string, bool>
 
 typedef std::map<std::string, std::string, HeaderComparator> HeaderMap;
 
-class HttpRequest : public fwRefCountable
+// name/value pairs referencing memory owned by someone else
+typedef std::vector<std::pair<boost::string_ref, boost::string_ref>> HeaderViewList;
+
+class
+#ifdef COMPILING_NET_HTTP_SERVER
+	DLL_EXPORT
+#endif
+	HttpRequest : public fwRefCountable
 {
 private:
 	int m_httpVersionMajor;
@@ -31,13 +42,26 @@ private:
 
 	std::string m_path;
 
-	HeaderMap m_headerList;
+	// header names and values, back to back
+	std::string m_headerData;
+
+	// views into m_headerData
+	HeaderViewList m_headerViews;
+
+	// only gets built if someone asks for the full map
+	mutable std::unique_ptr<HeaderMap> m_headerList;
 
 	std::function<void(const std::vector<uint8_t>&)> m_dataHandler;
 
+private:
+	void SetHeaders(const HeaderViewList& headers);
+
 public:
 	HttpRequest(int httpVersionMajor, int httpVersionMinor, const std::string& requestMethod, const std::string& path, const HeaderMap& headerList);
 
+	// copies the referenced headers once, so they can point into a transient parse buffer
+	HttpRequest(int httpVersionMajor, int httpVersionMinor, const std::string& requestMethod, const std::string& path, const HeaderViewList& headerList);
+
 	virtual ~HttpRequest() override;
 
 	inline const std::function<void(const std::vector<uint8_t>& data)>& GetDataHandler() const
@@ -65,19 +89,26 @@ public:
 		return m_path;
 	}
 
-	inline const HeaderMap& GetHeaders() const
+	inline const HeaderViewList& GetHeaderViews() const
 	{
-		return m_headerList;
+		return m_headerViews;
 	}
 
-	inline const std::string& GetHeader(const std::string& key, const std::string& default = std::string()) const
+	const HeaderMap& GetHeaders() const;
+
+	// looks up a header without allocating - returns nullptr if it isn't present
+	const boost::string_ref* FindHeader(boost::string_ref key) const;
+
+	inline std::string GetHeader(const std::string& key, const std::string& defaultValue = std::string()) const
 	{
-		auto it = m_headerList.find(key);
+		auto value = FindHeader(key);
 
-		return (it != m_headerList.end()) ? it->second : default;
+		return (value) ? value->to_string() : defaultValue;
 	}
 };
 
+struct HttpResponsePipeline;
+
 class
 #ifdef COMPILING_NET_HTTP_SERVER
 	DLL_EXPORT
@@ -91,19 +122,38 @@ private:
 
 	int m_statusCode;
 
-	bool m_ended;
+	// atomic, as handlers may end the response on another loop while the connection checks on it
+	std::atomic<bool> m_ended;
 
 	bool m_sentHeaders;
 
 	bool m_closeConnection;
 
+	// whether the body gets sent using chunked transfer encoding
+	bool m_chunked;
+
 	HeaderMap m_headerList;
 
+	// the responses to pipelined requests on our connection, which have to be sent in request order
+	std::shared_ptr<HttpResponsePipeline> m_pipeline;
+
+	// output held back until all responses queued before us have ended
+	std::vector<PooledBuffer> m_heldBuffers;
+
+	// WhenWritable callbacks waiting for us to get to the front of the pipeline
+	std::vector<std::function<void()>> m_heldWritableCallbacks;
+
+	friend struct HttpResponsePipeline;
+
 private:
 	static std::string GetStatusMessage(int statusCode);
 
+	PooledBuffer FormatHead(int statusCode, const std::string& statusMessage, const HeaderMap& headers);
+
+	void WriteOut(std::vector<PooledBuffer>& buffers, bool ending);
+
 public:
-	HttpResponse(fwRefContainer<TcpServerStream> clientStream, fwRefContainer<HttpRequest> request);
+	HttpResponse(fwRefContainer<TcpServerStream> clientStream, fwRefContainer<HttpRequest> request, const std::shared_ptr<HttpResponsePipeline>& pipeline = std::shared_ptr<HttpResponsePipeline>());
 
 	std::string GetHeader(const std::string& name);
 
@@ -119,8 +169,17 @@ public:
 
 	void WriteHead(int statusCode, const std::string& statusMessage, const HeaderMap& headers);
 
+	// if no Content-Length was set, the first Write will make this send a chunked response (or a
+	// connection-delimited one, for HTTP/1.0 clients)
 	void Write(const std::string& data);
 
+	// writes body data without copying it
+	void Write(const PooledBuffer& data);
+
+	// runs the callback once our output is below the connection's high-water mark, for streaming large bodies
+	// without buffering all of them. this may be called from any thread.
+	void WhenWritable(const std::function<void()>& callback);
+
 	void End();
 
 	void End(const std::string& data);
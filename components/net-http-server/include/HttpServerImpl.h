@@ -9,10 +9,27 @@
 
 #include "HttpServer.h"
 
+#include <atomic>
+#include <chrono>
 #include <forward_list>
 
 namespace net
 {
+struct HttpServerStatistics
+{
+	// connections closed for taking too long to send request headers
+	uint64_t headerTimeouts;
+
+	// connections closed for not sending any request body data for too long
+	uint64_t bodyTimeouts;
+
+	// persistent connections closed for being idle between requests
+	uint64_t idleTimeouts;
+
+	// connections closed for buffering too much request data
+	uint64_t oversizedRequests;
+};
+
 class 
 #ifdef COMPILING_NET_HTTP_SERVER
 	DLL_EXPORT
@@ -24,6 +41,20 @@ private:
 
 	std::forward_list<fwRefContainer<HttpHandler>> m_handlers;
 
+	std::chrono::milliseconds m_headerTimeout;
+
+	std::chrono::milliseconds m_bodyTimeout;
+
+	std::chrono::milliseconds m_keepAliveTimeout;
+
+	std::atomic<uint64_t> m_headerTimeouts;
+
+	std::atomic<uint64_t> m_bodyTimeouts;
+
+	std::atomic<uint64_t> m_idleTimeouts;
+
+	std::atomic<uint64_t> m_oversizedRequests;
+
 private:
 	void OnConnection(fwRefContainer<TcpServerStream> stream);
 
@@ -35,5 +66,15 @@ public:
 	virtual void AttachToServer(fwRefContainer<TcpServer> server) override;
 
 	virtual void RegisterHandler(fwRefContainer<HttpHandler> handler) override;
+
+	//
+	// Sets how long a request's headers may take to arrive in full, how long a request body may go without
+	// receiving any data, and how long a persistent connection may stay idle between requests. A zero timeout
+	// disables the respective limit. Nothing expires while a handler is still working on a response.
+	// This has to be called before any connections arrive.
+	//
+	void SetRequestTimeouts(std::chrono::milliseconds headerTimeout, std::chrono::milliseconds bodyTimeout, std::chrono::milliseconds keepAliveTimeout);
+
+	HttpServerStatistics GetStatistics();
 };
 }
\ No newline at end of file
@@ -0,0 +1,38 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include "HttpServer.h"
+
+#include <NetMetrics.h>
+
+namespace net
+{
+//
+// An HttpHandler exporting the connection metrics of a registry at a single path, in the Prometheus text format.
+//
+class
+#ifdef COMPILING_NET_HTTP_SERVER
+	DLL_EXPORT
+#endif
+	MetricsHandler : public HttpHandler
+{
+private:
+	std::string m_path;
+
+	fwRefContainer<MetricsRegistry> m_registry;
+
+public:
+	// exports the process-wide registry
+	MetricsHandler(const std::string& path);
+
+	MetricsHandler(const std::string& path, fwRefContainer<MetricsRegistry> registry);
+
+	virtual bool HandleRequest(fwRefContainer<HttpRequest> request, fwRefContainer<HttpResponse> response) override;
+};
+}
@@ -0,0 +1,71 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include "HttpServer.h"
+#include "UvLoopHolder.h"
+
+#include <mutex>
+#include <unordered_map>
+
+namespace net
+{
+//
+// An HttpHandler serving files below a root directory, supporting single byte ranges and conditional requests
+// using content-hash ETags.
+//
+// Files are read asynchronously, one pooled block at a time, and the next block is only read once the connection
+// drained below its high-water mark - so memory use per connection stays bounded no matter the file size.
+//
+class
+#ifdef COMPILING_NET_HTTP_SERVER
+	DLL_EXPORT
+#endif
+	StaticFileHandler : public HttpHandler
+{
+private:
+	struct CachedETag
+	{
+		uint64_t size;
+		int64_t modificationTime;
+
+		std::string etag;
+	};
+
+private:
+	std::string m_urlPrefix;
+
+	std::string m_rootPath;
+
+	fwRefContainer<UvLoopHolder> m_loop;
+
+	std::mutex m_etagMutex;
+
+	std::unordered_map<std::string, CachedETag> m_etags;
+
+public:
+	// serves requests for paths starting with urlPrefix from rootPath
+	StaticFileHandler(const std::string& urlPrefix, const std::string& rootPath);
+
+	virtual bool HandleRequest(fwRefContainer<HttpRequest> request, fwRefContainer<HttpResponse> response) override;
+
+	inline const fwRefContainer<UvLoopHolder>& GetLoop()
+	{
+		return m_loop;
+	}
+
+	// gets the ETag for a file, if it was hashed before and didn't change since
+	bool GetCachedETag(const std::string& path, uint64_t size, int64_t modificationTime, std::string* etag);
+
+	void SetCachedETag(const std::string& path, uint64_t size, int64_t modificationTime, const std::string& etag);
+
+private:
+	// maps a request path to a file below the root, returning false if it isn't ours or is invalid
+	bool MapPath(const std::string& requestPath, std::string* filePath, bool* isValid);
+};
+}
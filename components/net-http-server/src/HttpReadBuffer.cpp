@@ -0,0 +1,60 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "HttpReadBuffer.h"
+
+namespace net
+{
+HttpReadBuffer::HttpReadBuffer()
+	: m_start(0), m_end(0), m_bytesCopied(0)
+{
+
+}
+
+void HttpReadBuffer::Append(const uint8_t* data, size_t length)
+{
+	if (m_data.size() - m_end < length)
+	{
+		size_t size = GetSize();
+
+		// move the unconsumed data back to the start - this happens at most once per buffer length appended
+		if (m_start > 0)
+		{
+			memmove(m_data.data(), m_data.data() + m_start, size);
+
+			m_bytesCopied += size;
+
+			m_start = 0;
+			m_end = size;
+		}
+
+		// and grow if that wasn't enough
+		if (m_data.size() - m_end < length)
+		{
+			m_data.resize(std::max(m_data.size() * 2, size + length));
+		}
+	}
+
+	memcpy(m_data.data() + m_end, data, length);
+
+	m_bytesCopied += length;
+	m_end += length;
+}
+
+void HttpReadBuffer::Consume(size_t length)
+{
+	m_start += std::min(length, GetSize());
+
+	// rewind for free once everything got consumed
+	if (m_start == m_end)
+	{
+		m_start = 0;
+		m_end = 0;
+	}
+}
+}
@@ -8,13 +8,12 @@
 #include "StdInc.h"
 #include "HttpServer.h"
 #include "HttpServerImpl.h"
+#include "HttpReadBuffer.h"
 #include "TLSServer.h"
 
 #include <ctime>
 #include <deque>
-#include <iomanip>
 #include <memory>
-#include <sstream>
 
 #include <boost/algorithm/string.hpp>
 
@@ -22,7 +21,40 @@
 
 namespace net
 {
+// responses to pipelined requests, in request order
+struct HttpResponsePipeline
+{
+	std::mutex mutex;
+
+	std::deque<fwRefContainer<HttpResponse>> responses;
+
+	// invoked (outside of the mutex) once the last queued response has ended
+	std::function<void()> drainedCallback;
+
+	// drops all queued responses - to be called with the mutex held, and returning the responses
+	// so they get released outside of it
+	std::deque<fwRefContainer<HttpResponse>> Clear()
+	{
+		std::deque<fwRefContainer<HttpResponse>> droppedResponses;
+		droppedResponses.swap(responses);
+
+		// held callbacks may well reference the response itself
+		for (auto& response : droppedResponses)
+		{
+			response->m_heldBuffers.clear();
+			response->m_heldWritableCallbacks.clear();
+
+			// nothing is going to get sent anymore, so let streaming writers know they can stop
+			response->m_ended = true;
+		}
+
+		return droppedResponses;
+	}
+};
+
 HttpServerImpl::HttpServerImpl()
+	: m_headerTimeout(std::chrono::seconds(15)), m_bodyTimeout(std::chrono::seconds(30)), m_keepAliveTimeout(std::chrono::seconds(30)),
+	  m_headerTimeouts(0), m_bodyTimeouts(0), m_idleTimeouts(0), m_oversizedRequests(0)
 {
 
 }
@@ -42,6 +74,24 @@ void HttpServerImpl::RegisterHandler(fwRefContainer<HttpHandler> handler)
 	m_handlers.push_front(handler);
 }
 
+void HttpServerImpl::SetRequestTimeouts(std::chrono::milliseconds headerTimeout, std::chrono::milliseconds bodyTimeout, std::chrono::milliseconds keepAliveTimeout)
+{
+	m_headerTimeout = headerTimeout;
+	m_bodyTimeout = bodyTimeout;
+	m_keepAliveTimeout = keepAliveTimeout;
+}
+
+HttpServerStatistics HttpServerImpl::GetStatistics()
+{
+	HttpServerStatistics statistics;
+	statistics.headerTimeouts = m_headerTimeouts;
+	statistics.bodyTimeouts = m_bodyTimeouts;
+	statistics.idleTimeouts = m_idleTimeouts;
+	statistics.oversizedRequests = m_oversizedRequests;
+
+	return statistics;
+}
+
 void HttpServerImpl::OnConnection(fwRefContainer<TcpServerStream> stream)
 {
 	enum HttpConnectionReadState
@@ -51,11 +101,19 @@ void HttpServerImpl::OnConnection(fwRefContainer<TcpServerStream> stream)
 		ReadStateChunked
 	};
 
+	enum HttpConnectionDeadline
+	{
+		DeadlineNone,
+		DeadlineHeader,
+		DeadlineBody,
+		DeadlineIdle
+	};
+
 	struct HttpConnectionData
 	{
 		HttpConnectionReadState readState;
 
-		std::deque<uint8_t> readBuffer;
+		HttpReadBuffer readBuffer;
 
 		std::vector<uint8_t> requestData;
 
@@ -69,10 +127,18 @@ void HttpServerImpl::OnConnection(fwRefContainer<TcpServerStream> stream)
 
 		fwRefContainer<HttpResponse> response;
 
-		int contentLength;
+		std::shared_ptr<HttpResponsePipeline> pipeline;
+
+		size_t contentLength;
+
+		// only touched from the stream's I/O thread
+		HttpConnectionDeadline deadline;
+
+		// the read callback updates the deadline once it's done anyway
+		std::atomic<bool> processingRead;
 
 		HttpConnectionData()
-			: readState(ReadStateRequest), lastLength(0), contentLength(0)
+			: readState(ReadStateRequest), lastLength(0), pipeline(std::make_shared<HttpResponsePipeline>()), contentLength(0), deadline(DeadlineNone), processingRead(false)
 		{
 
 		}
@@ -80,26 +146,120 @@ void HttpServerImpl::OnConnection(fwRefContainer<TcpServerStream> stream)
 
 	std::shared_ptr<HttpConnectionData> connectionData = std::make_shared<HttpConnectionData>();
 
-	stream->SetReadCallback([=] (const std::vector<uint8_t>& data)
+	// arms the deadline for whatever we're waiting on the client for - this has to run on the stream's I/O thread
+	auto updateDeadline = [this, connectionData, stream] ()
 	{
-		// keep a reference to the connection data locally
-		std::shared_ptr<HttpConnectionData> localConnectionData = connectionData;
+		HttpConnectionDeadline deadline;
 
-		// place bytes in the read buffer
-		auto& readQueue = connectionData->readBuffer;
+		if (connectionData->readState != ReadStateRequest)
+		{
+			deadline = DeadlineBody;
+		}
+		else if (!connectionData->readBuffer.IsEmpty())
+		{
+			deadline = DeadlineHeader;
+		}
+		else
+		{
+			// while a handler is still working on a response, it's not on the client to send anything
+			std::unique_lock<std::mutex> lock(connectionData->pipeline->mutex);
+			deadline = (connectionData->pipeline->responses.empty()) ? DeadlineIdle : DeadlineNone;
+		}
 
-		size_t origSize = readQueue.size();
-		readQueue.resize(origSize + data.size());
+		// headers have to arrive in time as a whole, so trickling them in byte by byte doesn't push the deadline back
+		if (deadline == DeadlineHeader && connectionData->deadline == DeadlineHeader)
+		{
+			return;
+		}
 
-		// close the stream if the length is too big
-		if (readQueue.size() > (1024 * 1024 * 5))
+		connectionData->deadline = deadline;
+
+		std::chrono::milliseconds timeout(0);
+		std::atomic<uint64_t>* counter = nullptr;
+
+		switch (deadline)
+		{
+		case DeadlineHeader:
+			timeout = m_headerTimeout;
+			counter = &m_headerTimeouts;
+			break;
+		case DeadlineBody:
+			timeout = m_bodyTimeout;
+			counter = &m_bodyTimeouts;
+			break;
+		case DeadlineIdle:
+			timeout = m_keepAliveTimeout;
+			counter = &m_idleTimeouts;
+			break;
+		default:
+			break;
+		}
+
+		if (timeout.count() <= 0)
+		{
+			stream->ClearDeadline();
+			return;
+		}
+
+		stream->SetDeadline(timeout, [=] ()
 		{
+			(*counter)++;
+
+			connectionData->deadline = DeadlineNone;
 			stream->Close();
+		});
+	};
+
+	stream->SetCloseCallback([=] ()
+	{
+		// responses that are still queued won't ever get sent - and they'd keep the pipeline alive
+		std::deque<fwRefContainer<HttpResponse>> droppedResponses;
+		std::function<void()> drainedCallback;
+
+		{
+			std::unique_lock<std::mutex> lock(connectionData->pipeline->mutex);
+			droppedResponses = connectionData->pipeline->Clear();
+
+			drainedCallback.swap(connectionData->pipeline->drainedCallback);
+		}
+	});
+
+	// responses may end on any thread, but the deadline has to be updated from the I/O thread
+	connectionData->pipeline->drainedCallback = [=] ()
+	{
+		if (!connectionData->processingRead)
+		{
+			stream->ScheduleCallback(updateDeadline);
+		}
+	};
+
+	updateDeadline();
+
+	stream->SetReadCallback([=] (const PooledBuffer& data)
+	{
+		// keep everything we need locally - closing the stream from a handler destroys this callback
+		std::shared_ptr<HttpConnectionData> localConnectionData = connectionData;
+		fwRefContainer<TcpServerStream> localStream = stream;
+
+		auto& handlers = m_handlers;
+		auto& readBuffer = localConnectionData->readBuffer;
+
+		// close the stream if the length is too big
+		if ((readBuffer.GetSize() + data.size()) > (1024 * 1024 * 5))
+		{
+			m_oversizedRequests++;
+
+			localStream->Close();
 			return;
 		}
 
-		// actually copy
-		std::copy(data.begin(), data.end(), readQueue.begin() + origSize);
+		// place bytes in the read buffer
+		readBuffer.Append(data.data(), data.size());
+
+		localConnectionData->processingRead = true;
+
+		// responses to pipelined requests that complete right away get sent as a batch
+		localStream->Cork();
 
 		// process request data until there's no need anymore
 		bool continueProcessing = true;
@@ -109,9 +269,6 @@ void HttpServerImpl::OnConnection(fwRefContainer<TcpServerStream> stream)
 			// depending on the state, perform an action
 			if (localConnectionData->readState == ReadStateRequest)
 			{
-				// copy the deque into a vector for data purposes
-				std::vector<uint8_t> requestData(readQueue.begin(), readQueue.end());
-
 				// define output variables
 				const char* requestMethod;
 				size_t requestMethodLength;
@@ -122,7 +279,8 @@ void HttpServerImpl::OnConnection(fwRefContainer<TcpServerStream> stream)
 				int minorVersion;
 				size_t numHeaders = 50;
 
-				int result = phr_parse_request(reinterpret_cast<const char*>(&requestData[0]), requestData.size(), &requestMethod, &requestMethodLength,
+				// the parser is able to skip past the data it has already seen incomplete last time
+				int result = phr_parse_request(reinterpret_cast<const char*>(readBuffer.GetData()), readBuffer.GetSize(), &requestMethod, &requestMethodLength,
 											   &path, &pathLength, &minorVersion, localConnectionData->headers, &numHeaders, localConnectionData->lastLength);
 
 				if (result > 0)
@@ -131,24 +289,28 @@ void HttpServerImpl::OnConnection(fwRefContainer<TcpServerStream> stream)
 					std::string requestMethodStr(requestMethod, requestMethodLength);
 					std::string pathStr(path, pathLength);
 
-					HeaderMap headerList;
+					HeaderViewList headerList;
+					headerList.reserve(numHeaders);
 
-					for (int i = 0; i < numHeaders; i++)
+					for (size_t i = 0; i < numHeaders; i++)
 					{
 						auto& header = localConnectionData->headers[i];
 
-						headerList.insert(std::make_pair(std::string(header.name, header.name_len), std::string(header.value, header.value_len)));
+						headerList.emplace_back(boost::string_ref(header.name, header.name_len), boost::string_ref(header.value, header.value_len));
 					}
 
-					// remove the original bytes from the queue
-					readQueue.erase(readQueue.begin(), readQueue.begin() + result);
+					// store the request in a request instance - this copies the headers out of the read buffer
+					fwRefContainer<HttpRequest> request = new HttpRequest(1, minorVersion, requestMethodStr, pathStr, headerList);
+					fwRefContainer<HttpResponse> response = new HttpResponse(localStream, request, localConnectionData->pipeline);
+
+					// remove the original bytes from the buffer
+					readBuffer.Consume(result);
 					localConnectionData->lastLength = 0;
 
-					// store the request in a request instance
-					fwRefContainer<HttpRequest> request = new HttpRequest(1, minorVersion, requestMethodStr, pathStr, headerList);
-					fwRefContainer<HttpResponse> response = new HttpResponse(stream, request);
+					// the request is complete, so the next one gets a full header deadline of its own
+					localConnectionData->deadline = DeadlineNone;
 
-					for (auto& handler : m_handlers)
+					for (auto& handler : handlers)
 					{
 						if (handler->HandleRequest(request, response) || response->HasEnded())
 						{
@@ -156,71 +318,64 @@ void HttpServerImpl::OnConnection(fwRefContainer<TcpServerStream> stream)
 						}
 					}
 
-					continueProcessing = (readQueue.size() > 0);
+					continueProcessing = !readBuffer.IsEmpty();
+
+					// the body gets read even if the response has ended already - otherwise it'd be parsed as the next request
+					auto contentLengthStr = request->FindHeader("content-length");
+					long long contentLength = (contentLengthStr) ? strtoll(contentLengthStr->to_string().c_str(), nullptr, 10) : 0;
 
-					if (!response->HasEnded())
+					if (contentLength > 0)
 					{
-						// check to see if we'll have to read user data
-						static std::string contentLengthKey = "content-length";
-						static std::string contentLengthDefault = "0";
+						localConnectionData->request = request;
+						localConnectionData->response = response;
+						localConnectionData->contentLength = static_cast<size_t>(contentLength);
 
-						auto& contentLengthStr = request->GetHeader(contentLengthKey, contentLengthDefault);
-						int contentLength = atoi(contentLengthStr.c_str());
+						localConnectionData->readState = ReadStateBody;
+					}
+					else
+					{
+						auto transferEncoding = request->FindHeader("transfer-encoding");
 
-						if (contentLength > 0)
+						if (transferEncoding && *transferEncoding == "chunked")
 						{
 							localConnectionData->request = request;
 							localConnectionData->response = response;
-							localConnectionData->contentLength = contentLength;
-
-							localConnectionData->readState = ReadStateBody;
-						}
-						else
-						{
-							static std::string transferEncodingKey = "transfer-encoding";
-							static std::string transferEncodingDefault = "";
-							static std::string transferEncodingComparison = "chunked";
+							localConnectionData->contentLength = 0;
 
-							if (request->GetHeader(transferEncodingKey, transferEncodingDefault) == transferEncodingComparison)
-							{
-								localConnectionData->request = request;
-								localConnectionData->response = response;
-								localConnectionData->contentLength = -1;
+							localConnectionData->lastLength = 0;
 
-								localConnectionData->lastLength = 0;
+							localConnectionData->readState = ReadStateChunked;
 
-								localConnectionData->readState = ReadStateChunked;
-
-								memset(&localConnectionData->decoder, 0, sizeof(localConnectionData->decoder));
-								localConnectionData->decoder.consume_trailer = true;
-							}
+							memset(&localConnectionData->decoder, 0, sizeof(localConnectionData->decoder));
+							localConnectionData->decoder.consume_trailer = true;
 						}
 					}
 				}
 				else if (result == -1)
 				{
 					// should probably send 'bad request'?
-					stream->Close();
+					localStream->Uncork();
+					localStream->Close();
 					return;
 				}
 				else if (result == -2)
 				{
-					localConnectionData->lastLength = requestData.size();
+					localConnectionData->lastLength = readBuffer.GetSize();
 
 					continueProcessing = false;
 				}
 			}
-			else if (connectionData->readState == ReadStateBody)
+			else if (localConnectionData->readState == ReadStateBody)
 			{
-				int contentLength = localConnectionData->contentLength;
+				size_t contentLength = localConnectionData->contentLength;
 
-				if (readQueue.size() >= contentLength)
+				if (readBuffer.GetSize() >= contentLength)
 				{
-					// copy the deque into a vector for data purposes, again
-					std::vector<uint8_t> requestData(readQueue.begin(), readQueue.begin() + contentLength);
+					// copy the body out for the data handler
+					std::vector<uint8_t> requestData(readBuffer.GetData(), readBuffer.GetData() + contentLength);
 
-					// remove the original bytes from the queue
-					readQueue.erase(readQueue.begin(), readQueue.begin() + contentLength);
+					// remove the original bytes from the buffer
+					readBuffer.Consume(contentLength);
 
 					// call the data handler
 					auto& dataHandler = localConnectionData->request->GetDataHandler();
@@ -238,50 +393,58 @@ void HttpServerImpl::OnConnection(fwRefContainer<TcpServerStream> stream)
 
 					localConnectionData->readState = ReadStateRequest;
 
-					continueProcessing = (readQueue.size() > 0);
+					continueProcessing = !readBuffer.IsEmpty();
 				}
 				else
 				{
 					continueProcessing = false;
 				}
 			}
-			else if (connectionData->readState == ReadStateChunked)
+			else if (localConnectionData->readState == ReadStateChunked)
 			{
-				// append the remnant of the read queue to the vector
+				// move whatever got read into the decode buffer - lastLength is the amount of decoded bytes in there
 				auto& requestData = localConnectionData->requestData;
 
-				size_t addedSize = readQueue.size() - requestData.size();
-				size_t oldSize = requestData.size();
-				requestData.resize(readQueue.size());
+				size_t addedSize = readBuffer.GetSize();
+				requestData.insert(requestData.end(), readBuffer.GetData(), readBuffer.GetData() + addedSize);
 
-				// copy the appendant
-				std::copy(readQueue.begin() + oldSize, readQueue.end(), requestData.begin() + localConnectionData->lastLength);
+				readBuffer.Consume(addedSize);
 
-				// decode stuff
-				size_t requestSize = addedSize;
+				// decode stuff in-place
+				size_t requestSize = requestData.size() - localConnectionData->lastLength;
 
 				int result = phr_decode_chunked(&localConnectionData->decoder, reinterpret_cast<char*>(&requestData[localConnectionData->lastLength]), &requestSize);
 
 				if (result == -2)
 				{
 					localConnectionData->lastLength += requestSize;
+					requestData.resize(localConnectionData->lastLength);
 
 					continueProcessing = false;
 				}
 				else if (result == -1)
 				{
-					stream->Close();
+					localStream->Uncork();
+					localStream->Close();
 					return;
 				}
 				else
 				{
+					size_t decodedLength = localConnectionData->lastLength + requestSize;
+
+					// anything following the chunked data belongs to the next request
+					if (result > 0)
+					{
+						readBuffer.Append(&requestData[decodedLength], result);
+					}
+
+					requestData.resize(decodedLength);
+
 					// call the data handler
 					auto& dataHandler = localConnectionData->request->GetDataHandler();
 
 					if (dataHandler)
 					{
-						requestData.resize(localConnectionData->lastLength);
-
 						dataHandler(requestData);
 
 						localConnectionData->request->SetDataHandler(std::function<void(const std::vector<uint8_t>&)>());
@@ -292,19 +455,116 @@ void HttpServerImpl::OnConnection(fwRefContainer<TcpServerStream> stream)
 					localConnectionData->response = nullptr;
 
 					localConnectionData->requestData.clear();
+					localConnectionData->lastLength = 0;
 
 					localConnectionData->readState = ReadStateRequest;
 
-					continueProcessing = (readQueue.size() > 0);
+					continueProcessing = !readBuffer.IsEmpty();
 				}
 			}
 		}
+
+		localConnectionData->processingRead = false;
+		updateDeadline();
+
+		localStream->Uncork();
 	});
 }
 
 HttpRequest::HttpRequest(int httpVersionMajor, int httpVersionMinor, const std::string& requestMethod, const std::string& path, const HeaderMap& headerList)
-	: m_httpVersionMajor(httpVersionMajor), m_httpVersionMinor(httpVersionMinor), m_requestMethod(requestMethod), m_path(path), m_headerList(headerList)
+	: m_httpVersionMajor(httpVersionMajor), m_httpVersionMinor(httpVersionMinor), m_requestMethod(requestMethod), m_path(path)
 {
+	HeaderViewList headers;
+
+	for (auto& header : headerList)
+	{
+		headers.emplace_back(header.first, header.second);
+	}
+
+	SetHeaders(headers);
+}
+
+HttpRequest::HttpRequest(int httpVersionMajor, int httpVersionMinor, const std::string& requestMethod, const std::string& path, const HeaderViewList& headerList)
+	: m_httpVersionMajor(httpVersionMajor), m_httpVersionMinor(httpVersionMinor), m_requestMethod(requestMethod), m_path(path)
+{
+	SetHeaders(headerList);
+}
+
+void HttpRequest::SetHeaders(const HeaderViewList& headers)
+{
+	size_t length = 0;
+
+	for (auto& header : headers)
+	{
+		length += header.first.size() + header.second.size();
+	}
+
+	// reserve first, so appending won't move the data the views point to
+	m_headerData.reserve(length);
+	m_headerViews.reserve(headers.size());
+
+	for (auto& header : headers)
+	{
+		size_t nameOffset = m_headerData.size();
+		m_headerData.append(header.first.data(), header.first.size());
+
+		size_t valueOffset = m_headerData.size();
+		m_headerData.append(header.second.data(), header.second.size());
+
+		m_headerViews.emplace_back(boost::string_ref(m_headerData.data() + nameOffset, header.first.size()),
+								   boost::string_ref(m_headerData.data() + valueOffset, header.second.size()));
+	}
+}
+
+const HeaderMap& HttpRequest::GetHeaders() const
+{
+	if (!m_headerList)
+	{
+		m_headerList = std::make_unique<HeaderMap>();
+
+		for (auto& header : m_headerViews)
+		{
+			m_headerList->insert({ header.first.to_string(), header.second.to_string() });
+		}
+	}
+
+	return *m_headerList;
+}
+
+// header names and the values we compare are plain ASCII, so there's no need to involve locales
+static bool EqualsCaseInsensitive(boost::string_ref left, boost::string_ref right)
+{
+	if (left.size() != right.size())
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < left.size(); i++)
+	{
+		char l = left[i];
+		char r = right[i];
+
+		if (l != r && ((l | 0x20) != (r | 0x20) || (l | 0x20) < 'a' || (l | 0x20) > 'z'))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+const boost::string_ref* HttpRequest::FindHeader(boost::string_ref key) const
+{
+	// requests carry few enough headers for a linear scan to beat building a map
+	for (auto& header : m_headerViews)
+	{
+		if (EqualsCaseInsensitive(header.first, key))
+		{
+			return &header.second;
+		}
+	}
+
+	return nullptr;
 }
 
 HttpRequest::~HttpRequest()
@@ -312,10 +572,14 @@ HttpRequest::~HttpRequest()
 	SetDataHandler(std::function<void(const std::vector<uint8_t>&)>());
 }
 
-HttpResponse::HttpResponse(fwRefContainer<TcpServerStream> clientStream, fwRefContainer<HttpRequest> request)
-	: m_clientStream(clientStream), m_ended(false), m_statusCode(200), m_sentHeaders(false), m_request(request), m_closeConnection(false)
+HttpResponse::HttpResponse(fwRefContainer<TcpServerStream> clientStream, fwRefContainer<HttpRequest> request, const std::shared_ptr<HttpResponsePipeline>& pipeline)
+	: m_clientStream(clientStream), m_ended(false), m_statusCode(200), m_sentHeaders(false), m_request(request), m_closeConnection(false), m_chunked(false), m_pipeline(pipeline)
 {
-
+	if (m_pipeline)
+	{
+		std::unique_lock<std::mutex> lock(m_pipeline->mutex);
+		m_pipeline->responses.push_back(this);
+	}
 }
 
 std::string HttpResponse::GetHeader(const std::string& name)
@@ -357,79 +621,340 @@ void HttpResponse::WriteHead(int statusCode, const std::string& statusMessage, c
 		return;
 	}
 
-	std::ostringstream outData;
-	outData.imbue(std::locale());
+	std::vector<PooledBuffer> buffers;
+	buffers.push_back(FormatHead(statusCode, statusMessage, headers));
 
-	outData << "HTTP/1.0 " << std::to_string(statusCode) << " " << (statusMessage.empty() ? GetStatusMessage(statusCode) : statusMessage) << "\r\n";
+	WriteOut(buffers, false);
+}
 
-	auto& usedHeaders = (headers.size() == 0) ? m_headerList : headers;
-	
-	if (usedHeaders.find("date") == usedHeaders.end())
+// formatting the date is fairly expensive, so only do so once a second (per thread, so there's no need to lock)
+static const std::string& GetHttpDate()
+{
+	static thread_local std::time_t lastTime;
+	static thread_local std::string dateString;
+
+	std::time_t timeVal = std::time(nullptr);
+
+	if (timeVal != lastTime || dateString.empty())
 	{
-		std::time_t timeVal;
-		std::time(&timeVal);
+		static const char* days[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+		static const char* months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+		std::tm time;
 
-		std::tm time = *std::gmtime(&timeVal);
-		outData << "Date: " << std::put_time(&time, "%a, %d %b %Y %H:%M:%S %Z") << "\r\n";
+#ifdef _WIN32
+		gmtime_s(&time, &timeVal);
+#else
+		gmtime_r(&timeVal, &time);
+#endif
+
+		dateString = va("%s, %02d %s %04d %02d:%02d:%02d GMT", days[time.tm_wday], time.tm_mday, months[time.tm_mon], time.tm_year + 1900, time.tm_hour, time.tm_min, time.tm_sec);
+		lastTime = timeVal;
 	}
 
-	auto requestConnection = m_request->GetHeader(std::string("connection"), std::string("close"));
+	return dateString;
+}
 
-	if (_stricmp(requestConnection.c_str(), "keep-alive") != 0)
-	{
-		outData << "Connection: close\r\n";
+PooledBuffer HttpResponse::FormatHead(int statusCode, const std::string& statusMessage, const HeaderMap& headers)
+{
+	m_statusCode = statusCode;
 
-		m_closeConnection = true;
+	auto& usedHeaders = (headers.size() == 0) ? m_headerList : headers;
+
+	// persistent connections are the default since HTTP/1.1, but have to be asked for by HTTP/1.0 clients
+	bool isHttp11 = (m_request->GetHttpVersion() >= std::make_pair(1, 1));
+	auto requestConnection = m_request->FindHeader("connection");
+
+	if (isHttp11)
+	{
+		m_closeConnection = (requestConnection && EqualsCaseInsensitive(*requestConnection, "close"));
 	}
 	else
 	{
-		outData << "Connection: keep-alive\r\n";
+		m_closeConnection = !(requestConnection && EqualsCaseInsensitive(*requestConnection, "keep-alive"));
 	}
 
-	for (auto& header : usedHeaders)
+	// without a length, the body has to be delimited somehow
+	bool hasLength = (usedHeaders.find("content-length") != usedHeaders.end());
+	auto transferEncoding = usedHeaders.find("transfer-encoding");
+
+	bool addChunked = false;
+
+	if (transferEncoding != usedHeaders.end())
 	{
-		outData << header.first << ": " << header.second << "\r\n";
+		m_chunked = EqualsCaseInsensitive(transferEncoding->second, "chunked");
+	}
+	else if (!hasLength)
+	{
+		if (isHttp11)
+		{
+			m_chunked = true;
+			addChunked = true;
+		}
+		else
+		{
+			m_closeConnection = true;
+		}
 	}
 
-	outData << "\r\n";
+	std::string outData;
+	outData.reserve(256);
 
-	std::string outStr = outData.str();
+	outData += "HTTP/1.1 ";
+	outData += std::to_string(statusCode);
+	outData += " ";
+	outData += (statusMessage.empty() ? GetStatusMessage(statusCode) : statusMessage);
+	outData += "\r\n";
+
+	if (usedHeaders.find("date") == usedHeaders.end())
+	{
+		outData += "Date: ";
+		outData += GetHttpDate();
+		outData += "\r\n";
+	}
+
+	if (m_closeConnection)
+	{
+		outData += "Connection: close\r\n";
+	}
+	else if (!isHttp11)
+	{
+		outData += "Connection: keep-alive\r\n";
+	}
 
-	std::vector<uint8_t> dataBuffer(outStr.size());
-	memcpy(&dataBuffer[0], outStr.c_str(), outStr.size());
+	if (addChunked)
+	{
+		outData += "Transfer-Encoding: chunked\r\n";
+	}
 
-	m_clientStream->Write(dataBuffer);
+	for (auto& header : usedHeaders)
+	{
+		outData += header.first;
+		outData += ": ";
+		outData += header.second;
+		outData += "\r\n";
+	}
+
+	outData += "\r\n";
 
 	m_sentHeaders = true;
+
+	return PooledBuffer(outData.c_str(), outData.size());
 }
 
 void HttpResponse::Write(const std::string& data)
 {
-	SetHeader(std::string("Content-Length"), std::to_string(data.size()));
+	Write(PooledBuffer(data.c_str(), data.size()));
+}
+
+void HttpResponse::Write(const PooledBuffer& data)
+{
+	// send the head along with the first body chunk, so both leave in a single write
+	std::vector<PooledBuffer> buffers;
 
 	if (!m_sentHeaders)
 	{
-		WriteHead(m_statusCode);
+		buffers.push_back(FormatHead(m_statusCode, std::string(), m_headerList));
+	}
+
+	// an empty chunk would end the response
+	if (!data.empty())
+	{
+		if (m_chunked)
+		{
+			static PooledBuffer chunkTrailer("\r\n", 2);
+
+			char chunkHeader[20];
+			int chunkHeaderLength = snprintf(chunkHeader, sizeof(chunkHeader), "%zx\r\n", data.size());
+
+			buffers.emplace_back(std::vector<uint8_t>(chunkHeader, chunkHeader + chunkHeaderLength));
+			buffers.push_back(data);
+			buffers.push_back(chunkTrailer);
+		}
+		else
+		{
+			buffers.push_back(data);
+		}
 	}
 
-	std::vector<uint8_t> dataBuffer(data.size());
-	memcpy(&dataBuffer[0], data.c_str(), data.size());
+	WriteOut(buffers, false);
+}
+
+void HttpResponse::WhenWritable(const std::function<void()>& callback)
+{
+	if (m_pipeline)
+	{
+		std::unique_lock<std::mutex> lock(m_pipeline->mutex);
+
+		auto& responses = m_pipeline->responses;
+
+		if (m_ended)
+		{
+			return;
+		}
+
+		// our output is being held back anyway, so wait until it isn't
+		if (!responses.empty() && responses.front().GetRef() != this)
+		{
+			m_heldWritableCallbacks.push_back(callback);
+			return;
+		}
+	}
 
-	m_clientStream->Write(dataBuffer);
+	m_clientStream->WhenWritable(callback);
 }
 
 void HttpResponse::End(const std::string& data)
 {
+	// the entire body is known, so there's no need for a chunked response
+	if (!m_sentHeaders && m_headerList.find("content-length") == m_headerList.end() && m_headerList.find("transfer-encoding") == m_headerList.end())
+	{
+		SetHeader(std::string("Content-Length"), std::to_string(data.size()));
+	}
+
 	Write(data);
 	End();
 }
 
 void HttpResponse::End()
 {
-	if (m_closeConnection)
+	if (m_ended)
+	{
+		return;
+	}
+
+	std::vector<PooledBuffer> buffers;
+
+	if (!m_sentHeaders)
+	{
+		if (m_headerList.find("content-length") == m_headerList.end() && m_headerList.find("transfer-encoding") == m_headerList.end())
+		{
+			SetHeader(std::string("Content-Length"), std::string("0"));
+		}
+
+		buffers.push_back(FormatHead(m_statusCode, std::string(), m_headerList));
+	}
+
+	if (m_chunked)
+	{
+		buffers.emplace_back("0\r\n\r\n", 5);
+	}
+
+	WriteOut(buffers, true);
+}
+
+void HttpResponse::WriteOut(std::vector<PooledBuffer>& buffers, bool ending)
+{
+	if (!m_pipeline)
+	{
+		if (!buffers.empty())
+		{
+			m_clientStream->WriteV(buffers);
+		}
+
+		if (ending)
+		{
+			m_ended = true;
+
+			if (m_closeConnection)
+			{
+				m_clientStream->Close();
+			}
+		}
+
+		return;
+	}
+
+	// keep a reference, as we might get removed from the pipeline
+	fwRefContainer<HttpResponse> thisRef = this;
+
+	std::deque<fwRefContainer<HttpResponse>> droppedResponses;
+	std::vector<std::function<void()>> writableCallbacks;
+	std::function<void()> drainedCallback;
+	bool closeConnection = false;
+
+	{
+		std::unique_lock<std::mutex> lock(m_pipeline->mutex);
+
+		auto& responses = m_pipeline->responses;
+
+		// if a previous response is still going, wait for it to end
+		if (responses.empty() || responses.front().GetRef() != this)
+		{
+			m_heldBuffers.insert(m_heldBuffers.end(), buffers.begin(), buffers.end());
+
+			if (ending)
+			{
+				m_ended = true;
+			}
+
+			return;
+		}
+
+		if (!buffers.empty())
+		{
+			m_clientStream->WriteV(buffers);
+		}
+
+		if (!ending)
+		{
+			return;
+		}
+
+		m_ended = true;
+		closeConnection = m_closeConnection;
+
+		responses.pop_front();
+
+		// let the responses queued behind us catch up
+		while (!closeConnection && !responses.empty())
+		{
+			auto& next = responses.front();
+
+			if (!next->m_heldBuffers.empty())
+			{
+				m_clientStream->WriteV(next->m_heldBuffers);
+				next->m_heldBuffers.clear();
+			}
+
+			writableCallbacks.insert(writableCallbacks.end(), next->m_heldWritableCallbacks.begin(), next->m_heldWritableCallbacks.end());
+			next->m_heldWritableCallbacks.clear();
+
+			if (!next->m_ended)
+			{
+				break;
+			}
+
+			closeConnection = next->m_closeConnection;
+			responses.pop_front();
+		}
+
+		// nothing after a closing response will get sent
+		if (closeConnection)
+		{
+			droppedResponses = m_pipeline->Clear();
+			writableCallbacks.clear();
+		}
+		else if (responses.empty())
+		{
+			drainedCallback = m_pipeline->drainedCallback;
+		}
+	}
+
+	if (drainedCallback)
+	{
+		drainedCallback();
+	}
+
+	if (closeConnection)
 	{
 		m_clientStream->Close();
 	}
+
+	for (auto& callback : writableCallbacks)
+	{
+		m_clientStream->WhenWritable(callback);
+	}
 }
 
 
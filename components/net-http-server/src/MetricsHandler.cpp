@@ -0,0 +1,49 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "MetricsHandler.h"
+
+namespace net
+{
+MetricsHandler::MetricsHandler(const std::string& path)
+	: MetricsHandler(path, Instance<MetricsRegistry>::Get())
+{
+
+}
+
+MetricsHandler::MetricsHandler(const std::string& path, fwRefContainer<MetricsRegistry> registry)
+	: m_path(path), m_registry(registry)
+{
+
+}
+
+bool MetricsHandler::HandleRequest(fwRefContainer<HttpRequest> request, fwRefContainer<HttpResponse> response)
+{
+	const std::string& path = request->GetPath();
+
+	// ignore any query string, scrapers like to add some
+	if (path.compare(0, m_path.size(), m_path) != 0 || (path.size() > m_path.size() && path[m_path.size()] != '?'))
+	{
+		return false;
+	}
+
+	if (request->GetRequestMethod() != "GET" && request->GetRequestMethod() != "HEAD")
+	{
+		response->SetHeader("Allow", "GET, HEAD");
+		response->SetStatusCode(405);
+		response->End();
+
+		return true;
+	}
+
+	response->SetHeader("Content-Type", "text/plain; version=0.0.4");
+	response->End(m_registry->FormatPrometheus());
+
+	return true;
+}
+}
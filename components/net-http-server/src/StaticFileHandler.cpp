@@ -0,0 +1,675 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "StaticFileHandler.h"
+#include "UvLoopManager.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace net
+{
+// closes a file without going through a loop, as transfers may get released from any thread
+static void CloseFile(uv_file file)
+{
+#ifdef _WIN32
+	_close(file);
+#else
+	close(file);
+#endif
+}
+
+static const char* GetContentType(const std::string& path)
+{
+	static const std::pair<const char*, const char*> contentTypes[] = {
+		{ ".html", "text/html" },
+		{ ".htm", "text/html" },
+		{ ".css", "text/css" },
+		{ ".js", "application/javascript" },
+		{ ".json", "application/json" },
+		{ ".txt", "text/plain" },
+		{ ".xml", "text/xml" },
+		{ ".png", "image/png" },
+		{ ".jpg", "image/jpeg" },
+		{ ".jpeg", "image/jpeg" },
+		{ ".gif", "image/gif" },
+		{ ".svg", "image/svg+xml" },
+		{ ".ogg", "audio/ogg" },
+		{ ".ttf", "font/ttf" },
+		{ ".woff", "font/woff" },
+	};
+
+	size_t dot = path.find_last_of("./");
+
+	if (dot != std::string::npos && path[dot] == '.')
+	{
+		for (auto& type : contentTypes)
+		{
+			if (_stricmp(path.c_str() + dot, type.first) == 0)
+			{
+				return type.second;
+			}
+		}
+	}
+
+	return "application/octet-stream";
+}
+
+// parses a single 'bytes=' range - returns false if the header should be ignored, and sets isSatisfiable to false
+// if the range doesn't overlap the file
+static bool ParseRange(const std::string& rangeHeader, uint64_t size, uint64_t* start, uint64_t* length, bool* isSatisfiable)
+{
+	*isSatisfiable = true;
+
+	if (rangeHeader.compare(0, 6, "bytes=") != 0 || rangeHeader.find(',') != std::string::npos)
+	{
+		return false;
+	}
+
+	const char* spec = rangeHeader.c_str() + 6;
+	const char* dash = strchr(spec, '-');
+
+	if (!dash)
+	{
+		return false;
+	}
+
+	char* end;
+
+	if (dash == spec)
+	{
+		// suffix range: the last n bytes
+		uint64_t suffixLength = strtoull(dash + 1, &end, 10);
+
+		if (*end != '\0' || end == dash + 1)
+		{
+			return false;
+		}
+
+		if (suffixLength == 0 || size == 0)
+		{
+			*isSatisfiable = false;
+			return true;
+		}
+
+		suffixLength = std::min(suffixLength, size);
+
+		*start = size - suffixLength;
+		*length = suffixLength;
+
+		return true;
+	}
+
+	uint64_t first = strtoull(spec, &end, 10);
+
+	if (end != dash)
+	{
+		return false;
+	}
+
+	uint64_t last = size - 1;
+
+	if (dash[1] != '\0')
+	{
+		last = strtoull(dash + 1, &end, 10);
+
+		if (*end != '\0' || last < first)
+		{
+			return false;
+		}
+	}
+
+	if (first >= size)
+	{
+		*isSatisfiable = false;
+		return true;
+	}
+
+	last = std::min(last, size - 1);
+
+	*start = first;
+	*length = last - first + 1;
+
+	return true;
+}
+
+static bool MatchesETag(const std::string& ifNoneMatch, const std::string& etag)
+{
+	size_t offset = 0;
+
+	while (offset < ifNoneMatch.size())
+	{
+		size_t comma = ifNoneMatch.find(',', offset);
+
+		if (comma == std::string::npos)
+		{
+			comma = ifNoneMatch.size();
+		}
+
+		std::string candidate = ifNoneMatch.substr(offset, comma - offset);
+
+		// trim, and ignore weakness as If-None-Match uses weak comparison
+		size_t first = candidate.find_first_not_of(" \t");
+		size_t last = candidate.find_last_not_of(" \t");
+
+		if (first != std::string::npos)
+		{
+			candidate = candidate.substr(first, last - first + 1);
+
+			if (candidate.compare(0, 2, "W/") == 0)
+			{
+				candidate = candidate.substr(2);
+			}
+
+			if (candidate == "*" || candidate == etag)
+			{
+				return true;
+			}
+		}
+
+		offset = comma + 1;
+	}
+
+	return false;
+}
+
+//
+// The state of a single file response. Everything here runs on the handler's loop thread.
+//
+class StaticFileTransfer : public fwRefCountable
+{
+private:
+	fwRefContainer<StaticFileHandler> m_handler;
+
+	fwRefContainer<HttpRequest> m_request;
+
+	fwRefContainer<HttpResponse> m_response;
+
+	std::string m_path;
+
+	uv_file m_file;
+
+	uv_fs_t m_fsReq;
+
+	uv_work_t m_workReq;
+
+	uint64_t m_size;
+
+	int64_t m_modificationTime;
+
+	std::string m_etag;
+
+	// the rest of the range to send
+	uint64_t m_offset;
+
+	uint64_t m_remaining;
+
+	fwRefContainer<PooledBufferBlock> m_readBlock;
+
+public:
+	StaticFileTransfer(StaticFileHandler* handler, fwRefContainer<HttpRequest> request, fwRefContainer<HttpResponse> response, const std::string& path);
+
+	virtual ~StaticFileTransfer();
+
+	void Start();
+
+private:
+	uv_loop_t* GetLoop();
+
+	void OnOpen(ssize_t result);
+
+	void OnStat(ssize_t result);
+
+	void HashFile();
+
+	void Respond();
+
+	void ReadNext();
+
+	void OnRead(ssize_t result);
+
+	void Finish();
+
+	void RespondWithStatus(int statusCode);
+
+	// takes over the reference held while libuv owned the request
+	template<typename TReq>
+	static fwRefContainer<StaticFileTransfer> FromRequest(TReq* req)
+	{
+		fwRefContainer<StaticFileTransfer> self(reinterpret_cast<StaticFileTransfer*>(req->data));
+		self->Release();
+
+		return self;
+	}
+};
+
+StaticFileTransfer::StaticFileTransfer(StaticFileHandler* handler, fwRefContainer<HttpRequest> request, fwRefContainer<HttpResponse> response, const std::string& path)
+	: m_handler(handler), m_request(request), m_response(response), m_path(path), m_file(-1), m_size(0), m_modificationTime(0), m_offset(0), m_remaining(0)
+{
+	m_fsReq.data = this;
+	m_workReq.data = this;
+}
+
+StaticFileTransfer::~StaticFileTransfer()
+{
+	// we may get dropped along with a closed connection's callbacks
+	if (m_file >= 0)
+	{
+		CloseFile(m_file);
+	}
+}
+
+uv_loop_t* StaticFileTransfer::GetLoop()
+{
+	return m_handler->GetLoop()->GetLoop();
+}
+
+void StaticFileTransfer::Start()
+{
+	fwRefContainer<StaticFileTransfer> self = this;
+
+	m_handler->GetLoop()->EnqueueCallback([=] ()
+	{
+		self->AddRef();
+
+		uv_fs_open(self->GetLoop(), &self->m_fsReq, self->m_path.c_str(), O_RDONLY, 0, [] (uv_fs_t* req)
+		{
+			fwRefContainer<StaticFileTransfer> self = FromRequest(req);
+
+			ssize_t result = req->result;
+			uv_fs_req_cleanup(req);
+
+			self->OnOpen(result);
+		});
+	});
+}
+
+void StaticFileTransfer::OnOpen(ssize_t result)
+{
+	if (result < 0)
+	{
+		RespondWithStatus(404);
+		return;
+	}
+
+	m_file = static_cast<uv_file>(result);
+
+	AddRef();
+
+	uv_fs_fstat(GetLoop(), &m_fsReq, m_file, [] (uv_fs_t* req)
+	{
+		fwRefContainer<StaticFileTransfer> self = FromRequest(req);
+
+		ssize_t result = req->result;
+
+		if (result == 0)
+		{
+			// directories and such aren't served
+			if ((req->statbuf.st_mode & S_IFMT) != S_IFREG)
+			{
+				result = UV_EISDIR;
+			}
+
+			self->m_size = req->statbuf.st_size;
+			self->m_modificationTime = req->statbuf.st_mtim.tv_sec;
+		}
+
+		uv_fs_req_cleanup(req);
+
+		self->OnStat(result);
+	});
+}
+
+void StaticFileTransfer::OnStat(ssize_t result)
+{
+	if (result < 0)
+	{
+		RespondWithStatus(404);
+		return;
+	}
+
+	if (m_handler->GetCachedETag(m_path, m_size, m_modificationTime, &m_etag))
+	{
+		Respond();
+		return;
+	}
+
+	HashFile();
+}
+
+void StaticFileTransfer::HashFile()
+{
+	// hash the file contents on the thread pool, so the ETag stays stable across copies and restarts
+	AddRef();
+
+	uv_queue_work(GetLoop(), &m_workReq, [] (uv_work_t* req)
+	{
+		StaticFileTransfer* self = reinterpret_cast<StaticFileTransfer*>(req->data);
+
+		// FNV-1a - this runs off the loop, so plain stdio is used instead of synchronous libuv requests
+		uint64_t hash = 14695981039346656037ULL;
+		uint64_t length = 0;
+
+		FILE* file = fopen(self->m_path.c_str(), "rb");
+
+		if (file)
+		{
+			std::vector<uint8_t> buffer(65536);
+			size_t readLength;
+
+			while ((readLength = fread(buffer.data(), 1, buffer.size(), file)) > 0)
+			{
+				for (size_t i = 0; i < readLength; i++)
+				{
+					hash ^= buffer[i];
+					hash *= 1099511628211ULL;
+				}
+
+				length += readLength;
+			}
+
+			fclose(file);
+		}
+
+		self->m_etag = va("\"%016llx-%llx\"", static_cast<unsigned long long>(hash), static_cast<unsigned long long>(length));
+	}, [] (uv_work_t* req, int status)
+	{
+		fwRefContainer<StaticFileTransfer> self = FromRequest(req);
+
+		self->m_handler->SetCachedETag(self->m_path, self->m_size, self->m_modificationTime, self->m_etag);
+		self->Respond();
+	});
+}
+
+void StaticFileTransfer::Respond()
+{
+	m_response->SetHeader("ETag", m_etag);
+	m_response->SetHeader("Accept-Ranges", "bytes");
+
+	auto ifNoneMatch = m_request->FindHeader("if-none-match");
+
+	if (ifNoneMatch && MatchesETag(ifNoneMatch->to_string(), m_etag))
+	{
+		m_response->SetHeader("Content-Length", std::to_string(m_size));
+		m_response->WriteHead(304);
+		m_response->End();
+
+		Finish();
+		return;
+	}
+
+	uint64_t start = 0;
+	uint64_t length = m_size;
+
+	int statusCode = 200;
+
+	auto range = m_request->FindHeader("range");
+
+	if (range)
+	{
+		bool isSatisfiable;
+
+		if (ParseRange(range->to_string(), m_size, &start, &length, &isSatisfiable))
+		{
+			if (!isSatisfiable)
+			{
+				m_response->SetHeader("Content-Range", va("bytes */%llu", static_cast<unsigned long long>(m_size)));
+				RespondWithStatus(416);
+
+				return;
+			}
+
+			m_response->SetHeader("Content-Range", va("bytes %llu-%llu/%llu", static_cast<unsigned long long>(start), static_cast<unsigned long long>(start + length - 1), static_cast<unsigned long long>(m_size)));
+			statusCode = 206;
+		}
+	}
+
+	m_response->SetHeader("Content-Type", GetContentType(m_path));
+	m_response->SetHeader("Content-Length", std::to_string(length));
+	m_response->SetStatusCode(statusCode);
+
+	if (m_request->GetRequestMethod() == "HEAD")
+	{
+		m_response->End();
+
+		Finish();
+		return;
+	}
+
+	m_offset = start;
+	m_remaining = length;
+
+	ReadNext();
+}
+
+void StaticFileTransfer::ReadNext()
+{
+	// a dropped response means the connection is gone
+	if (m_remaining == 0 || m_response->HasEnded())
+	{
+		m_response->End();
+
+		Finish();
+		return;
+	}
+
+	// read straight into a pooled block, which will be handed to the stream as-is
+	m_readBlock = BufferPool::GetDefault()->Acquire();
+
+	uv_buf_t buf = uv_buf_init(reinterpret_cast<char*>(m_readBlock->GetData()), static_cast<unsigned int>(std::min<uint64_t>(m_readBlock->GetSize(), m_remaining)));
+
+	AddRef();
+
+	uv_fs_read(GetLoop(), &m_fsReq, m_file, &buf, 1, m_offset, [] (uv_fs_t* req)
+	{
+		fwRefContainer<StaticFileTransfer> self = FromRequest(req);
+
+		ssize_t result = req->result;
+		uv_fs_req_cleanup(req);
+
+		self->OnRead(result);
+	});
+}
+
+void StaticFileTransfer::OnRead(ssize_t result)
+{
+	if (result <= 0)
+	{
+		// the file got truncated or failed reading - we can't make up for promised data
+		trace("Reading %s failed - %s\n", m_path.c_str(), (result == 0) ? "unexpected end of file" : uv_strerror(result));
+
+		m_response->End();
+
+		Finish();
+		return;
+	}
+
+	PooledBuffer data(m_readBlock, 0, result);
+	m_readBlock = nullptr;
+
+	m_offset += result;
+	m_remaining -= result;
+
+	m_response->Write(data);
+
+	// wait for the connection to drain before reading any more
+	fwRefContainer<StaticFileTransfer> self = this;
+
+	m_response->WhenWritable([=] ()
+	{
+		self->m_handler->GetLoop()->EnqueueCallback([=] ()
+		{
+			self->ReadNext();
+		});
+	});
+}
+
+void StaticFileTransfer::RespondWithStatus(int statusCode)
+{
+	m_response->SetStatusCode(statusCode);
+	m_response->End();
+
+	Finish();
+}
+
+void StaticFileTransfer::Finish()
+{
+	if (m_file >= 0)
+	{
+		CloseFile(m_file);
+		m_file = -1;
+	}
+
+	m_response = nullptr;
+	m_request = nullptr;
+}
+
+StaticFileHandler::StaticFileHandler(const std::string& urlPrefix, const std::string& rootPath)
+	: m_urlPrefix(urlPrefix), m_rootPath(rootPath)
+{
+	m_loop = Instance<UvLoopManager>::Get()->GetOrCreate("httpFiles");
+}
+
+bool StaticFileHandler::MapPath(const std::string& requestPath, std::string* filePath, bool* isValid)
+{
+	*isValid = false;
+
+	std::string path = requestPath.substr(0, requestPath.find('?'));
+
+	if (path.compare(0, m_urlPrefix.size(), m_urlPrefix) != 0)
+	{
+		return false;
+	}
+
+	// '/files' shouldn't take '/filesystem'
+	bool prefixEndsSegment = (m_urlPrefix.empty() || m_urlPrefix.back() == '/' || path.size() == m_urlPrefix.size() || path[m_urlPrefix.size()] == '/');
+
+	if (!prefixEndsSegment)
+	{
+		return false;
+	}
+
+	// percent-decode the rest
+	std::string relativePath;
+
+	for (size_t i = m_urlPrefix.size(); i < path.size(); i++)
+	{
+		if (path[i] == '%' && i + 2 < path.size() && isxdigit(path[i + 1]) && isxdigit(path[i + 2]))
+		{
+			relativePath += static_cast<char>(strtol(path.substr(i + 1, 2).c_str(), nullptr, 16));
+			i += 2;
+		}
+		else
+		{
+			relativePath += path[i];
+		}
+	}
+
+	// don't allow escaping the root
+	if (relativePath.find('\0') != std::string::npos || relativePath.find('\\') != std::string::npos || relativePath.find(':') != std::string::npos)
+	{
+		return true;
+	}
+
+	// normalize the segments, dropping empty and '.' ones
+	std::string normalizedPath;
+	size_t offset = 0;
+
+	while (offset <= relativePath.size())
+	{
+		size_t slash = relativePath.find('/', offset);
+
+		if (slash == std::string::npos)
+		{
+			slash = relativePath.size();
+		}
+
+		std::string segment = relativePath.substr(offset, slash - offset);
+		offset = slash + 1;
+
+		if (segment.empty() || segment == ".")
+		{
+			continue;
+		}
+
+		// Windows drops trailing dots and spaces from names, so '...' or '.. ' would still mean the parent
+		if (segment.find_first_not_of(". ") == std::string::npos)
+		{
+			return true;
+		}
+
+		normalizedPath += "/" + segment;
+	}
+
+	*filePath = m_rootPath + normalizedPath;
+	*isValid = true;
+
+	return true;
+}
+
+bool StaticFileHandler::HandleRequest(fwRefContainer<HttpRequest> request, fwRefContainer<HttpResponse> response)
+{
+	std::string filePath;
+	bool isValid;
+
+	if (!MapPath(request->GetPath(), &filePath, &isValid))
+	{
+		return false;
+	}
+
+	if (!isValid)
+	{
+		response->SetStatusCode(400);
+		response->End();
+
+		return true;
+	}
+
+	if (request->GetRequestMethod() != "GET" && request->GetRequestMethod() != "HEAD")
+	{
+		response->SetHeader("Allow", "GET, HEAD");
+		response->SetStatusCode(405);
+		response->End();
+
+		return true;
+	}
+
+	fwRefContainer<StaticFileTransfer> transfer = new StaticFileTransfer(this, request, response, filePath);
+	transfer->Start();
+
+	return true;
+}
+
+bool StaticFileHandler::GetCachedETag(const std::string& path, uint64_t size, int64_t modificationTime, std::string* etag)
+{
+	std::unique_lock<std::mutex> lock(m_etagMutex);
+
+	auto it = m_etags.find(path);
+
+	if (it == m_etags.end() || it->second.size != size || it->second.modificationTime != modificationTime)
+	{
+		return false;
+	}
+
+	*etag = it->second.etag;
+	return true;
+}
+
+void StaticFileHandler::SetCachedETag(const std::string& path, uint64_t size, int64_t modificationTime, const std::string& etag)
+{
+	std::unique_lock<std::mutex> lock(m_etagMutex);
+
+	m_etags[path] = { size, modificationTime, etag };
+}
+}
@@ -0,0 +1,1053 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <HttpServerImpl.h>
+#include <HttpReadBuffer.h>
+#include <MetricsHandler.h>
+#include <PooledBuffer.h>
+#include <StaticFileHandler.h>
+#include <TcpServerManager.h>
+#include <UvLoopManager.h>
+
+#include <picohttpparser.h>
+
+#include <chrono>
+#include <deque>
+#include <future>
+
+class HttpServerTest : public ::testing::Test
+{
+public:
+	static void SetUpTestCase()
+	{
+		static bool initialized = ([] ()
+		{
+			Instance<net::UvLoopManager>::Set(new net::UvLoopManager());
+			return true;
+		})();
+	}
+};
+
+// responds to GET with the path, and to POST with the request body
+class EchoHttpHandler : public net::HttpHandler
+{
+public:
+	virtual bool HandleRequest(fwRefContainer<net::HttpRequest> request, fwRefContainer<net::HttpResponse> response) override
+	{
+		if (request->GetPath() == "/stream")
+		{
+			response->Write("first,");
+			response->Write("second,");
+			response->Write("third");
+			response->End();
+		}
+		else if (request->GetPath() == "/slow")
+		{
+			// respond from another thread, after later requests got handled already
+			std::thread([=] ()
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+				response->Write("slow");
+				response->End();
+			}).detach();
+		}
+		else if (request->GetPath() == "/sleep")
+		{
+			// takes longer than the keep-alive timeout in the timeout tests
+			std::thread([=] ()
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+				response->End(std::string("slept"));
+			}).detach();
+		}
+		else if (request->GetRequestMethod() == "GET")
+		{
+			response->End(request->GetPath());
+		}
+		else if (request->GetRequestMethod() == "POST")
+		{
+			request->SetDataHandler([=] (const std::vector<uint8_t>& data)
+			{
+				response->End(std::string(data.begin(), data.end()));
+			});
+		}
+
+		return true;
+	}
+};
+
+struct TestHttpServer
+{
+	fwRefContainer<net::TcpServerManager> manager;
+	fwRefContainer<net::TcpServer> tcpServer;
+	fwRefContainer<net::HttpServerImpl> httpServer;
+
+	net::PeerAddress address;
+
+	TestHttpServer(int port, fwRefContainer<net::HttpHandler> handler = nullptr)
+		: address(net::PeerAddress::FromString(va("127.0.0.1:%d", port), port, net::PeerAddress::LookupType::ResolveName).get())
+	{
+		manager = new net::TcpServerManager();
+		tcpServer = manager->CreateServer(address);
+
+		httpServer = new net::HttpServerImpl();
+		httpServer->AttachToServer(tcpServer);
+		httpServer->RegisterHandler(new EchoHttpHandler());
+
+		// handlers registered later get tried first
+		if (handler.GetRef())
+		{
+			httpServer->RegisterHandler(handler);
+		}
+	}
+};
+
+// a minimal keep-alive HTTP client
+class TestHttpClient
+{
+private:
+	PlatformSocketType m_socket;
+
+	std::string m_buffer;
+
+	bool m_headOnly;
+
+public:
+	TestHttpClient(const net::PeerAddress& address)
+		: m_headOnly(false)
+	{
+		m_socket = ::socket(address.GetAddressFamily(), SOCK_STREAM, IPPROTO_TCP);
+
+		if (connect(m_socket, address.GetSocketAddress(), address.GetSocketAddressLength()) != 0)
+		{
+			closesocket(m_socket);
+			m_socket = static_cast<PlatformSocketType>(-1);
+		}
+	}
+
+	~TestHttpClient()
+	{
+		if (IsConnected())
+		{
+			closesocket(m_socket);
+		}
+	}
+
+	inline bool IsConnected()
+	{
+		return (m_socket != static_cast<PlatformSocketType>(-1));
+	}
+
+	void Send(const std::string& data)
+	{
+		send(m_socket, data.c_str(), data.size(), 0);
+	}
+
+	// the next response is to a HEAD request
+	inline void ExpectHeadOnly()
+	{
+		m_headOnly = true;
+	}
+
+	// reads a response and returns its body
+	bool ReadResponse(std::string* body, std::string* head = nullptr)
+	{
+		size_t headEnd;
+
+		if (!ReadUntil("\r\n\r\n", &headEnd))
+		{
+			return false;
+		}
+
+		std::string headData = m_buffer.substr(0, headEnd + 4);
+		m_buffer.erase(0, headEnd + 4);
+
+		if (head)
+		{
+			*head = headData;
+		}
+
+		body->clear();
+
+		// these never have a body, whatever the headers say
+		if (headData.find(" 304 ") == 8 || m_headOnly)
+		{
+			m_headOnly = false;
+			return true;
+		}
+
+		if (headData.find("Transfer-Encoding: chunked\r\n") != std::string::npos)
+		{
+			while (true)
+			{
+				size_t lineEnd;
+
+				if (!ReadUntil("\r\n", &lineEnd))
+				{
+					return false;
+				}
+
+				size_t length = strtoul(m_buffer.c_str(), nullptr, 16);
+				m_buffer.erase(0, lineEnd + 2);
+
+				if (!ReadBytes(length + 2))
+				{
+					return false;
+				}
+
+				body->append(m_buffer, 0, length);
+				m_buffer.erase(0, length + 2);
+
+				if (length == 0)
+				{
+					return true;
+				}
+			}
+		}
+
+		size_t lengthStart = headData.find("Content-Length: ");
+
+		if (lengthStart == std::string::npos)
+		{
+			// delimited by the connection closing
+			while (Receive())
+			{
+			}
+
+			body->swap(m_buffer);
+			return true;
+		}
+
+		size_t length = atoi(&headData[lengthStart + 16]);
+
+		if (!ReadBytes(length))
+		{
+			return false;
+		}
+
+		*body = m_buffer.substr(0, length);
+		m_buffer.erase(0, length);
+
+		return true;
+	}
+
+	// checks if the server closed the connection
+	bool IsClosedByServer()
+	{
+		return m_buffer.empty() && !Receive();
+	}
+
+	// waits for the server to close the connection, without blocking for longer than the timeout
+	bool WaitForClose(std::chrono::milliseconds timeout)
+	{
+		fd_set readSet;
+		FD_ZERO(&readSet);
+		FD_SET(m_socket, &readSet);
+
+		timeval timeVal;
+		timeVal.tv_sec = static_cast<long>(timeout.count() / 1000);
+		timeVal.tv_usec = static_cast<long>((timeout.count() % 1000) * 1000);
+
+		if (select(static_cast<int>(m_socket) + 1, &readSet, nullptr, nullptr, &timeVal) <= 0)
+		{
+			return false;
+		}
+
+		return IsClosedByServer();
+	}
+
+private:
+	bool ReadUntil(const char* delimiter, size_t* offset)
+	{
+		while ((*offset = m_buffer.find(delimiter)) == std::string::npos)
+		{
+			if (!Receive())
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool ReadBytes(size_t length)
+	{
+		while (m_buffer.size() < length)
+		{
+			if (!Receive())
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool Receive()
+	{
+		char buffer[16384];
+		int length = recv(m_socket, buffer, sizeof(buffer), 0);
+
+		if (length <= 0)
+		{
+			return false;
+		}
+
+		m_buffer.append(buffer, length);
+		return true;
+	}
+};
+
+TEST(HttpReadBufferTest, ConsumesAndCompacts)
+{
+	net::HttpReadBuffer buffer;
+
+	buffer.Append(reinterpret_cast<const uint8_t*>("GET / HTTP/1.1"), 14);
+	buffer.Consume(4);
+
+	EXPECT_EQ(10, buffer.GetSize());
+	EXPECT_EQ(0, memcmp(buffer.GetData(), "/ HTTP/1.1", 10));
+
+	// consuming everything rewinds without moving any data
+	size_t copied = buffer.GetBytesCopied();
+	buffer.Consume(10);
+
+	EXPECT_TRUE(buffer.IsEmpty());
+	EXPECT_EQ(copied, buffer.GetBytesCopied());
+
+	// running out of room at the tail moves the unconsumed part back to the start
+	std::vector<uint8_t> data(1024, 'x');
+	buffer.Append(data.data(), data.size());
+	buffer.Consume(1000);
+	buffer.Append(data.data(), 1000);
+
+	EXPECT_EQ(1024, buffer.GetSize());
+	EXPECT_EQ(copied + 1024 + 24 + 1000, buffer.GetBytesCopied());
+}
+
+TEST_F(HttpServerTest, PipelinedRequests)
+{
+	TestHttpServer server(30220);
+
+	TestHttpClient client(server.address);
+	ASSERT_TRUE(client.IsConnected());
+
+	client.Send(
+		"GET /first HTTP/1.1\r\nConnection: keep-alive\r\n\r\n"
+		"POST /body HTTP/1.1\r\nConnection: keep-alive\r\nContent-Length: 11\r\n\r\nhello world"
+		"POST /chunked HTTP/1.1\r\nConnection: keep-alive\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n6\r\n there\r\n0\r\n\r\n"
+		"GET /last HTTP/1.1\r\nConnection: keep-alive\r\n\r\n"
+	);
+
+	std::string body;
+
+	ASSERT_TRUE(client.ReadResponse(&body));
+	EXPECT_EQ("/first", body);
+
+	ASSERT_TRUE(client.ReadResponse(&body));
+	EXPECT_EQ("hello world", body);
+
+	ASSERT_TRUE(client.ReadResponse(&body));
+	EXPECT_EQ("hello there", body);
+
+	ASSERT_TRUE(client.ReadResponse(&body));
+	EXPECT_EQ("/last", body);
+}
+
+TEST_F(HttpServerTest, SlowTrickleRequest)
+{
+	TestHttpServer server(30221);
+
+	TestHttpClient client(server.address);
+	ASSERT_TRUE(client.IsConnected());
+
+	std::string request = "GET /trickle HTTP/1.1\r\nConnection: keep-alive\r\nUser-Agent: test\r\n\r\n";
+
+	for (char c : request)
+	{
+		client.Send(std::string(1, c));
+	}
+
+	std::string body;
+
+	ASSERT_TRUE(client.ReadResponse(&body));
+	EXPECT_EQ("/trickle", body);
+}
+
+TEST_F(HttpServerTest, PersistentByDefault)
+{
+	TestHttpServer server(30223);
+
+	TestHttpClient client(server.address);
+	ASSERT_TRUE(client.IsConnected());
+
+	std::string body;
+	std::string head;
+
+	for (int i = 0; i < 3; i++)
+	{
+		client.Send("GET /again HTTP/1.1\r\nHost: localhost\r\n\r\n");
+
+		ASSERT_TRUE(client.ReadResponse(&body, &head));
+		EXPECT_EQ("/again", body);
+	}
+
+	EXPECT_EQ(0, head.find("HTTP/1.1 200 OK\r\n"));
+	EXPECT_EQ(std::string::npos, head.find("Connection: close"));
+
+	// dates are in IMF-fixdate format
+	size_t dateStart = head.find("Date: ");
+	ASSERT_NE(std::string::npos, dateStart);
+	EXPECT_EQ(" GMT\r\n", head.substr(dateStart + 6 + 25, 6));
+}
+
+TEST_F(HttpServerTest, ClosesHttp10Connections)
+{
+	TestHttpServer server(30224);
+
+	TestHttpClient client(server.address);
+	ASSERT_TRUE(client.IsConnected());
+
+	client.Send("GET /old HTTP/1.0\r\n\r\n");
+
+	std::string body;
+	std::string head;
+
+	ASSERT_TRUE(client.ReadResponse(&body, &head));
+	EXPECT_EQ("/old", body);
+	EXPECT_NE(std::string::npos, head.find("Connection: close\r\n"));
+
+	EXPECT_TRUE(client.IsClosedByServer());
+}
+
+TEST_F(HttpServerTest, ChunkedStreamingResponse)
+{
+	TestHttpServer server(30225);
+
+	TestHttpClient client(server.address);
+	ASSERT_TRUE(client.IsConnected());
+
+	client.Send("GET /stream HTTP/1.1\r\n\r\nGET /after HTTP/1.1\r\n\r\n");
+
+	std::string body;
+	std::string head;
+
+	ASSERT_TRUE(client.ReadResponse(&body, &head));
+	EXPECT_NE(std::string::npos, head.find("Transfer-Encoding: chunked\r\n"));
+	EXPECT_EQ("first,second,third", body);
+
+	ASSERT_TRUE(client.ReadResponse(&body));
+	EXPECT_EQ("/after", body);
+}
+
+TEST_F(HttpServerTest, PipelinedResponsesKeepRequestOrder)
+{
+	TestHttpServer server(30226);
+
+	TestHttpClient client(server.address);
+	ASSERT_TRUE(client.IsConnected());
+
+	client.Send("GET /slow HTTP/1.1\r\n\r\nGET /fast HTTP/1.1\r\n\r\nGET /slow HTTP/1.1\r\n\r\nGET /fast2 HTTP/1.1\r\n\r\n");
+
+	std::string body;
+
+	ASSERT_TRUE(client.ReadResponse(&body));
+	EXPECT_EQ("slow", body);
+
+	ASSERT_TRUE(client.ReadResponse(&body));
+	EXPECT_EQ("/fast", body);
+
+	ASSERT_TRUE(client.ReadResponse(&body));
+	EXPECT_EQ("slow", body);
+
+	ASSERT_TRUE(client.ReadResponse(&body));
+	EXPECT_EQ("/fast2", body);
+}
+
+TEST_F(HttpServerTest, IdleKeepAliveTimeout)
+{
+	TestHttpServer server(30234);
+	server.httpServer->SetRequestTimeouts(std::chrono::seconds(5), std::chrono::seconds(5), std::chrono::milliseconds(100));
+
+	TestHttpClient client(server.address);
+	ASSERT_TRUE(client.IsConnected());
+
+	// the connection doesn't count as idle while the handler is busy
+	client.Send("GET /sleep HTTP/1.1\r\n\r\n");
+
+	std::string body;
+
+	ASSERT_TRUE(client.ReadResponse(&body));
+	EXPECT_EQ("slept", body);
+
+	auto startTime = std::chrono::steady_clock::now();
+
+	EXPECT_TRUE(client.WaitForClose(std::chrono::seconds(3)));
+	EXPECT_GE(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count(), 90);
+
+	auto statistics = server.httpServer->GetStatistics();
+	EXPECT_EQ(1, statistics.idleTimeouts);
+	EXPECT_EQ(0, statistics.headerTimeouts);
+}
+
+TEST_F(HttpServerTest, TrickledHeadersTimeOut)
+{
+	TestHttpServer server(30235);
+	server.httpServer->SetRequestTimeouts(std::chrono::milliseconds(300), std::chrono::seconds(5), std::chrono::seconds(5));
+
+	TestHttpClient client(server.address);
+	ASSERT_TRUE(client.IsConnected());
+
+	client.Send("GET /loris HTTP/1.1\r\nX-Header: ");
+
+	auto startTime = std::chrono::steady_clock::now();
+	bool closed = false;
+
+	// each byte arrives well within the timeout, but the headers as a whole don't
+	for (int i = 0; i < 60 && !closed; i++)
+	{
+		client.Send("a");
+		closed = client.WaitForClose(std::chrono::milliseconds(50));
+	}
+
+	EXPECT_TRUE(closed);
+	EXPECT_GE(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count(), 250);
+
+	EXPECT_EQ(1, server.httpServer->GetStatistics().headerTimeouts);
+}
+
+TEST_F(HttpServerTest, StalledBodyTimesOut)
+{
+	TestHttpServer server(30236);
+	server.httpServer->SetRequestTimeouts(std::chrono::seconds(5), std::chrono::milliseconds(200), std::chrono::seconds(5));
+
+	TestHttpClient client(server.address);
+	ASSERT_TRUE(client.IsConnected());
+
+	client.Send("POST /body HTTP/1.1\r\nContent-Length: 100\r\n\r\n0123456789");
+
+	EXPECT_TRUE(client.WaitForClose(std::chrono::seconds(3)));
+
+	EXPECT_EQ(1, server.httpServer->GetStatistics().bodyTimeouts);
+}
+
+// writes a file for StaticFileHandler to serve, with contents that differ at each offset
+static std::string WriteStaticFile(const char* name, size_t size)
+{
+	std::string data;
+	data.reserve(size);
+
+	for (size_t i = 0; i < size; i++)
+	{
+		data += static_cast<char>('a' + (i * 7 + i / 26) % 26);
+	}
+
+	FILE* file = fopen(name, "wb");
+	fwrite(data.c_str(), 1, data.size(), file);
+	fclose(file);
+
+	return data;
+}
+
+static std::string GetHeaderValue(const std::string& head, const std::string& name)
+{
+	size_t start = head.find("\r\n" + name + ": ");
+
+	if (start == std::string::npos)
+	{
+		return std::string();
+	}
+
+	start += name.size() + 4;
+
+	return head.substr(start, head.find("\r\n", start) - start);
+}
+
+TEST_F(HttpServerTest, StaticFileConditionalRequests)
+{
+	std::string data = WriteStaticFile("static_conditional.txt", 1000);
+
+	TestHttpServer server(30230, new net::StaticFileHandler("/files/", "."));
+
+	TestHttpClient client(server.address);
+	ASSERT_TRUE(client.IsConnected());
+
+	std::string body;
+	std::string head;
+
+	client.Send("GET /files/static_conditional.txt HTTP/1.1\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body, &head));
+	EXPECT_EQ(0, head.find("HTTP/1.1 200 OK\r\n"));
+	EXPECT_EQ("text/plain", GetHeaderValue(head, "Content-Type"));
+	EXPECT_EQ("bytes", GetHeaderValue(head, "Accept-Ranges"));
+	EXPECT_EQ(data, body);
+
+	std::string etag = GetHeaderValue(head, "ETag");
+	ASSERT_FALSE(etag.empty());
+
+	client.Send("GET /files/static_conditional.txt HTTP/1.1\r\nIf-None-Match: \"other\", W/" + etag + "\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body, &head));
+	EXPECT_EQ(0, head.find("HTTP/1.1 304 Not Modified\r\n"));
+	EXPECT_EQ(etag, GetHeaderValue(head, "ETag"));
+
+	client.ExpectHeadOnly();
+	client.Send("HEAD /files/static_conditional.txt HTTP/1.1\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body, &head));
+	EXPECT_EQ("1000", GetHeaderValue(head, "Content-Length"));
+
+	// requests outside the prefix still go to the next handler
+	client.Send("GET /other HTTP/1.1\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body));
+	EXPECT_EQ("/other", body);
+
+	remove("static_conditional.txt");
+}
+
+TEST_F(HttpServerTest, StaticFileRanges)
+{
+	std::string data = WriteStaticFile("static_ranges.bin", 1000);
+
+	TestHttpServer server(30231, new net::StaticFileHandler("/files/", "."));
+
+	TestHttpClient client(server.address);
+	ASSERT_TRUE(client.IsConnected());
+
+	std::string body;
+	std::string head;
+
+	client.Send("GET /files/static_ranges.bin HTTP/1.1\r\nRange: bytes=100-199\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body, &head));
+	EXPECT_EQ(0, head.find("HTTP/1.1 206 Partial Content\r\n"));
+	EXPECT_EQ("bytes 100-199/1000", GetHeaderValue(head, "Content-Range"));
+	EXPECT_EQ(data.substr(100, 100), body);
+
+	client.Send("GET /files/static_ranges.bin HTTP/1.1\r\nRange: bytes=-10\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body, &head));
+	EXPECT_EQ("bytes 990-999/1000", GetHeaderValue(head, "Content-Range"));
+	EXPECT_EQ(data.substr(990), body);
+
+	client.Send("GET /files/static_ranges.bin HTTP/1.1\r\nRange: bytes=2000-\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body, &head));
+	EXPECT_EQ(0, head.find("HTTP/1.1 416 "));
+	EXPECT_EQ("bytes */1000", GetHeaderValue(head, "Content-Range"));
+
+	remove("static_ranges.bin");
+}
+
+TEST_F(HttpServerTest, StaticFileRejectsInvalidPaths)
+{
+	TestHttpServer server(30232, new net::StaticFileHandler("/files/", "."));
+
+	TestHttpClient client(server.address);
+	ASSERT_TRUE(client.IsConnected());
+
+	std::string body;
+	std::string head;
+
+	client.Send("GET /files/../secret HTTP/1.1\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body, &head));
+	EXPECT_EQ(0, head.find("HTTP/1.1 400 "));
+
+	client.Send("GET /files/%2e%2e/secret HTTP/1.1\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body, &head));
+	EXPECT_EQ(0, head.find("HTTP/1.1 400 "));
+
+	client.Send("GET /files/sub/./..%2f..%2fsecret HTTP/1.1\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body, &head));
+	EXPECT_EQ(0, head.find("HTTP/1.1 400 "));
+
+	client.Send("GET /files/..%20/secret HTTP/1.1\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body, &head));
+	EXPECT_EQ(0, head.find("HTTP/1.1 400 "));
+
+	client.Send("GET /files/missing.txt HTTP/1.1\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body, &head));
+	EXPECT_EQ(0, head.find("HTTP/1.1 404 "));
+
+	client.Send("POST /files/missing.txt HTTP/1.1\r\nContent-Length: 0\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body, &head));
+	EXPECT_EQ(0, head.find("HTTP/1.1 405 "));
+	EXPECT_EQ("GET, HEAD", GetHeaderValue(head, "Allow"));
+}
+
+TEST_F(HttpServerTest, StaticFileMatchesWholeSegments)
+{
+	std::string data = WriteStaticFile("static_prefix.txt", 100);
+
+	TestHttpServer server(30238, new net::StaticFileHandler("/files", "."));
+
+	TestHttpClient client(server.address);
+	ASSERT_TRUE(client.IsConnected());
+
+	std::string body;
+	std::string head;
+
+	client.Send("GET /files//./static_prefix.txt HTTP/1.1\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body, &head));
+	EXPECT_EQ(0, head.find("HTTP/1.1 200 "));
+	EXPECT_EQ(data, body);
+
+	// not below the prefix, so it falls through to the echo handler
+	client.Send("GET /filesstatic_prefix.txt HTTP/1.1\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body, &head));
+	EXPECT_EQ(0, head.find("HTTP/1.1 200 "));
+	EXPECT_EQ("/filesstatic_prefix.txt", body);
+
+	remove("static_prefix.txt");
+}
+
+TEST_F(HttpServerTest, BodyOfEndedResponseIsDiscarded)
+{
+	TestHttpServer server(30240, new net::StaticFileHandler("/files/", "."));
+
+	TestHttpClient client(server.address);
+	ASSERT_TRUE(client.IsConnected());
+
+	std::string body;
+	std::string head;
+
+	// the 405 ends the response before the body got read - the body must not turn into another request
+	std::string smuggled = "GET /smuggled HTTP/1.1\r\n\r\n";
+
+	client.Send(va("POST /files/x HTTP/1.1\r\nContent-Length: %d\r\n\r\n%s", static_cast<int>(smuggled.size()), smuggled.c_str()));
+	client.Send("GET /after HTTP/1.1\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body, &head));
+	EXPECT_EQ(0, head.find("HTTP/1.1 405 "));
+
+	ASSERT_TRUE(client.ReadResponse(&body));
+	EXPECT_EQ("/after", body);
+
+	client.Send(va("POST /files/x HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n%x\r\n%s\r\n0\r\n\r\n", static_cast<int>(smuggled.size()), smuggled.c_str()));
+	client.Send("GET /after-chunked HTTP/1.1\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body, &head));
+	EXPECT_EQ(0, head.find("HTTP/1.1 405 "));
+
+	ASSERT_TRUE(client.ReadResponse(&body));
+	EXPECT_EQ("/after-chunked", body);
+}
+
+TEST_F(HttpServerTest, StaticFileLargeTransfer)
+{
+	// a lot larger than the high-water mark, so the transfer has to wait for the client
+	std::string data = WriteStaticFile("static_large.bin", 16 * 1024 * 1024);
+
+	TestHttpServer server(30233, new net::StaticFileHandler("/files/", "."));
+
+	TestHttpClient client(server.address);
+	ASSERT_TRUE(client.IsConnected());
+
+	std::string body;
+
+	client.Send("GET /files/static_large.bin HTTP/1.1\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body));
+	EXPECT_TRUE(data == body);
+
+	client.Send("GET /after HTTP/1.1\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body));
+	EXPECT_EQ("/after", body);
+
+	remove("static_large.bin");
+}
+
+// hands connections to the HTTP server, so a test gets to see the underlying streams
+class ForwardingTcpServer : public net::TcpServer
+{
+public:
+	void Connect(fwRefContainer<net::TcpServerStream> stream)
+	{
+		GetConnectionCallback()(stream);
+	}
+};
+
+TEST_F(HttpServerTest, StaticFileBuffersBoundedForSlowReader)
+{
+	// far more than the socket buffers can take, so most of it would have to sit in our queue
+	std::string data = WriteStaticFile("static_slow.bin", 32 * 1024 * 1024);
+
+	int port = 30239;
+	net::PeerAddress address = net::PeerAddress::FromString(va("127.0.0.1:%d", port), port, net::PeerAddress::LookupType::ResolveName).get();
+
+	fwRefContainer<net::TcpServerManager> manager = new net::TcpServerManager();
+	fwRefContainer<net::TcpServer> tcpServer = manager->CreateServer(address);
+
+	fwRefContainer<ForwardingTcpServer> forwardingServer = new ForwardingTcpServer();
+
+	fwRefContainer<net::HttpServerImpl> httpServer = new net::HttpServerImpl();
+	httpServer->AttachToServer(forwardingServer);
+	httpServer->RegisterHandler(new net::StaticFileHandler("/files/", "."));
+
+	std::promise<fwRefContainer<net::TcpServerStream>> connected;
+
+	tcpServer->SetConnectionCallback([&] (fwRefContainer<net::TcpServerStream> stream)
+	{
+		connected.set_value(stream);
+		forwardingServer->Connect(stream);
+	});
+
+	TestHttpClient client(address);
+	ASSERT_TRUE(client.IsConnected());
+
+	client.Send("GET /files/static_slow.bin HTTP/1.1\r\n\r\n");
+
+	fwRefContainer<net::TcpServerStream> stream = connected.get_future().get();
+
+	// don't read for a while - the transfer has to stop at the high-water mark instead of queueing the file
+	size_t maxQueued = 0;
+	auto endTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+
+	while (std::chrono::steady_clock::now() < endTime)
+	{
+		maxQueued = std::max(maxQueued, stream->GetQueuedBytes());
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	EXPECT_GT(maxQueued, 0);
+	EXPECT_LE(maxQueued, stream->GetHighWaterMark() + 2 * net::BufferPool::GetDefault()->GetBlockSize());
+
+	std::string body;
+
+	ASSERT_TRUE(client.ReadResponse(&body));
+	EXPECT_TRUE(data == body);
+
+	remove("static_slow.bin");
+}
+
+TEST_F(HttpServerTest, MetricsExport)
+{
+	fwRefContainer<net::MetricsRegistry> registry = new net::MetricsRegistry();
+
+	auto connection = registry->CreateConnection("server");
+	connection->Record(net::ConnectionMetric::Rtt, 50);
+
+	TestHttpServer server(30237, new net::MetricsHandler("/metrics", registry));
+
+	TestHttpClient client(server.address);
+	ASSERT_TRUE(client.IsConnected());
+
+	std::string body;
+	std::string head;
+
+	client.Send("GET /metrics?format=text HTTP/1.1\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body, &head));
+	EXPECT_EQ(0, head.find("HTTP/1.1 200 OK\r\n"));
+	EXPECT_EQ("text/plain; version=0.0.4", GetHeaderValue(head, "Content-Type"));
+	EXPECT_NE(std::string::npos, body.find("citizen_net_rtt_milliseconds_count{connection=\"server\"} 1\n"));
+
+	client.Send("POST /metrics HTTP/1.1\r\nContent-Length: 0\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body, &head));
+	EXPECT_EQ(0, head.find("HTTP/1.1 405 "));
+
+	client.Send("GET /metricsfoo HTTP/1.1\r\n\r\n");
+
+	ASSERT_TRUE(client.ReadResponse(&body));
+	EXPECT_EQ("/metricsfoo", body);
+}
+
+TEST(HttpRequestTest, HeaderLookupIsCaseInsensitive)
+{
+	std::string raw = "Content-TypeTEXT/plain";
+
+	net::HeaderViewList headers;
+	headers.emplace_back(boost::string_ref(raw.data(), 12), boost::string_ref(raw.data() + 12, 10));
+
+	fwRefContainer<net::HttpRequest> request = new net::HttpRequest(1, 1, "GET", "/", headers);
+
+	// the request keeps its own copy
+	raw.assign(raw.size(), '?');
+
+	EXPECT_EQ("TEXT/plain", request->GetHeader("content-type"));
+	EXPECT_EQ("default", request->GetHeader("content-length", "default"));
+	EXPECT_EQ(nullptr, request->FindHeader("content-typf"));
+
+	EXPECT_EQ(1, request->GetHeaders().size());
+	EXPECT_EQ("TEXT/plain", request->GetHeaders().find("CONTENT-TYPE")->second);
+}
+
+// benchmark: bytes copied per request for a slowly trickling pipelined client, previous parsing path vs the read buffer
+static const int kBenchmarkRequests = 2000;
+static const size_t kTrickleSize = 16;
+
+static std::string MakeBenchmarkRequests()
+{
+	std::string requests;
+
+	for (int i = 0; i < kBenchmarkRequests; i++)
+	{
+		requests += va("GET /resource/%d HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\nUser-Agent: benchmark\r\nAccept: */*\r\n\r\n", i);
+	}
+
+	return requests;
+}
+
+TEST(HttpReadBufferTest, CopiesLessThanRequestQueue)
+{
+	std::string requests = MakeBenchmarkRequests();
+	const uint8_t* data = reinterpret_cast<const uint8_t*>(requests.data());
+
+	phr_header headers[50];
+
+	const char* method;
+	size_t methodLength;
+	const char* path;
+	size_t pathLength;
+	int minorVersion;
+
+	// the previous path: append to a deque, copy the entire deque into a vector for every parse attempt
+	size_t legacyCopied = 0;
+	int legacyParsed = 0;
+
+	{
+		std::deque<uint8_t> readQueue;
+
+		for (size_t offset = 0; offset < requests.size(); offset += kTrickleSize)
+		{
+			size_t length = std::min(kTrickleSize, requests.size() - offset);
+
+			readQueue.insert(readQueue.end(), data + offset, data + offset + length);
+			legacyCopied += length;
+
+			while (true)
+			{
+				std::vector<uint8_t> requestData(readQueue.begin(), readQueue.end());
+				legacyCopied += requestData.size();
+
+				size_t numHeaders = 50;
+				int result = phr_parse_request(reinterpret_cast<const char*>(requestData.data()), requestData.size(), &method, &methodLength, &path, &pathLength, &minorVersion, headers, &numHeaders, 0);
+
+				if (result <= 0)
+				{
+					break;
+				}
+
+				readQueue.erase(readQueue.begin(), readQueue.begin() + result);
+				legacyParsed++;
+			}
+		}
+	}
+
+	// the read buffer: append once, parse in place and incrementally
+	size_t bufferCopied = 0;
+	int bufferParsed = 0;
+
+	{
+		net::HttpReadBuffer readBuffer;
+		size_t lastLength = 0;
+
+		for (size_t offset = 0; offset < requests.size(); offset += kTrickleSize)
+		{
+			size_t length = std::min(kTrickleSize, requests.size() - offset);
+
+			readBuffer.Append(data + offset, length);
+
+			while (!readBuffer.IsEmpty())
+			{
+				size_t numHeaders = 50;
+				int result = phr_parse_request(reinterpret_cast<const char*>(readBuffer.GetData()), readBuffer.GetSize(), &method, &methodLength, &path, &pathLength, &minorVersion, headers, &numHeaders, lastLength);
+
+				if (result <= 0)
+				{
+					lastLength = readBuffer.GetSize();
+					break;
+				}
+
+				readBuffer.Consume(result);
+				lastLength = 0;
+
+				bufferParsed++;
+			}
+		}
+
+		bufferCopied = readBuffer.GetBytesCopied();
+	}
+
+	EXPECT_EQ(kBenchmarkRequests, legacyParsed);
+	EXPECT_EQ(kBenchmarkRequests, bufferParsed);
+	EXPECT_LT(bufferCopied, legacyCopied);
+}
+
+// wrk-style loopback benchmark: persistent connections with a fixed pipeline depth
+static const int kClientThreads = 8;
+static const int kRequestsPerThread = 4000;
+static const int kPipelineDepth = 16;
+
+TEST_F(HttpServerTest, DISABLED_BenchmarkLoopbackRequestsPerSecond)
+{
+	TestHttpServer server(30222);
+
+	std::atomic<int> completedRequests(0);
+	std::vector<std::thread> threads;
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < kClientThreads; i++)
+	{
+		threads.emplace_back([&] ()
+		{
+			TestHttpClient client(server.address);
+
+			if (!client.IsConnected())
+			{
+				return;
+			}
+
+			std::string batch;
+
+			for (int j = 0; j < kPipelineDepth; j++)
+			{
+				batch += "GET /bench HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n";
+			}
+
+			for (int j = 0; j < kRequestsPerThread; j += kPipelineDepth)
+			{
+				client.Send(batch);
+
+				for (int k = 0; k < kPipelineDepth; k++)
+				{
+					std::string body;
+
+					if (!client.ReadResponse(&body))
+					{
+						return;
+					}
+
+					completedRequests++;
+				}
+			}
+		});
+	}
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	double time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	printf("%.0f requests/s\n", completedRequests / time);
+
+	EXPECT_EQ(kClientThreads * kRequestsPerThread, completedRequests.load());
+}
@@ -0,0 +1,70 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include "UvTcpServer.h"
+
+namespace net
+{
+class TcpServerManager;
+
+//
+// A TCP server sharded over multiple libuv loops. Each loop owns a UvTcpServer shard, and streams stay pinned to
+// the loop that accepted them.
+//
+// Where SO_REUSEPORT is supported, every shard gets its own listening socket and the kernel balances incoming
+// connections. Otherwise, a single socket gets polled on the first loop and accepted sockets are handed off to the
+// shards round-robin.
+//
+// The connection callback will be invoked from any of the loop threads.
+//
+class MultiLoopTcpServer : public TcpServer
+{
+private:
+	TcpServerManager* m_manager;
+
+	std::vector<fwRefContainer<UvTcpServer>> m_shards;
+
+	// accept-and-hand-off fallback state
+	fwRefContainer<UvLoopHolder> m_acceptLoop;
+
+	std::unique_ptr<uv_poll_t> m_acceptPoll;
+
+	PlatformSocketType m_listenSocket;
+
+	size_t m_nextShard;
+
+private:
+	void CreateShards();
+
+	bool ListenReusePort(const PeerAddress& bindAddress);
+
+	bool ListenHandOff(const PeerAddress& bindAddress);
+
+	void OnAcceptReady();
+
+	void InvokeConnectionCallback(fwRefContainer<TcpServerStream> stream);
+
+public:
+	MultiLoopTcpServer(TcpServerManager* manager);
+
+	virtual ~MultiLoopTcpServer();
+
+	bool Listen(const PeerAddress& bindAddress);
+
+	inline size_t GetShardCount()
+	{
+		return m_shards.size();
+	}
+
+	inline bool IsUsingReusePort()
+	{
+		return !m_acceptPoll;
+	}
+};
+}
@@ -9,6 +9,10 @@
 
 #include "TcpServer.h"
 #include "TcpServerFactory.h"
+#include "UvLoopHolder.h"
+
+#include <chrono>
+#include <memory>
 
 #ifdef COMPILING_NET_TCP_SERVER
 #define TCP_SERVER_EXPORT DLL_EXPORT
@@ -25,9 +29,10 @@ class MultiplexTcpChildServerStream : public TcpServerStream
 private:
 	fwRefContainer<TcpServerStream> m_baseStream;
 
-	std::vector<uint8_t> m_initialData;
+	std::vector<PooledBuffer> m_initialData;
 
-	MultiplexTcpChildServer* m_server;
+	// connections keep their server around until they close, as the base stream can outlive the server's owner
+	fwRefContainer<MultiplexTcpChildServer> m_server;
 
 private:
 	void TrySendInitialData();
@@ -40,11 +45,33 @@ protected:
 public:
 	MultiplexTcpChildServerStream(MultiplexTcpChildServer* server, fwRefContainer<TcpServerStream> baseStream);
 
-	void SetInitialData(const std::vector<uint8_t>& initialData);
+	virtual ~MultiplexTcpChildServerStream();
+
+	void SetInitialData(std::vector<PooledBuffer>&& initialData);
+
+	using TcpServerStream::Write;
 
 	virtual PeerAddress GetPeerAddress() override;
 
-	virtual void Write(const std::vector<uint8_t>& data) override;
+	virtual void Write(const PooledBuffer& data) override;
+
+	virtual void WriteV(const std::vector<PooledBuffer>& data) override;
+
+	virtual void Cork() override;
+
+	virtual void Uncork() override;
+
+	virtual size_t GetQueuedBytes() override;
+
+	virtual void SetHighWaterMark(size_t highWaterMark) override;
+
+	virtual void SetBackpressureCallback(const TBackpressureCallback& callback) override;
+
+	virtual void WhenWritable(const std::function<void()>& callback) override;
+
+	virtual void ScheduleCallback(const std::function<void()>& callback) override;
+
+	virtual void SetDeadline(std::chrono::milliseconds timeout, const std::function<void()>& callback) override;
 
 	virtual void Close() override;
 };
@@ -58,6 +85,26 @@ enum class MultiplexPatternMatchResult
 
 typedef std::function<MultiplexPatternMatchResult(const std::vector<uint8_t>& bytes)> MultiplexPatternMatchFn;
 
+//
+// A byte prefix identifying a protocol. Each prefix byte is compared only in the bits set in the mask - though note
+// every masked-out bit doubles the size of the decision trie below that byte.
+//
+struct TCP_SERVER_EXPORT MultiplexPattern
+{
+	std::vector<uint8_t> prefix;
+
+	// empty to compare all bits
+	std::vector<uint8_t> mask;
+
+	MultiplexPattern(const std::string& prefix);
+
+	MultiplexPattern(const std::vector<uint8_t>& prefix, const std::vector<uint8_t>& mask = std::vector<uint8_t>());
+};
+
+struct MultiplexTrie;
+
+struct MultiplexSniffState;
+
 class MultiplexTcpChildServer : public TcpServer
 {
 private:
@@ -65,6 +112,9 @@ private:
 
 	std::set<fwRefContainer<TcpServerStream>> m_connections;
 
+	// connections may arrive on multiple loop threads
+	std::mutex m_connectionsMutex;
+
 public:
 	inline const MultiplexPatternMatchFn& GetPatternMatcher()
 	{
@@ -73,11 +123,18 @@ public:
 
 	void SetPatternMatcher(const MultiplexPatternMatchFn& function);
 
-	void AttachToResult(const std::vector<uint8_t>& existingData, fwRefContainer<TcpServerStream> baseStream);
+	// takes over a stream, along with the data that was read while finding out it's ours
+	void AttachToResult(std::vector<PooledBuffer>&& existingData, fwRefContainer<TcpServerStream> baseStream);
 
 	void CloseStream(MultiplexTcpChildServerStream* stream);
 };
 
+//
+// Hands off connections to child servers based on the first bytes received.
+//
+// Declarative patterns are compiled into a single trie which is walked as data arrives, and are checked before any
+// match functions, which get the accumulated data on each read.
+//
 class TCP_SERVER_EXPORT MultiplexTcpServer : public fwRefCountable
 {
 private:
@@ -87,11 +144,63 @@ private:
 private:
 	std::vector<fwRefContainer<MultiplexTcpChildServer>> m_childServers;
 
+	// children with a match function, rather than patterns
+	std::vector<fwRefContainer<MultiplexTcpChildServer>> m_matchFunctionServers;
+
+	std::vector<std::pair<MultiplexPattern, fwRefContainer<MultiplexTcpChildServer>>> m_patterns;
+
+	// rebuilt when patterns get added, while connections keep whichever one they started with
+	std::shared_ptr<const MultiplexTrie> m_trie;
+
+	std::mutex m_serversMutex;
+
+	size_t m_maxPeekLength;
+
+	std::chrono::milliseconds m_sniffTimeout;
+
+	// connections that didn't match anything yet
+	std::set<std::shared_ptr<MultiplexSniffState>> m_pendingConnections;
+
+	std::mutex m_pendingMutex;
+
+	fwRefContainer<UvLoopHolder> m_timerLoop;
+
+	std::unique_ptr<uv_timer_t> m_sniffTimer;
+
+private:
+	void OnConnection(fwRefContainer<TcpServerStream> stream);
+
+	void OnSniffData(const std::shared_ptr<MultiplexSniffState>& state, const PooledBuffer& data);
+
+	void RemovePending(const std::shared_ptr<MultiplexSniffState>& state);
+
+	// passes the connection and everything read from it so far on to a child server
+	void HandOff(const std::shared_ptr<MultiplexSniffState>& state, const fwRefContainer<MultiplexTcpChildServer>& server);
+
+	void CloseTimedOutConnections();
+
 public:
 	MultiplexTcpServer(const fwRefContainer<TcpServerFactory>& factory);
 
+	virtual ~MultiplexTcpServer();
+
 	void Bind(const PeerAddress& bindAddress);
 
 	fwRefContainer<TcpServer> CreateServer(const MultiplexPatternMatchFn& patternMatchFunction);
+
+	// creates a child server for connections starting with any of the patterns
+	fwRefContainer<TcpServer> CreateServer(const std::vector<MultiplexPattern>& patterns);
+
+	// connections sending this many bytes without a match get closed
+	inline void SetMaxPeekLength(size_t maxPeekLength)
+	{
+		m_maxPeekLength = maxPeekLength;
+	}
+
+	// connections not matching anything within this time get closed - this has to be set before binding
+	inline void SetSniffTimeout(std::chrono::milliseconds timeout)
+	{
+		m_sniffTimeout = timeout;
+	}
 };
 }
\ No newline at end of file
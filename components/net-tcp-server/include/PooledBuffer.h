@@ -0,0 +1,208 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+
+#ifdef COMPILING_NET_TCP_SERVER
+#define TCP_SERVER_EXPORT DLL_EXPORT
+#else
+#define TCP_SERVER_EXPORT DLL_IMPORT
+#endif
+
+namespace net
+{
+class BufferPool;
+
+//
+// A reference-counted block of memory, either owned by a BufferPool slab or adopting an existing vector.
+// Once the last reference is released, pooled blocks return to their pool instead of being freed.
+//
+class TCP_SERVER_EXPORT PooledBufferBlock : public fwRefCountable
+{
+private:
+	std::atomic<uint32_t> m_refCount;
+
+	BufferPool* m_pool;
+
+	std::unique_ptr<uint8_t[]> m_storage;
+
+	std::vector<uint8_t> m_adoptedStorage;
+
+	uint8_t* m_data;
+
+	size_t m_size;
+
+public:
+	PooledBufferBlock(BufferPool* pool, size_t size);
+
+	PooledBufferBlock(std::vector<uint8_t>&& adoptedData);
+
+	virtual void AddRef() override;
+
+	virtual bool Release() override;
+
+	inline uint8_t* GetData() const
+	{
+		return m_data;
+	}
+
+	inline size_t GetSize() const
+	{
+		return m_size;
+	}
+
+	inline bool IsShared() const
+	{
+		return (m_refCount > 1);
+	}
+};
+
+//
+// An immutable view of a range of bytes inside a PooledBufferBlock. Copying a PooledBuffer only copies the reference.
+//
+class TCP_SERVER_EXPORT PooledBuffer
+{
+private:
+	fwRefContainer<PooledBufferBlock> m_block;
+
+	const uint8_t* m_data;
+
+	size_t m_size;
+
+public:
+	PooledBuffer();
+
+	PooledBuffer(const fwRefContainer<PooledBufferBlock>& block, size_t offset, size_t length);
+
+	// copies the passed bytes into a (pooled, if small enough) block
+	explicit PooledBuffer(const std::vector<uint8_t>& data);
+
+	// adopts the passed vector without copying
+	explicit PooledBuffer(std::vector<uint8_t>&& data);
+
+	PooledBuffer(const void* data, size_t length);
+
+	inline const uint8_t* data() const
+	{
+		return m_data;
+	}
+
+	inline size_t size() const
+	{
+		return m_size;
+	}
+
+	inline bool empty() const
+	{
+		return (m_size == 0);
+	}
+
+	inline const uint8_t* begin() const
+	{
+		return m_data;
+	}
+
+	inline const uint8_t* end() const
+	{
+		return m_data + m_size;
+	}
+
+	inline const uint8_t& operator[](size_t index) const
+	{
+		return m_data[index];
+	}
+
+	inline const fwRefContainer<PooledBufferBlock>& GetBlock() const
+	{
+		return m_block;
+	}
+
+	PooledBuffer Slice(size_t offset, size_t length = -1) const;
+
+	std::vector<uint8_t> ToVector() const;
+};
+
+//
+// A thread-safe free list of fixed-size blocks.
+//
+class TCP_SERVER_EXPORT BufferPool
+{
+public:
+	struct Statistics
+	{
+		// number of blocks that had to be allocated from the heap
+		size_t heapAllocations;
+
+		// number of blocks handed out from the free list
+		size_t poolHits;
+
+		// number of blocks currently sitting in the free list
+		size_t freeBlocks;
+	};
+
+private:
+	size_t m_blockSize;
+
+	size_t m_maxFreeBlocks;
+
+	std::mutex m_mutex;
+
+	std::vector<PooledBufferBlock*> m_freeBlocks;
+
+	Statistics m_statistics;
+
+public:
+	BufferPool(size_t blockSize, size_t maxFreeBlocks);
+
+	~BufferPool();
+
+	fwRefContainer<PooledBufferBlock> Acquire();
+
+	// called by PooledBufferBlock once its last reference goes away
+	void Return(PooledBufferBlock* block);
+
+	Statistics GetStatistics();
+
+	inline size_t GetBlockSize() const
+	{
+		return m_blockSize;
+	}
+
+public:
+	// the process-wide pool used by the TCP stack
+	static BufferPool* GetDefault();
+};
+
+//
+// A per-stream read cursor which carves successive reads out of one pooled block, so that a
+// consumer retaining a small slice doesn't pin an entire block per read.
+//
+class TCP_SERVER_EXPORT PooledReadBuffer
+{
+private:
+	BufferPool* m_pool;
+
+	fwRefContainer<PooledBufferBlock> m_block;
+
+	size_t m_offset;
+
+public:
+	PooledReadBuffer(BufferPool* pool = BufferPool::GetDefault());
+
+	// gets writable memory for the next read
+	void Prepare(uint8_t** data, size_t* size);
+
+	// commits the first `length` bytes of the last prepared region and returns them as a buffer
+	PooledBuffer Commit(size_t length);
+
+	// drops the current block
+	void Reset();
+};
+}
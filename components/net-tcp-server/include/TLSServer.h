@@ -9,6 +9,7 @@
 
 #include "TcpServer.h"
 #include "TcpServerFactory.h"
+#include "WorkerPool.h"
 
 #ifdef min
 #undef min
@@ -19,6 +20,9 @@
 #include <botan/tls_server.h>
 #include <botan/tls_session_manager.h>
 
+#include <atomic>
+#include <chrono>
+
 #ifdef COMPILING_NET_TCP_SERVER
 #define TCP_SERVER_EXPORT DLL_EXPORT
 #else
@@ -34,24 +38,47 @@ class TLSServerStream : public TcpServerStream
 private:
 	fwRefContainer<TcpServerStream> m_baseStream;
 
+	// never reset, unlike m_baseStream - used to get back to the I/O thread from the strand
+	fwRefContainer<TcpServerStream> m_ioStream;
+
+	// if set, all TLS processing happens on this strand instead of the I/O thread
+	fwRefContainer<WorkerStrand> m_strand;
+
 	std::shared_ptr<Botan::TLS::Server> m_tlsServer;
 
 	TLSServer* m_parentServer;
 
 	Botan::AutoSeeded_RNG m_rng;
 
-	std::unique_ptr<Botan::TLS::Session_Manager> m_sessionManager;
-
-	std::unique_ptr<Botan::TLS::Policy> m_policy;
+	// resumed sessions carry their original start time, which is used to tell them apart
+	std::chrono::system_clock::time_point m_connectTime;
 
 	bool m_closing;
 
 public:
 	TLSServerStream(TLSServer* server, fwRefContainer<TcpServerStream> baseStream);
 
+	using TcpServerStream::Write;
+
 	virtual PeerAddress GetPeerAddress() override;
 
-	virtual void Write(const std::vector<uint8_t>& data) override;
+	virtual void Write(const PooledBuffer& data) override;
+
+	virtual void Cork() override;
+
+	virtual void Uncork() override;
+
+	virtual size_t GetQueuedBytes() override;
+
+	virtual void SetHighWaterMark(size_t highWaterMark) override;
+
+	virtual void SetBackpressureCallback(const TBackpressureCallback& callback) override;
+
+	virtual void WhenWritable(const std::function<void()>& callback) override;
+
+	virtual void ScheduleCallback(const std::function<void()>& callback) override;
+
+	virtual void SetDeadline(std::chrono::milliseconds timeout, const std::function<void()>& callback) override;
 
 	virtual void Close() override;
 
@@ -67,6 +94,12 @@ private:
 private:
 	void Initialize();
 
+	// runs TLS processing on the strand, if any
+	void RunOnStrand(const std::function<void()>& callback);
+
+	// gets back to the I/O thread from TLS processing
+	void RunOnStream(const std::function<void()>& callback);
+
 	void CloseInternal();
 };
 
@@ -77,8 +110,25 @@ private:
 
 	std::shared_ptr<Botan::Credentials_Manager> m_credentials;
 
+	std::unique_ptr<Botan::TLS::Policy> m_policy;
+
+	// the session cache is shared by all connections - Botan's in-memory manager locks internally, and only uses
+	// its RNG while holding that lock
+	Botan::AutoSeeded_RNG m_sessionRng;
+
+	std::unique_ptr<Botan::TLS::Session_Manager> m_sessionManager;
+
+	std::atomic<uint64_t> m_handshakeCount;
+
+	std::atomic<uint64_t> m_resumedHandshakeCount;
+
+	fwRefContainer<WorkerPool> m_workerPool;
+
 	std::set<fwRefContainer<TLSServerStream>> m_connections;
 
+	// connections may arrive on multiple loop threads
+	std::mutex m_connectionsMutex;
+
 public:
 	TLSServer(fwRefContainer<TcpServer> baseServer, const std::string& certificatePath, const std::string& keyPath);
 
@@ -87,6 +137,50 @@ public:
 		return m_credentials;
 	}
 
+	inline Botan::TLS::Session_Manager& GetSessionManager()
+	{
+		return *m_sessionManager;
+	}
+
+	inline const Botan::TLS::Policy& GetPolicy()
+	{
+		return *m_policy;
+	}
+
+	// the number of completed handshakes, including resumed ones
+	inline uint64_t GetHandshakeCount()
+	{
+		return m_handshakeCount;
+	}
+
+	// the number of handshakes that resumed a session, by session ID or ticket
+	inline uint64_t GetResumedHandshakeCount()
+	{
+		return m_resumedHandshakeCount;
+	}
+
+	double GetResumptionHitRate();
+
+	// moves handshakes and record processing off the I/O threads, onto a pool of the given number of threads.
+	// this has to be called before any connections arrive. while the pool's queue is full, new connections get
+	// closed right away, counted by the pool's GetRefusedWorkCount.
+	void SetWorkerThreadCount(size_t threadCount);
+
+	inline const fwRefContainer<WorkerPool>& GetWorkerPool()
+	{
+		return m_workerPool;
+	}
+
+	inline void OnHandshakeComplete(bool resumed)
+	{
+		m_handshakeCount++;
+
+		if (resumed)
+		{
+			m_resumedHandshakeCount++;
+		}
+	}
+
 	inline void InvokeConnectionCallback(TLSServerStream* stream)
 	{
 		if (GetConnectionCallback())
@@ -97,6 +191,7 @@ public:
 
 	inline void CloseStream(TLSServerStream* stream)
 	{
+		std::unique_lock<std::mutex> lock(m_connectionsMutex);
 		m_connections.erase(stream);
 	}
 };
@@ -8,6 +8,10 @@
 #pragma once
 
 #include "NetAddress.h"
+#include "PooledBuffer.h"
+
+#include <chrono>
+#include <mutex>
 
 #ifdef COMPILING_NET_TCP_SERVER
 #define TCP_SERVER_EXPORT DLL_EXPORT
@@ -20,15 +24,32 @@ namespace net
 class TCP_SERVER_EXPORT TcpServerStream : public fwRefCountable
 {
 public:
-	typedef std::function<void(const std::vector<uint8_t>&)> TReadCallback;
+	typedef std::function<void(const PooledBuffer&)> TReadCallback;
+
+	// legacy callback type, receiving a copy of the read data
+	typedef std::function<void(const std::vector<uint8_t>&)> TVectorReadCallback;
 
 	typedef std::function<void()> TCloseCallback;
 
+	// invoked with `true` once the queued bytes reach the high-water mark, and with `false` once they drain below half of it
+	typedef std::function<void(bool)> TBackpressureCallback;
+
 private:
 	TReadCallback m_readCallback;
 
 	TCloseCallback m_closeCallback;
 
+	TBackpressureCallback m_backpressureCallback;
+
+	size_t m_highWaterMark;
+
+	bool m_aboveHighWaterMark;
+
+	// guards m_aboveHighWaterMark against WhenWritable calls from other threads
+	std::mutex m_writableMutex;
+
+	std::vector<std::function<void()>> m_writableCallbacks;
+
 protected:
 	inline const TReadCallback& GetReadCallback()
 	{
@@ -42,19 +63,74 @@ protected:
 
 	virtual void OnFirstSetReadCallback() {}
 
+	// to be called by implementations whenever the amount of queued outgoing bytes changes
+	void UpdateQueuedBytes(size_t queuedBytes);
+
+	// to be called by implementations once closed, as pending WhenWritable callbacks won't ever run
+	void ClearWritableCallbacks();
+
 public:
 	virtual PeerAddress GetPeerAddress() = 0;
 
-	virtual void Write(const std::vector<uint8_t>& data) = 0;
+	virtual void Write(const PooledBuffer& data) = 0;
+
+	// copies the data into a pooled buffer
+	void Write(const std::vector<uint8_t>& data);
+
+	// adopts the data without copying
+	void Write(std::vector<uint8_t>&& data);
+
+	// writes multiple buffers at once - implementations may send these using a single system call
+	virtual void WriteV(const std::vector<PooledBuffer>& data);
+
+	// holds back writes until a matching Uncork call, so they can be sent as a batch
+	virtual void Cork() {}
+
+	virtual void Uncork() {}
+
+	// gets the amount of bytes that were written but haven't been sent yet
+	virtual size_t GetQueuedBytes()
+	{
+		return 0;
+	}
+
+	virtual void SetHighWaterMark(size_t highWaterMark);
+
+	inline size_t GetHighWaterMark()
+	{
+		return m_highWaterMark;
+	}
+
+	virtual void SetBackpressureCallback(const TBackpressureCallback& callback);
+
+	// runs the callback once the queued bytes are below the high-water mark - right away, if they already are.
+	// this may be called from any thread.
+	virtual void WhenWritable(const std::function<void()>& callback);
+
+	// runs the callback on the thread doing this stream's I/O, after anything already queued there.
+	// this may be called from any thread.
+	virtual void ScheduleCallback(const std::function<void()>& callback);
+
+	// runs the callback on the thread doing this stream's I/O once the timeout passes, unless the deadline gets
+	// replaced or cleared before that. there's only a single deadline per stream, and a zero timeout clears it.
+	// streams without timer support never expire. this may be called from any thread.
+	virtual void SetDeadline(std::chrono::milliseconds timeout, const std::function<void()>& callback);
+
+	inline void ClearDeadline()
+	{
+		SetDeadline(std::chrono::milliseconds(0), std::function<void()>());
+	}
 
 	virtual void Close() = 0;
 
 	void SetReadCallback(const TReadCallback& callback);
 
+	void SetReadCallback(const TVectorReadCallback& callback);
+
 	void SetCloseCallback(const TCloseCallback& callback);
 
 protected:
-	TcpServerStream() { }
+	TcpServerStream();
 };
 
 class TCP_SERVER_EXPORT TcpServer : public fwRefCountable
@@ -14,6 +14,7 @@
 #include "TcpServerFactory.h"
 
 #include <memory>
+#include <unordered_map>
 
 #ifdef COMPILING_NET_TCP_SERVER
 #define TCP_SERVER_EXPORT DLL_EXPORT
@@ -23,24 +24,153 @@
 
 namespace net
 {
+// applies to each server a manager creates on its own, with all shards of a server counting as one
+struct TcpServerLimits
+{
+	// the most connections open at once on a server - 0 means unlimited
+	size_t maxConnections;
+
+	// the most connections open at once on a server from a single IP address - 0 means unlimited
+	size_t maxConnectionsPerAddress;
+
+	// connections whose queued writes don't make any progress for this long get closed - 0 disables this
+	std::chrono::milliseconds writeStallTimeout;
+
+	// connections closed with writes still queued get this long to send them before they're dropped - 0 disables this
+	std::chrono::milliseconds lingerTimeout;
+
+	TcpServerLimits()
+		: maxConnections(0), maxConnectionsPerAddress(0), writeStallTimeout(0), lingerTimeout(std::chrono::seconds(30))
+	{
+
+	}
+};
+
+// connections open on a single server, for checking them against the limits
+struct TcpServerConnections
+{
+	size_t activeConnections;
+
+	std::unordered_map<std::string, size_t> addressConnections;
+
+	TcpServerConnections()
+		: activeConnections(0)
+	{
+
+	}
+};
+
+// counted over all servers of a manager
+struct TcpServerStatistics
+{
+	size_t activeConnections;
+
+	uint64_t acceptedConnections;
+
+	// connections closed right away for exceeding maxConnections
+	uint64_t rejectedConnections;
+
+	// connections closed right away for exceeding maxConnectionsPerAddress
+	uint64_t rejectedAddressConnections;
+
+	// stream deadlines that ran out
+	uint64_t expiredDeadlines;
+
+	// connections closed for exceeding writeStallTimeout
+	uint64_t stalledConnections;
+};
+
 class TCP_SERVER_EXPORT TcpServerManager : public TcpServerFactory
 {
 private:
-	std::set<fwRefContainer<UvTcpServer>> m_servers;
+	// declared first so the loops outlive the servers using them
+	std::vector<fwRefContainer<UvLoopHolder>> m_uvLoops;
+
+	// shared by all servers (and shards) of this manager, so these have to outlive them as well
+	std::mutex m_limitsMutex;
+
+	TcpServerLimits m_limits;
+
+	size_t m_activeConnections;
+
+	// read on every write, so this is kept outside of the mutex
+	std::atomic<int64_t> m_writeStallTimeout;
+
+	std::atomic<int64_t> m_lingerTimeout;
 
-	fwRefContainer<UvLoopHolder> m_uvLoop;
+	std::atomic<uint64_t> m_acceptedConnections;
+
+	std::atomic<uint64_t> m_rejectedConnections;
+
+	std::atomic<uint64_t> m_rejectedAddressConnections;
+
+	std::atomic<uint64_t> m_expiredDeadlines;
+
+	std::atomic<uint64_t> m_stalledConnections;
+
+	std::set<fwRefContainer<TcpServer>> m_servers;
 
 public:
 	TcpServerManager();
 
+	//
+	// Creates a manager that shards each server over multiple loops, or one loop per hardware thread if 0 is passed.
+	//
+	TcpServerManager(int loopCount);
+
 	virtual ~TcpServerManager();
 
+private:
+	fwRefContainer<TcpServer> CreateSingleLoopServer(const PeerAddress& bindAddress);
+
 public:
 	virtual fwRefContainer<TcpServer> CreateServer(const PeerAddress& bindAddress) override;
 
+	void SetLimits(const TcpServerLimits& limits);
+
+	TcpServerLimits GetLimits();
+
+	TcpServerStatistics GetStatistics();
+
+	inline std::chrono::milliseconds GetWriteStallTimeout()
+	{
+		return std::chrono::milliseconds(m_writeStallTimeout.load());
+	}
+
+	inline std::chrono::milliseconds GetLingerTimeout()
+	{
+		return std::chrono::milliseconds(m_lingerTimeout.load());
+	}
+
+	// to be called by servers for each accepted connection - returns false if the connection has to be closed,
+	// otherwise the returned key has to be passed to ReleaseConnection once it closes
+	bool AcquireConnection(TcpServerConnections* connections, const PeerAddress& peerAddress, std::string* addressKey);
+
+	void ReleaseConnection(TcpServerConnections* connections, const std::string& addressKey);
+
+	inline void CountExpiredDeadline()
+	{
+		m_expiredDeadlines++;
+	}
+
+	inline void CountStalledConnection()
+	{
+		m_stalledConnections++;
+	}
+
 	inline uv_loop_t* GetLoop()
 	{
-		return m_uvLoop->GetLoop();
+		return m_uvLoops[0]->GetLoop();
+	}
+
+	inline size_t GetLoopCount()
+	{
+		return m_uvLoops.size();
+	}
+
+	inline const fwRefContainer<UvLoopHolder>& GetLoopHolder(size_t index)
+	{
+		return m_uvLoops[index];
 	}
 };
 }
\ No newline at end of file
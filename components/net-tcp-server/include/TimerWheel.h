@@ -0,0 +1,81 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+#include <uv.h>
+
+#ifdef COMPILING_NET_TCP_SERVER
+#define TCP_SERVER_EXPORT DLL_EXPORT
+#else
+#define TCP_SERVER_EXPORT DLL_IMPORT
+#endif
+
+namespace net
+{
+//
+// A hashed timer wheel driven by a single libuv timer, for large amounts of coarse timeouts that mostly get
+// cancelled or pushed back before firing. Scheduling and cancelling are O(1); timers fire up to one resolution
+// step late. This may only be used from the loop thread.
+//
+class TCP_SERVER_EXPORT TimerWheel
+{
+public:
+	// 0 is never a valid timer
+	typedef uint64_t TimerId;
+
+private:
+	struct Entry
+	{
+		// full revolutions left before the timer is due
+		uint64_t rounds;
+
+		std::function<void()> callback;
+	};
+
+	std::unique_ptr<uv_timer_t> m_timer;
+
+	uint64_t m_resolution;
+
+	// timer ids per slot - cancelled ones only get dropped once their slot comes around
+	std::vector<std::vector<TimerId>> m_slots;
+
+	std::unordered_map<TimerId, Entry> m_entries;
+
+	size_t m_currentSlot;
+
+	// loop time the current slot was reached at
+	uint64_t m_lastTick;
+
+	TimerId m_nextId;
+
+private:
+	void OnTimer();
+
+	void AdvanceSlot();
+
+public:
+	TimerWheel(uv_loop_t* loop, std::chrono::milliseconds resolution = std::chrono::milliseconds(100), size_t slotCount = 512);
+
+	~TimerWheel();
+
+	TimerId Schedule(std::chrono::milliseconds delay, const std::function<void()>& callback);
+
+	// cancelling a timer that already fired or got cancelled is fine
+	void Cancel(TimerId timer);
+
+	inline size_t GetPendingCount() const
+	{
+		return m_entries.size();
+	}
+};
+}
@@ -7,10 +7,14 @@
 
 #pragma once
 
+#include <functional>
+#include <mutex>
 #include <thread>
 
 #include <uv.h>
 
+#include "TimerWheel.h"
+
 namespace net
 {
 class UvLoopHolder : public fwRefCountable
@@ -18,17 +22,56 @@ class UvLoopHolder : public fwRefCountable
 private:
 	uv_loop_t m_loop;
 
+	uv_async_t m_async;
+
 	std::thread m_thread;
 
-	bool m_shouldExit;
+	std::atomic<std::thread::id> m_threadId;
+
+	std::atomic<bool> m_shouldExit;
 
 	std::string m_loopTag;
 
+	std::mutex m_callbackMutex;
+
+	std::vector<std::function<void()>> m_callbacks;
+
+	// set once the loop thread is done running callbacks
+	bool m_callbacksClosed;
+
+	std::unique_ptr<TimerWheel> m_timerWheel;
+
+private:
+	void RunCallbacks();
+
+	// runs callbacks until none are left, and refuses any further ones
+	void DrainCallbacks();
+
 public:
 	UvLoopHolder(const std::string& loopTag);
 
 	virtual ~UvLoopHolder();
 
+	//
+	// Queues a function to be executed on the loop thread. This is safe to call from any thread.
+	//
+	void EnqueueCallback(const std::function<void()>& callback);
+
+	//
+	// Executes a function on the loop thread and waits for it to complete.
+	//
+	void RunOnLoop(const std::function<void()>& callback);
+
+	//
+	// Gets the timer wheel shared by everything on this loop. This may only be called from the loop thread.
+	//
+	TimerWheel& GetTimerWheel();
+
+	inline bool IsInLoopThread() const
+	{
+		return (std::this_thread::get_id() == m_threadId.load());
+	}
+
 	inline uv_loop_t* GetLoop()
 	{
 		return &m_loop;
@@ -12,6 +12,7 @@
 #include <memory>
 
 #include "TcpServer.h"
+#include "UvLoopHolder.h"
 
 namespace net
 {
@@ -20,22 +21,65 @@ class UvTcpServer;
 class UvTcpServerStream : public TcpServerStream
 {
 private:
+	// only touched on the loop thread, and unset once the server is gone
 	UvTcpServer* m_server;
 
+	// our own reference, as writes and closes may still come in after the server is gone
+	fwRefContainer<UvLoopHolder> m_loop;
+
 	std::unique_ptr<uv_tcp_t> m_client;
 
-	std::vector<char> m_readBuffer;
+	PooledReadBuffer m_readBuffer;
+
+	// writes held back while corked
+	std::vector<PooledBuffer> m_corkedBuffers;
+
+	int m_corkDepth;
+
+	std::atomic<size_t> m_queuedBytes;
+
+	// identifies our peer for the manager's connection limits
+	std::string m_addressKey;
+
+	TimerWheel::TimerId m_deadlineTimer;
+
+	TimerWheel::TimerId m_writeStallTimer;
+
+	// bounds how long a closed stream waits for its queued writes
+	TimerWheel::TimerId m_lingerTimer;
+
+	// closed, but the handle stays open until the queued writes are sent
+	bool m_shutdownPending;
 
 private:
 	void HandleRead(ssize_t nread, const uv_buf_t* buf);
 
-	void CloseClient();
+	void WriteInternal(const PooledBuffer* buffers, size_t count);
+
+	void SendBuffers(const PooledBuffer* buffers, size_t count);
+
+	void FlushCorkedBuffers();
 
-	inline std::vector<char>& GetReadBuffer()
+	void OnWriteCompleted(size_t length);
+
+	// (re)starts the write stall timer, or stops it if nothing is queued anymore
+	void ResetWriteStallTimer();
+
+	// the write stall and linger timers stay while a shutdown is pending, as they're what bounds the shutdown
+	void CancelTimers();
+
+	// queued writes get a chance to finish first, unless they're discarded
+	void CloseClient(bool discardQueued = false);
+
+	void OnShutdownCompleted();
+
+	inline PooledReadBuffer& GetReadBuffer()
 	{
 		return m_readBuffer;
 	}
 
+	bool StartReading();
+
 public:
 	UvTcpServerStream(UvTcpServer* server);
 
@@ -43,6 +87,22 @@ public:
 
 	bool Accept(std::unique_ptr<uv_tcp_t>&& client);
 
+	// takes ownership of an already-connected handle, such as one handed off from another loop
+	bool Open(std::unique_ptr<uv_tcp_t>&& client);
+
+	inline const std::string& GetAddressKey()
+	{
+		return m_addressKey;
+	}
+
+	inline void SetAddressKey(const std::string& addressKey)
+	{
+		m_addressKey = addressKey;
+	}
+
+	// called by the server on the loop thread once it closed us, as it's going away - this drops any queued writes
+	void DetachFromServer();
+
 	virtual void AddRef() override
 	{
 		TcpServerStream::AddRef();
@@ -54,20 +114,41 @@ public:
 	}
 
 public:
+	using TcpServerStream::Write;
+
 	virtual PeerAddress GetPeerAddress() override;
 
-	virtual void Write(const std::vector<uint8_t>& data) override;
+	virtual void Write(const PooledBuffer& data) override;
+
+	virtual void WriteV(const std::vector<PooledBuffer>& data) override;
+
+	virtual void Cork() override;
+
+	virtual void Uncork() override;
+
+	virtual size_t GetQueuedBytes() override;
+
+	virtual void ScheduleCallback(const std::function<void()>& callback) override;
+
+	virtual void SetDeadline(std::chrono::milliseconds timeout, const std::function<void()>& callback) override;
 
 	virtual void Close() override;
 };
 
 class TcpServerManager;
 
+struct TcpServerConnections;
+
 class UvTcpServer : public TcpServer
 {
 private:
 	TcpServerManager* m_manager;
 
+	// shared with the other shards of the same server
+	std::shared_ptr<TcpServerConnections> m_connections;
+
+	fwRefContainer<UvLoopHolder> m_loop;
+
 	std::unique_ptr<uv_tcp_t> m_server;
 
 	std::set<fwRefContainer<UvTcpServerStream>> m_clients;
@@ -75,18 +156,34 @@ private:
 private:
 	void OnConnection(int status);
 
+	void AddStream(fwRefContainer<UvTcpServerStream> stream);
+
 public:
-	UvTcpServer(TcpServerManager* manager);
+	UvTcpServer(TcpServerManager* manager, fwRefContainer<UvLoopHolder> loop, const std::shared_ptr<TcpServerConnections>& connections);
 
 	virtual ~UvTcpServer();
 
 	bool Listen(std::unique_ptr<uv_tcp_t>&& server);
 
+	// adopts a socket accepted elsewhere - this has to be called on our loop thread,
+	// and returns false if the socket wasn't taken over
+	bool AcceptSocket(uv_os_sock_t socket);
+
 	inline uv_tcp_t* GetServer()
 	{
 		return m_server.get();
 	}
 
+	inline const fwRefContainer<UvLoopHolder>& GetLoopHolder()
+	{
+		return m_loop;
+	}
+
+	inline TcpServerManager* GetManager()
+	{
+		return m_manager;
+	}
+
 public:
 	void RemoveStream(UvTcpServerStream* stream);
 };
@@ -0,0 +1,121 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#ifdef COMPILING_NET_TCP_SERVER
+#define TCP_SERVER_EXPORT DLL_EXPORT
+#else
+#define TCP_SERVER_EXPORT DLL_IMPORT
+#endif
+
+namespace net
+{
+class WorkerPool;
+
+//
+// A sequence of tasks executed on a WorkerPool in the order they were posted, never more than one at a time.
+// The pool has to outlive its strands.
+//
+class TCP_SERVER_EXPORT WorkerStrand : public fwRefCountable
+{
+private:
+	WorkerPool* m_pool;
+
+	std::mutex m_mutex;
+
+	std::deque<std::function<void()>> m_tasks;
+
+	// whether we're queued on (or running in) the pool
+	bool m_scheduled;
+
+public:
+	WorkerStrand(WorkerPool* pool);
+
+	// queues a task - this may be called from any thread
+	void Post(const std::function<void()>& task);
+
+	// runs queued tasks from a worker thread, returning true if there are more to run
+	bool Run();
+};
+
+//
+// A fixed set of worker threads running WorkerStrands. Tasks queued when it gets destroyed still run first.
+//
+// Posting a task never fails, as dropping one would leave its strand in an unknown state. Instead, whoever
+// takes on new work (like a TLS handshake) has to check AcceptsNewWork first, which refuses once too many
+// tasks are queued - so a flood of it gets turned away rather than piling up in memory.
+//
+class TCP_SERVER_EXPORT WorkerPool : public fwRefCountable
+{
+public:
+	static const size_t kDefaultMaxQueuedTasks = 16384;
+
+private:
+	std::vector<std::thread> m_threads;
+
+	std::mutex m_mutex;
+
+	std::condition_variable m_condition;
+
+	std::deque<fwRefContainer<WorkerStrand>> m_readyStrands;
+
+	bool m_shouldExit;
+
+	// posted on all strands, but not running yet
+	std::atomic<size_t> m_queuedTasks;
+
+	size_t m_maxQueuedTasks;
+
+	std::atomic<uint64_t> m_refusedWork;
+
+private:
+	void ThreadFunc();
+
+public:
+	WorkerPool(size_t threadCount, size_t maxQueuedTasks = kDefaultMaxQueuedTasks);
+
+	virtual ~WorkerPool();
+
+	fwRefContainer<WorkerStrand> CreateStrand();
+
+	inline size_t GetThreadCount() const
+	{
+		return m_threads.size();
+	}
+
+	// queues a strand that got tasks to run
+	void Schedule(const fwRefContainer<WorkerStrand>& strand);
+
+	// to be called before taking on new work - returns false (and counts it) if the queue is full
+	bool AcceptsNewWork();
+
+	inline size_t GetQueuedTaskCount() const
+	{
+		return m_queuedTasks;
+	}
+
+	// the times AcceptsNewWork returned false
+	inline uint64_t GetRefusedWorkCount() const
+	{
+		return m_refusedWork;
+	}
+
+	// for strands to keep count of their tasks
+	inline void AddQueuedTasks(ptrdiff_t count)
+	{
+		m_queuedTasks += count;
+	}
+};
+}
@@ -0,0 +1,258 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "MultiLoopTcpServer.h"
+#include "TcpServerManager.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+
+#define INVALID_SOCKET -1
+#endif
+
+#include "memdbgon.h"
+
+static bool SetNonBlocking(PlatformSocketType socket)
+{
+#ifdef _WIN32
+	u_long nonBlocking = 1;
+	return (ioctlsocket(socket, FIONBIO, &nonBlocking) == 0);
+#else
+	int flags = fcntl(socket, F_GETFL, 0);
+	return (flags != -1 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0);
+#endif
+}
+
+namespace net
+{
+MultiLoopTcpServer::MultiLoopTcpServer(TcpServerManager* manager)
+	: m_manager(manager), m_listenSocket(INVALID_SOCKET), m_nextShard(0)
+{
+
+}
+
+MultiLoopTcpServer::~MultiLoopTcpServer()
+{
+	if (m_acceptPoll)
+	{
+		uv_poll_t* poll = m_acceptPoll.release();
+
+		m_acceptLoop->RunOnLoop([=] ()
+		{
+			uv_poll_stop(poll);
+
+			uv_close(reinterpret_cast<uv_handle_t*>(poll), [] (uv_handle_t* handle)
+			{
+				delete reinterpret_cast<uv_poll_t*>(handle);
+			});
+		});
+	}
+
+	if (m_listenSocket != INVALID_SOCKET)
+	{
+		closesocket(m_listenSocket);
+	}
+
+	// shards own libuv handles, so they have to be released on their own loop
+	for (auto& shard : m_shards)
+	{
+		fwRefContainer<UvLoopHolder> loop = shard->GetLoopHolder();
+
+		loop->RunOnLoop([&] ()
+		{
+			shard = nullptr;
+		});
+	}
+}
+
+void MultiLoopTcpServer::CreateShards()
+{
+	m_shards.clear();
+
+	// the limits apply to the server as a whole, not to each shard
+	auto connections = std::make_shared<TcpServerConnections>();
+
+	for (size_t i = 0; i < m_manager->GetLoopCount(); i++)
+	{
+		fwRefContainer<UvTcpServer> shard = new UvTcpServer(m_manager, m_manager->GetLoopHolder(i), connections);
+
+		shard->SetConnectionCallback(std::bind(&MultiLoopTcpServer::InvokeConnectionCallback, this, std::placeholders::_1));
+
+		m_shards.push_back(shard);
+	}
+}
+
+bool MultiLoopTcpServer::Listen(const PeerAddress& bindAddress)
+{
+	if (ListenReusePort(bindAddress))
+	{
+		return true;
+	}
+
+	trace("SO_REUSEPORT listening on %s unavailable, using a single acceptor.\n", bindAddress.ToString().c_str());
+
+	return ListenHandOff(bindAddress);
+}
+
+bool MultiLoopTcpServer::ListenReusePort(const PeerAddress& bindAddress)
+{
+#ifdef SO_REUSEPORT
+	CreateShards();
+
+	for (auto& shard : m_shards)
+	{
+		bool success = false;
+
+		shard->GetLoopHolder()->RunOnLoop([&] ()
+		{
+			// allocate an owning pointer for the server handle
+			std::unique_ptr<uv_tcp_t> serverHandle = std::make_unique<uv_tcp_t>();
+
+			// create the socket right away, as the option has to be set before binding
+			if (uv_tcp_init_ex(shard->GetLoopHolder()->GetLoop(), serverHandle.get(), bindAddress.GetAddressFamily()) != 0)
+			{
+				return;
+			}
+
+			uv_os_fd_t fd;
+			uv_fileno(reinterpret_cast<uv_handle_t*>(serverHandle.get()), &fd);
+
+			int on = 1;
+
+			if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0 ||
+				uv_tcp_bind(serverHandle.get(), bindAddress.GetSocketAddress(), 0) != 0)
+			{
+				uv_close(reinterpret_cast<uv_handle_t*>(serverHandle.release()), [] (uv_handle_t* handle)
+				{
+					delete reinterpret_cast<uv_tcp_t*>(handle);
+				});
+
+				return;
+			}
+
+			serverHandle->data = shard.GetRef();
+
+			success = shard->Listen(std::move(serverHandle));
+		});
+
+		if (!success)
+		{
+			for (auto& shard : m_shards)
+			{
+				shard->GetLoopHolder()->RunOnLoop([&] ()
+				{
+					shard = nullptr;
+				});
+			}
+
+			m_shards.clear();
+
+			return false;
+		}
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool MultiLoopTcpServer::ListenHandOff(const PeerAddress& bindAddress)
+{
+	CreateShards();
+
+	// create a plain listening socket - libuv won't let us accept without taking ownership on the accepting loop
+	m_listenSocket = socket(bindAddress.GetAddressFamily(), SOCK_STREAM, IPPROTO_TCP);
+
+	if (m_listenSocket == INVALID_SOCKET)
+	{
+		trace("Creating a listening socket failed - error %d.\n", GetLastNetError());
+		return false;
+	}
+
+	int on = 1;
+	setsockopt(m_listenSocket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&on), sizeof(on));
+
+	if (bind(m_listenSocket, bindAddress.GetSocketAddress(), bindAddress.GetSocketAddressLength()) != 0 ||
+		listen(m_listenSocket, SOMAXCONN) != 0 ||
+		!SetNonBlocking(m_listenSocket))
+	{
+		trace("Listening on %s failed - error %d.\n", bindAddress.ToString().c_str(), GetLastNetError());
+
+		closesocket(m_listenSocket);
+		m_listenSocket = INVALID_SOCKET;
+
+		return false;
+	}
+
+	// poll the socket for readability on the first loop
+	bool success = false;
+
+	m_acceptLoop = m_manager->GetLoopHolder(0);
+	m_acceptLoop->RunOnLoop([&] ()
+	{
+		m_acceptPoll = std::make_unique<uv_poll_t>();
+
+		if (uv_poll_init_socket(m_acceptLoop->GetLoop(), m_acceptPoll.get(), m_listenSocket) != 0)
+		{
+			m_acceptPoll.reset();
+			return;
+		}
+
+		m_acceptPoll->data = this;
+
+		uv_poll_start(m_acceptPoll.get(), UV_READABLE, [] (uv_poll_t* poll, int status, int events)
+		{
+			if (status == 0)
+			{
+				reinterpret_cast<MultiLoopTcpServer*>(poll->data)->OnAcceptReady();
+			}
+		});
+
+		success = true;
+	});
+
+	return success;
+}
+
+void MultiLoopTcpServer::OnAcceptReady()
+{
+	// accept all pending connections
+	while (true)
+	{
+		PlatformSocketType socket = accept(m_listenSocket, nullptr, nullptr);
+
+		if (socket == INVALID_SOCKET)
+		{
+			break;
+		}
+
+		// hand the socket off to the next shard
+		fwRefContainer<UvTcpServer> shard = m_shards[m_nextShard];
+		m_nextShard = (m_nextShard + 1) % m_shards.size();
+
+		shard->GetLoopHolder()->EnqueueCallback([=] ()
+		{
+			if (!shard->AcceptSocket(socket))
+			{
+				closesocket(socket);
+			}
+		});
+	}
+}
+
+void MultiLoopTcpServer::InvokeConnectionCallback(fwRefContainer<TcpServerStream> stream)
+{
+	auto& connectionCallback = GetConnectionCallback();
+
+	if (connectionCallback)
+	{
+		connectionCallback(stream);
+	}
+}
+}
@@ -7,20 +7,196 @@
 
 #include "StdInc.h"
 #include "MultiplexTcpServer.h"
+#include "UvLoopManager.h"
 
+#include <array>
+#include <climits>
 #include <deque>
 #include <memory>
 
 #include "memdbgon.h"
 
+// the default for how long to wait for a connection to identify itself
+static const std::chrono::milliseconds kDefaultSniffTimeout(10000);
+
+static const size_t kDefaultMaxPeekLength = 4096;
+
 namespace net
 {
+struct MultiplexTrie
+{
+	struct Node
+	{
+		// the next node for each byte value, or -1
+		std::array<int, 256> next;
+
+		// the registration index of the pattern ending at this node, or -1
+		int pattern;
+
+		// the server that pattern belongs to
+		int server;
+
+		// the lowest registration index of any pattern ending below this node, or INT_MAX
+		int patternsBelow;
+
+		Node()
+			: pattern(-1), server(-1), patternsBelow(INT_MAX)
+		{
+			next.fill(-1);
+		}
+	};
+
+	std::vector<Node> nodes;
+
+	std::vector<fwRefContainer<MultiplexTcpChildServer>> servers;
+
+	MultiplexTrie()
+		: nodes(1)
+	{
+
+	}
+
+	// patterns have to be inserted in registration order
+	void Insert(const MultiplexPattern& pattern, int patternIndex, int server)
+	{
+		std::vector<int> current = { 0 };
+
+		for (size_t i = 0; i < pattern.prefix.size(); i++)
+		{
+			uint8_t mask = (i < pattern.mask.size()) ? pattern.mask[i] : 0xFF;
+			uint8_t value = pattern.prefix[i] & mask;
+
+			std::vector<int> next;
+
+			for (int node : current)
+			{
+				// a shorter pattern registered earlier matches already
+				if (nodes[node].pattern >= 0)
+				{
+					continue;
+				}
+
+				for (int byte = 0; byte < 256; byte++)
+				{
+					if ((byte & mask) != value)
+					{
+						continue;
+					}
+
+					if (nodes[node].next[byte] < 0)
+					{
+						nodes[node].next[byte] = static_cast<int>(nodes.size());
+						nodes.emplace_back();
+					}
+
+					next.push_back(nodes[node].next[byte]);
+				}
+			}
+
+			current = std::move(next);
+		}
+
+		for (int node : current)
+		{
+			if (nodes[node].pattern < 0)
+			{
+				nodes[node].pattern = patternIndex;
+				nodes[node].server = server;
+			}
+		}
+	}
+
+	// computes patternsBelow once everything got inserted
+	void Finalize()
+	{
+		// children always come after their parents
+		for (size_t i = nodes.size(); i-- > 0; )
+		{
+			Node& node = nodes[i];
+			node.patternsBelow = INT_MAX;
+
+			for (int child : node.next)
+			{
+				if (child >= 0)
+				{
+					node.patternsBelow = std::min({ node.patternsBelow, nodes[child].pattern >= 0 ? nodes[child].pattern : INT_MAX, nodes[child].patternsBelow });
+				}
+			}
+		}
+	}
+};
+
+struct MultiplexSniffState
+{
+	fwRefContainer<TcpServerStream> stream;
+
+	std::shared_ptr<const MultiplexTrie> trie;
+
+	// the current trie node, or -1 if the trie can't match anymore
+	int trieNode;
+
+	// the earliest registered pattern matched so far and its server, or -1 - it's used once no earlier registered
+	// pattern can match anymore
+	int matchedPattern;
+
+	int matchedServer;
+
+	// everything read so far, to be handed to the matching server
+	std::vector<PooledBuffer> peekedData;
+
+	size_t peekedLength;
+
+	// only collected for match functions, which need contiguous data
+	std::vector<uint8_t> contiguousData;
+
+	std::chrono::steady_clock::time_point deadline;
+
+	// set once handed off or closed - only accessed on the stream's thread
+	bool done;
+
+	MultiplexSniffState()
+		: trieNode(0), matchedPattern(-1), matchedServer(-1), peekedLength(0), done(false)
+	{
+
+	}
+};
+
+MultiplexPattern::MultiplexPattern(const std::string& prefix)
+	: prefix(prefix.begin(), prefix.end())
+{
+
+}
+
+MultiplexPattern::MultiplexPattern(const std::vector<uint8_t>& prefix, const std::vector<uint8_t>& mask)
+	: prefix(prefix), mask(mask)
+{
+
+}
+
 MultiplexTcpServer::MultiplexTcpServer(const fwRefContainer<TcpServerFactory>& factory)
-	: m_factory(factory)
+	: m_factory(factory), m_trie(std::make_shared<MultiplexTrie>()), m_maxPeekLength(kDefaultMaxPeekLength), m_sniffTimeout(kDefaultSniffTimeout)
 {
 	
 }
 
+MultiplexTcpServer::~MultiplexTcpServer()
+{
+	if (m_sniffTimer)
+	{
+		uv_timer_t* timer = m_sniffTimer.release();
+
+		m_timerLoop->RunOnLoop([=] ()
+		{
+			uv_timer_stop(timer);
+
+			uv_close(reinterpret_cast<uv_handle_t*>(timer), [] (uv_handle_t* handle)
+			{
+				delete reinterpret_cast<uv_timer_t*>(handle);
+			});
+		});
+	}
+}
+
 void MultiplexTcpServer::Bind(const PeerAddress& bindAddress)
 {
 	if (m_rootServer.GetRef())
@@ -33,75 +209,243 @@ void MultiplexTcpServer::Bind(const PeerAddress& bindAddress)
 	
 	if (m_rootServer.GetRef())
 	{
-		m_rootServer->SetConnectionCallback([=] (fwRefContainer<TcpServerStream> stream)
+		m_rootServer->SetConnectionCallback(std::bind(&MultiplexTcpServer::OnConnection, this, std::placeholders::_1));
+
+		// sweep for connections that are taking too long to identify themselves
+		m_timerLoop = Instance<UvLoopManager>::Get()->GetOrCreate("multiplexSniff");
+
+		m_timerLoop->RunOnLoop([=] ()
 		{
-			// start the attachment process for the stream
-			std::shared_ptr<std::vector<uint8_t>> recvQueue = std::make_shared<std::vector<uint8_t>>();
+			m_sniffTimer = std::make_unique<uv_timer_t>();
+			m_sniffTimer->data = this;
+
+			uint64_t interval = std::max<uint64_t>(m_sniffTimeout.count() / 4, 100);
 
-			TcpServerStream::TReadCallback readCallback = [=] (const std::vector<uint8_t>& data)
+			uv_timer_init(m_timerLoop->GetLoop(), m_sniffTimer.get());
+			uv_timer_start(m_sniffTimer.get(), [] (uv_timer_t* timer)
 			{
-				if (data.size() > 0)
-				{
-					// copy to the receive queue
-					size_t origSize = recvQueue->size();
-					recvQueue->resize(origSize + data.size());
+				reinterpret_cast<MultiplexTcpServer*>(timer->data)->CloseTimedOutConnections();
+			}, interval, interval);
+		});
+	}
+	else
+	{
+		trace("Could not bind MultiplexTcpServer to %s.\n", bindAddress.ToString().c_str());
+	}
+}
 
-					std::copy(data.begin(), data.end(), recvQueue->begin() + origSize);
+void MultiplexTcpServer::OnConnection(fwRefContainer<TcpServerStream> stream)
+{
+	// start the attachment process for the stream
+	auto state = std::make_shared<MultiplexSniffState>();
+	state->stream = stream;
+	state->deadline = std::chrono::steady_clock::now() + m_sniffTimeout;
 
-					// check all the servers for a pattern match
-					bool needMoreData = false;
+	{
+		std::unique_lock<std::mutex> lock(m_serversMutex);
+		state->trie = m_trie;
+	}
 
-					for (auto& server : m_childServers)
-					{
-						auto& matchFunction = server->GetPatternMatcher();
-						auto matchResult = matchFunction(*recvQueue);
-
-						// if we matched on this server
-						if (matchResult == MultiplexPatternMatchResult::Match)
-						{
-							// keep a scope-local reference to the receive queue/stream (as we'll lose the stored reference soon)
-							auto localStream = stream;
-							auto localRecvQueue = recvQueue;
-
-							// unset our read callback
-							stream->SetReadCallback(TcpServerStream::TReadCallback());
-
-							// forward the result
-							server->AttachToResult(*localRecvQueue, localStream);
-
-							// return so that the stream doesn't end up closed
-							return;
-						}
-						else if (matchResult == MultiplexPatternMatchResult::InsufficientData)
-						{
-							needMoreData = true;
-						}
-					}
+	{
+		std::unique_lock<std::mutex> lock(m_pendingMutex);
+		m_pendingConnections.insert(state);
+	}
 
-					if (!needMoreData)
-					{
-						// nobody matched, and we don't need more data - this stream is useless to us
-						stream->Close();
-					}
-				}
-			};
+	// the callbacks keep us alive until the stream gets handed off or closed, as it can outlive our owner's reference
+	fwRefContainer<MultiplexTcpServer> thisRef = this;
 
-			stream->SetReadCallback(readCallback);
-		});
+	stream->SetReadCallback([=] (const PooledBuffer& data)
+	{
+		thisRef->OnSniffData(state, data);
+	});
+
+	stream->SetCloseCallback([=] ()
+	{
+		thisRef->RemovePending(state);
+	});
+}
+
+void MultiplexTcpServer::OnSniffData(const std::shared_ptr<MultiplexSniffState>& state, const PooledBuffer& data)
+{
+	if (data.size() == 0 || state->done)
+	{
+		return;
 	}
-	else
+
+	// keep the slice as-is, it'll be handed to the matching server
+	state->peekedData.push_back(data);
+	state->peekedLength += data.size();
+
+	fwRefContainer<MultiplexTcpChildServer> matchedServer;
+	bool needMoreData = false;
+
+	// walk the trie for the new bytes only
+	if (state->trieNode >= 0)
 	{
-		trace("Could not bind MultiplexTcpServer to %s.\n", bindAddress.ToString().c_str());
+		auto& nodes = state->trie->nodes;
+
+		for (size_t i = 0; i < data.size(); i++)
+		{
+			state->trieNode = nodes[state->trieNode].next[data[i]];
+
+			if (state->trieNode < 0)
+			{
+				break;
+			}
+
+			// a longer pattern only takes precedence if it was registered earlier
+			auto& node = nodes[state->trieNode];
+
+			if (node.pattern >= 0 && (state->matchedPattern < 0 || node.pattern < state->matchedPattern))
+			{
+				state->matchedPattern = node.pattern;
+				state->matchedServer = node.server;
+			}
+
+			if (state->matchedPattern >= 0 && node.patternsBelow > state->matchedPattern)
+			{
+				state->trieNode = -1;
+				break;
+			}
+		}
+
+		needMoreData = (state->trieNode >= 0);
+
+		if (!needMoreData && state->matchedPattern >= 0)
+		{
+			matchedServer = state->trie->servers[state->matchedServer];
+		}
+	}
+
+	// then check match functions, if any - patterns come first, so not while one is waiting on an earlier one
+	if (!matchedServer.GetRef() && state->matchedPattern < 0)
+	{
+		std::vector<fwRefContainer<MultiplexTcpChildServer>> matchFunctionServers;
+
+		{
+			std::unique_lock<std::mutex> lock(m_serversMutex);
+			matchFunctionServers = m_matchFunctionServers;
+		}
+
+		if (!matchFunctionServers.empty())
+		{
+			state->contiguousData.insert(state->contiguousData.end(), data.begin(), data.end());
+		}
+
+		for (auto& server : matchFunctionServers)
+		{
+			auto matchResult = server->GetPatternMatcher()(state->contiguousData);
+
+			if (matchResult == MultiplexPatternMatchResult::Match)
+			{
+				matchedServer = server;
+				break;
+			}
+			else if (matchResult == MultiplexPatternMatchResult::InsufficientData)
+			{
+				needMoreData = true;
+			}
+		}
+	}
+
+	// out of patience for an earlier pattern, so take what matched
+	if (!matchedServer.GetRef() && state->matchedPattern >= 0 && state->peekedLength >= m_maxPeekLength)
+	{
+		matchedServer = state->trie->servers[state->matchedServer];
+	}
+
+	if (matchedServer.GetRef())
+	{
+		HandOff(state, matchedServer);
+	}
+	else if (!needMoreData || state->peekedLength >= m_maxPeekLength)
+	{
+		// nobody matched, and we don't need (or want) more data - this stream is useless to us
+		state->done = true;
+
+		state->stream->Close();
+	}
+}
+
+void MultiplexTcpServer::HandOff(const std::shared_ptr<MultiplexSniffState>& state, const fwRefContainer<MultiplexTcpChildServer>& server)
+{
+	// keep scope-local references, as unsetting the read callback drops the state, and the state will lose the stream
+	auto localState = state;
+	auto stream = state->stream;
+
+	localState->done = true;
+	RemovePending(localState);
+
+	// unset our callbacks
+	stream->SetReadCallback(TcpServerStream::TReadCallback());
+	stream->SetCloseCallback(TcpServerStream::TCloseCallback());
+
+	// forward the result
+	server->AttachToResult(std::move(localState->peekedData), stream);
+}
+
+void MultiplexTcpServer::RemovePending(const std::shared_ptr<MultiplexSniffState>& state)
+{
+	std::unique_lock<std::mutex> lock(m_pendingMutex);
+	m_pendingConnections.erase(state);
+}
+
+void MultiplexTcpServer::CloseTimedOutConnections()
+{
+	auto now = std::chrono::steady_clock::now();
+
+	std::vector<std::shared_ptr<MultiplexSniffState>> timedOut;
+
+	{
+		std::unique_lock<std::mutex> lock(m_pendingMutex);
+
+		for (auto it = m_pendingConnections.begin(); it != m_pendingConnections.end(); )
+		{
+			if ((*it)->deadline <= now)
+			{
+				timedOut.push_back(*it);
+				it = m_pendingConnections.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+	// the stream's own thread decides, as it may have matched in the meantime
+	for (auto& state : timedOut)
+	{
+		state->stream->ScheduleCallback([=] ()
+		{
+			if (state->done)
+			{
+				return;
+			}
+
+			// a pattern that matched while waiting on an earlier registered one still gets the connection
+			if (state->matchedPattern >= 0)
+			{
+				HandOff(state, state->trie->servers[state->matchedServer]);
+				return;
+			}
+
+			state->done = true;
+			state->stream->Close();
+		});
 	}
 }
 
-void MultiplexTcpChildServer::AttachToResult(const std::vector<uint8_t>& existingData, fwRefContainer<TcpServerStream> baseStream)
+void MultiplexTcpChildServer::AttachToResult(std::vector<PooledBuffer>&& existingData, fwRefContainer<TcpServerStream> baseStream)
 {
 	fwRefContainer<MultiplexTcpChildServerStream> stream = new MultiplexTcpChildServerStream(this, baseStream);
-	stream->SetInitialData(existingData);
+	stream->SetInitialData(std::move(existingData));
 
 	// keep a local reference to the connection
-	m_connections.insert(stream);
+	{
+		std::unique_lock<std::mutex> lock(m_connectionsMutex);
+		m_connections.insert(stream);
+	}
 
 	// invoke the connection callback
 	auto connectionCallback = GetConnectionCallback();
@@ -114,6 +458,7 @@ void MultiplexTcpChildServer::AttachToResult(const std::vector<uint8_t>& existin
 
 void MultiplexTcpChildServer::CloseStream(MultiplexTcpChildServerStream* stream)
 {
+	std::unique_lock<std::mutex> lock(m_connectionsMutex);
 	m_connections.erase(stream);
 }
 
@@ -125,13 +470,16 @@ void MultiplexTcpChildServer::SetPatternMatcher(const MultiplexPatternMatchFn& f
 MultiplexTcpChildServerStream::MultiplexTcpChildServerStream(MultiplexTcpChildServer* server, fwRefContainer<TcpServerStream> baseStream)
 	: m_baseStream(baseStream), m_server(server)
 {
-	baseStream->SetReadCallback([=] (const std::vector<uint8_t>& data)
+	// the base stream holds on to us until it closes, so its callbacks never outlive us
+	fwRefContainer<MultiplexTcpChildServerStream> thisRef = this;
+
+	baseStream->SetReadCallback([=] (const PooledBuffer& data)
 	{
-		auto ourReadCallback = GetReadCallback();
+		auto ourReadCallback = thisRef->GetReadCallback();
 
 		if (ourReadCallback)
 		{
-			TrySendInitialData();
+			thisRef->TrySendInitialData();
 
 			ourReadCallback(data);
 		}
@@ -139,10 +487,15 @@ MultiplexTcpChildServerStream::MultiplexTcpChildServerStream(MultiplexTcpChildSe
 
 	baseStream->SetCloseCallback([=] ()
 	{
-		CloseInternal();
+		thisRef->CloseInternal();
 	});
 }
 
+MultiplexTcpChildServerStream::~MultiplexTcpChildServerStream()
+{
+
+}
+
 void MultiplexTcpChildServerStream::TrySendInitialData()
 {
 	auto ourReadCallback = GetReadCallback();
@@ -151,8 +504,14 @@ void MultiplexTcpChildServerStream::TrySendInitialData()
 	{
 		if (!m_initialData.empty())
 		{
-			ourReadCallback(m_initialData);
-			m_initialData.clear();
+			// hand the initial data off without copying it again
+			std::vector<PooledBuffer> initialData;
+			initialData.swap(m_initialData);
+
+			for (auto& data : initialData)
+			{
+				ourReadCallback(data);
+			}
 		}
 	}
 }
@@ -194,19 +553,88 @@ void MultiplexTcpChildServerStream::Close()
 	CloseInternal();
 }
 
-void MultiplexTcpChildServerStream::Write(const std::vector<uint8_t>& data)
+void MultiplexTcpChildServerStream::Write(const PooledBuffer& data)
 {
 	m_baseStream->Write(data);
 }
 
+void MultiplexTcpChildServerStream::WriteV(const std::vector<PooledBuffer>& data)
+{
+	m_baseStream->WriteV(data);
+}
+
+void MultiplexTcpChildServerStream::Cork()
+{
+	if (m_baseStream.GetRef())
+	{
+		m_baseStream->Cork();
+	}
+}
+
+void MultiplexTcpChildServerStream::Uncork()
+{
+	if (m_baseStream.GetRef())
+	{
+		m_baseStream->Uncork();
+	}
+}
+
+size_t MultiplexTcpChildServerStream::GetQueuedBytes()
+{
+	return (m_baseStream.GetRef()) ? m_baseStream->GetQueuedBytes() : 0;
+}
+
+void MultiplexTcpChildServerStream::SetHighWaterMark(size_t highWaterMark)
+{
+	TcpServerStream::SetHighWaterMark(highWaterMark);
+
+	if (m_baseStream.GetRef())
+	{
+		m_baseStream->SetHighWaterMark(highWaterMark);
+	}
+}
+
+void MultiplexTcpChildServerStream::SetBackpressureCallback(const TBackpressureCallback& callback)
+{
+	// the base stream is the one actually queueing data
+	if (m_baseStream.GetRef())
+	{
+		m_baseStream->SetBackpressureCallback(callback);
+	}
+}
+
+void MultiplexTcpChildServerStream::WhenWritable(const std::function<void()>& callback)
+{
+	if (m_baseStream.GetRef())
+	{
+		m_baseStream->WhenWritable(callback);
+	}
+}
+
+void MultiplexTcpChildServerStream::ScheduleCallback(const std::function<void()>& callback)
+{
+	if (m_baseStream.GetRef())
+	{
+		m_baseStream->ScheduleCallback(callback);
+	}
+}
+
+void MultiplexTcpChildServerStream::SetDeadline(std::chrono::milliseconds timeout, const std::function<void()>& callback)
+{
+	if (m_baseStream.GetRef())
+	{
+		m_baseStream->SetDeadline(timeout, callback);
+	}
+}
+
 PeerAddress MultiplexTcpChildServerStream::GetPeerAddress()
 {
 	return m_baseStream->GetPeerAddress();
 }
 
-void MultiplexTcpChildServerStream::SetInitialData(const std::vector<uint8_t>& initialData)
+void MultiplexTcpChildServerStream::SetInitialData(std::vector<PooledBuffer>&& initialData)
 {
-	m_initialData = initialData;
+	m_initialData = std::move(initialData);
 }
 
 fwRefContainer<TcpServer> MultiplexTcpServer::CreateServer(const MultiplexPatternMatchFn& patternMatchFunction)
@@ -214,8 +642,49 @@ fwRefContainer<TcpServer> MultiplexTcpServer::CreateServer(const MultiplexPatter
 	fwRefContainer<MultiplexTcpChildServer> child = new MultiplexTcpChildServer();
 	child->SetPatternMatcher(patternMatchFunction);
 
+	std::unique_lock<std::mutex> lock(m_serversMutex);
+	m_childServers.push_back(child);
+	m_matchFunctionServers.push_back(child);
+
+	return child;
+}
+
+fwRefContainer<TcpServer> MultiplexTcpServer::CreateServer(const std::vector<MultiplexPattern>& patterns)
+{
+	fwRefContainer<MultiplexTcpChildServer> child = new MultiplexTcpChildServer();
+
+	std::unique_lock<std::mutex> lock(m_serversMutex);
 	m_childServers.push_back(child);
 
+	for (auto& pattern : patterns)
+	{
+		m_patterns.emplace_back(pattern, child);
+	}
+
+	// recompile the trie - patterns registered earlier take precedence
+	auto trie = std::make_shared<MultiplexTrie>();
+
+	for (size_t i = 0; i < m_patterns.size(); i++)
+	{
+		auto& entry = m_patterns[i];
+
+		auto it = std::find_if(trie->servers.begin(), trie->servers.end(), [&] (const fwRefContainer<MultiplexTcpChildServer>& server)
+		{
+			return (server.GetRef() == entry.second.GetRef());
+		});
+
+		if (it == trie->servers.end())
+		{
+			it = trie->servers.insert(trie->servers.end(), entry.second);
+		}
+
+		trie->Insert(entry.first, static_cast<int>(i), static_cast<int>(it - trie->servers.begin()));
+	}
+
+	trie->Finalize();
+
+	m_trie = trie;
+
 	return child;
 }
 }
\ No newline at end of file
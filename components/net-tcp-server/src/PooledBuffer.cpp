@@ -0,0 +1,252 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "PooledBuffer.h"
+
+#include <algorithm>
+
+#include "memdbgon.h"
+
+// the minimum amount of space left in a read block before we get a fresh one
+static const size_t kMinimumReadSpace = 4096;
+
+namespace net
+{
+PooledBufferBlock::PooledBufferBlock(BufferPool* pool, size_t size)
+	: m_refCount(0), m_pool(pool), m_storage(new uint8_t[size]), m_size(size)
+{
+	m_data = m_storage.get();
+}
+
+PooledBufferBlock::PooledBufferBlock(std::vector<uint8_t>&& adoptedData)
+	: m_refCount(0), m_pool(nullptr), m_adoptedStorage(std::move(adoptedData))
+{
+	m_data = m_adoptedStorage.data();
+	m_size = m_adoptedStorage.size();
+}
+
+void PooledBufferBlock::AddRef()
+{
+	m_refCount++;
+}
+
+bool PooledBufferBlock::Release()
+{
+	uint32_t c = m_refCount.fetch_sub(1);
+
+	if (c <= 1)
+	{
+		if (m_pool)
+		{
+			m_pool->Return(this);
+		}
+		else
+		{
+			delete this;
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+PooledBuffer::PooledBuffer()
+	: m_data(nullptr), m_size(0)
+{
+
+}
+
+PooledBuffer::PooledBuffer(const fwRefContainer<PooledBufferBlock>& block, size_t offset, size_t length)
+	: m_block(block), m_data(block->GetData() + offset), m_size(length)
+{
+	assert(offset + length <= block->GetSize());
+}
+
+PooledBuffer::PooledBuffer(const std::vector<uint8_t>& data)
+	: PooledBuffer(data.data(), data.size())
+{
+
+}
+
+PooledBuffer::PooledBuffer(std::vector<uint8_t>&& data)
+	: m_data(nullptr), m_size(0)
+{
+	if (!data.empty())
+	{
+		m_block = new PooledBufferBlock(std::move(data));
+		m_data = m_block->GetData();
+		m_size = m_block->GetSize();
+	}
+}
+
+PooledBuffer::PooledBuffer(const void* data, size_t length)
+	: m_data(nullptr), m_size(0)
+{
+	if (length == 0)
+	{
+		return;
+	}
+
+	auto pool = BufferPool::GetDefault();
+
+	if (length <= pool->GetBlockSize())
+	{
+		m_block = pool->Acquire();
+	}
+	else
+	{
+		m_block = new PooledBufferBlock(nullptr, length);
+	}
+
+	memcpy(m_block->GetData(), data, length);
+
+	m_data = m_block->GetData();
+	m_size = length;
+}
+
+PooledBuffer PooledBuffer::Slice(size_t offset, size_t length) const
+{
+	offset = std::min(offset, m_size);
+	length = std::min(length, m_size - offset);
+
+	PooledBuffer slice(*this);
+	slice.m_data += offset;
+	slice.m_size = length;
+
+	return slice;
+}
+
+std::vector<uint8_t> PooledBuffer::ToVector() const
+{
+	return std::vector<uint8_t>(begin(), end());
+}
+
+BufferPool::BufferPool(size_t blockSize, size_t maxFreeBlocks)
+	: m_blockSize(blockSize), m_maxFreeBlocks(maxFreeBlocks)
+{
+	memset(&m_statistics, 0, sizeof(m_statistics));
+}
+
+BufferPool::~BufferPool()
+{
+	for (auto block : m_freeBlocks)
+	{
+		delete block;
+	}
+}
+
+fwRefContainer<PooledBufferBlock> BufferPool::Acquire()
+{
+	PooledBufferBlock* block = nullptr;
+
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		if (!m_freeBlocks.empty())
+		{
+			block = m_freeBlocks.back();
+			m_freeBlocks.pop_back();
+
+			m_statistics.poolHits++;
+		}
+		else
+		{
+			m_statistics.heapAllocations++;
+		}
+	}
+
+	if (!block)
+	{
+		block = new PooledBufferBlock(this, m_blockSize);
+	}
+
+	return block;
+}
+
+void BufferPool::Return(PooledBufferBlock* block)
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		if (m_freeBlocks.size() < m_maxFreeBlocks)
+		{
+			m_freeBlocks.push_back(block);
+			return;
+		}
+	}
+
+	delete block;
+}
+
+BufferPool::Statistics BufferPool::GetStatistics()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	Statistics statistics = m_statistics;
+	statistics.freeBlocks = m_freeBlocks.size();
+
+	return statistics;
+}
+
+BufferPool* BufferPool::GetDefault()
+{
+	// 64 kB matches the suggested size libuv passes to allocation callbacks;
+	// keeping up to 1024 free blocks caps the idle pool at 64 MB
+	// (this is never freed, as blocks may still be returned during process exit)
+	static BufferPool* pool = new BufferPool(65536, 1024);
+
+	return pool;
+}
+
+PooledReadBuffer::PooledReadBuffer(BufferPool* pool)
+	: m_pool(pool), m_offset(0)
+{
+
+}
+
+void PooledReadBuffer::Prepare(uint8_t** data, size_t* size)
+{
+	if (m_block.GetRef())
+	{
+		// if nobody retained any data from this block, we can start from the beginning again
+		if (!m_block->IsShared())
+		{
+			m_offset = 0;
+		}
+		// otherwise, carve from the remainder unless it's too small to be useful
+		else if ((m_block->GetSize() - m_offset) < kMinimumReadSpace)
+		{
+			m_block = nullptr;
+		}
+	}
+
+	if (!m_block.GetRef())
+	{
+		m_block = m_pool->Acquire();
+		m_offset = 0;
+	}
+
+	*data = m_block->GetData() + m_offset;
+	*size = m_block->GetSize() - m_offset;
+}
+
+PooledBuffer PooledReadBuffer::Commit(size_t length)
+{
+	PooledBuffer buffer(m_block, m_offset, length);
+	m_offset += length;
+
+	return buffer;
+}
+
+void PooledReadBuffer::Reset()
+{
+	m_block = nullptr;
+	m_offset = 0;
+}
+}
@@ -17,14 +17,23 @@
 
 #include <fstream>
 
+// sessions to keep for resumption by session ID - clients supporting tickets don't need an entry
+static const size_t kSessionCacheSize = 10000;
+
+static const std::chrono::seconds kSessionLifetime(7200);
+
 class CredentialManager : public Botan::Credentials_Manager
 {
 private:
 	std::vector<Botan::X509_Certificate> m_certificates;
 	std::shared_ptr<Botan::Private_Key> m_key;
 
+	// encrypts session tickets - shared by all connections, but reset on restart
+	Botan::SymmetricKey m_ticketKey;
+
 public:
 	CredentialManager(Botan::RandomNumberGenerator& rng, const fwPlatformString& serverCert, const fwPlatformString& serverKey)
+		: m_ticketKey(rng, 32)
 	{
 		try
 		{
@@ -92,6 +101,17 @@ public:
 
 		return nullptr;
 	}
+
+	virtual Botan::SymmetricKey psk(const std::string& type, const std::string& context, const std::string& identity) override
+	{
+		// Botan only issues session tickets if it can get a key for them
+		if (type == "tls-server" && context == "session-ticket")
+		{
+			return m_ticketKey;
+		}
+
+		return Credentials_Manager::psk(type, context, identity);
+	}
 };
 
 class TLSPolicy : public Botan::TLS::Policy
@@ -106,6 +126,34 @@ public:
 	{
 		return Botan::TLS::Policy::acceptable_ciphersuite(suite);
 	}
+
+	// prefer AEAD suites, with AES-GCM first as it's hardware-accelerated nearly everywhere - CBC is only kept for
+	// older clients
+	virtual std::vector<std::string> allowed_ciphers() const override
+	{
+		return { "AES-128/GCM", "ChaCha20Poly1305", "AES-256/GCM", "AES-128", "AES-256" };
+	}
+
+	virtual std::vector<std::string> allowed_macs() const override
+	{
+		return { "AEAD", "SHA-256", "SHA-1" };
+	}
+
+	// finite-field DH is a lot slower than ECDH at comparable strength
+	virtual std::vector<std::string> allowed_key_exchange_methods() const override
+	{
+		return { "ECDH", "RSA" };
+	}
+
+	virtual std::vector<std::string> allowed_ecc_curves() const override
+	{
+		return { "secp256r1", "secp384r1" };
+	}
+
+	virtual Botan::u32bit session_ticket_lifetime() const override
+	{
+		return static_cast<Botan::u32bit>(kSessionLifetime.count());
+	}
 };
 
 #include <sstream>
@@ -113,24 +161,26 @@ public:
 namespace net
 {
 TLSServerStream::TLSServerStream(TLSServer* server, fwRefContainer<TcpServerStream> baseStream)
-	: m_parentServer(server), m_baseStream(baseStream), m_closing(false)
+	: m_parentServer(server), m_baseStream(baseStream), m_ioStream(baseStream), m_connectTime(std::chrono::system_clock::now()), m_closing(false)
 {
+	if (server->GetWorkerPool().GetRef())
+	{
+		m_strand = server->GetWorkerPool()->CreateStrand();
+	}
+
 	Initialize();
 }
 
 void TLSServerStream::Initialize()
 {
-	m_policy = std::make_unique<TLSPolicy>();
-	m_sessionManager = std::make_unique<Botan::TLS::Session_Manager_In_Memory>(m_rng);
-
 	m_tlsServer.reset(new Botan::TLS::Server(
 		std::bind(&TLSServerStream::WriteToClient, this, std::placeholders::_1, std::placeholders::_2),
 		std::bind(&TLSServerStream::ReceivedData, this, std::placeholders::_1, std::placeholders::_2),
 		std::bind(&TLSServerStream::ReceivedAlert, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
 		std::bind(&TLSServerStream::HandshakeComplete, this, std::placeholders::_1),
-		*(m_sessionManager.get()),
+		m_parentServer->GetSessionManager(),
 		*m_parentServer->GetCredentials(),
-		*(m_policy.get()),
+		m_parentServer->GetPolicy(),
 		m_rng,
 		[] (std::vector<std::string> protocols)
 		{
@@ -138,19 +188,23 @@ void TLSServerStream::Initialize()
 		}
 	));
 
-	m_baseStream->SetReadCallback([=] (const std::vector<uint8_t>& data)
+	m_baseStream->SetReadCallback([=] (const PooledBuffer& data)
 	{
 		// keep a reference to the TLS server in case we close due to a TLS alert
 		fwRefContainer<TLSServerStream> self = this;
 
-		try
+		// the slice keeps its pooled block alive, so it can be passed on without copying
+		RunOnStrand([=] ()
 		{
-			self->m_tlsServer->received_data(data);
-		}
-		catch (std::exception& e)
-		{
-			trace("%s\n", e.what());
-		}
+			try
+			{
+				self->m_tlsServer->received_data(data.data(), data.size());
+			}
+			catch (std::exception& e)
+			{
+				trace("%s\n", e.what());
+			}
+		});
 	});
 
 	m_baseStream->SetCloseCallback([=] ()
@@ -164,36 +218,144 @@ PeerAddress TLSServerStream::GetPeerAddress()
 	return m_baseStream->GetPeerAddress();
 }
 
-void TLSServerStream::Write(const std::vector<uint8_t>& data)
+void TLSServerStream::RunOnStrand(const std::function<void()>& callback)
 {
-	m_tlsServer->send(data);
+	if (m_strand.GetRef())
+	{
+		m_strand->Post(callback);
+	}
+	else
+	{
+		callback();
+	}
 }
 
-void TLSServerStream::Close()
+void TLSServerStream::RunOnStream(const std::function<void()>& callback)
 {
-	m_tlsServer->close();
+	if (m_strand.GetRef())
+	{
+		m_ioStream->ScheduleCallback(callback);
+	}
+	else
+	{
+		callback();
+	}
 }
 
-void TLSServerStream::WriteToClient(const uint8_t buf[], size_t length)
+void TLSServerStream::Write(const PooledBuffer& data)
+{
+	fwRefContainer<TLSServerStream> self = this;
+
+	RunOnStrand([=] ()
+	{
+		try
+		{
+			self->m_tlsServer->send(data.data(), data.size());
+		}
+		catch (std::exception& e)
+		{
+			trace("%s\n", e.what());
+		}
+	});
+}
+
+void TLSServerStream::Cork()
 {
-	std::vector<uint8_t> data(buf, buf + length);
-	
 	if (m_baseStream.GetRef())
 	{
-		m_baseStream->Write(data);
+		m_baseStream->Cork();
 	}
 }
 
-void TLSServerStream::ReceivedData(const uint8_t buf[], size_t length)
+void TLSServerStream::Uncork()
+{
+	if (m_baseStream.GetRef())
+	{
+		m_baseStream->Uncork();
+	}
+}
+
+size_t TLSServerStream::GetQueuedBytes()
+{
+	return (m_baseStream.GetRef()) ? m_baseStream->GetQueuedBytes() : 0;
+}
+
+void TLSServerStream::SetHighWaterMark(size_t highWaterMark)
 {
-	if (GetReadCallback())
+	TcpServerStream::SetHighWaterMark(highWaterMark);
+
+	if (m_baseStream.GetRef())
+	{
+		m_baseStream->SetHighWaterMark(highWaterMark);
+	}
+}
+
+void TLSServerStream::SetBackpressureCallback(const TBackpressureCallback& callback)
+{
+	// the base stream is the one actually queueing data
+	if (m_baseStream.GetRef())
 	{
-		std::vector<uint8_t> data(buf, buf + length);
+		m_baseStream->SetBackpressureCallback(callback);
+	}
+}
 
-		GetReadCallback()(data);
+void TLSServerStream::WhenWritable(const std::function<void()>& callback)
+{
+	if (m_baseStream.GetRef())
+	{
+		m_baseStream->WhenWritable(callback);
 	}
 }
 
+void TLSServerStream::ScheduleCallback(const std::function<void()>& callback)
+{
+	// read callbacks always end up on the I/O thread, even when TLS processing happens on a strand
+	m_ioStream->ScheduleCallback(callback);
+}
+
+void TLSServerStream::SetDeadline(std::chrono::milliseconds timeout, const std::function<void()>& callback)
+{
+	m_ioStream->SetDeadline(timeout, callback);
+}
+
+void TLSServerStream::Close()
+{
+	fwRefContainer<TLSServerStream> self = this;
+
+	RunOnStrand([=] ()
+	{
+		self->m_tlsServer->close();
+	});
+}
+
+void TLSServerStream::WriteToClient(const uint8_t buf[], size_t length)
+{
+	fwRefContainer<TLSServerStream> self = this;
+	PooledBuffer data(buf, length);
+
+	RunOnStream([=] ()
+	{
+		if (self->m_baseStream.GetRef())
+		{
+			self->m_baseStream->Write(data);
+		}
+	});
+}
+
+void TLSServerStream::ReceivedData(const uint8_t buf[], size_t length)
+{
+	fwRefContainer<TLSServerStream> self = this;
+	PooledBuffer data(buf, length);
+
+	RunOnStream([=] ()
+	{
+		if (self->GetReadCallback())
+		{
+			self->GetReadCallback()(data);
+		}
+	});
+}
+
 void TLSServerStream::ReceivedAlert(Botan::TLS::Alert alert, const uint8_t[], size_t)
 {
 	trace("alert %s\n", alert.type_string().c_str());
@@ -202,17 +364,28 @@ void TLSServerStream::ReceivedAlert(Botan::TLS::Alert alert, const uint8_t[], si
 	{
 		fwRefContainer<TLSServerStream> thisRef = this;
 
-		if (m_baseStream.GetRef())
+		RunOnStream([=] ()
 		{
-			m_baseStream->Close();
-			m_baseStream = nullptr;
-		}
+			if (thisRef->m_baseStream.GetRef())
+			{
+				thisRef->m_baseStream->Close();
+				thisRef->m_baseStream = nullptr;
+			}
+		});
 	}
 }
 
 bool TLSServerStream::HandshakeComplete(const Botan::TLS::Session& session)
 {
-	m_parentServer->InvokeConnectionCallback(this);
+	// a new session starts during this handshake, whereas a resumed one keeps the time of its original handshake
+	m_parentServer->OnHandshakeComplete(session.start_time() < m_connectTime);
+
+	fwRefContainer<TLSServerStream> self = this;
+
+	RunOnStream([=] ()
+	{
+		self->m_parentServer->InvokeConnectionCallback(self.GetRef());
+	});
 
 	return true;
 }
@@ -236,15 +409,50 @@ void TLSServerStream::CloseInternal()
 }
 
 TLSServer::TLSServer(fwRefContainer<TcpServer> baseServer, const std::string& certificatePath, const std::string& keyPath)
-	: m_baseServer(baseServer)
+	: m_baseServer(baseServer), m_handshakeCount(0), m_resumedHandshakeCount(0)
 {
 	// initialize credentials
 	Botan::AutoSeeded_RNG rng;
 	m_credentials = std::make_shared<CredentialManager>(rng, MakeRelativeCitPath(certificatePath), MakeRelativeCitPath(keyPath));
-	
+
+	m_policy = std::make_unique<TLSPolicy>();
+	m_sessionManager = std::make_unique<Botan::TLS::Session_Manager_In_Memory>(m_sessionRng, kSessionCacheSize, kSessionLifetime);
+
 	m_baseServer->SetConnectionCallback([=] (fwRefContainer<TcpServerStream> stream)
 	{
-		m_connections.insert(new TLSServerStream(this, stream));
+		// handshakes are the expensive part, so a flood of them gets turned away instead of queued
+		if (m_workerPool.GetRef() && !m_workerPool->AcceptsNewWork())
+		{
+			stream->Close();
+			return;
+		}
+
+		fwRefContainer<TLSServerStream> tlsStream = new TLSServerStream(this, stream);
+
+		std::unique_lock<std::mutex> lock(m_connectionsMutex);
+		m_connections.insert(tlsStream);
 	});
 }
+
+void TLSServer::SetWorkerThreadCount(size_t threadCount)
+{
+	// strands refer to their pool, so it can't be replaced once connections might be using it
+	if (m_workerPool.GetRef())
+	{
+		trace("TLSServer::SetWorkerThreadCount can only be called once.\n");
+		return;
+	}
+
+	if (threadCount > 0)
+	{
+		m_workerPool = new WorkerPool(threadCount);
+	}
+}
+
+double TLSServer::GetResumptionHitRate()
+{
+	uint64_t handshakeCount = m_handshakeCount;
+
+	return (handshakeCount > 0) ? (m_resumedHandshakeCount / static_cast<double>(handshakeCount)) : 0.0;
+}
 }
\ No newline at end of file
@@ -26,6 +26,126 @@ void TcpServerStream::SetCloseCallback(const TCloseCallback& callback)
 	m_closeCallback = callback;
 }
 
+TcpServerStream::TcpServerStream()
+	: m_highWaterMark(1024 * 1024), m_aboveHighWaterMark(false)
+{
+
+}
+
+void TcpServerStream::WriteV(const std::vector<PooledBuffer>& data)
+{
+	for (auto& buffer : data)
+	{
+		Write(buffer);
+	}
+}
+
+void TcpServerStream::SetHighWaterMark(size_t highWaterMark)
+{
+	m_highWaterMark = highWaterMark;
+}
+
+void TcpServerStream::SetBackpressureCallback(const TBackpressureCallback& callback)
+{
+	m_backpressureCallback = callback;
+}
+
+void TcpServerStream::UpdateQueuedBytes(size_t queuedBytes)
+{
+	std::vector<std::function<void()>> writableCallbacks;
+
+	bool wasAbove;
+	bool isAbove;
+
+	{
+		std::unique_lock<std::mutex> lock(m_writableMutex);
+
+		wasAbove = m_aboveHighWaterMark;
+
+		if (!wasAbove && queuedBytes >= m_highWaterMark)
+		{
+			m_aboveHighWaterMark = true;
+		}
+		else if (wasAbove && queuedBytes <= (m_highWaterMark / 2))
+		{
+			m_aboveHighWaterMark = false;
+
+			writableCallbacks.swap(m_writableCallbacks);
+		}
+
+		isAbove = m_aboveHighWaterMark;
+	}
+
+	if (wasAbove != isAbove && m_backpressureCallback)
+	{
+		m_backpressureCallback(isAbove);
+	}
+
+	for (auto& callback : writableCallbacks)
+	{
+		callback();
+	}
+}
+
+void TcpServerStream::ScheduleCallback(const std::function<void()>& callback)
+{
+	callback();
+}
+
+void TcpServerStream::SetDeadline(std::chrono::milliseconds timeout, const std::function<void()>& callback)
+{
+
+}
+
+void TcpServerStream::WhenWritable(const std::function<void()>& callback)
+{
+	{
+		std::unique_lock<std::mutex> lock(m_writableMutex);
+
+		if (m_aboveHighWaterMark)
+		{
+			m_writableCallbacks.push_back(callback);
+			return;
+		}
+	}
+
+	callback();
+}
+
+void TcpServerStream::ClearWritableCallbacks()
+{
+	std::vector<std::function<void()>> writableCallbacks;
+
+	{
+		std::unique_lock<std::mutex> lock(m_writableMutex);
+		writableCallbacks.swap(m_writableCallbacks);
+	}
+}
+
+void TcpServerStream::Write(const std::vector<uint8_t>& data)
+{
+	Write(PooledBuffer(data));
+}
+
+void TcpServerStream::Write(std::vector<uint8_t>&& data)
+{
+	Write(PooledBuffer(std::move(data)));
+}
+
+void TcpServerStream::SetReadCallback(const TVectorReadCallback& callback)
+{
+	if (!callback)
+	{
+		SetReadCallback(TReadCallback());
+		return;
+	}
+
+	SetReadCallback(TReadCallback([=] (const PooledBuffer& data)
+	{
+		callback(data.ToVector());
+	}));
+}
+
 void TcpServerStream::SetReadCallback(const TReadCallback& callback)
 {
 	bool wasFirst = !static_cast<bool>(m_readCallback);
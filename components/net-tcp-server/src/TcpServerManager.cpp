@@ -7,14 +7,35 @@
 
 #include "StdInc.h"
 #include "TcpServerManager.h"
+#include "MultiLoopTcpServer.h"
 #include "UvLoopManager.h"
 #include "memdbgon.h"
 
 namespace net
 {
 TcpServerManager::TcpServerManager()
+	: TcpServerManager(1)
 {
-	m_uvLoop = Instance<UvLoopManager>::Get()->GetOrCreate(std::string("default"));
+	
+}
+
+TcpServerManager::TcpServerManager(int loopCount)
+	: m_activeConnections(0), m_writeStallTimeout(0), m_lingerTimeout(m_limits.lingerTimeout.count()), m_acceptedConnections(0), m_rejectedConnections(0), m_rejectedAddressConnections(0),
+	  m_expiredDeadlines(0), m_stalledConnections(0)
+{
+	if (loopCount <= 0)
+	{
+		loopCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	}
+
+	// the first loop is the shared default loop, so single-loop managers behave as before
+	auto loopManager = Instance<UvLoopManager>::Get();
+	m_uvLoops.push_back(loopManager->GetOrCreate(std::string("default")));
+
+	for (int i = 1; i < loopCount; i++)
+	{
+		m_uvLoops.push_back(loopManager->GetOrCreate(va("default_%d", i)));
+	}
 }
 
 TcpServerManager::~TcpServerManager()
@@ -22,23 +43,122 @@ TcpServerManager::~TcpServerManager()
 	
 }
 
-fwRefContainer<TcpServer> TcpServerManager::CreateServer(const PeerAddress& bindAddress)
+void TcpServerManager::SetLimits(const TcpServerLimits& limits)
 {
-	// allocate an owning pointer for the server handle
-	std::unique_ptr<uv_tcp_t> serverHandle = std::make_unique<uv_tcp_t>();
+	std::unique_lock<std::mutex> lock(m_limitsMutex);
+	m_limits = limits;
 
-	// clear and associate the server handle with our loop
-	uv_tcp_init(m_uvLoop->GetLoop(), serverHandle.get());
+	m_writeStallTimeout = limits.writeStallTimeout.count();
+	m_lingerTimeout = limits.lingerTimeout.count();
+}
 
-	// set the socket binding to the peer address
-	uv_tcp_bind(serverHandle.get(), bindAddress.GetSocketAddress(), 0);
+TcpServerLimits TcpServerManager::GetLimits()
+{
+	std::unique_lock<std::mutex> lock(m_limitsMutex);
+	return m_limits;
+}
 
-	// create a server instance and associate it with the handle
-	fwRefContainer<UvTcpServer> tcpServer = new UvTcpServer(this);
-	serverHandle->data = tcpServer.GetRef();
+TcpServerStatistics TcpServerManager::GetStatistics()
+{
+	TcpServerStatistics statistics;
 
-	// attempt listening on the socket
-	if (tcpServer->Listen(std::move(serverHandle)))
+	{
+		std::unique_lock<std::mutex> lock(m_limitsMutex);
+		statistics.activeConnections = m_activeConnections;
+	}
+
+	statistics.acceptedConnections = m_acceptedConnections;
+	statistics.rejectedConnections = m_rejectedConnections;
+	statistics.rejectedAddressConnections = m_rejectedAddressConnections;
+	statistics.expiredDeadlines = m_expiredDeadlines;
+	statistics.stalledConnections = m_stalledConnections;
+
+	return statistics;
+}
+
+// connections are counted per IP, so the port doesn't take part in this
+static std::string GetAddressKey(const PeerAddress& peerAddress)
+{
+	const sockaddr* address = peerAddress.GetSocketAddress();
+
+	if (address->sa_family == AF_INET)
+	{
+		auto inAddress = reinterpret_cast<const sockaddr_in*>(address);
+		return std::string(reinterpret_cast<const char*>(&inAddress->sin_addr), sizeof(inAddress->sin_addr));
+	}
+	else if (address->sa_family == AF_INET6)
+	{
+		auto in6Address = reinterpret_cast<const sockaddr_in6*>(address);
+		return std::string(reinterpret_cast<const char*>(&in6Address->sin6_addr), sizeof(in6Address->sin6_addr));
+	}
+
+	return std::string();
+}
+
+bool TcpServerManager::AcquireConnection(TcpServerConnections* connections, const PeerAddress& peerAddress, std::string* addressKey)
+{
+	std::string key = GetAddressKey(peerAddress);
+
+	std::unique_lock<std::mutex> lock(m_limitsMutex);
+
+	if (m_limits.maxConnections > 0 && connections->activeConnections >= m_limits.maxConnections)
+	{
+		m_rejectedConnections++;
+		return false;
+	}
+
+	size_t& addressConnections = connections->addressConnections[key];
+
+	if (m_limits.maxConnectionsPerAddress > 0 && addressConnections >= m_limits.maxConnectionsPerAddress)
+	{
+		// don't keep entries around for addresses that never got in
+		if (addressConnections == 0)
+		{
+			connections->addressConnections.erase(key);
+		}
+
+		m_rejectedAddressConnections++;
+		return false;
+	}
+
+	addressConnections++;
+	connections->activeConnections++;
+
+	m_activeConnections++;
+
+	m_acceptedConnections++;
+
+	*addressKey = std::move(key);
+
+	return true;
+}
+
+void TcpServerManager::ReleaseConnection(TcpServerConnections* connections, const std::string& addressKey)
+{
+	std::unique_lock<std::mutex> lock(m_limitsMutex);
+
+	auto it = connections->addressConnections.find(addressKey);
+
+	if (it != connections->addressConnections.end() && --it->second == 0)
+	{
+		connections->addressConnections.erase(it);
+	}
+
+	connections->activeConnections--;
+
+	m_activeConnections--;
+}
+
+fwRefContainer<TcpServer> TcpServerManager::CreateServer(const PeerAddress& bindAddress)
+{
+	if (m_uvLoops.size() == 1)
+	{
+		return CreateSingleLoopServer(bindAddress);
+	}
+
+	fwRefContainer<MultiLoopTcpServer> tcpServer = new MultiLoopTcpServer(this);
+
+	if (tcpServer->Listen(bindAddress))
 	{
 		// insert to the owned list
 		m_servers.insert(tcpServer);
@@ -50,6 +170,44 @@ fwRefContainer<TcpServer> TcpServerManager::CreateServer(const PeerAddress& bind
 
 	return tcpServer;
 }
+
+fwRefContainer<TcpServer> TcpServerManager::CreateSingleLoopServer(const PeerAddress& bindAddress)
+{
+	fwRefContainer<UvLoopHolder> loop = m_uvLoops[0];
+
+	// create a server instance
+	fwRefContainer<UvTcpServer> tcpServer = new UvTcpServer(this, loop, std::make_shared<TcpServerConnections>());
+
+	// libuv handles may only be touched from the loop thread
+	loop->RunOnLoop([&] ()
+	{
+		// allocate an owning pointer for the server handle
+		std::unique_ptr<uv_tcp_t> serverHandle = std::make_unique<uv_tcp_t>();
+
+		// clear and associate the server handle with our loop
+		uv_tcp_init(loop->GetLoop(), serverHandle.get());
+
+		// set the socket binding to the peer address
+		uv_tcp_bind(serverHandle.get(), bindAddress.GetSocketAddress(), 0);
+
+		// associate the server instance with the handle
+		serverHandle->data = tcpServer.GetRef();
+
+		// attempt listening on the socket
+		if (!tcpServer->Listen(std::move(serverHandle)))
+		{
+			tcpServer = nullptr;
+		}
+	});
+
+	if (tcpServer.GetRef())
+	{
+		// insert to the owned list
+		m_servers.insert(tcpServer);
+	}
+
+	return tcpServer;
+}
 }
 
 #if 0
@@ -0,0 +1,118 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "TimerWheel.h"
+#include "memdbgon.h"
+
+namespace net
+{
+TimerWheel::TimerWheel(uv_loop_t* loop, std::chrono::milliseconds resolution, size_t slotCount)
+	: m_resolution(std::max<uint64_t>(1, resolution.count())), m_slots(std::max<size_t>(1, slotCount)), m_currentSlot(0), m_lastTick(0), m_nextId(1)
+{
+	m_timer = std::make_unique<uv_timer_t>();
+	uv_timer_init(loop, m_timer.get());
+
+	m_timer->data = this;
+}
+
+TimerWheel::~TimerWheel()
+{
+	uv_close(reinterpret_cast<uv_handle_t*>(m_timer.release()), [] (uv_handle_t* handle)
+	{
+		delete reinterpret_cast<uv_timer_t*>(handle);
+	});
+}
+
+TimerWheel::TimerId TimerWheel::Schedule(std::chrono::milliseconds delay, const std::function<void()>& callback)
+{
+	// the libuv timer only runs while there's something to wait for
+	if (m_entries.empty())
+	{
+		m_lastTick = uv_now(m_timer->loop);
+
+		uv_timer_start(m_timer.get(), [] (uv_timer_t* timer)
+		{
+			reinterpret_cast<TimerWheel*>(timer->data)->OnTimer();
+		}, m_resolution, m_resolution);
+	}
+
+	// count from the start of the current slot, so timers never fire early
+	uint64_t elapsed = uv_now(m_timer->loop) - m_lastTick;
+	uint64_t ticks = std::max<uint64_t>(1, (elapsed + std::max<int64_t>(0, delay.count()) + m_resolution - 1) / m_resolution);
+
+	TimerId id = m_nextId++;
+
+	Entry& entry = m_entries[id];
+	entry.rounds = (ticks - 1) / m_slots.size();
+	entry.callback = callback;
+
+	m_slots[(m_currentSlot + ticks) % m_slots.size()].push_back(id);
+
+	return id;
+}
+
+void TimerWheel::Cancel(TimerId timer)
+{
+	m_entries.erase(timer);
+}
+
+void TimerWheel::OnTimer()
+{
+	uint64_t now = uv_now(m_timer->loop);
+
+	// catch up on any steps we missed if the loop was busy
+	while (now - m_lastTick >= m_resolution)
+	{
+		m_lastTick += m_resolution;
+
+		AdvanceSlot();
+	}
+
+	if (m_entries.empty())
+	{
+		uv_timer_stop(m_timer.get());
+	}
+}
+
+void TimerWheel::AdvanceSlot()
+{
+	m_currentSlot = (m_currentSlot + 1) % m_slots.size();
+
+	std::vector<TimerId> slot;
+	slot.swap(m_slots[m_currentSlot]);
+
+	std::vector<std::function<void()>> dueCallbacks;
+
+	for (TimerId id : slot)
+	{
+		auto it = m_entries.find(id);
+
+		if (it == m_entries.end())
+		{
+			continue;
+		}
+
+		if (it->second.rounds > 0)
+		{
+			it->second.rounds--;
+			m_slots[m_currentSlot].push_back(id);
+
+			continue;
+		}
+
+		dueCallbacks.push_back(std::move(it->second.callback));
+		m_entries.erase(it);
+	}
+
+	// callbacks may well schedule or cancel timers themselves, so only run them once we're done with the slot
+	for (auto& callback : dueCallbacks)
+	{
+		callback();
+	}
+}
+}
@@ -9,10 +9,12 @@
 #include "UvLoopHolder.h"
 #include "memdbgon.h"
 
+#include <future>
+
 namespace net
 {
 UvLoopHolder::UvLoopHolder(const std::string& loopTag)
-	: m_shouldExit(false), m_loopTag(loopTag)
+	: m_shouldExit(false), m_loopTag(loopTag), m_callbacksClosed(false)
 {
 	// initialize the libuv loop
 	uv_loop_init(&m_loop);
@@ -20,22 +22,56 @@ UvLoopHolder::UvLoopHolder(const std::string& loopTag)
 	// assign our pointer to the loop
 	m_loop.data = this;
 
+	// initialize the async handle used for queued callbacks - this also keeps the loop alive
+	uv_async_init(&m_loop, &m_async, [] (uv_async_t* async)
+	{
+		UvLoopHolder* holder = reinterpret_cast<UvLoopHolder*>(async->loop->data);
+
+		if (holder->m_shouldExit)
+		{
+			uv_stop(async->loop);
+			return;
+		}
+
+		holder->RunCallbacks();
+	});
+
+	// IsInLoopThread has to be right as soon as we return
+	std::promise<void> threadStarted;
+
 	// start the loop's runtime thread
-	m_thread = std::thread([=] ()
+	m_thread = std::thread([&] ()
 	{
+		m_threadId = std::this_thread::get_id();
+		threadStarted.set_value();
+
 		// start running the loop
 		while (!m_shouldExit)
 		{
-			// execute the loop - this will probably return instantly before any events are added
+			// execute the loop - this will block until the loop gets stopped
 			uv_run(&m_loop, UV_RUN_DEFAULT);
 
 			// wait for a bit to not cause a full-load loop
-			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			if (!m_shouldExit)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			}
 		}
 
+		// callbacks queued while stopping still get to run, as RunOnLoop callers wait on them
+		DrainCallbacks();
+
+		// clean up the timer wheel and async handle and let the close callbacks run
+		m_timerWheel.reset();
+
+		uv_close(reinterpret_cast<uv_handle_t*>(&m_async), nullptr);
+		uv_run(&m_loop, UV_RUN_NOWAIT);
+
 		// clean up the libuv loop
 		uv_loop_close(&m_loop);
 	});
+
+	threadStarted.get_future().wait();
 }
 
 UvLoopHolder::~UvLoopHolder()
@@ -43,26 +79,94 @@ UvLoopHolder::~UvLoopHolder()
 	// mark the thread as needing to exit
 	m_shouldExit = true;
 
-	// stop the loop as soon as possible
-	uv_stop(&m_loop);
+	// signal the loop so it can get stopped from its own thread
+	uv_async_send(&m_async);
+
+	// wait for the thread to exit cleanly
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+}
 
-	// signal the loop so it can get triggered
-	uv_async_t async;
-	
-	uv_async_init(&m_loop, &async, [] (uv_async_t*)
+void UvLoopHolder::EnqueueCallback(const std::function<void()>& callback)
+{
 	{
+		std::unique_lock<std::mutex> lock(m_callbackMutex);
 
+		// the loop is gone - dropping the callback breaks any promise it holds
+		if (m_callbacksClosed)
+		{
+			return;
+		}
+
+		m_callbacks.push_back(callback);
+	}
+
+	uv_async_send(&m_async);
+}
+
+void UvLoopHolder::RunOnLoop(const std::function<void()>& callback)
+{
+	// if we're already on the loop thread, waiting would deadlock
+	if (IsInLoopThread())
+	{
+		callback();
+		return;
+	}
+
+	// shared with the callback, so a callback dropped on shutdown still wakes us up
+	auto promise = std::make_shared<std::promise<void>>();
+	auto future = promise->get_future();
+
+	EnqueueCallback([&callback, promise] ()
+	{
+		callback();
+
+		promise->set_value();
 	});
 
-	uv_async_send(&async);
+	future.wait();
+}
 
-	// wait for the thread to exit cleanly
-	if (m_thread.joinable())
+TimerWheel& UvLoopHolder::GetTimerWheel()
+{
+	if (!m_timerWheel)
 	{
-		m_thread.join();
+		m_timerWheel = std::make_unique<TimerWheel>(&m_loop);
 	}
 
-	// clean up the async
-	uv_close(reinterpret_cast<uv_handle_t*>(&async), nullptr);
+	return *m_timerWheel;
+}
+
+void UvLoopHolder::RunCallbacks()
+{
+	std::vector<std::function<void()>> callbacks;
+
+	{
+		std::unique_lock<std::mutex> lock(m_callbackMutex);
+		callbacks.swap(m_callbacks);
+	}
+
+	for (auto& callback : callbacks)
+	{
+		callback();
+	}
+}
+
+void UvLoopHolder::DrainCallbacks()
+{
+	while (true)
+	{
+		RunCallbacks();
+
+		std::unique_lock<std::mutex> lock(m_callbackMutex);
+
+		if (m_callbacks.empty())
+		{
+			m_callbacksClosed = true;
+			break;
+		}
+	}
 }
 }
\ No newline at end of file
@@ -46,27 +46,81 @@ void UvClose(std::unique_ptr<Handle> handle)
 
 namespace net
 {
-UvTcpServer::UvTcpServer(TcpServerManager* manager)
-	: m_manager(manager)
+// write request structure
+struct UvWriteReq
 {
+	std::vector<PooledBuffer> sendData;
+	std::vector<uv_buf_t> buffers;
+	size_t length;
+	uv_write_t write;
 
+	fwRefContainer<UvTcpServerStream> stream;
+};
+
+// write requests available for reuse - write callbacks always run on the owning loop thread,
+// so a free list per thread needs no locking
+static thread_local std::vector<std::unique_ptr<UvWriteReq>> g_freeWriteRequests;
+
+static std::unique_ptr<UvWriteReq> AcquireWriteRequest()
+{
+	if (g_freeWriteRequests.empty())
+	{
+		return std::make_unique<UvWriteReq>();
+	}
+
+	std::unique_ptr<UvWriteReq> request = std::move(g_freeWriteRequests.back());
+	g_freeWriteRequests.pop_back();
+
+	return request;
 }
 
-UvTcpServer::~UvTcpServer()
+static void ReturnWriteRequest(std::unique_ptr<UvWriteReq> request)
 {
-	m_clients.clear();
+	// drop references so data and streams don't outlive the write - clearing keeps the vectors' capacity around
+	request->sendData.clear();
+	request->buffers.clear();
+	request->stream = nullptr;
 
-	if (m_server.get())
+	// cap the free list so a burst of writes doesn't pin memory forever
+	if (g_freeWriteRequests.size() < 256)
 	{
-		UvClose(std::move(m_server));
+		g_freeWriteRequests.push_back(std::move(request));
 	}
 }
 
+UvTcpServer::UvTcpServer(TcpServerManager* manager, fwRefContainer<UvLoopHolder> loop, const std::shared_ptr<TcpServerConnections>& connections)
+	: m_manager(manager), m_connections(connections), m_loop(loop)
+{
+
+}
+
+UvTcpServer::~UvTcpServer()
+{
+	// streams can outlive us, so close them and have them let go of us - on the loop, as that's where they get used
+	m_loop->RunOnLoop([this] ()
+	{
+		if (m_server.get())
+		{
+			UvClose(std::move(m_server));
+		}
+
+		// closing removes them from the list, or detaching does for those still sending their queued writes
+		std::vector<fwRefContainer<UvTcpServerStream>> clients(m_clients.begin(), m_clients.end());
+
+		for (auto& client : clients)
+		{
+			client->Close();
+			client->DetachFromServer();
+		}
+	});
+}
+
 bool UvTcpServer::Listen(std::unique_ptr<uv_tcp_t>&& server)
 {
 	m_server = std::move(server);
 
-	int result = uv_listen(reinterpret_cast<uv_stream_t*>(m_server.get()), 0, UvCallback<uv_stream_t, UvTcpServer, int, &UvTcpServer::OnConnection>);
+	// use the system maximum backlog so connection bursts don't get dropped before we can accept them
+	int result = uv_listen(reinterpret_cast<uv_stream_t*>(m_server.get()), SOMAXCONN, UvCallback<uv_stream_t, UvTcpServer, int, &UvTcpServer::OnConnection>);
 
 	bool retval = (result == 0);
 
@@ -89,7 +143,7 @@ void UvTcpServer::OnConnection(int status)
 
 	// initialize a handle for the client
 	std::unique_ptr<uv_tcp_t> clientHandle = std::make_unique<uv_tcp_t>();
-	uv_tcp_init(m_manager->GetLoop(), clientHandle.get());
+	uv_tcp_init(m_loop->GetLoop(), clientHandle.get());
 
 	// create a stream instance and associate
 	fwRefContainer<UvTcpServerStream> stream(new UvTcpServerStream(this));
@@ -98,43 +152,179 @@ void UvTcpServer::OnConnection(int status)
 	// attempt accepting the connection
 	if (stream->Accept(std::move(clientHandle)))
 	{
-		m_clients.insert(stream);
-		
-		// invoke the connection callback
-		if (GetConnectionCallback())
-		{
-			GetConnectionCallback()(stream);
-		}
+		AddStream(stream);
 	}
-	else
+}
+
+bool UvTcpServer::AcceptSocket(uv_os_sock_t socket)
+{
+	// initialize a handle for the client on our own loop
+	std::unique_ptr<uv_tcp_t> clientHandle = std::make_unique<uv_tcp_t>();
+	uv_tcp_init(m_loop->GetLoop(), clientHandle.get());
+
+	int result = uv_tcp_open(clientHandle.get(), socket);
+
+	if (result != 0)
+	{
+		trace("Adopting socket failed - libuv error %s.\n", uv_strerror(result));
+
+		UvClose(std::move(clientHandle));
+		return false;
+	}
+
+	// create a stream instance and associate
+	fwRefContainer<UvTcpServerStream> stream(new UvTcpServerStream(this));
+	clientHandle->data = stream.GetRef();
+
+	if (stream->Open(std::move(clientHandle)))
 	{
-		stream = nullptr;
+		AddStream(stream);
+	}
+
+	// the handle owns the socket from here on, even if reading failed
+	return true;
+}
+
+void UvTcpServer::AddStream(fwRefContainer<UvTcpServerStream> stream)
+{
+	std::string addressKey;
+
+	// over the limits, the connection gets dropped before anyone gets to see it
+	if (!m_manager->AcquireConnection(m_connections.get(), stream->GetPeerAddress(), &addressKey))
+	{
+		stream->Close();
+		return;
+	}
+
+	stream->SetAddressKey(addressKey);
+
+	m_clients.insert(stream);
+
+	// invoke the connection callback
+	if (GetConnectionCallback())
+	{
+		GetConnectionCallback()(stream);
 	}
 }
 
 void UvTcpServer::RemoveStream(UvTcpServerStream* stream)
 {
-	m_clients.erase(stream);
+	// streams rejected by the limits were never added, and Close may run more than once
+	std::string addressKey = stream->GetAddressKey();
+
+	if (m_clients.erase(stream) > 0)
+	{
+		m_manager->ReleaseConnection(m_connections.get(), addressKey);
+	}
 }
 
 UvTcpServerStream::UvTcpServerStream(UvTcpServer* server)
-	: m_server(server)
+	: m_server(server), m_loop(server->GetLoopHolder()), m_corkDepth(0), m_queuedBytes(0), m_deadlineTimer(0), m_writeStallTimer(0), m_lingerTimer(0), m_shutdownPending(false)
 {
 
 }
 
 UvTcpServerStream::~UvTcpServerStream()
 {
-	CloseClient();
+	// pending writes hold a reference to us, so there's nothing left to wait for
+	CloseClient(true);
 }
 
-void UvTcpServerStream::CloseClient()
+void UvTcpServerStream::CloseClient(bool discardQueued)
 {
-	if (m_client.get())
+	if (!m_client.get())
+	{
+		return;
+	}
+
+	// the queued writes are already being waited on
+	if (m_shutdownPending && !discardQueued)
+	{
+		return;
+	}
+
+	uv_stream_t* stream = reinterpret_cast<uv_stream_t*>(m_client.get());
+
+	uv_read_stop(stream);
+
+	// closing right away would cancel any queued writes, so let those finish first
+	if (m_queuedBytes > 0 && !discardQueued)
+	{
+		uv_shutdown_t* shutdownReq = new uv_shutdown_t;
+		shutdownReq->data = this;
+
+		int result = uv_shutdown(shutdownReq, stream, [] (uv_shutdown_t* req, int status)
+		{
+			UvTcpServerStream* self = reinterpret_cast<UvTcpServerStream*>(req->data);
+			delete req;
+
+			self->OnShutdownCompleted();
+
+			// the reference taken for the request
+			self->Release();
+		});
+
+		if (result == 0)
+		{
+			AddRef();
+			m_shutdownPending = true;
+
+			// a peer that stops reading would keep the handle open forever otherwise
+			auto timeout = m_server->GetManager()->GetLingerTimeout();
+
+			if (timeout.count() > 0)
+			{
+				fwRefContainer<UvTcpServerStream> selfRef = this;
+
+				m_lingerTimer = m_loop->GetTimerWheel().Schedule(timeout, [=] ()
+				{
+					selfRef->m_lingerTimer = 0;
+
+					selfRef->CloseClient(true);
+					selfRef->Close();
+				});
+			}
+
+			return;
+		}
+
+		delete shutdownReq;
+	}
+
+	// a forced close cancels the shutdown, whose callback won't have anything left to do
+	m_shutdownPending = false;
+
+	UvClose(std::move(m_client));
+}
+
+void UvTcpServerStream::OnShutdownCompleted()
+{
+	if (!m_shutdownPending)
 	{
-		uv_read_stop(reinterpret_cast<uv_stream_t*>(m_client.get()));
+		return;
+	}
+
+	m_shutdownPending = false;
 
-		UvClose(std::move(m_client));
+	CancelTimers();
+
+	UvClose(std::move(m_client));
+
+	if (m_server)
+	{
+		m_server->RemoveStream(this);
+	}
+}
+
+void UvTcpServerStream::DetachFromServer()
+{
+	CloseClient(true);
+	CancelTimers();
+
+	if (m_server)
+	{
+		m_server->RemoveStream(this);
+		m_server = nullptr;
 	}
 }
 
@@ -145,19 +335,29 @@ bool UvTcpServerStream::Accept(std::unique_ptr<uv_tcp_t>&& client)
 	int result = uv_accept(reinterpret_cast<uv_stream_t*>(m_server->GetServer()),
 						   reinterpret_cast<uv_stream_t*>(m_client.get()));
 
-	if (result == 0)
+	return (result == 0 && StartReading());
+}
+
+bool UvTcpServerStream::Open(std::unique_ptr<uv_tcp_t>&& client)
+{
+	m_client = std::move(client);
+
+	return StartReading();
+}
+
+bool UvTcpServerStream::StartReading()
+{
+	int result = uv_read_start(reinterpret_cast<uv_stream_t*>(m_client.get()), [] (uv_handle_t* handle, size_t suggestedSize, uv_buf_t* buf)
 	{
-		uv_read_start(reinterpret_cast<uv_stream_t*>(m_client.get()), [] (uv_handle_t* handle, size_t suggestedSize, uv_buf_t* buf)
-		{
-			UvTcpServerStream* stream = reinterpret_cast<UvTcpServerStream*>(handle->data);
+		UvTcpServerStream* stream = reinterpret_cast<UvTcpServerStream*>(handle->data);
 
-			auto& readBuffer = stream->GetReadBuffer();
-			readBuffer.resize(suggestedSize);
+		uint8_t* data;
+		size_t size;
+		stream->GetReadBuffer().Prepare(&data, &size);
 
-			buf->base = &readBuffer[0];
-			buf->len = suggestedSize;
-		}, UvCallback<uv_stream_t, UvTcpServerStream, ssize_t, const uv_buf_t*, &UvTcpServerStream::HandleRead>);
-	}
+		buf->base = reinterpret_cast<char*>(data);
+		buf->len = size;
+	}, UvCallback<uv_stream_t, UvTcpServerStream, ssize_t, const uv_buf_t*, &UvTcpServerStream::HandleRead>);
 
 	return (result == 0);
 }
@@ -166,8 +366,8 @@ void UvTcpServerStream::HandleRead(ssize_t nread, const uv_buf_t* buf)
 {
 	if (nread > 0)
 	{
-		std::vector<uint8_t> targetBuf(nread);
-		memcpy(&targetBuf[0], buf->base, targetBuf.size());
+		// the data was read in-place into our pooled block, so we only need to reference it
+		PooledBuffer targetBuf = m_readBuffer.Commit(nread);
 
 		if (GetReadCallback())
 		{
@@ -179,7 +379,10 @@ void UvTcpServerStream::HandleRead(ssize_t nread, const uv_buf_t* buf)
 		// hold a reference to ourselves while in this scope
 		fwRefContainer<UvTcpServerStream> tempContainer = this;
 
-		trace("read error: %s\n", uv_strerror(nread));
+		if (nread != UV_EOF)
+		{
+			trace("read error: %s\n", uv_strerror(nread));
+		}
 
 		Close();
 	}
@@ -187,6 +390,11 @@ void UvTcpServerStream::HandleRead(ssize_t nread, const uv_buf_t* buf)
 
 PeerAddress UvTcpServerStream::GetPeerAddress()
 {
+	if (!m_client.get())
+	{
+		return PeerAddress();
+	}
+
 	sockaddr_storage addr;
 	int len = sizeof(addr);
 
@@ -195,50 +403,417 @@ PeerAddress UvTcpServerStream::GetPeerAddress()
 	return PeerAddress(reinterpret_cast<sockaddr*>(&addr), static_cast<socklen_t>(len));
 }
 
-void UvTcpServerStream::Write(const std::vector<uint8_t>& data)
+void UvTcpServerStream::Write(const PooledBuffer& data)
 {
-	// write request structure
-	struct UvWriteReq
+	WriteInternal(&data, 1);
+}
+
+void UvTcpServerStream::WriteV(const std::vector<PooledBuffer>& data)
+{
+	WriteInternal(data.data(), data.size());
+}
+
+void UvTcpServerStream::WriteInternal(const PooledBuffer* buffers, size_t count)
+{
+	// libuv handles may only be touched from their own loop thread
+	auto& loop = m_loop;
+
+	if (!loop->IsInLoopThread())
 	{
-		std::vector<uint8_t> sendData;
-		uv_buf_t buffer;
-		uv_write_t write;
+		fwRefContainer<UvTcpServerStream> selfRef = this;
+		std::vector<PooledBuffer> data(buffers, buffers + count);
 
-		fwRefContainer<UvTcpServerStream> stream;
-	};
+		// count the data as queued right away, so backpressure applies to writers on other threads as well
+		size_t length = 0;
+
+		for (auto& buffer : data)
+		{
+			length += buffer.size();
+		}
+
+		m_queuedBytes += length;
+		UpdateQueuedBytes(m_queuedBytes);
+
+		loop->EnqueueCallback([=] ()
+		{
+			// the write itself accounts for whatever it leaves queued
+			selfRef->m_queuedBytes -= length;
+			selfRef->WriteInternal(data.data(), data.size());
+
+			selfRef->UpdateQueuedBytes(selfRef->m_queuedBytes);
+
+			if (selfRef->m_queuedBytes == 0)
+			{
+				selfRef->ResetWriteStallTimer();
+			}
+		});
+
+		return;
+	}
+
+	// closed streams don't take any more writes, even if their handle is still sending queued ones
+	if (!m_client.get() || m_shutdownPending)
+	{
+		return;
+	}
+
+	// while corked, only collect the buffers
+	if (m_corkDepth > 0)
+	{
+		size_t length = 0;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			if (!buffers[i].empty())
+			{
+				m_corkedBuffers.push_back(buffers[i]);
+				length += buffers[i].size();
+			}
+		}
+
+		m_queuedBytes += length;
+		UpdateQueuedBytes(m_queuedBytes);
+
+		return;
+	}
+
+	SendBuffers(buffers, count);
+}
+
+void UvTcpServerStream::SendBuffers(const PooledBuffer* buffers, size_t count)
+{
+	// prepare a write request - this only takes references to the data
+	std::unique_ptr<UvWriteReq> writeReq = AcquireWriteRequest();
+	size_t length = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const PooledBuffer& buffer = buffers[i];
+
+		if (!buffer.empty())
+		{
+			writeReq->sendData.push_back(buffer);
+			writeReq->buffers.push_back(uv_buf_init(reinterpret_cast<char*>(const_cast<uint8_t*>(buffer.data())), buffer.size()));
+
+			length += buffer.size();
+		}
+	}
+
+	if (length == 0)
+	{
+		ReturnWriteRequest(std::move(writeReq));
+		return;
+	}
+
+	uv_stream_t* stream = reinterpret_cast<uv_stream_t*>(m_client.get());
+	auto& uvBuffers = writeReq->buffers;
+
+	// if nothing is queued, try writing right away - this usually completes the write in a single system call
+	int result = uv_try_write(stream, uvBuffers.data(), uvBuffers.size());
+
+	// negative results are errors (or UV_EAGAIN), which leave everything to the queued write
+	if (result > 0)
+	{
+		size_t written = static_cast<size_t>(result);
+
+		if (written == length)
+		{
+			ReturnWriteRequest(std::move(writeReq));
+			return;
+		}
+
+		// skip whatever got written already
+		length -= written;
+
+		size_t skip = written;
+		auto it = uvBuffers.begin();
 
-	// prepare a write request
-	UvWriteReq* writeReq = new UvWriteReq;
-	writeReq->sendData = data;
-	writeReq->buffer.base = reinterpret_cast<char*>(&writeReq->sendData[0]);
-	writeReq->buffer.len = writeReq->sendData.size();
+		while (skip >= it->len)
+		{
+			skip -= it->len;
+			it++;
+		}
+
+		it->base += skip;
+		it->len -= skip;
+
+		uvBuffers.erase(uvBuffers.begin(), it);
+	}
+
+	writeReq->length = length;
 	writeReq->stream = this;
-	
-	writeReq->write.data = writeReq;
+	writeReq->write.data = writeReq.get();
+
+	// queue the remainder
+	UvWriteReq* req = writeReq.get();
 
-	// send the write request
-	uv_write(&writeReq->write, reinterpret_cast<uv_stream_t*>(m_client.get()), &writeReq->buffer, 1, [] (uv_write_t* write, int status)
+	result = uv_write(&req->write, stream, uvBuffers.data(), uvBuffers.size(), [] (uv_write_t* write, int status)
 	{
-		UvWriteReq* req = reinterpret_cast<UvWriteReq*>(write->data);
+		std::unique_ptr<UvWriteReq> req(reinterpret_cast<UvWriteReq*>(write->data));
 
-		if (status < 0)
+		if (status < 0 && status != UV_ECANCELED)
 		{
 			trace("write to %s failed - %s\n", req->stream->GetPeerAddress().ToString().c_str(), uv_strerror(status));
 		}
 
-		delete req;
+		req->stream->OnWriteCompleted(req->length);
+
+		ReturnWriteRequest(std::move(req));
+	});
+
+	if (result == 0)
+	{
+		// libuv owns the request until the callback fires
+		writeReq.release();
+
+		m_queuedBytes += length;
+		UpdateQueuedBytes(m_queuedBytes);
+
+		// only completed writes push the timer back, so a peer that doesn't read gets evicted eventually
+		if (!m_writeStallTimer)
+		{
+			ResetWriteStallTimer();
+		}
+	}
+	else
+	{
+		trace("write to %s failed - %s\n", GetPeerAddress().ToString().c_str(), uv_strerror(result));
+
+		ReturnWriteRequest(std::move(writeReq));
+	}
+}
+
+void UvTcpServerStream::OnWriteCompleted(size_t length)
+{
+	m_queuedBytes -= length;
+	UpdateQueuedBytes(m_queuedBytes);
+
+	ResetWriteStallTimer();
+}
+
+void UvTcpServerStream::ResetWriteStallTimer()
+{
+	auto& timerWheel = m_loop->GetTimerWheel();
+
+	if (m_writeStallTimer)
+	{
+		timerWheel.Cancel(m_writeStallTimer);
+		m_writeStallTimer = 0;
+	}
+
+	// writes can still complete after we're closed - and detached from the server
+	if (m_queuedBytes == 0 || !m_client.get())
+	{
+		return;
+	}
+
+	auto timeout = m_server->GetManager()->GetWriteStallTimeout();
+
+	if (timeout.count() <= 0)
+	{
+		return;
+	}
+
+	fwRefContainer<UvTcpServerStream> selfRef = this;
+
+	m_writeStallTimer = timerWheel.Schedule(timeout, [=] ()
+	{
+		selfRef->m_writeStallTimer = 0;
+
+		if (selfRef->m_server)
+		{
+			selfRef->m_server->GetManager()->CountStalledConnection();
+		}
+
+		// waiting for the queued writes to finish is what got us here
+		selfRef->CloseClient(true);
+		selfRef->Close();
+	});
+}
+
+void UvTcpServerStream::SetDeadline(std::chrono::milliseconds timeout, const std::function<void()>& callback)
+{
+	auto& loop = m_loop;
+
+	if (!loop->IsInLoopThread())
+	{
+		fwRefContainer<UvTcpServerStream> selfRef = this;
+
+		loop->EnqueueCallback([=] ()
+		{
+			selfRef->SetDeadline(timeout, callback);
+		});
+
+		return;
+	}
+
+	auto& timerWheel = loop->GetTimerWheel();
+
+	if (m_deadlineTimer)
+	{
+		timerWheel.Cancel(m_deadlineTimer);
+		m_deadlineTimer = 0;
+	}
+
+	if (timeout.count() <= 0 || !m_client.get() || m_shutdownPending)
+	{
+		return;
+	}
+
+	fwRefContainer<UvTcpServerStream> selfRef = this;
+
+	m_deadlineTimer = timerWheel.Schedule(timeout, [=] ()
+	{
+		selfRef->m_deadlineTimer = 0;
+		selfRef->m_server->GetManager()->CountExpiredDeadline();
+
+		if (callback)
+		{
+			callback();
+		}
 	});
 }
 
+void UvTcpServerStream::CancelTimers()
+{
+	if (!m_deadlineTimer && !m_writeStallTimer && !m_lingerTimer)
+	{
+		return;
+	}
+
+	auto& timerWheel = m_loop->GetTimerWheel();
+
+	// the timers hold references to us, so these have to go for us to get freed
+	if (m_deadlineTimer)
+	{
+		timerWheel.Cancel(m_deadlineTimer);
+		m_deadlineTimer = 0;
+	}
+
+	if (m_writeStallTimer && !m_shutdownPending)
+	{
+		timerWheel.Cancel(m_writeStallTimer);
+		m_writeStallTimer = 0;
+	}
+
+	if (m_lingerTimer && !m_shutdownPending)
+	{
+		timerWheel.Cancel(m_lingerTimer);
+		m_lingerTimer = 0;
+	}
+}
+
+void UvTcpServerStream::Cork()
+{
+	auto& loop = m_loop;
+
+	if (!loop->IsInLoopThread())
+	{
+		fwRefContainer<UvTcpServerStream> selfRef = this;
+
+		loop->EnqueueCallback([=] ()
+		{
+			selfRef->Cork();
+		});
+
+		return;
+	}
+
+	m_corkDepth++;
+}
+
+void UvTcpServerStream::Uncork()
+{
+	auto& loop = m_loop;
+
+	if (!loop->IsInLoopThread())
+	{
+		fwRefContainer<UvTcpServerStream> selfRef = this;
+
+		loop->EnqueueCallback([=] ()
+		{
+			selfRef->Uncork();
+		});
+
+		return;
+	}
+
+	if (m_corkDepth > 0 && --m_corkDepth == 0)
+	{
+		FlushCorkedBuffers();
+	}
+}
+
+void UvTcpServerStream::FlushCorkedBuffers()
+{
+	if (m_corkedBuffers.empty())
+	{
+		return;
+	}
+
+	std::vector<PooledBuffer> buffers;
+	buffers.swap(m_corkedBuffers);
+
+	// these are no longer queued by us - SendBuffers will account for whatever stays queued in libuv
+	size_t length = 0;
+
+	for (auto& buffer : buffers)
+	{
+		length += buffer.size();
+	}
+
+	m_queuedBytes -= length;
+
+	if (m_client.get())
+	{
+		SendBuffers(buffers.data(), buffers.size());
+	}
+	else
+	{
+		UpdateQueuedBytes(m_queuedBytes);
+	}
+}
+
+size_t UvTcpServerStream::GetQueuedBytes()
+{
+	return m_queuedBytes;
+}
+
+void UvTcpServerStream::ScheduleCallback(const std::function<void()>& callback)
+{
+	m_loop->EnqueueCallback(callback);
+}
+
 void UvTcpServerStream::Close()
 {
 	// keep a reference in scope
 	fwRefContainer<UvTcpServerStream> selfRef = this;
 
+	// marshal to the loop thread, same as for writes
+	auto& loop = m_loop;
+
+	if (!loop->IsInLoopThread())
+	{
+		loop->EnqueueCallback([=] ()
+		{
+			selfRef->Close();
+		});
+
+		return;
+	}
+
+	// don't drop anything that was written while corked
+	m_corkDepth = 0;
+	FlushCorkedBuffers();
+
 	CloseClient();
 
+	CancelTimers();
+
 	SetReadCallback(TReadCallback());
 
+	ClearWritableCallbacks();
+
 	// get it locally as we may recurse
 	auto closeCallback = GetCloseCallback();
 
@@ -249,6 +824,10 @@ void UvTcpServerStream::Close()
 		closeCallback();
 	}
 
-	m_server->RemoveStream(this);
+	// streams still sending their queued writes keep their connection slot until they're done
+	if (m_server && !m_shutdownPending)
+	{
+		m_server->RemoveStream(this);
+	}
 }
 }
\ No newline at end of file
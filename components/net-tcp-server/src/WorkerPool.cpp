@@ -0,0 +1,163 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "WorkerPool.h"
+
+#include "memdbgon.h"
+
+// tasks a strand runs before giving other strands a turn
+static const size_t kStrandBatchSize = 16;
+
+namespace net
+{
+WorkerStrand::WorkerStrand(WorkerPool* pool)
+	: m_pool(pool), m_scheduled(false)
+{
+
+}
+
+void WorkerStrand::Post(const std::function<void()>& task)
+{
+	bool needsSchedule = false;
+
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_tasks.push_back(task);
+
+		m_pool->AddQueuedTasks(1);
+
+		if (!m_scheduled)
+		{
+			m_scheduled = true;
+			needsSchedule = true;
+		}
+	}
+
+	if (needsSchedule)
+	{
+		m_pool->Schedule(this);
+	}
+}
+
+bool WorkerStrand::Run()
+{
+	for (size_t i = 0; i < kStrandBatchSize; i++)
+	{
+		std::function<void()> task;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			if (m_tasks.empty())
+			{
+				m_scheduled = false;
+				return false;
+			}
+
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+
+		m_pool->AddQueuedTasks(-1);
+
+		task();
+	}
+
+	// still scheduled, so nobody else will queue us in the meantime
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	if (m_tasks.empty())
+	{
+		m_scheduled = false;
+		return false;
+	}
+
+	return true;
+}
+
+WorkerPool::WorkerPool(size_t threadCount, size_t maxQueuedTasks)
+	: m_shouldExit(false), m_queuedTasks(0), m_maxQueuedTasks(maxQueuedTasks), m_refusedWork(0)
+{
+	for (size_t i = 0; i < threadCount; i++)
+	{
+		m_threads.emplace_back(std::bind(&WorkerPool::ThreadFunc, this));
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_shouldExit = true;
+	}
+
+	m_condition.notify_all();
+
+	for (auto& thread : m_threads)
+	{
+		thread.join();
+	}
+}
+
+fwRefContainer<WorkerStrand> WorkerPool::CreateStrand()
+{
+	return new WorkerStrand(this);
+}
+
+void WorkerPool::Schedule(const fwRefContainer<WorkerStrand>& strand)
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_readyStrands.push_back(strand);
+	}
+
+	m_condition.notify_one();
+}
+
+bool WorkerPool::AcceptsNewWork()
+{
+	if (m_queuedTasks >= m_maxQueuedTasks)
+	{
+		m_refusedWork++;
+		return false;
+	}
+
+	return true;
+}
+
+void WorkerPool::ThreadFunc()
+{
+	while (true)
+	{
+		fwRefContainer<WorkerStrand> strand;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			m_condition.wait(lock, [this] ()
+			{
+				return m_shouldExit || !m_readyStrands.empty();
+			});
+
+			if (m_readyStrands.empty())
+			{
+				return;
+			}
+
+			strand = std::move(m_readyStrands.front());
+			m_readyStrands.pop_front();
+		}
+
+		// requeue at the back if there's more, so a busy strand can't starve the others
+		if (strand->Run())
+		{
+			Schedule(strand);
+		}
+	}
+}
+}
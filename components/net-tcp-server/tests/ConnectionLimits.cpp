@@ -0,0 +1,404 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <TcpServerManager.h>
+#include <UvLoopManager.h>
+
+#include <chrono>
+#include <future>
+
+class ConnectionLimitsTest : public ::testing::Test
+{
+public:
+	static void SetUpTestCase()
+	{
+		static bool initialized = ([] ()
+		{
+			Instance<net::UvLoopManager>::Set(new net::UvLoopManager());
+			return true;
+		})();
+	}
+};
+
+static PlatformSocketType ConnectClient(const net::PeerAddress& address)
+{
+	PlatformSocketType socket = ::socket(address.GetAddressFamily(), SOCK_STREAM, IPPROTO_TCP);
+
+	if (connect(socket, address.GetSocketAddress(), address.GetSocketAddressLength()) != 0)
+	{
+		closesocket(socket);
+		return static_cast<PlatformSocketType>(-1);
+	}
+
+	return socket;
+}
+
+// returns true if the server closed the connection within the timeout
+static bool WaitForClose(PlatformSocketType socket, std::chrono::milliseconds timeout)
+{
+	fd_set readSet;
+	FD_ZERO(&readSet);
+	FD_SET(socket, &readSet);
+
+	timeval timeVal;
+	timeVal.tv_sec = static_cast<long>(timeout.count() / 1000);
+	timeVal.tv_usec = static_cast<long>((timeout.count() % 1000) * 1000);
+
+	if (select(static_cast<int>(socket) + 1, &readSet, nullptr, nullptr, &timeVal) <= 0)
+	{
+		return false;
+	}
+
+	char buffer[16];
+	return (recv(socket, buffer, sizeof(buffer), 0) <= 0);
+}
+
+template<typename TPredicate>
+static bool WaitFor(const TPredicate& predicate)
+{
+	for (int i = 0; i < 200; i++)
+	{
+		if (predicate())
+		{
+			return true;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	return false;
+}
+
+TEST_F(ConnectionLimitsTest, TimerWheelFiresInOrderAndSkipsCancelled)
+{
+	fwRefContainer<net::UvLoopHolder> loop = Instance<net::UvLoopManager>::Get()->GetOrCreate("timerWheelTest");
+
+	// a tiny wheel, so the longer timers have to go around a few times
+	std::unique_ptr<net::TimerWheel> timerWheel;
+
+	std::mutex mutex;
+	std::vector<std::pair<int, std::chrono::milliseconds>> fired;
+	std::promise<void> done;
+
+	auto startTime = std::chrono::steady_clock::now();
+
+	auto record = [&] (int index)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		fired.emplace_back(index, std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime));
+	};
+
+	loop->RunOnLoop([&] ()
+	{
+		timerWheel = std::make_unique<net::TimerWheel>(loop->GetLoop(), std::chrono::milliseconds(10), 4);
+
+		timerWheel->Schedule(std::chrono::milliseconds(150), [&] ()
+		{
+			record(2);
+			done.set_value();
+		});
+
+		timerWheel->Schedule(std::chrono::milliseconds(20), [&] () { record(0); });
+		timerWheel->Schedule(std::chrono::milliseconds(75), [&] () { record(1); });
+
+		auto cancelled = timerWheel->Schedule(std::chrono::milliseconds(50), [&] () { record(-1); });
+		timerWheel->Cancel(cancelled);
+	});
+
+	ASSERT_EQ(std::future_status::ready, done.get_future().wait_for(std::chrono::seconds(5)));
+
+	ASSERT_EQ(3, fired.size());
+
+	EXPECT_EQ(0, fired[0].first);
+	EXPECT_EQ(1, fired[1].first);
+	EXPECT_EQ(2, fired[2].first);
+
+	// timers may be late by a step, but never early - other than by the loop clock only counting whole milliseconds
+	EXPECT_GE(fired[0].second.count(), 20 - 1);
+	EXPECT_GE(fired[1].second.count(), 75 - 1);
+	EXPECT_GE(fired[2].second.count(), 150 - 1);
+
+	loop->RunOnLoop([&] ()
+	{
+		EXPECT_EQ(0, timerWheel->GetPendingCount());
+
+		timerWheel.reset();
+	});
+}
+
+TEST_F(ConnectionLimitsTest, PerAddressLimitRejectsExtraConnections)
+{
+	int port = 30260;
+	net::PeerAddress address = net::PeerAddress::FromString(va("127.0.0.1:%d", port), port, net::PeerAddress::LookupType::ResolveName).get();
+
+	fwRefContainer<net::TcpServerManager> manager = new net::TcpServerManager();
+
+	net::TcpServerLimits limits;
+	limits.maxConnectionsPerAddress = 2;
+	manager->SetLimits(limits);
+
+	fwRefContainer<net::TcpServer> server = manager->CreateServer(address);
+	ASSERT_NE(nullptr, server.GetRef());
+
+	std::atomic<int> connections(0);
+
+	server->SetConnectionCallback([&] (fwRefContainer<net::TcpServerStream> stream)
+	{
+		connections++;
+	});
+
+	PlatformSocketType sockets[3];
+
+	for (auto& socket : sockets)
+	{
+		socket = ConnectClient(address);
+		ASSERT_NE(static_cast<PlatformSocketType>(-1), socket);
+	}
+
+	EXPECT_TRUE(WaitForClose(sockets[2], std::chrono::seconds(2)));
+	EXPECT_FALSE(WaitForClose(sockets[0], std::chrono::milliseconds(100)));
+
+	EXPECT_EQ(2, connections.load());
+
+	auto statistics = manager->GetStatistics();
+	EXPECT_EQ(2, statistics.acceptedConnections);
+	EXPECT_EQ(1, statistics.rejectedAddressConnections);
+	EXPECT_EQ(2, statistics.activeConnections);
+
+	// closing a connection frees up its slot again
+	closesocket(sockets[0]);
+	closesocket(sockets[2]);
+
+	EXPECT_TRUE(WaitFor([&] () { return manager->GetStatistics().activeConnections == 1; }));
+
+	PlatformSocketType socket = ConnectClient(address);
+	EXPECT_FALSE(WaitForClose(socket, std::chrono::milliseconds(100)));
+	EXPECT_EQ(3, connections.load());
+
+	closesocket(socket);
+	closesocket(sockets[1]);
+}
+
+TEST_F(ConnectionLimitsTest, ConnectionLimitAppliesToEachServer)
+{
+	int port = 30263;
+	net::PeerAddress address = net::PeerAddress::FromString(va("127.0.0.1:%d", port), port, net::PeerAddress::LookupType::ResolveName).get();
+	net::PeerAddress otherAddress = net::PeerAddress::FromString(va("127.0.0.1:%d", port + 1), port + 1, net::PeerAddress::LookupType::ResolveName).get();
+
+	fwRefContainer<net::TcpServerManager> manager = new net::TcpServerManager();
+
+	net::TcpServerLimits limits;
+	limits.maxConnections = 1;
+	manager->SetLimits(limits);
+
+	fwRefContainer<net::TcpServer> server = manager->CreateServer(address);
+	fwRefContainer<net::TcpServer> otherServer = manager->CreateServer(otherAddress);
+
+	ASSERT_NE(nullptr, server.GetRef());
+	ASSERT_NE(nullptr, otherServer.GetRef());
+
+	PlatformSocketType first = ConnectClient(address);
+	PlatformSocketType second = ConnectClient(address);
+
+	ASSERT_NE(static_cast<PlatformSocketType>(-1), first);
+	ASSERT_NE(static_cast<PlatformSocketType>(-1), second);
+
+	EXPECT_TRUE(WaitForClose(second, std::chrono::seconds(2)));
+
+	// the other server still has its own slot
+	PlatformSocketType other = ConnectClient(otherAddress);
+	ASSERT_NE(static_cast<PlatformSocketType>(-1), other);
+
+	EXPECT_FALSE(WaitForClose(other, std::chrono::milliseconds(100)));
+	EXPECT_FALSE(WaitForClose(first, std::chrono::milliseconds(100)));
+
+	auto statistics = manager->GetStatistics();
+	EXPECT_EQ(2, statistics.acceptedConnections);
+	EXPECT_EQ(1, statistics.rejectedConnections);
+	EXPECT_EQ(2, statistics.activeConnections);
+
+	closesocket(first);
+	closesocket(second);
+	closesocket(other);
+}
+
+TEST_F(ConnectionLimitsTest, DeadlineClosesIdleConnection)
+{
+	int port = 30261;
+	net::PeerAddress address = net::PeerAddress::FromString(va("127.0.0.1:%d", port), port, net::PeerAddress::LookupType::ResolveName).get();
+
+	fwRefContainer<net::TcpServerManager> manager = new net::TcpServerManager();
+	fwRefContainer<net::TcpServer> server = manager->CreateServer(address);
+
+	ASSERT_NE(nullptr, server.GetRef());
+
+	server->SetConnectionCallback([&] (fwRefContainer<net::TcpServerStream> stream)
+	{
+		net::TcpServerStream* streamPtr = stream.GetRef();
+
+		auto expire = [=] ()
+		{
+			streamPtr->Close();
+		};
+
+		stream->SetDeadline(std::chrono::milliseconds(200), expire);
+
+		// any data pushes the deadline back
+		stream->SetReadCallback([=] (const net::PooledBuffer& data)
+		{
+			streamPtr->SetDeadline(std::chrono::milliseconds(200), expire);
+		});
+	});
+
+	PlatformSocketType socket = ConnectClient(address);
+	ASSERT_NE(static_cast<PlatformSocketType>(-1), socket);
+
+	for (int i = 0; i < 5; i++)
+	{
+		EXPECT_FALSE(WaitForClose(socket, std::chrono::milliseconds(100)));
+		send(socket, "x", 1, 0);
+	}
+
+	EXPECT_TRUE(WaitForClose(socket, std::chrono::seconds(2)));
+	closesocket(socket);
+
+	EXPECT_EQ(1, manager->GetStatistics().expiredDeadlines);
+}
+
+TEST_F(ConnectionLimitsTest, StalledWriterGetsEvicted)
+{
+	int port = 30262;
+	net::PeerAddress address = net::PeerAddress::FromString(va("127.0.0.1:%d", port), port, net::PeerAddress::LookupType::ResolveName).get();
+
+	fwRefContainer<net::TcpServerManager> manager = new net::TcpServerManager();
+
+	net::TcpServerLimits limits;
+	limits.writeStallTimeout = std::chrono::milliseconds(300);
+	manager->SetLimits(limits);
+
+	fwRefContainer<net::TcpServer> server = manager->CreateServer(address);
+	ASSERT_NE(nullptr, server.GetRef());
+
+	std::promise<void> closed;
+
+	server->SetConnectionCallback([&] (fwRefContainer<net::TcpServerStream> stream)
+	{
+		stream->SetCloseCallback([&] ()
+		{
+			closed.set_value();
+		});
+
+		// far more than the socket buffers take, and the client never reads
+		std::vector<uint8_t> chunk(1024 * 1024, 0x42);
+
+		for (int i = 0; i < 64; i++)
+		{
+			stream->Write(chunk);
+		}
+	});
+
+	PlatformSocketType socket = ConnectClient(address);
+	ASSERT_NE(static_cast<PlatformSocketType>(-1), socket);
+
+	EXPECT_EQ(std::future_status::ready, closed.get_future().wait_for(std::chrono::seconds(5)));
+
+	closesocket(socket);
+
+	// the close callback runs just before the connection gets released
+	EXPECT_TRUE(WaitFor([&] () { return manager->GetStatistics().activeConnections == 0; }));
+	EXPECT_EQ(1, manager->GetStatistics().stalledConnections);
+}
+
+TEST_F(ConnectionLimitsTest, ClosedStalledWriterGetsEvicted)
+{
+	int port = 30265;
+	net::PeerAddress address = net::PeerAddress::FromString(va("127.0.0.1:%d", port), port, net::PeerAddress::LookupType::ResolveName).get();
+
+	fwRefContainer<net::TcpServerManager> manager = new net::TcpServerManager();
+
+	// only the write stall timeout gets to end the shutdown
+	net::TcpServerLimits limits;
+	limits.writeStallTimeout = std::chrono::milliseconds(300);
+	limits.lingerTimeout = std::chrono::milliseconds(0);
+	manager->SetLimits(limits);
+
+	fwRefContainer<net::TcpServer> server = manager->CreateServer(address);
+	ASSERT_NE(nullptr, server.GetRef());
+
+	server->SetConnectionCallback([&] (fwRefContainer<net::TcpServerStream> stream)
+	{
+		std::vector<uint8_t> chunk(1024 * 1024, 0x42);
+
+		for (int i = 0; i < 64; i++)
+		{
+			stream->Write(chunk);
+		}
+
+		stream->Close();
+	});
+
+	PlatformSocketType socket = ConnectClient(address);
+	ASSERT_NE(static_cast<PlatformSocketType>(-1), socket);
+
+	EXPECT_TRUE(WaitFor([&] () { return manager->GetStatistics().stalledConnections == 1; }));
+	EXPECT_TRUE(WaitFor([&] () { return manager->GetStatistics().activeConnections == 0; }));
+
+	closesocket(socket);
+}
+
+TEST_F(ConnectionLimitsTest, ClosedStreamLingersForBoundedTime)
+{
+	static const size_t kChunkSize = 1024 * 1024;
+	static const size_t kChunkCount = 64;
+
+	int port = 30264;
+	net::PeerAddress address = net::PeerAddress::FromString(va("127.0.0.1:%d", port), port, net::PeerAddress::LookupType::ResolveName).get();
+
+	fwRefContainer<net::TcpServerManager> manager = new net::TcpServerManager();
+
+	net::TcpServerLimits limits;
+	limits.lingerTimeout = std::chrono::milliseconds(300);
+	manager->SetLimits(limits);
+
+	fwRefContainer<net::TcpServer> server = manager->CreateServer(address);
+	ASSERT_NE(nullptr, server.GetRef());
+
+	std::promise<void> closed;
+
+	server->SetConnectionCallback([&] (fwRefContainer<net::TcpServerStream> stream)
+	{
+		// far more than the socket buffers take, and the client doesn't read until it's too late
+		std::vector<uint8_t> chunk(kChunkSize, 0x42);
+
+		for (size_t i = 0; i < kChunkCount; i++)
+		{
+			stream->Write(chunk);
+		}
+
+		stream->Close();
+		closed.set_value();
+	});
+
+	PlatformSocketType socket = ConnectClient(address);
+	ASSERT_NE(static_cast<PlatformSocketType>(-1), socket);
+
+	EXPECT_EQ(std::future_status::ready, closed.get_future().wait_for(std::chrono::seconds(5)));
+
+	// the handle stays open, and counted, while the queued writes wait for the client
+	EXPECT_EQ(1, manager->GetStatistics().activeConnections);
+	EXPECT_TRUE(WaitFor([&] () { return manager->GetStatistics().activeConnections == 0; }));
+
+	// whatever wasn't sent in time got dropped
+	char buffer[65536];
+	size_t received = 0;
+	int length;
+
+	while ((length = recv(socket, buffer, sizeof(buffer), 0)) > 0)
+	{
+		received += length;
+	}
+
+	closesocket(socket);
+
+	EXPECT_LT(received, kChunkSize * kChunkCount);
+}
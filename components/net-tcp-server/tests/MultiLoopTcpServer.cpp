@@ -0,0 +1,253 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <TcpServerManager.h>
+#include <UvLoopManager.h>
+
+#include <chrono>
+#include <future>
+
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#endif
+
+// loopback load: connections/s and requests/s against an echo server at various loop counts
+static const int kClientThreads = 16;
+static const int kRequestSize = 64;
+
+class MultiLoopTcpServerTest : public ::testing::TestWithParam<int>
+{
+public:
+	static void SetUpTestCase()
+	{
+		static bool initialized = ([] ()
+		{
+			Instance<net::UvLoopManager>::Set(new net::UvLoopManager());
+			return true;
+		})();
+	}
+};
+
+static PlatformSocketType ConnectClient(const net::PeerAddress& address)
+{
+	PlatformSocketType socket = ::socket(address.GetAddressFamily(), SOCK_STREAM, IPPROTO_TCP);
+
+	int on = 1;
+	setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on), sizeof(on));
+
+	if (connect(socket, address.GetSocketAddress(), address.GetSocketAddressLength()) != 0)
+	{
+		closesocket(socket);
+		return static_cast<PlatformSocketType>(-1);
+	}
+
+	return socket;
+}
+
+template<typename TFunc>
+static double RunClients(const TFunc& function)
+{
+	std::vector<std::thread> threads;
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < kClientThreads; i++)
+	{
+		threads.emplace_back(function);
+	}
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+struct LoadResult
+{
+	double connectTime;
+
+	double requestTime;
+
+	int failedConnections;
+
+	int completedRequests;
+};
+
+static LoadResult RunLoopbackLoad(int loopCount, int port, int connectionsPerThread, int requestsPerThread)
+{
+	LoadResult result = { 0 };
+
+	net::PeerAddress address = net::PeerAddress::FromString(va("127.0.0.1:%d", port), port, net::PeerAddress::LookupType::ResolveName).get();
+
+	fwRefContainer<net::TcpServerManager> manager = new net::TcpServerManager(loopCount);
+	fwRefContainer<net::TcpServer> server = manager->CreateServer(address);
+
+	EXPECT_NE(nullptr, server.GetRef());
+
+	if (!server.GetRef())
+	{
+		return result;
+	}
+
+	std::atomic<int> acceptedConnections(0);
+
+	server->SetConnectionCallback([&] (fwRefContainer<net::TcpServerStream> stream)
+	{
+		acceptedConnections++;
+
+		// echo everything back
+		net::TcpServerStream* streamPtr = stream.GetRef();
+
+		stream->SetReadCallback([=] (const net::PooledBuffer& data)
+		{
+			streamPtr->Write(data);
+		});
+	});
+
+	// connections/s: connect, exchange a single request and disconnect
+	std::atomic<int> failedConnections(0);
+
+	result.connectTime = RunClients([&] ()
+	{
+		char buffer[kRequestSize] = { 0 };
+
+		for (int i = 0; i < connectionsPerThread; i++)
+		{
+			PlatformSocketType socket = ConnectClient(address);
+
+			if (socket == static_cast<PlatformSocketType>(-1))
+			{
+				failedConnections++;
+				continue;
+			}
+
+			send(socket, buffer, sizeof(buffer), 0);
+			recv(socket, buffer, sizeof(buffer), 0);
+
+			closesocket(socket);
+		}
+	});
+
+	// requests/s: one persistent connection per client thread
+	std::atomic<int> completedRequests(0);
+
+	result.requestTime = RunClients([&] ()
+	{
+		PlatformSocketType socket = ConnectClient(address);
+
+		if (socket == static_cast<PlatformSocketType>(-1))
+		{
+			return;
+		}
+
+		char buffer[kRequestSize] = { 0 };
+
+		for (int i = 0; i < requestsPerThread; i++)
+		{
+			send(socket, buffer, sizeof(buffer), 0);
+
+			int received = 0;
+
+			while (received < kRequestSize)
+			{
+				int length = recv(socket, buffer + received, kRequestSize - received, 0);
+
+				if (length <= 0)
+				{
+					closesocket(socket);
+					return;
+				}
+
+				received += length;
+			}
+
+			completedRequests++;
+		}
+
+		closesocket(socket);
+	});
+
+	result.failedConnections = failedConnections;
+	result.completedRequests = completedRequests;
+
+	return result;
+}
+
+TEST_P(MultiLoopTcpServerTest, EchoesOnEveryLoop)
+{
+	int loopCount = GetParam();
+
+	LoadResult result = RunLoopbackLoad(loopCount, 30270 + loopCount, 10, 50);
+
+	EXPECT_EQ(0, result.failedConnections);
+	EXPECT_EQ(kClientThreads * 50, result.completedRequests);
+}
+
+TEST_P(MultiLoopTcpServerTest, DISABLED_BenchmarkLoopbackLoad)
+{
+	const int connectionsPerThread = 250;
+	const int requestsPerThread = 2000;
+
+	int loopCount = GetParam();
+
+	LoadResult result = RunLoopbackLoad(loopCount, 30190 + loopCount, connectionsPerThread, requestsPerThread);
+
+	printf("%d loop(s): %.0f connections/s, %.0f requests/s\n",
+		loopCount,
+		(kClientThreads * connectionsPerThread - result.failedConnections) / result.connectTime,
+		result.completedRequests / result.requestTime);
+
+	EXPECT_EQ(0, result.failedConnections);
+	EXPECT_EQ(kClientThreads * requestsPerThread, result.completedRequests);
+}
+
+INSTANTIATE_TEST_CASE_P(LoopCounts, MultiLoopTcpServerTest, ::testing::Values(1, 2, 4, 8));
+
+TEST(UvLoopHolderTest, RunsCallbacksQueuedWhileStopping)
+{
+	fwRefContainer<net::UvLoopHolder> loop = new net::UvLoopHolder("stoppingTest");
+	net::UvLoopHolder* loopPtr = loop.GetRef();
+
+	EXPECT_FALSE(loop->IsInLoopThread());
+
+	// keep the loop busy, so the next callback is still queued once the loop gets told to stop
+	std::promise<void> busy;
+
+	loop->EnqueueCallback([&] ()
+	{
+		busy.set_value();
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	});
+
+	busy.get_future().wait();
+
+	std::atomic<bool> ranOnLoop(false);
+	std::promise<void> done;
+
+	std::thread waiter([&] ()
+	{
+		loopPtr->RunOnLoop([&] ()
+		{
+			ranOnLoop = loopPtr->IsInLoopThread();
+		});
+
+		done.set_value();
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	loop = nullptr;
+
+	if (done.get_future().wait_for(std::chrono::seconds(5)) != std::future_status::ready)
+	{
+		waiter.detach();
+		FAIL() << "RunOnLoop didn't return after the loop stopped";
+	}
+
+	waiter.join();
+
+	EXPECT_TRUE(ranOnLoop);
+}
@@ -0,0 +1,272 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <MultiplexTcpServer.h>
+#include <TcpServerManager.h>
+#include <UvLoopManager.h>
+
+#include <chrono>
+#include <thread>
+
+class MultiplexTcpServerTest : public ::testing::Test
+{
+public:
+	static void SetUpTestCase()
+	{
+		static bool initialized = ([] ()
+		{
+			Instance<net::UvLoopManager>::Set(new net::UvLoopManager());
+			return true;
+		})();
+	}
+};
+
+// echoes everything back, prefixed with the server's tag on connecting
+static void EchoWithTag(fwRefContainer<net::TcpServer> server, const std::string& tag)
+{
+	server->SetConnectionCallback([=] (fwRefContainer<net::TcpServerStream> stream)
+	{
+		net::TcpServerStream* streamPtr = stream.GetRef();
+
+		stream->Write(net::PooledBuffer(tag.c_str(), tag.size()));
+
+		stream->SetReadCallback([=] (const net::PooledBuffer& data)
+		{
+			streamPtr->Write(data);
+		});
+	});
+}
+
+static PlatformSocketType ConnectClient(const net::PeerAddress& address)
+{
+	PlatformSocketType socket = ::socket(address.GetAddressFamily(), SOCK_STREAM, IPPROTO_TCP);
+
+	if (connect(socket, address.GetSocketAddress(), address.GetSocketAddressLength()) != 0)
+	{
+		closesocket(socket);
+		return static_cast<PlatformSocketType>(-1);
+	}
+
+	return socket;
+}
+
+static std::string ReceiveUntil(PlatformSocketType socket, size_t length)
+{
+	std::string data;
+	char buffer[1024];
+
+	while (data.size() < length)
+	{
+		int bytes = recv(socket, buffer, sizeof(buffer), 0);
+
+		if (bytes <= 0)
+		{
+			break;
+		}
+
+		data.append(buffer, bytes);
+	}
+
+	return data;
+}
+
+// returns true if the server closes the connection within the timeout
+static bool WaitForClose(PlatformSocketType socket, int timeoutMs)
+{
+#ifdef _WIN32
+	DWORD timeout = timeoutMs;
+#else
+	timeval timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000 };
+#endif
+
+	setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+
+	char buffer[16];
+	return (recv(socket, buffer, sizeof(buffer), 0) == 0);
+}
+
+struct TestMultiplexServer
+{
+	fwRefContainer<net::TcpServerManager> manager;
+	fwRefContainer<net::MultiplexTcpServer> server;
+
+	net::PeerAddress address;
+
+	TestMultiplexServer(int port)
+		: address(net::PeerAddress::FromString(va("127.0.0.1:%d", port), port, net::PeerAddress::LookupType::ResolveName).get())
+	{
+		manager = new net::TcpServerManager();
+		server = new net::MultiplexTcpServer(manager);
+
+		EchoWithTag(server->CreateServer(std::vector<net::MultiplexPattern>{ net::MultiplexPattern("GET "), net::MultiplexPattern("POST ") }), "[http]");
+
+		// a TLS handshake record for any TLS version
+		EchoWithTag(server->CreateServer(std::vector<net::MultiplexPattern>{ net::MultiplexPattern({ 0x16, 0x03, 0x00 }, { 0xFF, 0xFF, 0xFC }) }), "[tls]");
+
+		EchoWithTag(server->CreateServer([] (const std::vector<uint8_t>& data)
+		{
+			if (data.size() < 4)
+			{
+				return net::MultiplexPatternMatchResult::InsufficientData;
+			}
+
+			return (memcmp(&data[0], "cake", 4) == 0) ? net::MultiplexPatternMatchResult::Match : net::MultiplexPatternMatchResult::NoMatch;
+		}), "[cake]");
+	}
+
+	void Bind()
+	{
+		server->Bind(address);
+	}
+};
+
+TEST_F(MultiplexTcpServerTest, RoutesByPatterns)
+{
+	TestMultiplexServer server(30250);
+	server.Bind();
+
+	// trickle the prefix, to check the trie is walked incrementally
+	{
+		PlatformSocketType socket = ConnectClient(server.address);
+		ASSERT_NE(static_cast<PlatformSocketType>(-1), socket);
+
+		send(socket, "PO", 2, 0);
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		send(socket, "ST /", 4, 0);
+
+		EXPECT_EQ("[http]POST /", ReceiveUntil(socket, 12));
+
+		closesocket(socket);
+	}
+
+	{
+		PlatformSocketType socket = ConnectClient(server.address);
+		ASSERT_NE(static_cast<PlatformSocketType>(-1), socket);
+
+		send(socket, "\x16\x03\x01hi", 5, 0);
+
+		EXPECT_EQ("[tls]\x16\x03\x01hi", ReceiveUntil(socket, 10));
+
+		closesocket(socket);
+	}
+
+	// match functions still work, after the patterns didn't match
+	{
+		PlatformSocketType socket = ConnectClient(server.address);
+		ASSERT_NE(static_cast<PlatformSocketType>(-1), socket);
+
+		send(socket, "cakes", 5, 0);
+
+		EXPECT_EQ("[cake]cakes", ReceiveUntil(socket, 11));
+
+		closesocket(socket);
+	}
+}
+
+TEST_F(MultiplexTcpServerTest, ClosesUnmatchedConnections)
+{
+	TestMultiplexServer server(30251);
+	server.server->SetMaxPeekLength(16);
+	server.Bind();
+
+	{
+		PlatformSocketType socket = ConnectClient(server.address);
+		ASSERT_NE(static_cast<PlatformSocketType>(-1), socket);
+
+		send(socket, "GEX / HTTP/1.1", 14, 0);
+
+		EXPECT_TRUE(WaitForClose(socket, 1000));
+
+		closesocket(socket);
+	}
+
+	// a match function wanting more data forever gets cut off
+	fwRefContainer<net::TcpServer> greedyServer = server.server->CreateServer([] (const std::vector<uint8_t>& data)
+	{
+		return net::MultiplexPatternMatchResult::InsufficientData;
+	});
+
+	{
+		PlatformSocketType socket = ConnectClient(server.address);
+		ASSERT_NE(static_cast<PlatformSocketType>(-1), socket);
+
+		send(socket, "0123456789abcdef0123456789abcdef", 32, 0);
+
+		EXPECT_TRUE(WaitForClose(socket, 1000));
+
+		closesocket(socket);
+	}
+}
+
+TEST_F(MultiplexTcpServerTest, ClosesIdleConnectionsAfterSniffTimeout)
+{
+	TestMultiplexServer server(30252);
+	server.server->SetSniffTimeout(std::chrono::milliseconds(200));
+	server.Bind();
+
+	PlatformSocketType socket = ConnectClient(server.address);
+	ASSERT_NE(static_cast<PlatformSocketType>(-1), socket);
+
+	// a partial match, which would wait for more data
+	send(socket, "GE", 2, 0);
+
+	auto startTime = std::chrono::steady_clock::now();
+
+	EXPECT_TRUE(WaitForClose(socket, 2000));
+	EXPECT_LT(std::chrono::steady_clock::now() - startTime, std::chrono::milliseconds(1000));
+
+	closesocket(socket);
+}
+
+TEST_F(MultiplexTcpServerTest, EarlierPatternsTakePrecedence)
+{
+	fwRefContainer<net::TcpServerManager> manager = new net::TcpServerManager();
+	fwRefContainer<net::MultiplexTcpServer> server = new net::MultiplexTcpServer(manager);
+
+	net::PeerAddress address = net::PeerAddress::FromString("127.0.0.1:30253", 30253, net::PeerAddress::LookupType::ResolveName).get();
+
+	// the longer pattern got registered first, so it wins even though the shorter one matches sooner
+	EchoWithTag(server->CreateServer(std::vector<net::MultiplexPattern>{ net::MultiplexPattern("GET /ws") }), "[ws]");
+	EchoWithTag(server->CreateServer(std::vector<net::MultiplexPattern>{ net::MultiplexPattern("GET ") }), "[http]");
+
+	server->SetSniffTimeout(std::chrono::milliseconds(200));
+	server->Bind(address);
+
+	// waits for the rest, even after the shorter pattern matched
+	{
+		PlatformSocketType socket = ConnectClient(address);
+		ASSERT_NE(static_cast<PlatformSocketType>(-1), socket);
+
+		send(socket, "GET ", 4, 0);
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		send(socket, "/ws", 3, 0);
+
+		EXPECT_EQ("[ws]GET /ws", ReceiveUntil(socket, 11));
+
+		closesocket(socket);
+	}
+
+	// and falls back to the shorter one once the longer can't match anymore
+	{
+		PlatformSocketType socket = ConnectClient(address);
+		ASSERT_NE(static_cast<PlatformSocketType>(-1), socket);
+
+		send(socket, "GET /index", 10, 0);
+
+		EXPECT_EQ("[http]GET /index", ReceiveUntil(socket, 16));
+
+		closesocket(socket);
+	}
+
+	// or once the sniff timeout passes
+	{
+		PlatformSocketType socket = ConnectClient(address);
+		ASSERT_NE(static_cast<PlatformSocketType>(-1), socket);
+
+		send(socket, "GET /w", 6, 0);
+
+		EXPECT_EQ("[http]GET /w", ReceiveUntil(socket, 12));
+
+		closesocket(socket);
+	}
+}
@@ -0,0 +1,185 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <PooledBuffer.h>
+
+#include <chrono>
+#include <memory>
+
+// counts heap allocations made from this module, for comparing read/write paths
+static std::atomic<size_t> g_allocationCount;
+
+void* operator new(size_t size)
+{
+	g_allocationCount++;
+
+	void* ptr = malloc(size ? size : 1);
+
+	if (!ptr)
+	{
+		throw std::bad_alloc();
+	}
+
+	return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+TEST(PooledBufferTest, SliceSharesBlock)
+{
+	net::PooledBuffer buffer("hello, world", 12);
+	net::PooledBuffer slice = buffer.Slice(7, 5);
+
+	ASSERT_EQ(5, slice.size());
+	EXPECT_EQ(0, memcmp(slice.data(), "world", 5));
+	EXPECT_EQ(buffer.GetBlock().GetRef(), slice.GetBlock().GetRef());
+
+	// out-of-range slices get clamped
+	EXPECT_EQ(0, buffer.Slice(20).size());
+	EXPECT_EQ(5, buffer.Slice(7).size());
+}
+
+TEST(PooledBufferTest, AdoptsVector)
+{
+	std::vector<uint8_t> data(100, 0x42);
+	const uint8_t* origData = data.data();
+
+	net::PooledBuffer buffer(std::move(data));
+
+	EXPECT_EQ(origData, buffer.data());
+	EXPECT_EQ(100, buffer.size());
+}
+
+TEST(PooledBufferTest, BlocksReturnToPool)
+{
+	net::BufferPool pool(1024, 4);
+
+	{
+		auto block = pool.Acquire();
+		EXPECT_EQ(1, pool.GetStatistics().heapAllocations);
+	}
+
+	EXPECT_EQ(1, pool.GetStatistics().freeBlocks);
+
+	{
+		auto block = pool.Acquire();
+		EXPECT_EQ(1, pool.GetStatistics().heapAllocations);
+		EXPECT_EQ(1, pool.GetStatistics().poolHits);
+	}
+}
+
+TEST(PooledBufferTest, ReadBufferCarvesRetainedBlocks)
+{
+	net::BufferPool pool(65536, 4);
+	net::PooledReadBuffer readBuffer(&pool);
+
+	uint8_t* data;
+	size_t size;
+
+	// an unretained read gets the start of the block every time
+	readBuffer.Prepare(&data, &size);
+	uint8_t* firstData = data;
+
+	readBuffer.Commit(100);
+	readBuffer.Prepare(&data, &size);
+
+	EXPECT_EQ(firstData, data);
+	EXPECT_EQ(65536, size);
+
+	// a retained read makes the next read continue after it
+	net::PooledBuffer retained = readBuffer.Commit(100);
+	readBuffer.Prepare(&data, &size);
+
+	EXPECT_EQ(firstData + 100, data);
+	EXPECT_EQ(65536 - 100, size);
+	EXPECT_EQ(1, pool.GetStatistics().heapAllocations);
+}
+
+static const size_t kSegmentSize = 1460;
+
+// the previous implementation: resize a per-stream read buffer, copy into a fresh vector, deep-copy on write
+static size_t RunLegacyPath(size_t bytes)
+{
+	struct LegacyWriteReq
+	{
+		std::vector<uint8_t> sendData;
+	};
+
+	std::vector<char> readBuffer;
+
+	size_t start = g_allocationCount;
+
+	for (size_t i = 0; i < bytes; i += kSegmentSize)
+	{
+		readBuffer.resize(65536);
+		memset(&readBuffer[0], i & 0xFF, kSegmentSize);
+
+		std::vector<uint8_t> targetBuf(kSegmentSize);
+		memcpy(&targetBuf[0], &readBuffer[0], targetBuf.size());
+
+		std::unique_ptr<LegacyWriteReq> writeReq = std::make_unique<LegacyWriteReq>();
+		writeReq->sendData = targetBuf;
+	}
+
+	return g_allocationCount - start;
+}
+
+// the pooled implementation: read in-place into a pooled block, pass a slice through to the write
+static size_t RunPooledPath(size_t bytes)
+{
+	net::BufferPool pool(65536, 64);
+	net::PooledReadBuffer readBuffer(&pool);
+
+	size_t start = g_allocationCount;
+
+	for (size_t i = 0; i < bytes; i += kSegmentSize)
+	{
+		uint8_t* data;
+		size_t size;
+		readBuffer.Prepare(&data, &size);
+
+		memset(data, i & 0xFF, kSegmentSize);
+
+		net::PooledBuffer targetBuf = readBuffer.Commit(kSegmentSize);
+		net::PooledBuffer writeData = targetBuf;
+	}
+
+	return (g_allocationCount - start) + pool.GetStatistics().heapAllocations;
+}
+
+TEST(PooledBufferTest, ReadPathAllocatesPerBlockNotPerSegment)
+{
+	const size_t bytes = 4 * 1024 * 1024;
+
+	// ~2900 segments, but blocks come back to the pool as soon as their slices are gone
+	size_t pooledAllocations = RunPooledPath(bytes);
+
+	EXPECT_LE(pooledAllocations, 4);
+	EXPECT_LT(pooledAllocations, RunLegacyPath(bytes));
+}
+
+TEST(PooledBufferTest, DISABLED_BenchmarkAllocationsPerMegabyte)
+{
+	const size_t bytes = 64 * 1024 * 1024;
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	size_t legacyAllocations = RunLegacyPath(bytes);
+	double legacyMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	startTime = std::chrono::high_resolution_clock::now();
+	size_t pooledAllocations = RunPooledPath(bytes);
+	double pooledMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	double megabytes = bytes / (1024.0 * 1024.0);
+
+	printf("legacy: %.2f allocations/MB, %.2f ms\n", legacyAllocations / megabytes, legacyMs);
+	printf("pooled: %.2f allocations/MB, %.2f ms\n", pooledAllocations / megabytes, pooledMs);
+}
@@ -0,0 +1,219 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <TcpServerManager.h>
+#include <UvLoopManager.h>
+
+#include <future>
+
+class StreamWritesTest : public ::testing::Test
+{
+public:
+	static void SetUpTestCase()
+	{
+		static bool initialized = ([] ()
+		{
+			Instance<net::UvLoopManager>::Set(new net::UvLoopManager());
+			return true;
+		})();
+	}
+};
+
+static PlatformSocketType ConnectClient(const net::PeerAddress& address)
+{
+	PlatformSocketType socket = ::socket(address.GetAddressFamily(), SOCK_STREAM, IPPROTO_TCP);
+
+	if (connect(socket, address.GetSocketAddress(), address.GetSocketAddressLength()) != 0)
+	{
+		closesocket(socket);
+		return static_cast<PlatformSocketType>(-1);
+	}
+
+	return socket;
+}
+
+static size_t ReceiveAll(PlatformSocketType socket, size_t length, std::string* outData = nullptr)
+{
+	char buffer[16384];
+	size_t received = 0;
+
+	while (received < length)
+	{
+		int bytes = recv(socket, buffer, sizeof(buffer), 0);
+
+		if (bytes <= 0)
+		{
+			break;
+		}
+
+		if (outData)
+		{
+			outData->append(buffer, bytes);
+		}
+
+		received += bytes;
+	}
+
+	return received;
+}
+
+TEST_F(StreamWritesTest, CorkedWritesArriveInOrder)
+{
+	int port = 30210;
+	net::PeerAddress address = net::PeerAddress::FromString(va("127.0.0.1:%d", port), port, net::PeerAddress::LookupType::ResolveName).get();
+
+	fwRefContainer<net::TcpServerManager> manager = new net::TcpServerManager();
+	fwRefContainer<net::TcpServer> server = manager->CreateServer(address);
+
+	ASSERT_NE(nullptr, server.GetRef());
+
+	std::promise<size_t> queuedWhileCorked;
+
+	server->SetConnectionCallback([&] (fwRefContainer<net::TcpServerStream> stream)
+	{
+		stream->Cork();
+
+		stream->Write(net::PooledBuffer("HTTP/1.1 200 OK\r\n\r\n", 19));
+		stream->WriteV({ net::PooledBuffer("hello", 5), net::PooledBuffer(), net::PooledBuffer(", world", 7) });
+
+		size_t queued = stream->GetQueuedBytes();
+
+		stream->Uncork();
+		stream->Close();
+
+		// only once we're done with the stream, as the client can see the data before Close returns
+		queuedWhileCorked.set_value(queued);
+	});
+
+	PlatformSocketType socket = ConnectClient(address);
+	ASSERT_NE(static_cast<PlatformSocketType>(-1), socket);
+
+	std::string data;
+	ReceiveAll(socket, 31, &data);
+
+	closesocket(socket);
+
+	EXPECT_EQ(31, queuedWhileCorked.get_future().get());
+	EXPECT_EQ("HTTP/1.1 200 OK\r\n\r\nhello, world", data);
+}
+
+TEST_F(StreamWritesTest, BackpressureCallbackFiresAndDrains)
+{
+	static const size_t kChunkSize = 64 * 1024;
+	static const size_t kChunkCount = 256;
+
+	int port = 30211;
+	net::PeerAddress address = net::PeerAddress::FromString(va("127.0.0.1:%d", port), port, net::PeerAddress::LookupType::ResolveName).get();
+
+	fwRefContainer<net::TcpServerManager> manager = new net::TcpServerManager();
+	fwRefContainer<net::TcpServer> server = manager->CreateServer(address);
+
+	ASSERT_NE(nullptr, server.GetRef());
+
+	std::vector<bool> events;
+	std::promise<void> drained;
+
+	server->SetConnectionCallback([&] (fwRefContainer<net::TcpServerStream> stream)
+	{
+		stream->SetHighWaterMark(kChunkSize * 4);
+		stream->SetBackpressureCallback([&] (bool aboveHighWaterMark)
+		{
+			events.push_back(aboveHighWaterMark);
+
+			if (!aboveHighWaterMark)
+			{
+				drained.set_value();
+			}
+		});
+
+		// the client isn't reading yet, so this has to pile up
+		std::vector<uint8_t> chunk(kChunkSize, 0x42);
+
+		for (size_t i = 0; i < kChunkCount; i++)
+		{
+			stream->Write(chunk);
+		}
+	});
+
+	PlatformSocketType socket = ConnectClient(address);
+	ASSERT_NE(static_cast<PlatformSocketType>(-1), socket);
+
+	EXPECT_EQ(kChunkSize * kChunkCount, ReceiveAll(socket, kChunkSize * kChunkCount));
+
+	drained.get_future().wait();
+	closesocket(socket);
+
+	ASSERT_EQ(2, events.size());
+	EXPECT_TRUE(events[0]);
+	EXPECT_FALSE(events[1]);
+}
+
+TEST_F(StreamWritesTest, WritesFromOtherThreadsApplyBackpressure)
+{
+	static const size_t kChunkSize = 64 * 1024;
+	static const size_t kChunkCount = 8;
+
+	int port = 30212;
+	net::PeerAddress address = net::PeerAddress::FromString(va("127.0.0.1:%d", port), port, net::PeerAddress::LookupType::ResolveName).get();
+
+	fwRefContainer<net::TcpServerManager> manager = new net::TcpServerManager();
+	fwRefContainer<net::TcpServer> server = manager->CreateServer(address);
+
+	ASSERT_NE(nullptr, server.GetRef());
+
+	std::promise<fwRefContainer<net::TcpServerStream>> connected;
+
+	server->SetConnectionCallback([&] (fwRefContainer<net::TcpServerStream> stream)
+	{
+		connected.set_value(stream);
+	});
+
+	PlatformSocketType socket = ConnectClient(address);
+	ASSERT_NE(static_cast<PlatformSocketType>(-1), socket);
+
+	fwRefContainer<net::TcpServerStream> stream = connected.get_future().get();
+	stream->SetHighWaterMark(kChunkSize * 4);
+
+	// hold up the loop thread, so nothing written from here can get sent yet
+	std::promise<void> loopBlocked;
+	std::promise<void> unblockLoop;
+	std::shared_future<void> unblocked = unblockLoop.get_future().share();
+
+	stream->ScheduleCallback([&loopBlocked, unblocked] ()
+	{
+		loopBlocked.set_value();
+		unblocked.wait();
+	});
+
+	loopBlocked.get_future().wait();
+
+	std::vector<uint8_t> chunk(kChunkSize, 0x42);
+
+	for (size_t i = 0; i < kChunkCount; i++)
+	{
+		stream->Write(chunk);
+	}
+
+	EXPECT_EQ(kChunkSize * kChunkCount, stream->GetQueuedBytes());
+
+	std::promise<void> writable;
+	std::atomic<bool> wasWritable(false);
+
+	stream->WhenWritable([&] ()
+	{
+		wasWritable = true;
+		writable.set_value();
+	});
+
+	EXPECT_FALSE(wasWritable);
+
+	unblockLoop.set_value();
+
+	EXPECT_EQ(kChunkSize * kChunkCount, ReceiveAll(socket, kChunkSize * kChunkCount));
+
+	writable.get_future().wait();
+	EXPECT_TRUE(wasWritable);
+
+	stream->Close();
+	closesocket(socket);
+}
@@ -0,0 +1,317 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <TcpServerManager.h>
+#include <TLSServer.h>
+#include <UvLoopManager.h>
+
+#include <botan/credentials_manager.h>
+#include <botan/pkcs8.h>
+#include <botan/rsa.h>
+#include <botan/tls_client.h>
+#include <botan/x509self.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+class TLSServerTest : public ::testing::Test
+{
+public:
+	static void SetUpTestCase()
+	{
+		static bool initialized = ([] ()
+		{
+			Instance<net::UvLoopManager>::Set(new net::UvLoopManager());
+
+			WriteCredentials();
+			return true;
+		})();
+	}
+
+private:
+	static void WriteCredentials()
+	{
+		Botan::AutoSeeded_RNG rng;
+		Botan::RSA_PrivateKey key(rng, 2048);
+
+		Botan::X509_Cert_Options options("localhost");
+		Botan::X509_Certificate certificate = Botan::X509::create_self_signed_cert(options, key, "SHA-256", rng);
+
+		std::ofstream(MakeRelativeCitPath("tls_test.key")) << Botan::PKCS8::PEM_encode(key);
+		std::ofstream(MakeRelativeCitPath("tls_test.crt")) << certificate.PEM_encode();
+	}
+};
+
+// accepts whatever the server presents
+class TestClientCredentials : public Botan::Credentials_Manager
+{
+public:
+	virtual void verify_certificate_chain(const std::string& type, const std::string& hostname, const std::vector<Botan::X509_Certificate>& cert_chain) override
+	{
+	}
+};
+
+// performs a single blocking handshake, and returns whether it completed
+static bool Handshake(const net::PeerAddress& address, int port, Botan::TLS::Session_Manager& sessionManager, Botan::RandomNumberGenerator& rng)
+{
+	PlatformSocketType socket = ::socket(address.GetAddressFamily(), SOCK_STREAM, IPPROTO_TCP);
+
+	if (connect(socket, address.GetSocketAddress(), address.GetSocketAddressLength()) != 0)
+	{
+		closesocket(socket);
+		return false;
+	}
+
+	TestClientCredentials credentials;
+	Botan::TLS::Policy policy;
+
+	bool handshakeComplete = false;
+
+	{
+		Botan::TLS::Client client(
+			[&] (const uint8_t data[], size_t length)
+			{
+				send(socket, reinterpret_cast<const char*>(data), length, 0);
+			},
+			[] (const uint8_t[], size_t)
+			{
+			},
+			[] (Botan::TLS::Alert, const uint8_t[], size_t)
+			{
+			},
+			[&] (const Botan::TLS::Session&)
+			{
+				handshakeComplete = true;
+				return true;
+			},
+			sessionManager,
+			credentials,
+			policy,
+			rng,
+			Botan::TLS::Server_Information("localhost", port));
+
+		while (!handshakeComplete && !client.is_closed())
+		{
+			uint8_t buffer[16384];
+			int length = recv(socket, reinterpret_cast<char*>(buffer), sizeof(buffer), 0);
+
+			if (length <= 0)
+			{
+				break;
+			}
+
+			client.received_data(buffer, length);
+		}
+
+		if (handshakeComplete)
+		{
+			client.close();
+		}
+	}
+
+	closesocket(socket);
+
+	return handshakeComplete;
+}
+
+// runs handshakeCount loopback handshakes, full or resumed, and checks the server counted all of them
+static void RunHandshakes(int port, bool resume, int handshakeCount, double* handshakesPerSecond)
+{
+	*handshakesPerSecond = 0.0;
+
+	net::PeerAddress address = net::PeerAddress::FromString(va("127.0.0.1:%d", port), port, net::PeerAddress::LookupType::ResolveName).get();
+
+	fwRefContainer<net::TcpServerManager> manager = new net::TcpServerManager();
+	fwRefContainer<net::TcpServer> tcpServer = manager->CreateServer(address);
+
+	ASSERT_NE(nullptr, tcpServer.GetRef());
+
+	fwRefContainer<net::TLSServer> server = new net::TLSServer(tcpServer, "tls_test.crt", "tls_test.key");
+
+	Botan::AutoSeeded_RNG rng;
+
+	// the client keeps its sessions (and tickets) around only when resuming
+	std::unique_ptr<Botan::TLS::Session_Manager> sessionManager;
+
+	if (resume)
+	{
+		sessionManager = std::make_unique<Botan::TLS::Session_Manager_In_Memory>(rng);
+	}
+	else
+	{
+		sessionManager = std::make_unique<Botan::TLS::Session_Manager_Noop>();
+	}
+
+	int completedHandshakes = 0;
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < handshakeCount; i++)
+	{
+		if (Handshake(address, port, *sessionManager, rng))
+		{
+			completedHandshakes++;
+		}
+	}
+
+	double time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	// the server may count the last handshake slightly after the client finished it
+	for (int i = 0; i < 100 && server->GetHandshakeCount() < handshakeCount; i++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	*handshakesPerSecond = completedHandshakes / time;
+
+	EXPECT_EQ(handshakeCount, completedHandshakes);
+	EXPECT_EQ(handshakeCount, server->GetHandshakeCount());
+
+	if (resume)
+	{
+		// only the first handshake has nothing to resume
+		EXPECT_EQ(handshakeCount - 1, server->GetResumedHandshakeCount());
+		EXPECT_DOUBLE_EQ((handshakeCount - 1) / static_cast<double>(handshakeCount), server->GetResumptionHitRate());
+	}
+	else
+	{
+		EXPECT_EQ(0, server->GetResumedHandshakeCount());
+	}
+}
+
+TEST_F(TLSServerTest, CompletesFullHandshakes)
+{
+	double handshakesPerSecond;
+	RunHandshakes(30246, false, 10, &handshakesPerSecond);
+}
+
+TEST_F(TLSServerTest, ResumesSessions)
+{
+	double handshakesPerSecond;
+	RunHandshakes(30247, true, 10, &handshakesPerSecond);
+}
+
+// loopback handshake benchmark: full handshakes against resumed ones
+static const int kHandshakeCount = 200;
+
+TEST_F(TLSServerTest, DISABLED_BenchmarkFullHandshakes)
+{
+	double handshakesPerSecond;
+	RunHandshakes(30240, false, kHandshakeCount, &handshakesPerSecond);
+
+	printf("full handshakes: %.0f handshakes/s\n", handshakesPerSecond);
+}
+
+TEST_F(TLSServerTest, DISABLED_BenchmarkResumedHandshakes)
+{
+	double handshakesPerSecond;
+	RunHandshakes(30241, true, kHandshakeCount, &handshakesPerSecond);
+
+	printf("resumption: %.0f handshakes/s\n", handshakesPerSecond);
+}
+
+// plaintext request latency on a loop shared with a TLS server that's busy handshaking
+static const int kInFlightHandshakes = 500;
+static const int kLatencySamples = 1000;
+
+static double MeasurePlaintextLatency(int port, size_t workerThreads)
+{
+	net::PeerAddress address = net::PeerAddress::FromString(va("127.0.0.1:%d", port), port, net::PeerAddress::LookupType::ResolveName).get();
+	net::PeerAddress tlsAddress = net::PeerAddress::FromString(va("127.0.0.1:%d", port + 1), port + 1, net::PeerAddress::LookupType::ResolveName).get();
+
+	// both servers run on the manager's single loop
+	fwRefContainer<net::TcpServerManager> manager = new net::TcpServerManager();
+	fwRefContainer<net::TcpServer> plainServer = manager->CreateServer(address);
+	fwRefContainer<net::TcpServer> tcpServer = manager->CreateServer(tlsAddress);
+
+	fwRefContainer<net::TLSServer> tlsServer = new net::TLSServer(tcpServer, "tls_test.crt", "tls_test.key");
+	tlsServer->SetWorkerThreadCount(workerThreads);
+
+	plainServer->SetConnectionCallback([] (fwRefContainer<net::TcpServerStream> stream)
+	{
+		net::TcpServerStream* streamPtr = stream.GetRef();
+
+		stream->SetReadCallback([=] (const net::PooledBuffer& data)
+		{
+			static const char response[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+			streamPtr->Write(net::PooledBuffer(response, sizeof(response) - 1));
+		});
+	});
+
+	// keep the TLS server busy with handshakes until we're done measuring
+	std::atomic<bool> measuring(true);
+	std::vector<std::thread> handshakeThreads;
+
+	for (int i = 0; i < kInFlightHandshakes; i++)
+	{
+		handshakeThreads.emplace_back([&] ()
+		{
+			Botan::AutoSeeded_RNG rng;
+			Botan::TLS::Session_Manager_Noop sessionManager;
+
+			while (measuring)
+			{
+				Handshake(tlsAddress, port + 1, sessionManager, rng);
+			}
+		});
+	}
+
+	PlatformSocketType socket = ::socket(address.GetAddressFamily(), SOCK_STREAM, IPPROTO_TCP);
+	EXPECT_EQ(0, connect(socket, address.GetSocketAddress(), address.GetSocketAddressLength()));
+
+	std::vector<double> latencies;
+
+	for (int i = 0; i < kLatencySamples; i++)
+	{
+		static const char request[] = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+		auto startTime = std::chrono::high_resolution_clock::now();
+
+		send(socket, request, sizeof(request) - 1, 0);
+
+		char buffer[256];
+		int received = 0;
+
+		while (received < 40)
+		{
+			int length = recv(socket, buffer, sizeof(buffer), 0);
+
+			if (length <= 0)
+			{
+				break;
+			}
+
+			received += length;
+		}
+
+		latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count());
+	}
+
+	closesocket(socket);
+
+	measuring = false;
+
+	for (auto& thread : handshakeThreads)
+	{
+		thread.join();
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+
+	return latencies[latencies.size() * 99 / 100];
+}
+
+TEST_F(TLSServerTest, DISABLED_BenchmarkLatencyDuringHandshakes)
+{
+	double inlineLatency = MeasurePlaintextLatency(30242, 0);
+	double offloadedLatency = MeasurePlaintextLatency(30244, 4);
+
+	printf("p99 plaintext latency with %d handshakes in flight: %.2f ms inline, %.2f ms offloaded\n",
+		kInFlightHandshakes,
+		inlineLatency,
+		offloadedLatency);
+
+	EXPECT_LT(offloadedLatency, inlineLatency);
+}
@@ -0,0 +1,170 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <WorkerPool.h>
+
+#include <atomic>
+#include <future>
+
+TEST(WorkerPoolTest, StrandsKeepTaskOrder)
+{
+	static const int kStrandCount = 16;
+	static const int kTaskCount = 10000;
+
+	fwRefContainer<net::WorkerPool> pool = new net::WorkerPool(4);
+
+	std::vector<fwRefContainer<net::WorkerStrand>> strands;
+	std::vector<std::vector<int>> results(kStrandCount);
+
+	for (int i = 0; i < kStrandCount; i++)
+	{
+		strands.push_back(pool->CreateStrand());
+	}
+
+	std::promise<void> done;
+	std::atomic<int> remaining(kStrandCount * kTaskCount);
+
+	// post from several threads at once, each strand from a single one
+	std::vector<std::thread> threads;
+
+	for (int t = 0; t < 4; t++)
+	{
+		threads.emplace_back([&, t] ()
+		{
+			for (int i = 0; i < kTaskCount; i++)
+			{
+				for (int s = t; s < kStrandCount; s += 4)
+				{
+					auto& result = results[s];
+
+					strands[s]->Post([&, i] ()
+					{
+						// tasks on the same strand never overlap, so nothing else touches this vector
+						result.push_back(i);
+
+						if (--remaining == 0)
+						{
+							done.set_value();
+						}
+					});
+				}
+			}
+		});
+	}
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	done.get_future().wait();
+
+	for (auto& result : results)
+	{
+		ASSERT_EQ(kTaskCount, result.size());
+
+		for (int i = 0; i < kTaskCount; i++)
+		{
+			ASSERT_EQ(i, result[i]);
+		}
+	}
+}
+
+TEST(WorkerPoolTest, StrandsRunInParallel)
+{
+	fwRefContainer<net::WorkerPool> pool = new net::WorkerPool(2);
+
+	fwRefContainer<net::WorkerStrand> first = pool->CreateStrand();
+	fwRefContainer<net::WorkerStrand> second = pool->CreateStrand();
+
+	// the first strand blocks until the second one ran
+	std::promise<void> secondRan;
+	std::promise<void> firstDone;
+
+	first->Post([&] ()
+	{
+		secondRan.get_future().wait();
+		firstDone.set_value();
+	});
+
+	second->Post([&] ()
+	{
+		secondRan.set_value();
+	});
+
+	EXPECT_EQ(std::future_status::ready, firstDone.get_future().wait_for(std::chrono::seconds(5)));
+}
+
+TEST(WorkerPoolTest, DrainsOnDestruction)
+{
+	std::atomic<int> ranTasks(0);
+
+	{
+		fwRefContainer<net::WorkerPool> pool = new net::WorkerPool(1);
+		fwRefContainer<net::WorkerStrand> strand = pool->CreateStrand();
+
+		for (int i = 0; i < 100; i++)
+		{
+			strand->Post([&] ()
+			{
+				ranTasks++;
+			});
+		}
+
+		strand = nullptr;
+	}
+
+	EXPECT_EQ(100, ranTasks.load());
+}
+
+TEST(WorkerPoolTest, RefusesNewWorkWhileQueueIsFull)
+{
+	fwRefContainer<net::WorkerPool> pool = new net::WorkerPool(1, 4);
+	fwRefContainer<net::WorkerStrand> strand = pool->CreateStrand();
+
+	// keep the only worker busy, so everything after this stays queued
+	std::promise<void> blocked;
+	std::promise<void> release;
+	std::shared_future<void> released = release.get_future().share();
+
+	strand->Post([&] ()
+	{
+		blocked.set_value();
+		released.wait();
+	});
+
+	blocked.get_future().wait();
+
+	std::atomic<int> ranTasks(0);
+
+	for (int i = 0; i < 4; i++)
+	{
+		EXPECT_TRUE(pool->AcceptsNewWork());
+
+		strand->Post([&] ()
+		{
+			ranTasks++;
+		});
+	}
+
+	EXPECT_EQ(4, pool->GetQueuedTaskCount());
+	EXPECT_FALSE(pool->AcceptsNewWork());
+	EXPECT_EQ(1, pool->GetRefusedWorkCount());
+
+	// posting still works for work that got accepted earlier
+	std::promise<void> done;
+
+	strand->Post([&] ()
+	{
+		done.set_value();
+	});
+
+	release.set_value();
+
+	EXPECT_EQ(std::future_status::ready, done.get_future().wait_for(std::chrono::seconds(5)));
+	EXPECT_EQ(4, ranTasks.load());
+
+	EXPECT_EQ(0, pool->GetQueuedTaskCount());
+	EXPECT_TRUE(pool->AcceptsNewWork());
+	EXPECT_EQ(1, pool->GetRefusedWorkCount());
+}
@@ -13,6 +13,12 @@
 
 class NetPacketMetrics;
 
+enum NetQueueType
+{
+	NET_QUEUE_ROUTED_PACKETS,
+	NET_QUEUE_SERVER_MESSAGES
+};
+
 class INetMetricSink : public fwRefCountable
 {
 public:
@@ -21,6 +27,10 @@ public:
 	virtual void OnOutgoingPacket(const NetPacketMetrics& packetMetrics) = 0;
 
 	virtual void OnPingResult(int msec) = 0;
+
+	// a message got taken from a queue between the network thread and the game, with `depth` more still waiting -
+	// `latency` is the time in microseconds since it came in from the socket
+	virtual void OnQueuedMessage(NetQueueType queue, uint32_t depth, uint32_t latency) = 0;
 };
 
 enum NetPacketSubComponent
@@ -36,10 +46,15 @@ class NetPacketMetrics
 private:
 	uint32_t m_subSizes[NET_PACKET_SUB_MAX];
 
+	// the size as sent over the wire, or 0 if the packet wasn't compressed
+	uint32_t m_compressedSize;
+
 public:
 	inline NetPacketMetrics()
 	{
 		memset(m_subSizes, 0, sizeof(m_subSizes));
+
+		m_compressedSize = 0;
 	}
 
 	inline uint32_t GetTotalSize() const
@@ -61,6 +76,16 @@ public:
 	{
 		m_subSizes[index] += value;
 	}
+
+	inline uint32_t GetCompressedSize() const
+	{
+		return (m_compressedSize) ? m_compressedSize : GetTotalSize();
+	}
+
+	inline void SetCompressedSize(uint32_t value)
+	{
+		m_compressedSize = value;
+	}
 };
 
 inline NetPacketMetrics operator+(const NetPacketMetrics& left, const NetPacketMetrics& right)
@@ -74,5 +99,7 @@ inline NetPacketMetrics operator+(const NetPacketMetrics& left, const NetPacketM
 		retval.SetElementSize(sub, left.GetElementSize(sub) + right.GetElementSize(sub));
 	}
 
+	retval.SetCompressedSize(left.GetCompressedSize() + right.GetCompressedSize());
+
 	return retval;
 }
\ No newline at end of file
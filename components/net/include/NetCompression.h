@@ -0,0 +1,69 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <zlib.h>
+
+// the first byte of every packet once compression got negotiated
+enum NetCompressionType : uint8_t
+{
+	NET_COMPRESSION_NONE = 0,
+	NET_COMPRESSION_DEFLATE = 1,
+	NET_COMPRESSION_DEFLATE_DICTIONARY = 2
+};
+
+//
+// Compresses packets one by one, so each can be decompressed on its own no matter which ones got lost. Small packets
+// compress badly without any history, which is what the optional preset dictionary (shared by both ends) is for.
+// Packets that don't get any smaller are sent as they are.
+//
+class
+#ifdef COMPILING_NET
+	__declspec(dllexport)
+#endif
+	NetCompressor
+{
+private:
+	z_stream m_deflateStream;
+
+	z_stream m_inflateStream;
+
+	std::vector<uint8_t> m_dictionary;
+
+	std::vector<char> m_compressBuffer;
+
+	std::vector<char> m_decompressBuffer;
+
+public:
+	NetCompressor();
+
+	~NetCompressor();
+
+	NetCompressor(const NetCompressor&) = delete;
+
+	NetCompressor& operator=(const NetCompressor&) = delete;
+
+	// both ends need the same dictionary - an empty one disables it
+	void SetDictionary(const std::vector<uint8_t>& dictionary);
+
+	inline bool HasDictionary() const
+	{
+		return !m_dictionary.empty();
+	}
+
+	//
+	// Returns a pointer to the packet including its compression header, valid until the next call.
+	//
+	const char* Compress(const char* data, size_t length, size_t* outLength);
+
+	//
+	// Returns a pointer to the decompressed packet, valid until the next call, or nullptr if the packet is malformed
+	// or would decompress to more than maxLength bytes.
+	//
+	const char* Decompress(const char* data, size_t length, size_t maxLength, size_t* outLength);
+};
@@ -7,14 +7,24 @@
 
 #pragma once
 #include <queue>
+#include <atomic>
 #include <bitset>
 #include <functional>
+#include <mutex>
 #include <thread>
 #include <WS2tcpip.h>
 #include "HttpClient.h"
 #include "CrossLibraryInterfaces.h"
 
 #include "INetMetricSink.h"
+#include "ReliableCommandWindow.h"
+#include "NetCompression.h"
+#include "NetRouteDelta.h"
+
+#include <NetDispatchTable.h>
+#include <NetMetrics.h>
+#include <NetPacketRing.h>
+#include <NetSpscQueue.h>
 
 #include <concurrent_queue.h>
 
@@ -70,7 +80,8 @@ class NetChannel
 private:
 	int m_fragmentSequence;
 	int m_fragmentLength;
-	char* m_fragmentBuffer;
+	// allocated once and reused for every fragmented sequence - the NetBuffer handed out from Process only borrows it
+	std::unique_ptr<char[]> m_fragmentBuffer;
 	std::bitset<65536 / FRAGMENT_SIZE> m_fragmentValidSet;
 	int m_fragmentLastBit;
 
@@ -81,20 +92,35 @@ private:
 	NetLibrary* m_netLibrary;
 
 private:
-	void SendFragmented(NetBuffer& buffer);
+	size_t SendFragmented(NetBuffer& buffer);
 
 public:
 	NetChannel();
 
 	void Reset(NetAddress& target, NetLibrary* netLibrary);
 
-	void Send(NetBuffer& buffer);
+	// returns the number of datagrams the buffer got sent in
+	size_t Send(NetBuffer& buffer);
 
 	bool Process(const char* message, size_t size, NetBuffer** buffer);
 };
 
 #define MAX_RELIABLE_COMMANDS 64
 
+// reliable commands beyond the first one only get added to a packet while they fit in here
+#define RELIABLE_BYTES_PER_PACKET 8192
+
+// kept free after reliable commands for whatever OnBuildMessage adds
+#define RELIABLE_RESERVED_BYTES 1024
+
+// routed packets larger than this get dropped - the game doesn't send datagrams this large
+#define ROUTED_PACKET_SLOT_SIZE 1536
+
+#define ROUTED_PACKET_SLOTS 1024
+
+// new baselines for delta-encoded routed packets only get sent while fewer reliable commands than this are in flight
+#define MAX_ROUTE_BASELINE_WINDOW 16
+
 class
 #ifdef COMPILING_NET
 	__declspec(dllexport)
@@ -114,13 +140,6 @@ public:
 		CS_ACTIVE
 	};
 
-	struct OutReliableCommand
-	{
-		uint32_t id;
-		uint32_t type;
-		std::string command;
-	};
-
 private:
 	uint16_t m_serverNetID;
 
@@ -130,7 +149,7 @@ private:
 
 	uint32_t m_hostBase;
 
-	ConnectionState m_connectionState;
+	std::atomic<ConnectionState> m_connectionState;
 
 	NetAddress m_currentServer;
 
@@ -158,13 +177,24 @@ private:
 
 	uint32_t m_lastReceivedReliableCommand;
 
-	uint32_t m_outReliableAcknowledged;
+	ReliableCommandWindow m_outReliableCommands;
+
+	// whether both ends agreed on compressing packets while connecting
+	bool m_compressionEnabled;
 
-	uint32_t m_outReliableSequence;
+	NetCompressor m_compressor;
 
-	std::list<OutReliableCommand> m_outReliableCommands;
+	// whether both ends agreed on delta-encoding routed packets while connecting
+	bool m_routeDeltaEnabled;
 
-	uint32_t m_lastReceivedAt;
+	NetRouteDeltaEncoder m_routeEncoder;
+
+	NetRouteDeltaDecoder m_routeDecoder;
+
+	// a msgRouteDelta batch being read or written
+	std::vector<uint8_t> m_routeBatch;
+
+	std::atomic<uint32_t> m_lastReceivedAt;
 
 	uint32_t m_lastFrameNumber;
 
@@ -172,39 +202,108 @@ private:
 
 	fwRefContainer<INetMetricSink> m_metricSink;
 
+	// histograms of the server connection, exported through the metrics registry
+	fwRefContainer<net::ConnectionMetrics> m_metrics;
+
 	HANDLE m_receiveEvent;
 
 private:
-	typedef std::function<void(const char* buf, size_t len)> ReliableHandlerType;
+	// the network thread owns receiving, decoding and sending packets - it holds m_networkMutex while doing so, which
+	// anything else changing the connection it works on (connecting, disconnecting) takes as well
+	std::thread m_networkThread;
+
+	std::atomic<bool> m_networkThreadRunning;
+
+	std::mutex m_networkMutex;
 
-	std::unordered_multimap<uint32_t, ReliableHandlerType> m_reliableHandlers;
+	// set by both sockets once they've got something to read
+	WSAEVENT m_socketEvent;
+
+	HANDLE m_networkWakeEvent;
+
+	// set by whoever signaled m_networkWakeEvent for a filling route queue, until the network thread gets to it
+	std::atomic<bool> m_routeWakePending;
+
+	// as of the last time the network thread looked
+	std::atomic<uint32_t> m_unacknowledgedCommands;
 
 private:
-	struct RoutingPacket
+	typedef net::DispatchTable<void(const char* buf, size_t len)> ReliableHandlerTable;
+
+	// the table's own handler type, so handlers get stored as passed instead of wrapped in a std::function first
+	typedef ReliableHandlerTable::THandler ReliableHandlerType;
+
+	ReliableHandlerTable m_reliableHandlers;
+
+private:
+	// a reliable command or out-of-band message the network thread received, for the game thread to handle
+	struct ServerMessage
 	{
-		uint16_t netID;
+		bool outOfBand;
+		uint32_t type;
 		std::string payload;
-		uint32_t genTime;
+		NetAddress from;
+		uint32_t receivedAt;
+	};
 
-		RoutingPacket();
+	struct OutgoingCommand
+	{
+		uint32_t type;
+		std::string command;
 	};
 
 private:
-	std::mutex m_incomingPacketMutex;
-	std::queue<RoutingPacket> m_incomingPackets;
-	concurrency::concurrent_queue<RoutingPacket> m_outgoingPackets;
+	// network thread to whoever reads routed packets - if they don't keep up, new packets get dropped
+	net::PacketRing<ROUTED_PACKET_SLOT_SIZE, ROUTED_PACKET_SLOTS> m_incomingPackets;
+
+	// any game thread to network thread - once this is half full, the network thread sends right away instead of
+	// waiting for the next frame, and only drops packets if that isn't enough
+	net::PacketRing<ROUTED_PACKET_SLOT_SIZE, ROUTED_PACKET_SLOTS> m_outgoingPackets;
+
+	// network thread to game thread
+	net::SpscQueue<ServerMessage, 256> m_incomingMessages;
+
+	// game thread to network thread
+	net::SpscQueue<OutgoingCommand, 128> m_outgoingCommands;
+
+	// game thread to network thread: what OnBuildMessage handlers wrote during a frame
+	net::SpscQueue<std::string, 8> m_builtMessages;
+
+	// the latest of those, added to every packet the network thread sends
+	std::string m_builtMessage;
+
+	// the only thread allowed to dequeue routed packets, once one did
+	std::atomic<std::thread::id> m_routedPacketConsumer;
 
 private:
 	void ProcessOOB(NetAddress& from, char* oob, size_t length);
 
-	void ProcessServerMessage(NetBuffer& msg);
+	// compressedLength is the size the message had on the wire, if it was compressed
+	void ProcessServerMessage(NetBuffer& msg, size_t compressedLength = 0);
 
 	void ProcessSend();
 
+	// runs OnBuildMessage on the game thread, for the network thread to send along
+	void BuildMessage();
+
+	// writes as many routed packets as fit as a single msgRouteDelta, leaving `reserved` bytes for what comes after
+	void WriteRouteDeltaBatch(NetBuffer& msg, size_t reserved, NetPacketMetrics& metrics);
+
+	void FlushRouteDeltaBatch(NetBuffer& msg, NetPacketMetrics& metrics);
+
+	void WriteRoutePacket(NetBuffer& msg, uint16_t netID, const uint8_t* data, size_t length, NetPacketMetrics& metrics);
+
 	void HandleReliableCommand(uint32_t msgType, const char* buf, size_t length);
 
 	void ProcessPacketsInternal(NetAddressType addrType);
 
+	// handles whatever the network thread received for the game thread
+	void ProcessMessages();
+
+	void RunNetworkThread();
+
+	void ReportQueuedMessage(NetQueueType queue, size_t depth, uint32_t receivedAt);
+
 	NetLibrary();
 
 public:
@@ -245,7 +344,7 @@ public:
 
 	bool WaitForRoutedPacket(uint32_t timeout);
 
-	void EnqueueRoutedPacket(uint16_t netID, std::string packet);
+	void EnqueueRoutedPacket(uint16_t netID, const char* buffer, size_t length);
 
 	void SendOutOfBand(NetAddress& address, const char* format, ...);
 
@@ -274,11 +373,19 @@ public:
 
 	inline bool IsDisconnected() { return m_connectionState == CS_IDLE; }
 
+	inline net::PacketRingStatistics GetIncomingPacketStatistics() { return m_incomingPackets.GetStatistics(); }
+
+	inline net::PacketRingStatistics GetOutgoingPacketStatistics() { return m_outgoingPackets.GetStatistics(); }
+
 	void SetMetricSink(fwRefContainer<INetMetricSink>& sink);
 
+	inline const fwRefContainer<net::ConnectionMetrics>& GetMetrics() { return m_metrics; }
+
 public:
 	static NetLibrary* Create();
 
+	~NetLibrary();
+
 public:
 	static
 #ifndef COMPILING_NET
@@ -296,6 +403,7 @@ public:
 
 	fwEvent<const char*> OnConnectionError;
 
+	// called on the game thread once a frame - what gets written goes out with every packet until the next frame
 	fwEvent<NetBuffer&> OnBuildMessage;
 
 	fwEvent<> OnConnectionTimedOut;
@@ -0,0 +1,131 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <NetBufferView.h>
+
+#include <array>
+#include <unordered_map>
+#include <vector>
+
+// 'msgRouteDelta': a batch of delta-encoded routed packets
+#define NET_MSG_ROUTE_DELTA 0xAFEF31B3
+
+// 'msgRouteBaseline': a reliable command setting a new baseline for a netID
+#define NET_MSG_ROUTE_BASELINE 0x4C2DD0F2
+
+//
+// Encodes routed packets as the difference to an earlier packet for the same netID, as consecutive sync packets
+// tend to only differ in a few bytes. Payloads get XORed with the baseline, and the result gets run-length encoded:
+// alternating runs of unchanged bytes (only their count is sent) and changed bytes.
+//
+// Baselines themselves go out as reliable commands, and only get used once the reliable command got acknowledged -
+// so the other end is guaranteed to have any baseline a packet refers to, no matter which packets got lost. A new
+// baseline gets sent whenever packets stop encoding well against the current one.
+//
+// Every entry looks like this, all of them varints:
+//   netID, baseline index (0 for none), payload length, then runs of (unchanged count, changed count, changed bytes)
+//   until the payload length is covered
+//
+class
+#ifdef COMPILING_NET
+	__declspec(dllexport)
+#endif
+	NetRouteDeltaEncoder
+{
+private:
+	struct Stream
+	{
+		// the acknowledged baseline, index 0 meaning there's none yet
+		uint32_t index;
+
+		std::vector<uint8_t> data;
+
+		// a baseline waiting for its reliable command to be acknowledged
+		uint32_t pendingIndex;
+
+		uint32_t pendingCommand;
+
+		std::vector<uint8_t> pendingData;
+
+		uint32_t nextIndex;
+
+		// how the last payload encoded
+		size_t lastLength;
+
+		size_t lastEncodedLength;
+	};
+
+	std::unordered_map<uint16_t, Stream> m_streams;
+
+	size_t m_pendingBaselines;
+
+	std::vector<uint8_t> m_encodeBuffer;
+
+	std::vector<uint8_t> m_baselineBuffer;
+
+public:
+	NetRouteDeltaEncoder();
+
+	void Reset();
+
+	//
+	// Returns a pointer to the encoded entry, valid until the next call - or nullptr if the payload didn't fit the
+	// encode buffer, in which case it has to be sent as a plain msgRoute instead.
+	//
+	const uint8_t* Encode(uint16_t netID, const uint8_t* data, size_t length, size_t* outLength);
+
+	// whether the last payload encoded for netID did badly enough to be worth sending as a new baseline
+	bool WantsBaseline(uint16_t netID) const;
+
+	//
+	// Makes the payload a pending baseline, returning the reliable command to send it in - valid until the next call.
+	// The caller has to pass the id it got sent with to SetBaselineCommand.
+	//
+	const std::vector<uint8_t>& CreateBaseline(uint16_t netID, const uint8_t* data, size_t length);
+
+	void SetBaselineCommand(uint16_t netID, uint32_t commandId);
+
+	// switches to any pending baseline whose reliable command got acknowledged
+	void Acknowledge(uint32_t acknowledged);
+};
+
+class
+#ifdef COMPILING_NET
+	__declspec(dllexport)
+#endif
+	NetRouteDeltaDecoder
+{
+private:
+	struct Baseline
+	{
+		uint32_t index;
+
+		std::vector<uint8_t> data;
+	};
+
+	// the newest two baselines per netID - packets sent before the newest one got acknowledged still use the older one
+	std::unordered_map<uint16_t, std::array<Baseline, 2>> m_baselines;
+
+	std::vector<uint8_t> m_decodeBuffer;
+
+public:
+	NetRouteDeltaDecoder();
+
+	void Reset();
+
+	// takes the body of a msgRouteBaseline command, returning false if it's malformed
+	bool AddBaseline(const uint8_t* data, size_t length);
+
+	//
+	// Reads the next entry of a batch. Returns false if it's malformed, which leaves the rest of the batch unreadable
+	// as well. Otherwise, `data` points to the payload until the next call - or is nullptr if the entry referred to a
+	// baseline we don't have (anymore), as can happen with packets arriving very late.
+	//
+	bool Decode(net::BufferView& view, uint16_t* netID, const uint8_t** data, size_t* length);
+};
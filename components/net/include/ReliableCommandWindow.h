@@ -0,0 +1,147 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <NetMetrics.h>
+
+#include <deque>
+
+struct ReliableCommandStatistics
+{
+	uint64_t commandsSent;
+
+	uint64_t bytesSent;
+
+	uint64_t retransmissions;
+};
+
+//
+// Decides which reliable commands go into an outgoing packet.
+//
+// The server acknowledges cumulatively and runs any command newer than the last one it ran, so a command that gets
+// lost while a later one arrives would be skipped for good. Every packet carrying commands therefore has to start
+// at the oldest unacknowledged command: these go out as a 'flight', and are only sent again once the flight times
+// out (based on the measured round-trip time) or the acknowledgement moves, instead of in every single packet.
+// Commands queued while a flight is outstanding join the next one - unless all of them are small enough to just
+// send the whole flight again right away.
+//
+// Times are in milliseconds.
+//
+class
+#ifdef COMPILING_NET
+	__declspec(dllexport)
+#endif
+	ReliableCommandWindow
+{
+public:
+	struct Command
+	{
+		uint32_t id;
+		uint32_t type;
+		std::string command;
+
+		// packets this command went out in so far
+		uint32_t sendCount;
+
+		// when it last went out
+		uint32_t sendTime;
+
+		// type, id, length and the command itself, as serialized into a packet
+		inline size_t GetWireSize() const
+		{
+			return 8 + ((command.size() > UINT16_MAX) ? 4 : 2) + command.size();
+		}
+	};
+
+private:
+	std::deque<Command> m_commands;
+
+	uint32_t m_outSequence;
+
+	uint32_t m_acknowledged;
+
+	// the last command of the outstanding flight, or the last acknowledged command if there is none
+	uint32_t m_flightEnd;
+
+	uint32_t m_flightSendTime;
+
+	// retransmissions of the current flight, for backing off the timeout
+	uint32_t m_flightRetries;
+
+	bool m_flightExpired;
+
+	bool m_hasRttSample;
+
+	double m_smoothedRtt;
+
+	double m_rttVariance;
+
+	ReliableCommandStatistics m_statistics;
+
+	fwRefContainer<net::ConnectionMetrics> m_metrics;
+
+private:
+	void AddRttSample(double rtt);
+
+	bool CanExtendFlight() const;
+
+public:
+	ReliableCommandWindow();
+
+	void Reset();
+
+	// returns the new command's id
+	uint32_t Push(uint32_t type, const char* buffer, size_t length);
+
+	void Acknowledge(uint32_t acknowledged, uint32_t now);
+
+	//
+	// Fills `commands` with whatever should be written into a packet sent now. Commands get added until they'd take
+	// up more than `budget` bytes, but the first one only needs to fit into `space` - so a command larger than the
+	// budget still gets sent, just on its own. Callers have to leave at least GetHeadWireSize() bytes of `space` at
+	// some point, or nothing after that command will ever go out.
+	//
+	void GetCommandsToSend(uint32_t now, size_t budget, size_t space, std::vector<const Command*>& commands);
+
+	// makes the next GetCommandsToSend call send everything from the oldest unacknowledged command on
+	void ExpireFlight();
+
+	uint32_t GetRetransmitTimeout() const;
+
+	// records how often each command had to be resent, once it's acknowledged
+	inline void SetMetrics(const fwRefContainer<net::ConnectionMetrics>& metrics)
+	{
+		m_metrics = metrics;
+	}
+
+	// wire size of the oldest unacknowledged command, or 0 if there is none
+	inline size_t GetHeadWireSize() const
+	{
+		return (m_commands.empty()) ? 0 : m_commands.front().GetWireSize();
+	}
+
+	inline size_t GetUnacknowledgedCount() const
+	{
+		return m_outSequence - m_acknowledged;
+	}
+
+	inline uint32_t GetAcknowledged() const
+	{
+		return m_acknowledged;
+	}
+
+	inline double GetSmoothedRtt() const
+	{
+		return m_smoothedRtt;
+	}
+
+	inline const ReliableCommandStatistics& GetStatistics() const
+	{
+		return m_statistics;
+	}
+};
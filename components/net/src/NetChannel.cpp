@@ -17,7 +17,6 @@ NetChannel::NetChannel()
 
 void NetChannel::Reset(NetAddress& target, NetLibrary* netLibrary)
 {
-	m_fragmentBuffer = "";
 	m_fragmentLength = 0;
 	m_fragmentSequence = -1;
 
@@ -28,7 +27,7 @@ void NetChannel::Reset(NetAddress& target, NetLibrary* netLibrary)
 	m_netLibrary = netLibrary;
 }
 
-void NetChannel::Send(NetBuffer& buffer)
+size_t NetChannel::Send(NetBuffer& buffer)
 {
 	if (buffer.GetCurLength() > FRAGMENT_SIZE)
 	{
@@ -42,13 +41,16 @@ void NetChannel::Send(NetBuffer& buffer)
 	m_netLibrary->SendData(m_targetAddress, msgBuffer, buffer.GetCurLength() + 4);
 
 	m_outSequence++;
+
+	return 1;
 }
 
-void NetChannel::SendFragmented(NetBuffer& buffer)
+size_t NetChannel::SendFragmented(NetBuffer& buffer)
 {
 	uint32_t outSequence = m_outSequence | 0x80000000;
 	uint32_t remaining = buffer.GetCurLength();
 	uint16_t i = 0;
+	size_t fragments = 0;
 
 	assert(buffer.GetCurLength() < 65536);
 
@@ -64,6 +66,7 @@ void NetChannel::SendFragmented(NetBuffer& buffer)
 		memcpy(&msgBuffer[8], buffer.GetBuffer() + i, thisSize);
 
 		m_netLibrary->SendData(m_targetAddress, msgBuffer, thisSize + 8);
+		fragments++;
 
 		// decrement counters
 		remaining -= thisSize;
@@ -77,6 +80,8 @@ void NetChannel::SendFragmented(NetBuffer& buffer)
 	}
 
 	m_outSequence++;
+
+	return fragments;
 }
 
 bool NetChannel::Process(const char* message, size_t size, NetBuffer** buffer)
@@ -121,7 +126,12 @@ bool NetChannel::Process(const char* message, size_t size, NetBuffer** buffer)
 		{
 			m_fragmentLength = 0;
 			m_fragmentSequence = sequence;
-			m_fragmentBuffer = new char[65536];
+
+			if (!m_fragmentBuffer)
+			{
+				m_fragmentBuffer = std::make_unique<char[]>(65536);
+			}
+
 			m_fragmentValidSet.reset();
 			m_fragmentLastBit = -1;
 		}
@@ -162,7 +172,7 @@ bool NetChannel::Process(const char* message, size_t size, NetBuffer** buffer)
 
 		m_inSequence = sequence;
 
-		*buffer = new NetBuffer(m_fragmentBuffer, m_fragmentLength);
+		*buffer = new NetBuffer(m_fragmentBuffer.get(), m_fragmentLength);
 
 		m_fragmentLength = 0;
 
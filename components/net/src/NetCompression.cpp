@@ -0,0 +1,131 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "NetCompression.h"
+
+// anything smaller than this won't get much smaller, but will take time to compress
+static const size_t kMinCompressLength = 64;
+
+// the compression type, followed by the uncompressed length
+static const size_t kHeaderLength = 3;
+
+NetCompressor::NetCompressor()
+{
+	memset(&m_deflateStream, 0, sizeof(m_deflateStream));
+	memset(&m_inflateStream, 0, sizeof(m_inflateStream));
+
+	// raw deflate streams, as every packet has its own header already - and the fastest level, as this runs every frame.
+	// the hash table gets cleared for every packet, so keep it small: packets are a few hundred bytes anyway.
+	deflateInit2(&m_deflateStream, Z_BEST_SPEED, Z_DEFLATED, -MAX_WBITS, 5, Z_DEFAULT_STRATEGY);
+	inflateInit2(&m_inflateStream, -MAX_WBITS);
+}
+
+NetCompressor::~NetCompressor()
+{
+	deflateEnd(&m_deflateStream);
+	inflateEnd(&m_inflateStream);
+}
+
+void NetCompressor::SetDictionary(const std::vector<uint8_t>& dictionary)
+{
+	m_dictionary = dictionary;
+}
+
+const char* NetCompressor::Compress(const char* data, size_t length, size_t* outLength)
+{
+	if (length >= kMinCompressLength && length <= UINT16_MAX)
+	{
+		m_compressBuffer.resize(kHeaderLength + deflateBound(&m_deflateStream, length));
+
+		deflateReset(&m_deflateStream);
+
+		if (HasDictionary())
+		{
+			deflateSetDictionary(&m_deflateStream, &m_dictionary[0], m_dictionary.size());
+		}
+
+		m_deflateStream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+		m_deflateStream.avail_in = length;
+		m_deflateStream.next_out = reinterpret_cast<Bytef*>(&m_compressBuffer[kHeaderLength]);
+		m_deflateStream.avail_out = m_compressBuffer.size() - kHeaderLength;
+
+		if (deflate(&m_deflateStream, Z_FINISH) == Z_STREAM_END && m_deflateStream.total_out + kHeaderLength < length + 1)
+		{
+			m_compressBuffer[0] = HasDictionary() ? NET_COMPRESSION_DEFLATE_DICTIONARY : NET_COMPRESSION_DEFLATE;
+			*reinterpret_cast<uint16_t*>(&m_compressBuffer[1]) = static_cast<uint16_t>(length);
+
+			*outLength = m_deflateStream.total_out + kHeaderLength;
+			return &m_compressBuffer[0];
+		}
+	}
+
+	m_compressBuffer.resize(length + 1);
+	m_compressBuffer[0] = NET_COMPRESSION_NONE;
+	memcpy(&m_compressBuffer[1], data, length);
+
+	*outLength = length + 1;
+	return &m_compressBuffer[0];
+}
+
+const char* NetCompressor::Decompress(const char* data, size_t length, size_t maxLength, size_t* outLength)
+{
+	if (length < 1)
+	{
+		return nullptr;
+	}
+
+	uint8_t type = data[0];
+
+	if (type == NET_COMPRESSION_NONE)
+	{
+		if (length - 1 > maxLength)
+		{
+			return nullptr;
+		}
+
+		*outLength = length - 1;
+		return &data[1];
+	}
+
+	if ((type != NET_COMPRESSION_DEFLATE && type != NET_COMPRESSION_DEFLATE_DICTIONARY) || length < kHeaderLength)
+	{
+		return nullptr;
+	}
+
+	size_t originalLength = *reinterpret_cast<const uint16_t*>(&data[1]);
+
+	if (originalLength > maxLength)
+	{
+		return nullptr;
+	}
+
+	inflateReset(&m_inflateStream);
+
+	if (type == NET_COMPRESSION_DEFLATE_DICTIONARY)
+	{
+		if (!HasDictionary() || inflateSetDictionary(&m_inflateStream, &m_dictionary[0], m_dictionary.size()) != Z_OK)
+		{
+			return nullptr;
+		}
+	}
+
+	m_decompressBuffer.resize(std::max<size_t>(originalLength, 1));
+
+	m_inflateStream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(&data[kHeaderLength]));
+	m_inflateStream.avail_in = length - kHeaderLength;
+	m_inflateStream.next_out = reinterpret_cast<Bytef*>(&m_decompressBuffer[0]);
+	m_inflateStream.avail_out = originalLength;
+
+	if (inflate(&m_inflateStream, Z_FINISH) != Z_STREAM_END || m_inflateStream.total_out != originalLength)
+	{
+		return nullptr;
+	}
+
+	*outLength = originalLength;
+	return &m_decompressBuffer[0];
+}
@@ -8,6 +8,7 @@
 #include "StdInc.h"
 #include "NetLibrary.h"
 #include <base64.h>
+#include <chrono>
 #include <mutex>
 #include <mmsystem.h>
 #include <yaml-cpp/yaml.h>
@@ -15,6 +16,12 @@
 #include <ProfileManager.h>
 #include <terminal.h>
 
+// for measuring how long messages wait for the game, wrapping around every hour or so
+static uint32_t GetMicroseconds()
+{
+	return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
 uint16_t NetLibrary::GetServerNetID()
 {
 	return m_serverNetID;
@@ -61,9 +68,22 @@ void NetLibrary::ProcessPacketsInternal(NetAddressType addrType)
 			return;
 		}
 
+		m_metrics->Record(net::ConnectionMetric::IncomingPacketSize, len);
+
 		if (*(int*)buf == -1)
 		{
-			ProcessOOB(fromAddr, &buf[4], len - 4);
+			// these are rare enough to just leave them to the game thread
+			ServerMessage message;
+			message.outOfBand = true;
+			message.type = 0;
+			message.payload = std::string(&buf[4], len - 4);
+			message.from = fromAddr;
+			message.receivedAt = GetMicroseconds();
+
+			if (!m_incomingMessages.TryPush(std::move(message)))
+			{
+				trace("dropped out-of-band message, the game isn't keeping up\n");
+			}
 		}
 		else
 		{
@@ -77,7 +97,26 @@ void NetLibrary::ProcessPacketsInternal(NetAddressType addrType)
 
 			if (m_netChannel.Process(buf, len, &msg))
 			{
-				ProcessServerMessage(*msg);
+				if (m_compressionEnabled)
+				{
+					size_t decompressedLength;
+					const char* decompressed = m_compressor.Decompress(msg->GetBuffer(), msg->GetLength(), 65536, &decompressedLength);
+
+					if (decompressed)
+					{
+						NetBuffer decompressedMsg(decompressed, decompressedLength);
+
+						ProcessServerMessage(decompressedMsg, msg->GetLength());
+					}
+					else
+					{
+						trace("invalid compressed server msg\n");
+					}
+				}
+				else
+				{
+					ProcessServerMessage(*msg);
+				}
 
 				delete msg;
 			}
@@ -85,35 +124,23 @@ void NetLibrary::ProcessPacketsInternal(NetAddressType addrType)
 	}
 }
 
-void NetLibrary::ProcessServerMessage(NetBuffer& msg)
+void NetLibrary::ProcessServerMessage(NetBuffer& msg, size_t compressedLength)
 {
 	// update received-at time
 	m_lastReceivedAt = GetTickCount();
 
 	// metrics bits
 	NetPacketMetrics metrics;
+	metrics.SetCompressedSize(compressedLength);
 
 	// receive the message
 	uint32_t msgType;
 
 	uint32_t curReliableAck = msg.Read<uint32_t>();
 
-	if (curReliableAck != m_outReliableAcknowledged)
-	{
-		for (auto it = m_outReliableCommands.begin(); it != m_outReliableCommands.end();)
-		{
-			if (it->id <= curReliableAck)
-			{
-				it = m_outReliableCommands.erase(it);
-			}
-			else
-			{
-				it++;
-			}
-		}
-
-		m_outReliableAcknowledged = curReliableAck;
-	}
+	m_outReliableCommands.Acknowledge(curReliableAck, timeGetTime());
+	m_routeEncoder.Acknowledge(m_outReliableCommands.GetAcknowledged());
+	m_unacknowledgedCommands = m_outReliableCommands.GetUnacknowledgedCount();
 
 	if (m_connectionState == CS_CONNECTED)
 	{
@@ -125,6 +152,9 @@ void NetLibrary::ProcessServerMessage(NetBuffer& msg)
 		return;
 	}
 
+	// once the game thread falls behind, later commands can't be taken either - they'd be skipped for good otherwise
+	bool incomingMessagesFull = false;
+
 	do
 	{
 		if (msg.End())
@@ -147,11 +177,45 @@ void NetLibrary::ProcessServerMessage(NetBuffer& msg)
 				break;
 			}
 
-			EnqueueRoutedPacket(netID, std::string(routeBuffer, rlength));
+			EnqueueRoutedPacket(netID, routeBuffer, rlength);
 
 			// add to metrics
 			metrics.AddElementSize(NET_PACKET_SUB_ROUTED_MESSAGES, 2 + rlength);
 		}
+		else if (msgType == NET_MSG_ROUTE_DELTA)
+		{
+			uint16_t batchLength = msg.Read<uint16_t>();
+
+			m_routeBatch.resize(batchLength);
+
+			if (!msg.Read(m_routeBatch.data(), batchLength))
+			{
+				break;
+			}
+
+			net::BufferView batch(m_routeBatch.data(), batchLength);
+
+			while (!batch.IsAtEnd())
+			{
+				uint16_t netID;
+				const uint8_t* payload;
+				size_t length;
+
+				if (!m_routeDecoder.Decode(batch, &netID, &payload, &length))
+				{
+					trace("invalid msgRouteDelta entry\n");
+					break;
+				}
+
+				// sent against a baseline we no longer have - it's unreliable anyway
+				if (payload)
+				{
+					EnqueueRoutedPacket(netID, reinterpret_cast<const char*>(payload), length);
+				}
+			}
+
+			metrics.AddElementSize(NET_PACKET_SUB_ROUTED_MESSAGES, 2 + batchLength);
+		}
 		else if (msgType == 0x53FFFA3F) // msgFrame
 		{
 			// for now, frames are only an identifier - this will change once game features get moved to our code
@@ -166,6 +230,8 @@ void NetLibrary::ProcessServerMessage(NetBuffer& msg)
 			{
 				int currentPing = msg.Read<int>();
 
+				m_metrics->Record(net::ConnectionMetric::Rtt, std::max(currentPing, 0));
+
 				if (m_metricSink.GetRef())
 				{
 					m_metricSink->OnPingResult(currentPing);
@@ -209,13 +275,35 @@ void NetLibrary::ProcessServerMessage(NetBuffer& msg)
 				break;
 			}
 
-			// check to prevent double execution
-			if (id > m_lastReceivedReliableCommand)
+			// check to prevent double execution - commands the game thread can't take yet don't get acknowledged,
+			// so the server will send them again
+			if (id > m_lastReceivedReliableCommand && !incomingMessagesFull && msgType == NET_MSG_ROUTE_BASELINE)
 			{
-				HandleReliableCommand(msgType, reliableBuf, size);
+				// these are needed for decoding routed packets right here, the game never gets to see them
+				if (!m_routeDecoder.AddBaseline(reinterpret_cast<const uint8_t*>(reliableBuf), size))
+				{
+					trace("invalid msgRouteBaseline\n");
+				}
 
 				m_lastReceivedReliableCommand = id;
 			}
+			else if (id > m_lastReceivedReliableCommand && !incomingMessagesFull)
+			{
+				ServerMessage message;
+				message.outOfBand = false;
+				message.type = msgType;
+				message.payload = std::string(reliableBuf, size);
+				message.receivedAt = GetMicroseconds();
+
+				if (m_incomingMessages.TryPush(std::move(message)))
+				{
+					m_lastReceivedReliableCommand = id;
+				}
+				else
+				{
+					incomingMessagesFull = true;
+				}
+			}
 
 			delete[] reliableBuf;
 
@@ -232,34 +320,22 @@ void NetLibrary::ProcessServerMessage(NetBuffer& msg)
 
 bool NetLibrary::WaitForRoutedPacket(uint32_t timeout)
 {
+	if (!m_incomingPackets.IsEmpty())
 	{
-		std::lock_guard<std::mutex> guard(m_incomingPacketMutex);
-
-		if (!m_incomingPackets.empty())
-		{
-			return true;
-		}
+		return true;
 	}
 
 	WaitForSingleObject(m_receiveEvent, timeout);
 
-	{
-		std::lock_guard<std::mutex> guard(m_incomingPacketMutex);
-
-		return (!m_incomingPackets.empty());
-	}
+	return (!m_incomingPackets.IsEmpty());
 }
 
-void NetLibrary::EnqueueRoutedPacket(uint16_t netID, std::string packet)
+void NetLibrary::EnqueueRoutedPacket(uint16_t netID, const char* buffer, size_t length)
 {
+	// routed packets are unreliable anyway, so rather lose some than hold up everything else - the ring counts them
+	if (!m_incomingPackets.TryPush(netID, buffer, length, GetMicroseconds()))
 	{
-		std::lock_guard<std::mutex> guard(m_incomingPacketMutex);
-
-		RoutingPacket routePacket;
-		routePacket.netID = netID;
-		routePacket.payload = packet;
-
-		m_incomingPackets.push(routePacket);
+		return;
 	}
 
 	SetEvent(m_receiveEvent);
@@ -267,34 +343,76 @@ void NetLibrary::EnqueueRoutedPacket(uint16_t netID, std::string packet)
 
 bool NetLibrary::DequeueRoutedPacket(char* buffer, size_t* length, uint16_t* netID)
 {
-	{
-		std::lock_guard<std::mutex> guard(m_incomingPacketMutex);
+	// the packet ring only supports a single consumer
+	std::thread::id consumer;
+	m_routedPacketConsumer.compare_exchange_strong(consumer, std::this_thread::get_id());
 
-		if (m_incomingPackets.empty())
-		{
-			return false;
-		}
+	assert(consumer == std::thread::id() || consumer == std::this_thread::get_id());
 
-		auto packet = m_incomingPackets.front();
-		m_incomingPackets.pop();
+	auto packet = m_incomingPackets.Peek();
 
-		memcpy(buffer, packet.payload.c_str(), packet.payload.size());
-		*netID = packet.netID;
-		*length = packet.payload.size();
+	if (!packet)
+	{
+		return false;
 	}
 
+	memcpy(buffer, packet->data, packet->length);
+	*netID = packet->tag;
+	*length = packet->length;
+
+	uint32_t receivedAt = packet->time;
+
+	m_incomingPackets.Pop();
+
 	ResetEvent(m_receiveEvent);
 
+	ReportQueuedMessage(NET_QUEUE_ROUTED_PACKETS, m_incomingPackets.GetSize(), receivedAt);
+
 	return true;
 }
 
+void NetLibrary::ReportQueuedMessage(NetQueueType queue, size_t depth, uint32_t receivedAt)
+{
+	m_metrics->Record(net::ConnectionMetric::QueueDepth, depth);
+
+	if (m_metricSink.GetRef())
+	{
+		m_metricSink->OnQueuedMessage(queue, static_cast<uint32_t>(depth), GetMicroseconds() - receivedAt);
+	}
+}
+
+void NetLibrary::ProcessMessages()
+{
+	ServerMessage message;
+
+	while (m_incomingMessages.TryPop(message))
+	{
+		ReportQueuedMessage(NET_QUEUE_SERVER_MESSAGES, m_incomingMessages.GetSize(), message.receivedAt);
+
+		if (message.outOfBand)
+		{
+			ProcessOOB(message.from, &message.payload[0], message.payload.size());
+		}
+		else
+		{
+			HandleReliableCommand(message.type, message.payload.c_str(), message.payload.size());
+		}
+	}
+}
+
 void NetLibrary::RoutePacket(const char* buffer, size_t length, uint16_t netID)
 {
-	RoutingPacket routePacket;
-	routePacket.netID = netID;
-	routePacket.payload = std::string(buffer, length);
+	if (!m_outgoingPackets.TryPush(netID, buffer, length, GetMicroseconds()))
+	{
+		return;
+	}
 
-	m_outgoingPackets.push(routePacket);
+	// get the network thread to flush these before they run out - producers racing past the threshold only need to
+	// signal it once
+	if (m_outgoingPackets.GetSize() >= (ROUTED_PACKET_SLOTS / 2) && !m_routeWakePending.exchange(true))
+	{
+		SetEvent(m_networkWakeEvent);
+	}
 }
 
 void NetLibrary::ProcessOOB(NetAddress& from, char* oob, size_t length)
@@ -318,12 +436,14 @@ void NetLibrary::ProcessOOB(NetAddress& from, char* oob, size_t length)
 			m_hostNetID = atoi(hostIDStr);
 			m_hostBase = atoi(hostBaseStr);
 
-			m_lastReceivedReliableCommand = 0;
-
 			trace("connectOK, our id %d, host id %d\n", m_serverNetID, m_hostNetID);
 
 			OnConnectOKReceived(m_currentServer);
 
+			std::lock_guard<std::mutex> lock(m_networkMutex);
+
+			m_lastReceivedReliableCommand = 0;
+
 			m_netChannel.Reset(m_currentServer, this);
 			m_connectionState = CS_CONNECTED;
 		}
@@ -365,33 +485,41 @@ void NetLibrary::SetMetricSink(fwRefContainer<INetMetricSink>& sink)
 
 void NetLibrary::HandleReliableCommand(uint32_t msgType, const char* buf, size_t length)
 {
-	auto range = m_reliableHandlers.equal_range(msgType);
-
-	std::for_each(range.first, range.second, [&] (std::pair<uint32_t, ReliableHandlerType> handler)
-	{
-		handler.second(buf, length);
-	});
+	m_reliableHandlers.Dispatch(msgType, buf, length);
 }
 
-NetLibrary::RoutingPacket::RoutingPacket()
-{
-	//genTime = timeGetTime();
-	genTime = 0;
-}
 
 void NetLibrary::ProcessSend()
 {
+	// take over whatever reliable commands the game queued
+	OutgoingCommand outgoingCommand;
+
+	while (m_outgoingCommands.TryPop(outgoingCommand))
+	{
+		m_outReliableCommands.Push(outgoingCommand.type, outgoingCommand.command.c_str(), outgoingCommand.command.size());
+	}
+
+	m_unacknowledgedCommands = m_outReliableCommands.GetUnacknowledgedCount();
+
 	// is it time to send a packet yet?
 	bool continueSend = false;
 
 /*	if (GameFlags::GetFlag(GameFlag::InstantSendPackets))
 	{
-		if (!m_outgoingPackets.empty())
+		if (!m_outgoingPackets.IsEmpty())
 		{
 			continueSend = true;
 		}
 	}*/
 
+	// anything routed from here on gets to wake us up again
+	m_routeWakePending = false;
+
+	if (m_outgoingPackets.GetSize() >= (ROUTED_PACKET_SLOTS / 2))
+	{
+		continueSend = true;
+	}
+
 	if (!continueSend)
 	{
 		uint32_t diff = timeGetTime() - m_lastSend;
@@ -416,8 +544,13 @@ void NetLibrary::ProcessSend()
 	// metrics
 	NetPacketMetrics metrics;
 
+	// the oldest reliable command always gets room on top of the routed data, so neither a busy route queue nor a
+	// command larger than the packet can hold up every command queued after it
+	size_t reliableHeadSize = m_outReliableCommands.GetHeadWireSize();
+	size_t reliableReserved = RELIABLE_RESERVED_BYTES + reliableHeadSize;
+
 	// build a nice packet
-	NetBuffer msg(24000);
+	NetBuffer msg(24000 + reliableHeadSize);
 
 	msg.Write(m_lastReceivedReliableCommand);
 
@@ -426,46 +559,56 @@ void NetLibrary::ProcessSend()
 		msg.Write(m_lastFrameNumber);
 	}
 
-	RoutingPacket packet;
-
-	while (m_outgoingPackets.try_pop(packet))
+	if (m_routeDeltaEnabled)
 	{
-		msg.Write(0xE938445B); // msgRoute
-		msg.Write(packet.netID);
-		msg.Write<uint16_t>(packet.payload.size());
-
-		//trace("sending msgRoute to %d len %d\n", packet.netID, packet.payload.size());
+		WriteRouteDeltaBatch(msg, reliableReserved, metrics);
+	}
+	else
+	{
+		while (auto packet = m_outgoingPackets.Peek())
+		{
+			// whatever doesn't fit waits for the next packet
+			if (msg.GetCurLength() + packet->length + 8 + reliableReserved > msg.GetLength())
+			{
+				break;
+			}
 
-		msg.Write(packet.payload.c_str(), packet.payload.size());
+			WriteRoutePacket(msg, packet->tag, packet->data, packet->length, metrics);
 
-		metrics.AddElementSize(NET_PACKET_SUB_ROUTED_MESSAGES, packet.payload.size() + 2 + 2 + 4);
+			m_outgoingPackets.Pop();
+		}
 	}
 
-	// send pending reliable commands
-	for (auto& command : m_outReliableCommands)
+	// send pending reliable commands, in whatever space routed packets left over
+	size_t reliableSpace = msg.GetLength() - std::min(msg.GetLength(), msg.GetCurLength() + RELIABLE_RESERVED_BYTES);
+
+	std::vector<const ReliableCommandWindow::Command*> reliableCommands;
+	m_outReliableCommands.GetCommandsToSend(timeGetTime(), std::min<size_t>(RELIABLE_BYTES_PER_PACKET, reliableSpace), reliableSpace, reliableCommands);
+
+	for (auto command : reliableCommands)
 	{
-		msg.Write(command.type);
+		msg.Write(command->type);
 
-		if (command.command.size() > UINT16_MAX)
+		if (command->command.size() > UINT16_MAX)
 		{
-			msg.Write(command.id | 0x80000000);
+			msg.Write(command->id | 0x80000000);
 
-			msg.Write<uint32_t>(command.command.size());
+			msg.Write<uint32_t>(command->command.size());
 
 			metrics.AddElementSize(NET_PACKET_SUB_RELIABLES, 4);
 		}
 		else
 		{
-			msg.Write(command.id);
+			msg.Write(command->id);
 
-			msg.Write<uint16_t>(command.command.size());
+			msg.Write<uint16_t>(command->command.size());
 
 			metrics.AddElementSize(NET_PACKET_SUB_RELIABLES, 2);
 		}
 
-		msg.Write(command.command.c_str(), command.command.size());
+		msg.Write(command->command.c_str(), command->command.size());
 
-		metrics.AddElementSize(NET_PACKET_SUB_RELIABLES, command.command.size() + 8);
+		metrics.AddElementSize(NET_PACKET_SUB_RELIABLES, command->command.size() + 8);
 	}
 
 	// FIXME: REPLACE HARDCODED STUFF
@@ -475,11 +618,38 @@ void NetLibrary::ProcessSend()
 		msg.Write(m_serverBase);
 	}*/
 
-	OnBuildMessage(msg);
+	// whatever OnBuildMessage handlers wrote, as of the latest game frame
+	std::string builtMessage;
+
+	while (m_builtMessages.TryPop(builtMessage))
+	{
+		m_builtMessage = std::move(builtMessage);
+	}
+
+	msg.Write(m_builtMessage.c_str(), m_builtMessage.size());
 
 	msg.Write(0xCA569E63); // msgEnd
 
-	m_netChannel.Send(msg);
+	size_t datagrams;
+
+	if (m_compressionEnabled)
+	{
+		size_t compressedLength;
+		const char* compressed = m_compressor.Compress(msg.GetBuffer(), msg.GetCurLength(), &compressedLength);
+
+		NetBuffer compressedMsg(compressedLength);
+		compressedMsg.Write(compressed, compressedLength);
+
+		datagrams = m_netChannel.Send(compressedMsg);
+
+		metrics.SetCompressedSize(compressedLength);
+	}
+	else
+	{
+		datagrams = m_netChannel.Send(msg);
+	}
+
+	m_metrics->Record(net::ConnectionMetric::FragmentCount, datagrams);
 
 	m_lastSend = timeGetTime();
 
@@ -489,53 +659,139 @@ void NetLibrary::ProcessSend()
 	}
 }
 
-void NetLibrary::SendReliableCommand(const char* type, const char* buffer, size_t length)
+void NetLibrary::BuildMessage()
 {
-	uint32_t unacknowledged = m_outReliableSequence - m_outReliableAcknowledged;
-
-	if (unacknowledged > MAX_RELIABLE_COMMANDS)
+	if (m_connectionState != CS_ACTIVE)
 	{
-		GlobalError("Reliable client command overflow.");
+		return;
 	}
 
-	m_outReliableSequence++;
+	// leave room for msgEnd
+	NetBuffer msg(RELIABLE_RESERVED_BYTES - 4);
 
-	OutReliableCommand cmd;
-	cmd.type = HashRageString(type);
-	cmd.id = m_outReliableSequence;
-	cmd.command = std::string(buffer, length);
+	OnBuildMessage(msg);
 
-	m_outReliableCommands.push_back(cmd);
+	// the network thread will keep using the last one it got until this one gets through
+	m_builtMessages.TryPush(std::string(msg.GetBuffer(), msg.GetCurLength()));
 }
 
-static std::string g_disconnectReason;
+void NetLibrary::WriteRoutePacket(NetBuffer& msg, uint16_t netID, const uint8_t* data, size_t length, NetPacketMetrics& metrics)
+{
+	msg.Write(0xE938445B); // msgRoute
+	msg.Write(netID);
+	msg.Write<uint16_t>(length);
 
-static std::mutex g_netFrameMutex;
+	//trace("sending msgRoute to %d len %d\n", netID, length);
 
-void NetLibrary::PreProcessNativeNet()
+	msg.Write(data, length);
+
+	metrics.AddElementSize(NET_PACKET_SUB_ROUTED_MESSAGES, length + 2 + 2 + 4);
+}
+
+void NetLibrary::WriteRouteDeltaBatch(NetBuffer& msg, size_t reserved, NetPacketMetrics& metrics)
 {
-	if (!g_netFrameMutex.try_lock())
+	m_routeBatch.clear();
+
+	while (auto packet = m_outgoingPackets.Peek())
+	{
+		// leave room for the msgRouteDelta header
+		size_t space = msg.GetLength() - std::min(msg.GetLength(), msg.GetCurLength() + 6 + reserved);
+		space = std::min<size_t>(space, UINT16_MAX);
+
+		size_t length;
+		const uint8_t* entry = m_routeEncoder.Encode(packet->tag, packet->data, packet->length, &length);
+
+		if (entry)
+		{
+			// whatever doesn't fit waits for the next packet
+			if (m_routeBatch.size() + length > space)
+			{
+				break;
+			}
+
+			m_routeBatch.insert(m_routeBatch.end(), entry, entry + length);
+		}
+		else
+		{
+			// packets the encoder couldn't handle go out as a plain msgRoute, after the batch so far to keep them in order
+			if (m_routeBatch.size() + packet->length + 8 > space)
+			{
+				break;
+			}
+
+			FlushRouteDeltaBatch(msg, metrics);
+			WriteRoutePacket(msg, packet->tag, packet->data, packet->length, metrics);
+		}
+
+		// baselines only get used once the server acknowledged them, so they go along with the reliable commands
+		if (m_routeEncoder.WantsBaseline(packet->tag) && m_outReliableCommands.GetUnacknowledgedCount() < MAX_ROUTE_BASELINE_WINDOW)
+		{
+			auto& baseline = m_routeEncoder.CreateBaseline(packet->tag, packet->data, packet->length);
+			uint32_t id = m_outReliableCommands.Push(NET_MSG_ROUTE_BASELINE, reinterpret_cast<const char*>(baseline.data()), baseline.size());
+
+			m_routeEncoder.SetBaselineCommand(packet->tag, id);
+		}
+
+		m_outgoingPackets.Pop();
+	}
+
+	FlushRouteDeltaBatch(msg, metrics);
+}
+
+void NetLibrary::FlushRouteDeltaBatch(NetBuffer& msg, NetPacketMetrics& metrics)
+{
+	if (m_routeBatch.empty())
 	{
 		return;
 	}
 
-	ProcessPackets();
+	msg.Write(NET_MSG_ROUTE_DELTA);
+	msg.Write<uint16_t>(m_routeBatch.size());
+	msg.Write(m_routeBatch.data(), m_routeBatch.size());
 
-	g_netFrameMutex.unlock();
+	metrics.AddElementSize(NET_PACKET_SUB_ROUTED_MESSAGES, m_routeBatch.size() + 2 + 4);
+
+	m_routeBatch.clear();
 }
 
-void NetLibrary::PostProcessNativeNet()
+void NetLibrary::SendReliableCommand(const char* type, const char* buffer, size_t length)
+{
+	if (m_unacknowledgedCommands + m_outgoingCommands.GetSize() > MAX_RELIABLE_COMMANDS)
+	{
+		GlobalError("Reliable client command overflow.");
+	}
+
+	OutgoingCommand command;
+	command.type = HashRageString(type);
+	command.command = std::string(buffer, length);
+
+	if (!m_outgoingCommands.TryPush(std::move(command)))
+	{
+		GlobalError("Reliable client command overflow.");
+	}
+}
+
+static std::string g_disconnectReason;
+
+static std::mutex g_netFrameMutex;
+
+void NetLibrary::PreProcessNativeNet()
 {
 	if (!g_netFrameMutex.try_lock())
 	{
 		return;
 	}
 
-	ProcessSend();
+	ProcessMessages();
 
 	g_netFrameMutex.unlock();
 }
 
+void NetLibrary::PostProcessNativeNet()
+{
+	// packets get sent from the network thread
+}
+
 void NetLibrary::RunFrame()
 {
 	if (!g_netFrameMutex.try_lock())
@@ -543,9 +799,9 @@ void NetLibrary::RunFrame()
 		return;
 	}
 
-	ProcessPackets();
+	ProcessMessages();
 
-	ProcessSend();
+	BuildMessage();
 
 	switch (m_connectionState)
 	{
@@ -625,15 +881,49 @@ void NetLibrary::ConnectToServer(const char* hostname, uint16_t port)
 		Disconnect("Bye!");
 	}
 
-	m_connectionState = CS_INITING;
-	m_currentServer = NetAddress(hostname, port);
+	{
+		std::lock_guard<std::mutex> lock(m_networkMutex);
+
+		m_connectionState = CS_INITING;
+		m_currentServer = NetAddress(hostname, port);
 
-	m_outReliableAcknowledged = 0;
-	m_outSequence = 0;
-	m_lastReceivedReliableCommand = 0;
-	m_outReliableCommands.clear();
+		m_outSequence = 0;
+		m_lastReceivedReliableCommand = 0;
+		m_outReliableCommands.Reset();
 
-	m_lastFrameNumber = 0;
+		m_lastFrameNumber = 0;
+
+		m_compressionEnabled = false;
+		m_compressor.SetDictionary(std::vector<uint8_t>());
+
+		m_routeDeltaEnabled = false;
+		m_routeEncoder.Reset();
+		m_routeDecoder.Reset();
+
+		// anything still queued belongs to the last connection - the network thread can't be using either queue
+		// while we hold the lock, so emptying the one it reads from is fine as well
+		ServerMessage message;
+
+		while (m_incomingMessages.TryPop(message))
+		{
+		}
+
+		OutgoingCommand command;
+
+		while (m_outgoingCommands.TryPop(command))
+		{
+		}
+
+		std::string builtMessage;
+
+		while (m_builtMessages.TryPop(builtMessage))
+		{
+		}
+
+		m_builtMessage.clear();
+
+		m_unacknowledgedCommands = 0;
+	}
 
 	wchar_t wideHostname[256];
 	mbstowcs(wideHostname, hostname, _countof(wideHostname) - 1);
@@ -646,6 +936,8 @@ void NetLibrary::ConnectToServer(const char* hostname, uint16_t port)
 	postMap["method"] = "initConnect";
 	postMap["name"] = GetPlayerName();
 	postMap["protocol"] = va("%d", NETWORK_PROTOCOL);
+	postMap["compression"] = "deflate";
+	postMap["routeDelta"] = "xor-rle";
 
 	TerminalClient* clientContainer = Instance<TerminalClient>::Get();
 	auto client = clientContainer->GetClient();
@@ -718,6 +1010,37 @@ void NetLibrary::ConnectToServer(const char* hostname, uint16_t port)
 
 			m_serverProtocol = node["protocol"].as<uint32_t>();
 
+			// servers not knowing about compression won't reply with anything here
+			if (node["compression"].IsDefined() && node["compression"].as<std::string>() == "deflate")
+			{
+				std::lock_guard<std::mutex> lock(m_networkMutex);
+
+				if (node["compressionDictionary"].IsDefined())
+				{
+					std::string dictionaryEncoded = node["compressionDictionary"].as<std::string>();
+
+					size_t dictionaryLength;
+					uint8_t* dictionary = base64_decode(dictionaryEncoded.c_str(), dictionaryEncoded.size(), &dictionaryLength);
+
+					if (dictionary)
+					{
+						m_compressor.SetDictionary(std::vector<uint8_t>(dictionary, dictionary + dictionaryLength));
+
+						free(dictionary);
+					}
+				}
+
+				m_compressionEnabled = true;
+			}
+
+			// likewise for delta-encoding routed packets
+			if (node["routeDelta"].IsDefined() && node["routeDelta"].as<std::string>() == "xor-rle")
+			{
+				std::lock_guard<std::mutex> lock(m_networkMutex);
+
+				m_routeDeltaEnabled = true;
+			}
+
 			m_connectionState = CS_INITRECEIVED;
 		}
 		catch (YAML::Exception&)
@@ -743,11 +1066,18 @@ void NetLibrary::FinalizeDisconnect()
 	{
 		SendReliableCommand("msgIQuit", g_disconnectReason.c_str(), g_disconnectReason.length() + 1);
 
-		m_lastSend = 0;
-		ProcessSend();
+		{
+			std::lock_guard<std::mutex> lock(m_networkMutex);
+
+			// there's no waiting for acknowledgements here, so send everything twice right away
+			m_lastSend = 0;
+			m_outReliableCommands.ExpireFlight();
+			ProcessSend();
 
-		m_lastSend = 0;
-		ProcessSend();
+			m_lastSend = 0;
+			m_outReliableCommands.ExpireFlight();
+			ProcessSend();
+		}
 
 		OnFinalizeDisconnect(m_currentServer);
 		//GameFlags::ResetFlags();
@@ -755,6 +1085,8 @@ void NetLibrary::FinalizeDisconnect()
 		//TheResources.CleanUp();
 		//TheDownloads.ReleaseLastServer();
 
+		std::lock_guard<std::mutex> lock(m_networkMutex);
+
 		m_connectionState = CS_IDLE;
 		m_currentServer = NetAddress();
 
@@ -810,6 +1142,23 @@ void NetLibrary::CreateResources()
 	m_httpClient = new HttpClient();
 	//m_httpClient = new HttpClient();
 
+	// start the network thread, waking up whenever either socket has something to read
+	m_socketEvent = WSACreateEvent();
+	WSAEventSelect(m_socket, m_socketEvent, FD_READ);
+
+	if (m_socket6 != INVALID_SOCKET)
+	{
+		WSAEventSelect(m_socket6, m_socketEvent, FD_READ);
+	}
+
+	m_networkWakeEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+
+	m_networkThreadRunning = true;
+	m_networkThread = std::thread([=] ()
+	{
+		RunNetworkThread();
+	});
+
 	// TEMPTEMP
 	/*uint8_t out[1024];
 	uint8_t in[] = { 0x19, 0x00, 0xF7, 0x03, 0xC7, 0x40, 0x00, 0x02, 0x00, 0x01, 0xB4, 0x8D, 0xFD, 0x94, 0x8D, 0xAD, 0x03, 0xC5, 0xC0, 0xE4, 0x00, 0xB0, 0xF0, 0xDA, 0x30, 0xDA, 0x4D, 0x03, 0xC7, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0xB0, 0x53, 0xF0, 0x54, 0x0D };
@@ -889,6 +1238,8 @@ void NetLibrary::SendData(NetAddress& address, const char* data, size_t length)
 	int addrLen;
 	address.GetSockAddr(&addr, &addrLen);
 
+	m_metrics->Record(net::ConnectionMetric::OutgoingPacketSize, length);
+
 	if (addr.ss_family == AF_INET)
 	{
 		sendto(m_socket, data, length, 0, (sockaddr*)&addr, addrLen);
@@ -903,7 +1254,7 @@ void NetLibrary::AddReliableHandler(const char* type, ReliableHandlerType functi
 {
 	uint32_t hash = HashRageString(type);
 
-	m_reliableHandlers.insert(std::make_pair(hash, function));
+	m_reliableHandlers.Register(hash, std::move(function));
 }
 
 void NetLibrary::DownloadsComplete()
@@ -962,12 +1313,59 @@ void NetLibrary::SendNetEvent(fwString eventName, fwString jsonString, int i)
 }*/
 
 NetLibrary::NetLibrary()
-	: m_serverNetID(0), m_serverBase(0), m_hostBase(0), m_hostNetID(0), m_connectionState(CS_IDLE),
-	  m_tempGuid(0), m_lastConnect(0), m_lastSend(0), m_outSequence(0), m_lastReceivedReliableCommand(0), m_outReliableAcknowledged(0), m_outReliableSequence(0),
-	  m_lastReceivedAt(0)
+	: m_serverNetID(0), m_hostNetID(0), m_serverBase(0), m_hostBase(0), m_connectionState(CS_IDLE),
+	  m_tempGuid(0), m_lastConnect(0), m_lastSend(0), m_outSequence(0), m_lastReceivedReliableCommand(0),
+	  m_compressionEnabled(false), m_routeDeltaEnabled(false), m_lastReceivedAt(0), m_networkThreadRunning(false), m_routeWakePending(false),
+	  m_unacknowledgedCommands(0), m_routedPacketConsumer(std::thread::id())
 
 {
 	m_receiveEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+	m_metrics = Instance<net::MetricsRegistry>::Get()->CreateConnection("server");
+	m_outReliableCommands.SetMetrics(m_metrics);
+}
+
+NetLibrary::~NetLibrary()
+{
+	if (m_networkThread.joinable())
+	{
+		m_networkThreadRunning = false;
+		SetEvent(m_networkWakeEvent);
+
+		m_networkThread.join();
+	}
+
+	Instance<net::MetricsRegistry>::Get()->RemoveConnection(m_metrics);
+}
+
+void NetLibrary::RunNetworkThread()
+{
+	SetThreadName(-1, "[Net] Network Thread");
+
+	WSAEVENT events[] = { m_socketEvent, m_networkWakeEvent };
+
+	while (m_networkThreadRunning)
+	{
+		DWORD timeout;
+
+		// reset first, so anything arriving while we're busy wakes us up again right away
+		WSAResetEvent(m_socketEvent);
+
+		{
+			std::lock_guard<std::mutex> lock(m_networkMutex);
+
+			ProcessPackets();
+
+			ProcessSend();
+
+			// until the next packet is due to be sent, or something comes in
+			uint32_t sinceSend = timeGetTime() - m_lastSend;
+
+			timeout = (sinceSend < (1000 / 60)) ? ((1000 / 60) - sinceSend) : (1000 / 60);
+		}
+
+		WSAWaitForMultipleEvents(_countof(events), events, FALSE, timeout, FALSE);
+	}
 }
 
 __declspec(dllexport) fwEvent<NetLibrary*> NetLibrary::OnNetLibraryCreate;
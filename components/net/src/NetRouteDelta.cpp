@@ -0,0 +1,320 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "NetRouteDelta.h"
+
+// baselines waiting for an acknowledgement at once, as each one takes up space in the reliable command window
+static const size_t kMaxPendingBaselines = 4;
+
+// packets encoding to more than 1/kBaselineRatio of their size ask for a new baseline
+static const size_t kBaselineRatio = 2;
+
+// unchanged runs shorter than this are cheaper to send as changed bytes than to split the run for
+static const size_t kMinUnchangedRun = 3;
+
+static const size_t kMaxPayloadLength = UINT16_MAX;
+
+// bytes past the end of the baseline count as zero
+static inline uint8_t GetBaselineByte(const std::vector<uint8_t>& baseline, size_t offset)
+{
+	return (offset < baseline.size()) ? baseline[offset] : 0;
+}
+
+NetRouteDeltaEncoder::NetRouteDeltaEncoder()
+{
+	Reset();
+}
+
+void NetRouteDeltaEncoder::Reset()
+{
+	m_streams.clear();
+	m_pendingBaselines = 0;
+}
+
+const uint8_t* NetRouteDeltaEncoder::Encode(uint16_t netID, const uint8_t* data, size_t length, size_t* outLength)
+{
+	auto it = m_streams.find(netID);
+
+	if (it == m_streams.end())
+	{
+		Stream stream;
+		stream.index = 0;
+		stream.pendingIndex = 0;
+		stream.pendingCommand = 0;
+		stream.nextIndex = 1;
+
+		it = m_streams.emplace(netID, std::move(stream)).first;
+	}
+
+	Stream& stream = it->second;
+	const std::vector<uint8_t>& baseline = stream.data;
+
+	// a run header never costs more than the bytes it replaces, bar a few at the start
+	m_encodeBuffer.resize(length + 32);
+
+	net::BufferWriter writer(m_encodeBuffer.data(), m_encodeBuffer.size());
+	writer.WriteVarInt(netID);
+	writer.WriteVarInt(stream.index);
+	writer.WriteVarInt(length);
+
+	size_t headerLength = writer.GetLength();
+	size_t offset = 0;
+
+	while (offset < length)
+	{
+		size_t unchanged = 0;
+
+		while (offset + unchanged < length && data[offset + unchanged] == GetBaselineByte(baseline, offset + unchanged))
+		{
+			unchanged++;
+		}
+
+		size_t changedStart = offset + unchanged;
+		size_t changedEnd = changedStart;
+
+		// extend the changed run over short unchanged stretches
+		while (changedEnd < length)
+		{
+			size_t run = 0;
+
+			while (changedEnd + run < length && run < kMinUnchangedRun && data[changedEnd + run] == GetBaselineByte(baseline, changedEnd + run))
+			{
+				run++;
+			}
+
+			if (run == kMinUnchangedRun || changedEnd + run == length)
+			{
+				break;
+			}
+
+			changedEnd += run + 1;
+		}
+
+		writer.WriteVarInt(unchanged);
+		writer.WriteVarInt(changedEnd - changedStart);
+
+		for (size_t i = changedStart; i < changedEnd; i++)
+		{
+			writer.Write<uint8_t>(data[i] ^ GetBaselineByte(baseline, i));
+		}
+
+		offset = changedEnd;
+	}
+
+	stream.lastLength = length;
+
+	// should an entry not fit the buffer after all, the payload has to go out as it is - and a new baseline might do better
+	if (writer.IsOverflowed())
+	{
+		stream.lastEncodedLength = length;
+
+		*outLength = 0;
+		return nullptr;
+	}
+
+	stream.lastEncodedLength = writer.GetLength() - headerLength;
+
+	*outLength = writer.GetLength();
+	return m_encodeBuffer.data();
+}
+
+bool NetRouteDeltaEncoder::WantsBaseline(uint16_t netID) const
+{
+	auto it = m_streams.find(netID);
+
+	if (it == m_streams.end() || it->second.pendingIndex != 0 || m_pendingBaselines >= kMaxPendingBaselines)
+	{
+		return false;
+	}
+
+	const Stream& stream = it->second;
+
+	return (stream.lastEncodedLength * kBaselineRatio > stream.lastLength);
+}
+
+const std::vector<uint8_t>& NetRouteDeltaEncoder::CreateBaseline(uint16_t netID, const uint8_t* data, size_t length)
+{
+	Stream& stream = m_streams[netID];
+
+	if (stream.pendingIndex == 0)
+	{
+		m_pendingBaselines++;
+	}
+
+	stream.pendingIndex = stream.nextIndex;
+	stream.pendingCommand = 0;
+	stream.pendingData.assign(data, data + length);
+
+	stream.nextIndex++;
+
+	if (stream.nextIndex == 0)
+	{
+		stream.nextIndex = 1;
+	}
+
+	m_baselineBuffer.resize(length + 16);
+
+	net::BufferWriter writer(m_baselineBuffer.data(), m_baselineBuffer.size());
+	writer.WriteVarInt(netID);
+	writer.WriteVarInt(stream.pendingIndex);
+	writer.Write(data, length);
+
+	m_baselineBuffer.resize(writer.GetLength());
+
+	return m_baselineBuffer;
+}
+
+void NetRouteDeltaEncoder::SetBaselineCommand(uint16_t netID, uint32_t commandId)
+{
+	auto it = m_streams.find(netID);
+
+	if (it != m_streams.end())
+	{
+		it->second.pendingCommand = commandId;
+	}
+}
+
+void NetRouteDeltaEncoder::Acknowledge(uint32_t acknowledged)
+{
+	if (m_pendingBaselines == 0)
+	{
+		return;
+	}
+
+	for (auto& entry : m_streams)
+	{
+		Stream& stream = entry.second;
+
+		if (stream.pendingIndex != 0 && stream.pendingCommand != 0 && static_cast<int32_t>(acknowledged - stream.pendingCommand) >= 0)
+		{
+			stream.index = stream.pendingIndex;
+			stream.data = std::move(stream.pendingData);
+
+			stream.pendingIndex = 0;
+			stream.pendingCommand = 0;
+			stream.pendingData.clear();
+
+			m_pendingBaselines--;
+		}
+	}
+}
+
+NetRouteDeltaDecoder::NetRouteDeltaDecoder()
+	: m_decodeBuffer(kMaxPayloadLength)
+{
+
+}
+
+void NetRouteDeltaDecoder::Reset()
+{
+	m_baselines.clear();
+}
+
+bool NetRouteDeltaDecoder::AddBaseline(const uint8_t* data, size_t length)
+{
+	net::BufferView view(data, length);
+
+	uint64_t netID = view.ReadVarInt();
+	uint64_t index = view.ReadVarInt();
+
+	if (view.IsOverrun() || netID > UINT16_MAX || index == 0 || index > UINT32_MAX || view.GetRemainingBytes() > kMaxPayloadLength)
+	{
+		return false;
+	}
+
+	auto& baselines = m_baselines[static_cast<uint16_t>(netID)];
+
+	// the newest one goes first
+	baselines[1] = std::move(baselines[0]);
+
+	baselines[0].index = static_cast<uint32_t>(index);
+	baselines[0].data.assign(data + view.GetCurOffset(), data + length);
+
+	return true;
+}
+
+bool NetRouteDeltaDecoder::Decode(net::BufferView& view, uint16_t* netID, const uint8_t** data, size_t* length)
+{
+	uint64_t entryNetID = view.ReadVarInt();
+	uint64_t index = view.ReadVarInt();
+	uint64_t entryLength = view.ReadVarInt();
+
+	if (view.IsOverrun() || entryNetID > UINT16_MAX || entryLength > kMaxPayloadLength)
+	{
+		return false;
+	}
+
+	static const std::vector<uint8_t> emptyBaseline;
+	const std::vector<uint8_t>* baseline = &emptyBaseline;
+
+	bool haveBaseline = (index == 0);
+
+	if (index != 0)
+	{
+		auto it = m_baselines.find(static_cast<uint16_t>(entryNetID));
+
+		if (it != m_baselines.end())
+		{
+			for (auto& candidate : it->second)
+			{
+				if (candidate.index == index)
+				{
+					baseline = &candidate.data;
+					haveBaseline = true;
+
+					break;
+				}
+			}
+		}
+	}
+
+	// runs get read even without the baseline, to get to the next entry
+	size_t offset = 0;
+
+	while (offset < entryLength)
+	{
+		uint64_t unchanged = view.ReadVarInt();
+		uint64_t changed = view.ReadVarInt();
+
+		if (view.IsOverrun() || unchanged > entryLength - offset || changed > entryLength - offset - unchanged)
+		{
+			return false;
+		}
+
+		// nothing but an empty run would never get anywhere
+		if (unchanged == 0 && changed == 0)
+		{
+			return false;
+		}
+
+		for (size_t i = offset; i < offset + unchanged; i++)
+		{
+			m_decodeBuffer[i] = GetBaselineByte(*baseline, i);
+		}
+
+		offset += unchanged;
+
+		if (!view.Read(m_decodeBuffer.data() + offset, changed))
+		{
+			return false;
+		}
+
+		for (size_t i = offset; i < offset + changed; i++)
+		{
+			m_decodeBuffer[i] ^= GetBaselineByte(*baseline, i);
+		}
+
+		offset += changed;
+	}
+
+	*netID = static_cast<uint16_t>(entryNetID);
+	*data = (haveBaseline) ? m_decodeBuffer.data() : nullptr;
+	*length = static_cast<size_t>(entryLength);
+
+	return true;
+}
@@ -0,0 +1,210 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "ReliableCommandWindow.h"
+
+// until we've got an RTT sample, assume a slow-ish connection
+static const uint32_t kInitialRetransmitTimeout = 500;
+
+// the server only acknowledges once per server frame, so there's no point in going much lower
+static const uint32_t kMinRetransmitTimeout = 100;
+
+static const uint32_t kMaxRetransmitTimeout = 3000;
+
+static const uint32_t kMaxBackoff = 4;
+
+// outstanding flights this small get new commands added right away instead of making them wait for the acknowledgement,
+// as sending them again costs next to nothing
+static const size_t kExtendFlightBytes = 1200;
+
+ReliableCommandWindow::ReliableCommandWindow()
+{
+	Reset();
+}
+
+void ReliableCommandWindow::Reset()
+{
+	m_commands.clear();
+
+	m_outSequence = 0;
+	m_acknowledged = 0;
+
+	m_flightEnd = 0;
+	m_flightSendTime = 0;
+	m_flightRetries = 0;
+	m_flightExpired = false;
+
+	m_hasRttSample = false;
+	m_smoothedRtt = 0.0;
+	m_rttVariance = 0.0;
+
+	memset(&m_statistics, 0, sizeof(m_statistics));
+}
+
+uint32_t ReliableCommandWindow::Push(uint32_t type, const char* buffer, size_t length)
+{
+	Command command;
+	command.id = ++m_outSequence;
+	command.type = type;
+	command.command = std::string(buffer, length);
+	command.sendCount = 0;
+	command.sendTime = 0;
+
+	m_commands.push_back(std::move(command));
+
+	return m_outSequence;
+}
+
+void ReliableCommandWindow::Acknowledge(uint32_t acknowledged, uint32_t now)
+{
+	// old or bogus acknowledgements don't tell us anything
+	if (static_cast<int32_t>(acknowledged - m_acknowledged) <= 0 || static_cast<int32_t>(acknowledged - m_outSequence) > 0)
+	{
+		return;
+	}
+
+	while (!m_commands.empty() && static_cast<int32_t>(m_commands.front().id - acknowledged) <= 0)
+	{
+		auto& command = m_commands.front();
+
+		if (m_metrics.GetRef() && command.sendCount > 0)
+		{
+			m_metrics->Record(net::ConnectionMetric::ReliableResends, command.sendCount - 1);
+		}
+
+		// only a command that was sent once tells us how long a round trip takes, as we can't tell which of its
+		// sends got acknowledged otherwise
+		if (command.id == acknowledged && command.sendCount == 1)
+		{
+			AddRttSample(now - command.sendTime);
+		}
+
+		m_commands.pop_front();
+	}
+
+	// any progress ends the flight, whatever is left gets sent again right away
+	m_acknowledged = acknowledged;
+
+	m_flightEnd = acknowledged;
+	m_flightRetries = 0;
+	m_flightExpired = false;
+}
+
+void ReliableCommandWindow::AddRttSample(double rtt)
+{
+	if (!m_hasRttSample)
+	{
+		m_smoothedRtt = rtt;
+		m_rttVariance = rtt / 2.0;
+
+		m_hasRttSample = true;
+	}
+	else
+	{
+		m_rttVariance = 0.75 * m_rttVariance + 0.25 * std::abs(m_smoothedRtt - rtt);
+		m_smoothedRtt = 0.875 * m_smoothedRtt + 0.125 * rtt;
+	}
+}
+
+uint32_t ReliableCommandWindow::GetRetransmitTimeout() const
+{
+	if (!m_hasRttSample)
+	{
+		return kInitialRetransmitTimeout;
+	}
+
+	uint32_t timeout = static_cast<uint32_t>(m_smoothedRtt + std::max(10.0, 4.0 * m_rttVariance));
+
+	return std::min(kMaxRetransmitTimeout, std::max(kMinRetransmitTimeout, timeout));
+}
+
+bool ReliableCommandWindow::CanExtendFlight() const
+{
+	size_t size = 0;
+
+	for (auto& command : m_commands)
+	{
+		size += command.GetWireSize();
+
+		if (size > kExtendFlightBytes)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void ReliableCommandWindow::ExpireFlight()
+{
+	m_flightExpired = true;
+}
+
+void ReliableCommandWindow::GetCommandsToSend(uint32_t now, size_t budget, size_t space, std::vector<const Command*>& commands)
+{
+	commands.clear();
+
+	if (m_commands.empty())
+	{
+		return;
+	}
+
+	bool outstanding = (m_flightEnd != m_acknowledged);
+	bool retransmit = outstanding;
+
+	if (outstanding && !m_flightExpired)
+	{
+		uint32_t timeout = std::min(kMaxRetransmitTimeout, GetRetransmitTimeout() << std::min(m_flightRetries, kMaxBackoff));
+
+		if ((now - m_flightSendTime) < timeout)
+		{
+			if (m_commands.back().id == m_flightEnd || !CanExtendFlight())
+			{
+				return;
+			}
+
+			retransmit = false;
+		}
+	}
+
+	size_t size = 0;
+
+	for (auto& command : m_commands)
+	{
+		size_t commandSize = command.GetWireSize();
+
+		if ((commands.empty() && commandSize > space) || (!commands.empty() && size + commandSize > budget))
+		{
+			break;
+		}
+
+		commands.push_back(&command);
+		size += commandSize;
+
+		command.sendCount++;
+		command.sendTime = now;
+	}
+
+	if (commands.empty())
+	{
+		return;
+	}
+
+	if (retransmit)
+	{
+		m_flightRetries++;
+		m_statistics.retransmissions++;
+	}
+
+	m_flightEnd = commands.back()->id;
+	m_flightSendTime = now;
+	m_flightExpired = false;
+
+	m_statistics.commandsSent += commands.size();
+	m_statistics.bytesSent += size;
+}
@@ -0,0 +1,303 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <NetCompression.h>
+
+#include <chrono>
+#include <random>
+
+static void Append(std::vector<char>& packet, const void* data, size_t length)
+{
+	packet.insert(packet.end(), reinterpret_cast<const char*>(data), reinterpret_cast<const char*>(data) + length);
+}
+
+template<typename T>
+static void Append(std::vector<char>& packet, T value)
+{
+	Append(packet, &value, sizeof(value));
+}
+
+// something shaped like what NetLibrary::ProcessSend builds: routed sync data, and now and then a net event
+static std::vector<std::vector<char>> BuildCorpus(uint32_t seed, size_t count)
+{
+	static const char* eventNames[] = { "playerSpawned", "chatMessage", "es:updatePositions", "vehicleDamaged", "hardcap:playerActivated" };
+
+	std::mt19937 random(seed);
+	std::vector<std::vector<char>> corpus;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		std::vector<char> packet;
+		Append<uint32_t>(packet, i / 2);
+		Append<uint32_t>(packet, i);
+
+		size_t routed = random() % 4;
+
+		for (size_t j = 0; j < routed; j++)
+		{
+			// mostly-zero sync node bits with a few changing fields
+			std::vector<char> payload(40 + (random() % 160));
+
+			for (size_t k = 0; k < payload.size(); k++)
+			{
+				payload[k] = ((k % 8) == 0 || (random() % 6) == 0) ? static_cast<char>(random()) : 0;
+			}
+
+			Append<uint32_t>(packet, 0xE938445B);
+			Append<uint16_t>(packet, 1 + (random() % 32));
+			Append<uint16_t>(packet, payload.size());
+			Append(packet, payload.data(), payload.size());
+		}
+
+		if ((random() % 8) == 0)
+		{
+			const char* eventName = eventNames[random() % _countof(eventNames)];
+
+			std::vector<char> command;
+			Append<uint16_t>(command, 0xFFFF);
+			Append<uint16_t>(command, strlen(eventName) + 1);
+			Append(command, eventName, strlen(eventName) + 1);
+
+			// a msgpack map of positions, as scripts like sending
+			Append<uint8_t>(command, 0x83);
+
+			for (const char* key : { "x", "y", "z" })
+			{
+				Append<uint8_t>(command, 0xA1);
+				Append(command, key, 1);
+				Append<uint8_t>(command, 0xCA);
+				Append<float>(command, std::uniform_real_distribution<float>(-3000.0f, 3000.0f)(random));
+			}
+
+			Append<uint32_t>(packet, 0x7337FD7A); // msgNetEvent
+			Append<uint32_t>(packet, i);
+			Append<uint16_t>(packet, command.size());
+			Append(packet, command.data(), command.size());
+		}
+
+		Append<uint32_t>(packet, 0xCA569E63); // msgEnd
+
+		corpus.push_back(std::move(packet));
+	}
+
+	return corpus;
+}
+
+// what a server would ship: the start of some packets it saw before, most common content last
+static std::vector<uint8_t> BuildDictionary()
+{
+	std::vector<uint8_t> dictionary;
+
+	for (auto& packet : BuildCorpus(1, 512))
+	{
+		if (dictionary.size() + packet.size() > 4096)
+		{
+			break;
+		}
+
+		dictionary.insert(dictionary.end(), packet.begin(), packet.end());
+	}
+
+	return dictionary;
+}
+
+TEST(NetCompression, RoundTripsPackets)
+{
+	NetCompressor sender;
+	NetCompressor receiver;
+
+	for (auto& packet : BuildCorpus(2, 256))
+	{
+		size_t compressedLength;
+		const char* compressed = sender.Compress(packet.data(), packet.size(), &compressedLength);
+
+		std::vector<char> wire(compressed, compressed + compressedLength);
+
+		size_t length;
+		const char* decompressed = receiver.Decompress(wire.data(), wire.size(), 65536, &length);
+
+		ASSERT_NE(nullptr, decompressed);
+		ASSERT_EQ(packet.size(), length);
+		EXPECT_EQ(0, memcmp(packet.data(), decompressed, length));
+	}
+}
+
+TEST(NetCompression, SendsSmallAndIncompressiblePacketsAsTheyAre)
+{
+	NetCompressor compressor;
+
+	std::string small = "tiny";
+
+	size_t compressedLength;
+	const char* compressed = compressor.Compress(small.c_str(), small.size(), &compressedLength);
+
+	ASSERT_EQ(small.size() + 1, compressedLength);
+	EXPECT_EQ(NET_COMPRESSION_NONE, compressed[0]);
+
+	std::mt19937 random(3);
+	std::vector<char> noise(1000);
+
+	for (auto& byte : noise)
+	{
+		byte = static_cast<char>(random());
+	}
+
+	compressed = compressor.Compress(noise.data(), noise.size(), &compressedLength);
+
+	ASSERT_EQ(noise.size() + 1, compressedLength);
+	EXPECT_EQ(NET_COMPRESSION_NONE, compressed[0]);
+}
+
+TEST(NetCompression, RejectsMalformedPackets)
+{
+	NetCompressor compressor;
+
+	std::vector<char> packet(1000, 'a');
+
+	size_t compressedLength;
+	const char* compressed = compressor.Compress(packet.data(), packet.size(), &compressedLength);
+
+	ASSERT_EQ(NET_COMPRESSION_DEFLATE, compressed[0]);
+
+	std::vector<char> wire(compressed, compressed + compressedLength);
+
+	size_t length;
+
+	// too large for the caller
+	EXPECT_EQ(nullptr, compressor.Decompress(wire.data(), wire.size(), 999, &length));
+
+	// truncated
+	EXPECT_EQ(nullptr, compressor.Decompress(wire.data(), wire.size() - 1, 65536, &length));
+	EXPECT_EQ(nullptr, compressor.Decompress(wire.data(), 2, 65536, &length));
+	EXPECT_EQ(nullptr, compressor.Decompress(wire.data(), 0, 65536, &length));
+
+	// lying about the length
+	std::vector<char> longer = wire;
+	*reinterpret_cast<uint16_t*>(&longer[1]) = 1001;
+
+	EXPECT_EQ(nullptr, compressor.Decompress(longer.data(), longer.size(), 65536, &length));
+
+	// unknown compression type
+	std::vector<char> unknown = wire;
+	unknown[0] = 42;
+
+	EXPECT_EQ(nullptr, compressor.Decompress(unknown.data(), unknown.size(), 65536, &length));
+
+	// a dictionary we don't have
+	std::vector<char> dictionary = wire;
+	dictionary[0] = NET_COMPRESSION_DEFLATE_DICTIONARY;
+
+	EXPECT_EQ(nullptr, compressor.Decompress(dictionary.data(), dictionary.size(), 65536, &length));
+
+	// and after all that, it still works
+	EXPECT_NE(nullptr, compressor.Decompress(wire.data(), wire.size(), 65536, &length));
+}
+
+TEST(NetCompression, UsesDictionary)
+{
+	NetCompressor sender;
+	sender.SetDictionary(BuildDictionary());
+
+	NetCompressor receiver;
+
+	auto corpus = BuildCorpus(4, 64);
+
+	size_t compressedLength;
+	const char* compressed = sender.Compress(corpus[0].data(), corpus[0].size(), &compressedLength);
+
+	ASSERT_EQ(NET_COMPRESSION_DEFLATE_DICTIONARY, compressed[0]);
+
+	std::vector<char> wire(compressed, compressed + compressedLength);
+
+	size_t length;
+	EXPECT_EQ(nullptr, receiver.Decompress(wire.data(), wire.size(), 65536, &length));
+
+	receiver.SetDictionary(BuildDictionary());
+
+	const char* decompressed = receiver.Decompress(wire.data(), wire.size(), 65536, &length);
+
+	ASSERT_NE(nullptr, decompressed);
+	ASSERT_EQ(corpus[0].size(), length);
+	EXPECT_EQ(0, memcmp(corpus[0].data(), decompressed, length));
+}
+
+struct ReplayResult
+{
+	uint64_t inBytes;
+	uint64_t outBytes;
+
+	std::chrono::nanoseconds compressTime;
+	std::chrono::nanoseconds decompressTime;
+
+	inline double GetRatio() const
+	{
+		return outBytes / static_cast<double>(inBytes);
+	}
+};
+
+// replays a corpus of packets through a sender/receiver pair, measuring the compression ratio and time taken
+static ReplayResult Replay(const std::vector<std::vector<char>>& corpus, const std::vector<uint8_t>& dictionary)
+{
+	NetCompressor sender;
+	NetCompressor receiver;
+
+	sender.SetDictionary(dictionary);
+	receiver.SetDictionary(dictionary);
+
+	uint64_t inBytes = 0;
+	uint64_t outBytes = 0;
+
+	std::chrono::nanoseconds compressTime(0);
+	std::chrono::nanoseconds decompressTime(0);
+
+	for (auto& packet : corpus)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		size_t compressedLength;
+		const char* compressed = sender.Compress(packet.data(), packet.size(), &compressedLength);
+
+		auto mid = std::chrono::high_resolution_clock::now();
+
+		size_t length;
+		const char* decompressed = receiver.Decompress(compressed, compressedLength, 65536, &length);
+
+		auto end = std::chrono::high_resolution_clock::now();
+
+		EXPECT_NE(nullptr, decompressed);
+		EXPECT_EQ(packet.size(), length);
+
+		compressTime += mid - start;
+		decompressTime += end - mid;
+
+		inBytes += packet.size();
+		outBytes += compressedLength;
+	}
+
+	return { inBytes, outBytes, compressTime, decompressTime };
+}
+
+TEST(NetCompression, DictionaryImprovesRatio)
+{
+	auto corpus = BuildCorpus(5, 2000);
+
+	double plain = Replay(corpus, std::vector<uint8_t>()).GetRatio();
+	double dictionary = Replay(corpus, BuildDictionary()).GetRatio();
+
+	EXPECT_LT(plain, 1.0);
+	EXPECT_LT(dictionary, plain);
+}
+
+static void PrintReplay(const char* name, const ReplayResult& result, size_t packets)
+{
+	printf("%-16s %8.1f KiB -> %8.1f KiB (%.1f%%), compress %.2f us/packet, decompress %.2f us/packet\n", name, result.inBytes / 1024.0, result.outBytes / 1024.0,
+		result.GetRatio() * 100.0, result.compressTime.count() / 1000.0 / packets, result.decompressTime.count() / 1000.0 / packets);
+}
+
+TEST(NetCompression, DISABLED_BenchmarkReplay)
+{
+	auto corpus = BuildCorpus(5, 20000);
+
+	PrintReplay("deflate", Replay(corpus, std::vector<uint8_t>()), corpus.size());
+	PrintReplay("deflate + dict", Replay(corpus, BuildDictionary()), corpus.size());
+}
@@ -0,0 +1,347 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <NetRouteDelta.h>
+
+#include <deque>
+#include <random>
+
+static std::vector<uint8_t> Decode(NetRouteDeltaDecoder& decoder, const uint8_t* entry, size_t length, uint16_t* netID = nullptr)
+{
+	net::BufferView view(entry, length);
+
+	uint16_t entryNetID;
+	const uint8_t* data;
+	size_t dataLength;
+
+	EXPECT_TRUE(decoder.Decode(view, &entryNetID, &data, &dataLength));
+	EXPECT_TRUE(view.IsAtEnd());
+
+	if (netID)
+	{
+		*netID = entryNetID;
+	}
+
+	return (data) ? std::vector<uint8_t>(data, data + dataLength) : std::vector<uint8_t>();
+}
+
+TEST(NetRouteDelta, EncodesAgainstAcknowledgedBaselines)
+{
+	NetRouteDeltaEncoder encoder;
+	NetRouteDeltaDecoder decoder;
+
+	std::vector<uint8_t> payload(100);
+
+	for (size_t i = 0; i < payload.size(); i++)
+	{
+		payload[i] = static_cast<uint8_t>(i * 7);
+	}
+
+	// without a baseline, everything is a change
+	size_t length;
+	const uint8_t* entry = encoder.Encode(12, payload.data(), payload.size(), &length);
+
+	uint16_t netID;
+	EXPECT_EQ(payload, Decode(decoder, entry, length, &netID));
+	EXPECT_EQ(12, netID);
+
+	ASSERT_TRUE(encoder.WantsBaseline(12));
+
+	auto& baseline = encoder.CreateBaseline(12, payload.data(), payload.size());
+	ASSERT_TRUE(decoder.AddBaseline(baseline.data(), baseline.size()));
+
+	encoder.SetBaselineCommand(12, 5);
+
+	// one baseline at a time
+	EXPECT_FALSE(encoder.WantsBaseline(12));
+
+	// not acknowledged yet
+	encoder.Acknowledge(4);
+
+	payload[50] ^= 0xFF;
+
+	entry = encoder.Encode(12, payload.data(), payload.size(), &length);
+	EXPECT_GT(length, payload.size());
+	EXPECT_EQ(payload, Decode(decoder, entry, length));
+
+	encoder.Acknowledge(5);
+
+	entry = encoder.Encode(12, payload.data(), payload.size(), &length);
+	EXPECT_EQ(payload, Decode(decoder, entry, length));
+
+	// header, a run up to the changed byte, and the run of the rest
+	EXPECT_EQ(3 + 3 + 2, length);
+	EXPECT_FALSE(encoder.WantsBaseline(12));
+
+	// lengths don't have to match the baseline's
+	std::vector<uint8_t> longer = payload;
+	longer.resize(300, 0x55);
+
+	entry = encoder.Encode(12, longer.data(), longer.size(), &length);
+	EXPECT_EQ(longer, Decode(decoder, entry, length));
+
+	std::vector<uint8_t> shorter(payload.begin(), payload.begin() + 30);
+
+	entry = encoder.Encode(12, shorter.data(), shorter.size(), &length);
+	EXPECT_EQ(shorter, Decode(decoder, entry, length));
+
+	entry = encoder.Encode(12, nullptr, 0, &length);
+	EXPECT_EQ(std::vector<uint8_t>(), Decode(decoder, entry, length));
+}
+
+TEST(NetRouteDelta, KeepsThePreviousBaselineForLatePackets)
+{
+	NetRouteDeltaEncoder encoder;
+	NetRouteDeltaDecoder decoder;
+
+	std::vector<uint8_t> first(64, 1);
+	std::vector<uint8_t> second(64, 2);
+
+	size_t length;
+	encoder.Encode(3, first.data(), first.size(), &length);
+
+	auto& baseline = encoder.CreateBaseline(3, first.data(), first.size());
+	decoder.AddBaseline(baseline.data(), baseline.size());
+	encoder.SetBaselineCommand(3, 1);
+	encoder.Acknowledge(1);
+
+	// sent against the first baseline, but only arriving once the second one is in
+	const uint8_t* entry = encoder.Encode(3, second.data(), second.size(), &length);
+	std::vector<uint8_t> late(entry, entry + length);
+
+	ASSERT_TRUE(encoder.WantsBaseline(3));
+
+	auto& nextBaseline = encoder.CreateBaseline(3, second.data(), second.size());
+	decoder.AddBaseline(nextBaseline.data(), nextBaseline.size());
+	encoder.SetBaselineCommand(3, 2);
+	encoder.Acknowledge(2);
+
+	EXPECT_EQ(second, Decode(decoder, late.data(), late.size()));
+
+	entry = encoder.Encode(3, second.data(), second.size(), &length);
+	EXPECT_EQ(second, Decode(decoder, entry, length));
+}
+
+TEST(NetRouteDelta, RejectsMalformedEntries)
+{
+	NetRouteDeltaEncoder encoder;
+	NetRouteDeltaDecoder decoder;
+
+	std::vector<uint8_t> payload(80, 0x20);
+
+	size_t length;
+	const uint8_t* entry = encoder.Encode(7, payload.data(), payload.size(), &length);
+
+	std::vector<uint8_t> wire(entry, entry + length);
+
+	uint16_t netID;
+	const uint8_t* data;
+	size_t dataLength;
+
+	// truncated
+	for (size_t cut : { size_t(0), size_t(2), wire.size() - 1 })
+	{
+		net::BufferView view(wire.data(), cut);
+		EXPECT_FALSE(decoder.Decode(view, &netID, &data, &dataLength));
+	}
+
+	// runs longer than the payload
+	std::vector<uint8_t> lying = wire;
+	lying[2] = 10;
+
+	{
+		net::BufferView view(lying.data(), lying.size());
+		EXPECT_FALSE(decoder.Decode(view, &netID, &data, &dataLength));
+	}
+
+	// empty runs
+	std::vector<uint8_t> empty = { 7, 0, 1, 0, 0 };
+
+	{
+		net::BufferView view(empty.data(), empty.size());
+		EXPECT_FALSE(decoder.Decode(view, &netID, &data, &dataLength));
+	}
+
+	// an unknown baseline still gets skipped over properly
+	std::vector<uint8_t> batch = wire;
+	batch[1] = 42;
+	batch.insert(batch.end(), wire.begin(), wire.end());
+
+	net::BufferView view(batch.data(), batch.size());
+
+	ASSERT_TRUE(decoder.Decode(view, &netID, &data, &dataLength));
+	EXPECT_EQ(nullptr, data);
+
+	ASSERT_TRUE(decoder.Decode(view, &netID, &data, &dataLength));
+	ASSERT_NE(nullptr, data);
+	EXPECT_EQ(payload, std::vector<uint8_t>(data, data + dataLength));
+	EXPECT_TRUE(view.IsAtEnd());
+
+	// and baselines need an index
+	std::vector<uint8_t> baseline = { 7, 0, 1, 2, 3 };
+	EXPECT_FALSE(decoder.AddBaseline(baseline.data(), baseline.size()));
+}
+
+// the sync data one player sends another: mostly static node data, a few fields that change every frame, and now
+// and then a larger change as entities get created or removed
+class SyncStream
+{
+private:
+	std::vector<uint8_t> m_state;
+
+	std::vector<size_t> m_movingFields;
+
+	uint32_t m_frame;
+
+public:
+	SyncStream(std::mt19937& random)
+		: m_frame(0)
+	{
+		m_state.resize(60 + (random() % 140));
+
+		for (auto& byte : m_state)
+		{
+			byte = ((random() % 3) == 0) ? static_cast<uint8_t>(random()) : 0;
+		}
+
+		for (size_t i = 0; i < 6; i++)
+		{
+			m_movingFields.push_back(8 + (random() % ((m_state.size() - 12) / 4)) * 4);
+		}
+	}
+
+	const std::vector<uint8_t>& Next(std::mt19937& random)
+	{
+		m_frame++;
+
+		// a frame counter up front
+		memcpy(&m_state[0], &m_frame, sizeof(m_frame));
+
+		// positions and velocities drifting a little
+		for (size_t field : m_movingFields)
+		{
+			float value;
+			memcpy(&value, &m_state[field], sizeof(value));
+
+			value = (value != value || value > 1e6f || value < -1e6f) ? 0.0f : value + std::uniform_real_distribution<float>(-0.5f, 0.5f)(random);
+			memcpy(&m_state[field], &value, sizeof(value));
+		}
+
+		// about every two seconds, something else changes
+		if ((random() % 40) == 0)
+		{
+			size_t start = random() % m_state.size();
+			size_t count = std::min<size_t>(m_state.size() - start, 8 + (random() % 40));
+
+			for (size_t i = start; i < start + count; i++)
+			{
+				m_state[i] = static_cast<uint8_t>(random());
+			}
+
+			if ((random() % 4) == 0)
+			{
+				m_state.resize(std::max<size_t>(32, m_state.size() + (random() % 33) - 16));
+			}
+		}
+
+		return m_state;
+	}
+};
+
+struct ReplayResult
+{
+	double plainBytesPerSecond;
+
+	double deltaBytesPerSecond;
+};
+
+// replays what a single client sends at 20 frames per second with everyone else in range, acknowledging reliable
+// commands a round trip of 100ms later, and checks what the other end decodes
+static ReplayResult Replay(int players, int seconds)
+{
+	static const int kFramesPerSecond = 20;
+	static const int kRoundTripFrames = 2;
+
+	std::mt19937 random(players);
+
+	std::vector<SyncStream> streams;
+
+	for (int i = 1; i < players; i++)
+	{
+		streams.emplace_back(random);
+	}
+
+	NetRouteDeltaEncoder encoder;
+	NetRouteDeltaDecoder decoder;
+
+	uint64_t plainBytes = 0;
+	uint64_t deltaBytes = 0;
+
+	uint32_t commandId = 0;
+	std::deque<std::pair<int, uint32_t>> acknowledgements;
+
+	for (int frame = 0; frame < seconds * kFramesPerSecond; frame++)
+	{
+		while (!acknowledgements.empty() && acknowledgements.front().first <= frame)
+		{
+			encoder.Acknowledge(acknowledgements.front().second);
+			acknowledgements.pop_front();
+		}
+
+		// msgRouteDelta, and its batch length
+		deltaBytes += 4 + 2;
+
+		for (size_t i = 0; i < streams.size(); i++)
+		{
+			uint16_t netID = static_cast<uint16_t>(i + 1);
+			const std::vector<uint8_t>& payload = streams[i].Next(random);
+
+			// msgRoute, netID, length
+			plainBytes += 4 + 2 + 2 + payload.size();
+
+			size_t length;
+			const uint8_t* entry = encoder.Encode(netID, payload.data(), payload.size(), &length);
+
+			deltaBytes += length;
+
+			net::BufferView view(entry, length);
+
+			uint16_t decodedNetID;
+			const uint8_t* decoded;
+			size_t decodedLength;
+
+			EXPECT_TRUE(decoder.Decode(view, &decodedNetID, &decoded, &decodedLength));
+			EXPECT_EQ(netID, decodedNetID);
+			EXPECT_TRUE(decoded && decodedLength == payload.size() && memcmp(decoded, payload.data(), decodedLength) == 0);
+
+			if (encoder.WantsBaseline(netID))
+			{
+				auto& baseline = encoder.CreateBaseline(netID, payload.data(), payload.size());
+
+				// type, id, length, as a reliable command
+				deltaBytes += 4 + 4 + 2 + baseline.size();
+
+				decoder.AddBaseline(baseline.data(), baseline.size());
+
+				encoder.SetBaselineCommand(netID, ++commandId);
+				acknowledgements.emplace_back(frame + kRoundTripFrames, commandId);
+			}
+		}
+	}
+
+	ReplayResult result;
+	result.plainBytesPerSecond = plainBytes / static_cast<double>(seconds);
+	result.deltaBytesPerSecond = deltaBytes / static_cast<double>(seconds);
+
+	return result;
+}
+
+TEST(NetRouteDelta, SavesBandwidthInReplay)
+{
+	for (int players : { 32, 64 })
+	{
+		auto result = Replay(players, 30);
+
+		EXPECT_LT(result.deltaBytesPerSecond * 2, result.plainBytesPerSecond);
+	}
+}
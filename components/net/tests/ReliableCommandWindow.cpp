@@ -0,0 +1,269 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <ReliableCommandWindow.h>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <random>
+
+// a one-way link delivering whole packets after a delay, or not at all
+template<typename TPacket>
+class SimulatedLink
+{
+private:
+	std::multimap<uint32_t, TPacket> m_inFlight;
+
+	std::mt19937& m_random;
+
+	double m_lossRate;
+
+public:
+	SimulatedLink(std::mt19937& random, double lossRate)
+		: m_random(random), m_lossRate(lossRate)
+	{
+	}
+
+	void Send(uint32_t now, const TPacket& packet)
+	{
+		if (std::uniform_real_distribution<double>(0.0, 1.0)(m_random) < m_lossRate)
+		{
+			return;
+		}
+
+		m_inFlight.emplace(now + 50 + (m_random() % 20), packet);
+	}
+
+	template<typename TReceiver>
+	void Deliver(uint32_t now, const TReceiver& receiver)
+	{
+		while (!m_inFlight.empty() && m_inFlight.begin()->first <= now)
+		{
+			receiver(m_inFlight.begin()->second);
+			m_inFlight.erase(m_inFlight.begin());
+		}
+	}
+};
+
+struct SimulationResult
+{
+	uint64_t reliableBytes;
+
+	std::vector<uint32_t> latencies;
+};
+
+typedef std::function<void(uint32_t now, size_t space, std::vector<std::pair<uint32_t, size_t>>& packet)> TBuildPacket;
+
+// runs 20 seconds of traffic through a lossy link, checking the server runs every command once and in order
+static SimulationResult Simulate(double lossRate, const std::function<uint32_t(uint32_t now, size_t size)>& push, const TBuildPacket& build,
+	const std::function<void(uint32_t now, uint32_t ack)>& acknowledge)
+{
+	std::mt19937 random(42);
+
+	// packets are lists of (command id, wire size)
+	SimulatedLink<std::vector<std::pair<uint32_t, size_t>>> toServer(random, lossRate);
+	SimulatedLink<uint32_t> toClient(random, lossRate);
+
+	SimulationResult result;
+	result.reliableBytes = 0;
+
+	std::map<uint32_t, uint32_t> pushTimes;
+	uint32_t serverLastReceived = 0;
+	uint32_t lastCommand = 0;
+
+	for (uint32_t now = 0; now < 20000 || serverLastReceived < lastCommand; now++)
+	{
+		// a steady trickle of small commands, and a big one every two seconds
+		if (now < 20000 && (now % 100) == 0)
+		{
+			lastCommand = push(now, ((now % 2000) == 0) ? 16000 : 120);
+			pushTimes[lastCommand] = now;
+		}
+
+		// 60 Hz client frames, with a couple of routed packets taking up space first
+		if ((now % 16) == 0)
+		{
+			std::vector<std::pair<uint32_t, size_t>> packet;
+			build(now, 24000 - 8 - 600 - 1024, packet);
+
+			for (auto& command : packet)
+			{
+				result.reliableBytes += command.second;
+			}
+
+			if (!packet.empty())
+			{
+				toServer.Send(now, packet);
+			}
+		}
+
+		// the server runs anything newer than what it ran last, as the real one does
+		toServer.Deliver(now, [&] (const std::vector<std::pair<uint32_t, size_t>>& packet)
+		{
+			for (auto& command : packet)
+			{
+				if (command.first > serverLastReceived)
+				{
+					EXPECT_EQ(serverLastReceived + 1, command.first);
+
+					serverLastReceived = command.first;
+					result.latencies.push_back(now - pushTimes[command.first]);
+				}
+			}
+		});
+
+		// 30 Hz server frames acknowledging what it got so far
+		if ((now % 33) == 0)
+		{
+			toClient.Send(now, serverLastReceived);
+		}
+
+		toClient.Deliver(now, [&] (uint32_t ack)
+		{
+			acknowledge(now, ack);
+		});
+	}
+
+	return result;
+}
+
+class ReliableCommandWindowTest : public ::testing::TestWithParam<double>
+{
+};
+
+TEST_P(ReliableCommandWindowTest, SavesBandwidthOverResendingEverything)
+{
+	double lossRate = GetParam();
+
+	// what NetLibrary used to do: every unacknowledged command in every packet
+	std::vector<std::pair<uint32_t, size_t>> pending;
+	uint32_t sequence = 0;
+
+	SimulationResult baseline = Simulate(lossRate, [&] (uint32_t now, size_t size)
+	{
+		pending.emplace_back(++sequence, 10 + size);
+		return sequence;
+	}, [&] (uint32_t now, size_t space, std::vector<std::pair<uint32_t, size_t>>& packet)
+	{
+		packet = pending;
+	}, [&] (uint32_t now, uint32_t ack)
+	{
+		pending.erase(std::remove_if(pending.begin(), pending.end(), [&] (const std::pair<uint32_t, size_t>& command)
+		{
+			return command.first <= ack;
+		}), pending.end());
+	});
+
+	ReliableCommandWindow window;
+	std::vector<const ReliableCommandWindow::Command*> commands;
+	std::string payload(16000, 'x');
+
+	SimulationResult windowed = Simulate(lossRate, [&] (uint32_t now, size_t size)
+	{
+		return window.Push(0x1234, payload.c_str(), size);
+	}, [&] (uint32_t now, size_t space, std::vector<std::pair<uint32_t, size_t>>& packet)
+	{
+		window.GetCommandsToSend(now, std::min<size_t>(8192, space), space, commands);
+
+		for (auto command : commands)
+		{
+			packet.emplace_back(command->id, command->GetWireSize());
+		}
+	}, [&] (uint32_t now, uint32_t ack)
+	{
+		window.Acknowledge(ack, now);
+	});
+
+	EXPECT_EQ(200, baseline.latencies.size());
+	EXPECT_EQ(200, windowed.latencies.size());
+
+	EXPECT_LT(windowed.reliableBytes * 4, baseline.reliableBytes);
+}
+
+INSTANTIATE_TEST_CASE_P(LossRates, ReliableCommandWindowTest, ::testing::Values(0.0, 0.02, 0.10));
+
+TEST(ReliableCommandWindow, RespectsBudgetAndRetransmitsOnTimeout)
+{
+	ReliableCommandWindow window;
+	std::string small(100, 's');
+
+	fwRefContainer<net::ConnectionMetrics> metrics = new net::ConnectionMetrics("test");
+	window.SetMetrics(metrics);
+	std::string large(10000, 'l');
+
+	window.Push(1, large.c_str(), large.size());
+	window.Push(2, small.c_str(), small.size());
+	window.Push(3, small.c_str(), small.size());
+
+	std::vector<const ReliableCommandWindow::Command*> commands;
+
+	// too large for the budget, but it's first in line
+	window.GetCommandsToSend(0, 1000, 20000, commands);
+	ASSERT_EQ(1, commands.size());
+	EXPECT_EQ(1, commands[0]->id);
+
+	// nothing while that's in flight
+	window.GetCommandsToSend(100, 1000, 20000, commands);
+	EXPECT_TRUE(commands.empty());
+
+	// until it times out, and then again from the start
+	window.GetCommandsToSend(window.GetRetransmitTimeout(), 1000, 20000, commands);
+	ASSERT_EQ(1, commands.size());
+	EXPECT_EQ(1, commands[0]->id);
+	EXPECT_EQ(1, window.GetStatistics().retransmissions);
+
+	// an acknowledgement lets the rest go right away
+	window.Acknowledge(1, 1000);
+
+	window.GetCommandsToSend(1000, 1000, 20000, commands);
+	ASSERT_EQ(2, commands.size());
+	EXPECT_EQ(2, commands[0]->id);
+	EXPECT_EQ(3, commands[1]->id);
+
+	// and the next one starts with an RTT sample
+	window.Acknowledge(3, 1080);
+	EXPECT_DOUBLE_EQ(80.0, window.GetSmoothedRtt());
+	EXPECT_EQ(0, window.GetUnacknowledgedCount());
+
+	// only the first command had to be resent
+	auto resends = metrics->GetHistogram(net::ConnectionMetric::ReliableResends).GetSnapshot();
+	EXPECT_EQ(3, resends.GetCount());
+	EXPECT_EQ(1, resends.GetSum());
+	EXPECT_EQ(1, resends.GetMax());
+
+	// the space limit applies even to the first command
+	window.Push(4, large.c_str(), large.size());
+	window.GetCommandsToSend(2000, 1000, 5000, commands);
+	EXPECT_TRUE(commands.empty());
+
+	// which is why it tells how much space it needs
+	window.GetCommandsToSend(2000, 1000, window.GetHeadWireSize(), commands);
+	ASSERT_EQ(1, commands.size());
+	EXPECT_EQ(4, commands[0]->id);
+}
+
+TEST(ReliableCommandWindow, SamplesRttOnlyFromCommandsSentOnce)
+{
+	ReliableCommandWindow window;
+	std::string small(100, 's');
+
+	std::vector<const ReliableCommandWindow::Command*> commands;
+
+	window.Push(1, small.c_str(), small.size());
+	window.GetCommandsToSend(0, 1000, 20000, commands);
+	ASSERT_EQ(1, commands.size());
+
+	// extending the flight sends the first command again
+	window.Push(2, small.c_str(), small.size());
+	window.GetCommandsToSend(50, 1000, 20000, commands);
+	ASSERT_EQ(2, commands.size());
+
+	// so it can't tell which send this acknowledges
+	window.Acknowledge(1, 80);
+	EXPECT_DOUBLE_EQ(0.0, window.GetSmoothedRtt());
+
+	// but the second command only went out once, at its own time
+	window.Acknowledge(2, 140);
+	EXPECT_DOUBLE_EQ(90.0, window.GetSmoothedRtt());
+}
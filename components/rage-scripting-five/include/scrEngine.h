@@ -129,6 +129,15 @@ public:
 		m_nDataCount = 0;
 	}
 
+	// uses a caller-owned buffer (of MaxNativeParams entries) for the arguments and results, instead of copying them
+	inline NativeContext(void* arguments, int numArguments)
+	{
+		m_pArgs = arguments;
+		m_pReturn = arguments;
+		m_nArgCount = numArguments;
+		m_nDataCount = 0;
+	}
+
 	template <typename T>
 	inline void Push(T value)
 	{
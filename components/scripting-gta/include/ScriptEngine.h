@@ -15,6 +15,8 @@
 
 #include <boost/optional.hpp>
 
+#include <atomic>
+
 namespace fx
 {
 	class ScriptContext
@@ -27,7 +29,9 @@ namespace fx
 		};
 
 	private:
-		uint8_t m_functionData[MaxArguments][ArgumentSize];
+		uint8_t m_ownData[MaxArguments][ArgumentSize];
+
+		uint8_t (*m_functionData)[ArgumentSize];
 
 		int m_numArguments;
 		int m_numResults;
@@ -35,16 +39,34 @@ namespace fx
 	public:
 		inline ScriptContext()
 		{
+			m_functionData = m_ownData;
 			m_numArguments = 0;
 			m_numResults = 0;
 		}
 
+		// wraps a caller-owned buffer of MaxArguments arguments in place, results get written over its start
+		inline ScriptContext(uintptr_t* argumentBuffer, int numArguments)
+		{
+			m_functionData = reinterpret_cast<uint8_t(*)[ArgumentSize]>(argumentBuffer);
+			m_numArguments = numArguments;
+			m_numResults = 0;
+		}
+
+		ScriptContext(const ScriptContext&) = delete;
+
+		ScriptContext& operator=(const ScriptContext&) = delete;
+
 		template<typename T>
 		inline const T& GetArgument(int index)
 		{
 			return *reinterpret_cast<T*>(&m_functionData[index][0]);
 		}
 
+		inline uintptr_t* GetArgumentBuffer()
+		{
+			return reinterpret_cast<uintptr_t*>(m_functionData);
+		}
+
 		inline int GetArgumentCount()
 		{
 			return m_numArguments;
@@ -87,11 +109,48 @@ namespace fx
 
 	typedef std::function<void(ScriptContext&)> TNativeHandler;
 
+	// a native handler resolved once, to be invoked on the caller's own argument buffer after
+	// handlers registered later on get swapped in here, so whoever holds on to it calls the override from then on
+	class SCRT_EXPORT ResolvedNative
+	{
+	private:
+		uint64_t m_identifier;
+
+		// the game's own handler, a rage::scrEngine::NativeHandler - used as long as no handler got registered
+		void* m_gameHandler;
+
+		std::atomic<TNativeHandler*> m_handler;
+
+	public:
+		inline ResolvedNative(uint64_t identifier, void* gameHandler, TNativeHandler* handler)
+			: m_identifier(identifier), m_gameHandler(gameHandler), m_handler(handler)
+		{
+
+		}
+
+		ResolvedNative(const ResolvedNative&) = delete;
+
+		ResolvedNative& operator=(const ResolvedNative&) = delete;
+
+		inline void SetHandler(TNativeHandler* handler)
+		{
+			m_handler.store(handler, std::memory_order_release);
+		}
+
+		// reads the arguments from `arguments` (of ScriptContext::MaxArguments entries) and writes results over its start
+		// throws std::exception if the native fails
+		void Invoke(uintptr_t* arguments, int numArguments);
+	};
+
 	class SCRT_EXPORT ScriptEngine
 	{
 	public:
 		static boost::optional<TNativeHandler> GetNativeHandler(uint64_t nativeIdentifier);
 
+		// resolves a native, returning nullptr if it doesn't exist (yet)
+		// the result stays valid for the lifetime of the process, so callers are expected to keep it around
+		static ResolvedNative* ResolveNative(uint64_t nativeIdentifier);
+
 		static void RegisterNativeHandler(uint64_t nativeIdentifier, TNativeHandler function);
 
 		static void RegisterNativeHandler(const std::string& nativeName, TNativeHandler function);
@@ -12,44 +12,108 @@
 
 #include <scrEngine.h>
 
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
 namespace fx
 {
-	boost::optional<TNativeHandler> ScriptEngine::GetNativeHandler(uint64_t nativeIdentifier)
+	// invokes a game native directly on the caller's buffer
+	static void InvokeGameNative(uint64_t identifier, rage::scrEngine::NativeHandler handler, uintptr_t* arguments, int numArguments)
 	{
-		auto rageHandler = rage::scrEngine::GetNativeHandler(nativeIdentifier);
+		NativeContext rageContext(arguments, numArguments);
 
-		if (rageHandler == nullptr)
+		// call the original function
+		static void* exceptionAddress;
+
+		__try
 		{
-			return boost::optional<TNativeHandler>();
+			handler(&rageContext);
+		}
+		__except (exceptionAddress = (GetExceptionInformation())->ExceptionRecord->ExceptionAddress, EXCEPTION_EXECUTE_HANDLER)
+		{
+			throw std::exception(va("Error executing native 0x%016llx at address %p.", identifier, exceptionAddress));
 		}
 
-		return boost::optional<TNativeHandler>([=] (ScriptContext& context)
+		// append vector3 result components
+		rageContext.SetVectorResults();
+	}
+
+	void ResolvedNative::Invoke(uintptr_t* arguments, int numArguments)
+	{
+		TNativeHandler* handler = m_handler.load(std::memory_order_acquire);
+
+		// registered natives get called without going through their game stub
+		if (handler)
 		{
-			// push arguments from the original context
-			NativeContext rageContext;
-			
-			for (int i = 0; i < context.GetArgumentCount(); i++)
-			{
-				rageContext.Push(context.GetArgument<uintptr_t>(i));
-			}
+			ScriptContext context(arguments, numArguments);
 
-			// call the original function
-			static void* exceptionAddress;
+			(*handler)(context);
+			return;
+		}
 
-			__try
-			{
-				rageHandler(&rageContext);
-			}
-			__except (exceptionAddress = (GetExceptionInformation())->ExceptionRecord->ExceptionAddress, EXCEPTION_EXECUTE_HANDLER)
+		InvokeGameNative(m_identifier, reinterpret_cast<rage::scrEngine::NativeHandler>(m_gameHandler), arguments, numArguments);
+	}
+
+	static std::mutex g_nativesMutex;
+
+	// handlers passed to RegisterNativeHandler - never freed, as resolved natives and game stubs point to them
+	static std::unordered_map<uint64_t, TNativeHandler*> g_registeredHandlers;
+
+	// everything resolved so far - never removed, as callers hold on to the pointers
+	static std::unordered_map<uint64_t, std::unique_ptr<ResolvedNative>> g_resolvedNatives;
+
+	ResolvedNative* ScriptEngine::ResolveNative(uint64_t nativeIdentifier)
+	{
+		std::unique_lock<std::mutex> lock(g_nativesMutex);
+
+		auto it = g_resolvedNatives.find(nativeIdentifier);
+
+		if (it != g_resolvedNatives.end())
+		{
+			return it->second.get();
+		}
+
+		TNativeHandler* handler = nullptr;
+		rage::scrEngine::NativeHandler rageHandler = nullptr;
+
+		auto registeredIt = g_registeredHandlers.find(nativeIdentifier);
+
+		if (registeredIt != g_registeredHandlers.end())
+		{
+			handler = registeredIt->second;
+		}
+		else
+		{
+			rageHandler = rage::scrEngine::GetNativeHandler(nativeIdentifier);
+
+			// not cached, the game may not have registered its natives yet
+			if (rageHandler == nullptr)
 			{
-				throw std::exception(va("Error executing native 0x%016llx at address %p.", nativeIdentifier, exceptionAddress));
+				return nullptr;
 			}
+		}
 
-			// append vector3 result components
-			rageContext.SetVectorResults();
+		auto native = std::make_unique<ResolvedNative>(nativeIdentifier, reinterpret_cast<void*>(rageHandler), handler);
 
-			// set return data
-			context.SetResult(rageContext.GetResult<scrVector>());
+		ResolvedNative* result = native.get();
+		g_resolvedNatives[nativeIdentifier] = std::move(native);
+
+		return result;
+	}
+
+	boost::optional<TNativeHandler> ScriptEngine::GetNativeHandler(uint64_t nativeIdentifier)
+	{
+		ResolvedNative* native = ResolveNative(nativeIdentifier);
+
+		if (native == nullptr)
+		{
+			return boost::optional<TNativeHandler>();
+		}
+
+		return boost::optional<TNativeHandler>([=] (ScriptContext& context)
+		{
+			native->Invoke(context.GetArgumentBuffer(), context.GetArgumentCount());
 		});
 	}
 
@@ -63,6 +127,20 @@ namespace fx
 #ifdef _M_AMD64
 		TNativeHandler* handler = new TNativeHandler(function);
 
+		{
+			std::unique_lock<std::mutex> lock(g_nativesMutex);
+
+			g_registeredHandlers[nativeIdentifier] = handler;
+
+			// a native resolved earlier keeps its pointer, but gets the new handler - even if it was the game's so far
+			auto it = g_resolvedNatives.find(nativeIdentifier);
+
+			if (it != g_resolvedNatives.end())
+			{
+				it->second->SetHandler(handler);
+			}
+		}
+
 		struct StubGenerator : public jitasm::Frontend
 		{
 			typedef void(*TFunction)(void*, rage::scrNativeCallContext*);
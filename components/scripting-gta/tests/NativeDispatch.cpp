@@ -0,0 +1,173 @@
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <ScriptEngine.h>
+
+#include <chrono>
+
+using fx::ScriptContext;
+using fx::ScriptEngine;
+
+// hashes that don't collide with any game native
+static const uint64_t g_testNatives[] = { 0xCF00000000000000, 0xCF00000000000004, 0xCF0000000000000C };
+
+static const int g_testArgumentCounts[] = { 0, 4, 12 };
+
+static void RegisterTestNatives()
+{
+	static bool registered;
+
+	if (registered)
+	{
+		return;
+	}
+
+	for (uint64_t hash : g_testNatives)
+	{
+		// sums all arguments, so the calls can't be optimized away
+		ScriptEngine::RegisterNativeHandler(hash, [] (ScriptContext& context)
+		{
+			uintptr_t sum = 1;
+
+			for (int i = 0; i < context.GetArgumentCount(); i++)
+			{
+				sum += context.GetArgument<uintptr_t>(i);
+			}
+
+			context.SetResult(sum);
+		});
+	}
+
+	registered = true;
+}
+
+TEST(NativeDispatch, ResolvesRegisteredNatives)
+{
+	RegisterTestNatives();
+
+	fx::ResolvedNative* native = ScriptEngine::ResolveNative(g_testNatives[1]);
+	ASSERT_NE(nullptr, native);
+	EXPECT_EQ(native, ScriptEngine::ResolveNative(g_testNatives[1]));
+
+	uintptr_t arguments[ScriptContext::MaxArguments] = { 1, 2, 3, 4 };
+	native->Invoke(arguments, 4);
+
+	EXPECT_EQ(11u, arguments[0]);
+
+	// the old interface still works, on the context's own buffer
+	ScriptContext context;
+	context.Push(5);
+	context.Push(6);
+
+	(*ScriptEngine::GetNativeHandler(g_testNatives[1]))(context);
+
+	EXPECT_EQ(12u, context.GetResult<uintptr_t>());
+}
+
+TEST(NativeDispatch, ReregisteringKeepsHandle)
+{
+	const uint64_t hash = 0xCF000000000000FF;
+
+	ScriptEngine::RegisterNativeHandler(hash, [] (ScriptContext& context)
+	{
+		context.SetResult<uintptr_t>(1);
+	});
+
+	fx::ResolvedNative* native = ScriptEngine::ResolveNative(hash);
+	ASSERT_NE(nullptr, native);
+
+	ScriptEngine::RegisterNativeHandler(hash, [] (ScriptContext& context)
+	{
+		context.SetResult<uintptr_t>(2);
+	});
+
+	uintptr_t arguments[ScriptContext::MaxArguments] = { 0 };
+	native->Invoke(arguments, 0);
+
+	EXPECT_EQ(2u, arguments[0]);
+	EXPECT_EQ(native, ScriptEngine::ResolveNative(hash));
+}
+
+// calls a native count times through both paths, returning the difference between their results
+static uintptr_t RunDispatch(uint64_t hash, int numArguments, int count, int64_t* lookupTime, int64_t* resolvedTime)
+{
+	uintptr_t sum = 0;
+
+	// what InvokeNative used to do: look up the handler and copy the arguments into a context on every call
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < count; i++)
+	{
+		auto handler = ScriptEngine::GetNativeHandler(hash);
+
+		ScriptContext context;
+
+		for (int j = 0; j < numArguments; j++)
+		{
+			context.Push<uintptr_t>(i + j);
+		}
+
+		(*handler)(context);
+
+		sum += context.GetResult<uintptr_t>();
+	}
+
+	*lookupTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+	// resolved once, invoked on the caller's buffer
+	fx::ResolvedNative* native = ScriptEngine::ResolveNative(hash);
+	uintptr_t arguments[ScriptContext::MaxArguments];
+
+	start = std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < count; i++)
+	{
+		for (int j = 0; j < numArguments; j++)
+		{
+			arguments[j] = i + j;
+		}
+
+		native->Invoke(arguments, numArguments);
+
+		sum -= arguments[0];
+	}
+
+	*resolvedTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+	return sum;
+}
+
+TEST(NativeDispatch, ResolvedMatchesPerCallLookup)
+{
+	RegisterTestNatives();
+
+	for (size_t n = 0; n < _countof(g_testNatives); n++)
+	{
+		int64_t lookupTime;
+		int64_t resolvedTime;
+
+		// both paths have to agree on every result
+		EXPECT_EQ(0u, RunDispatch(g_testNatives[n], g_testArgumentCounts[n], 1000, &lookupTime, &resolvedTime));
+	}
+}
+
+TEST(NativeDispatch, DISABLED_BenchmarkResolvedAgainstPerCallLookup)
+{
+	RegisterTestNatives();
+
+	const int count = 1000000;
+
+	for (size_t n = 0; n < _countof(g_testNatives); n++)
+	{
+		int numArguments = g_testArgumentCounts[n];
+
+		int64_t lookupTime;
+		int64_t resolvedTime;
+
+		EXPECT_EQ(0u, RunDispatch(g_testNatives[n], numArguments, count, &lookupTime, &resolvedTime));
+
+		printf("%2d arguments: %10.0f calls/sec per-call lookup, %10.0f calls/sec resolved\n", numArguments,
+			count / (lookupTime / 1e9),
+			count / (resolvedTime / 1e9));
+	}
+}
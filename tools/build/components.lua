@@ -323,7 +323,8 @@ local do_component = function(name, comp)
 		return
 	end
 
-	-- test project
+	-- test project - benchmarks in there are tests named DISABLED_Benchmark*, so they only run when asked for using
+	-- --gtest_also_run_disabled_tests --gtest_filter=*.DISABLED_Benchmark*
 	local f = io.open('components/' .. name .. '/tests/main.cpp')
 
 	if f then
@@ -348,6 +349,31 @@ local do_component = function(name, comp)
 
 	links { "Shared", "CitiCore", "gmock_main", "gtest_main", name }
 
+	-- tests get to use the headers and libraries of their component's dependencies as well
+	for dep, data in pairs(hasDeps) do
+		configuration {}
+
+		if data.vendor then
+			if data.vendor.include then
+				data.vendor.include()
+			end
+
+			-- static vendor libraries, for tests that call into them directly
+			if not data.vendor.dummy then
+				links { dep }
+			end
+		else
+			includedirs { 'components/' .. dep .. '/include/' }
+			links { dep }
+		end
+	end
+
+	-- as well as whatever the component itself links against
+	configuration {}
+	dofile(comp.absPath .. '/component.lua')
+
+	configuration {}
+
 	pchsource "client/common/StdInc.cpp"
 	pchheader "StdInc.h"
 end